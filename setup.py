@@ -87,7 +87,9 @@ cython_extensions = [
     Extension("yt.geometry.selection_routines",
               ["yt/geometry/selection_routines.pyx"],
               include_dirs=["yt/utilities/lib/"],
-              libraries=std_libs),
+              libraries=std_libs,
+              extra_compile_args=omp_args,
+              extra_link_args=omp_args),
     Extension("yt.geometry.particle_deposit",
               ["yt/geometry/particle_deposit.pyx"],
               include_dirs=["yt/utilities/lib/"],
@@ -126,7 +128,8 @@ cython_extensions = [
               ["yt/utilities/lib/geometry_utils.pyx"],
               extra_compile_args=omp_args,
               extra_link_args=omp_args,
-              libraries=std_libs),
+              libraries=std_libs,
+              depends=["yt/utilities/lib/space_filling_curves.h"]),
     Extension("yt.utilities.lib.marching_cubes",
               ["yt/utilities/lib/marching_cubes.pyx",
                "yt/utilities/lib/fixed_interpolator.c"],
@@ -151,6 +154,8 @@ cython_extensions = [
               ["yt/utilities/lib/origami.pyx",
                "yt/utilities/lib/origami_tags.c"],
               include_dirs=["yt/utilities/lib/"],
+              extra_compile_args=omp_args,
+              extra_link_args=omp_args,
               depends=["yt/utilities/lib/origami_tags.h"]),
     Extension("yt.utilities.lib.grid_traversal",
               ["yt/utilities/lib/grid_traversal.pyx",
@@ -202,16 +207,23 @@ extensions = [
     Extension("yt.analysis_modules.halo_finding.fof.EnzoFOF",
               ["yt/analysis_modules/halo_finding/fof/EnzoFOF.c",
                "yt/analysis_modules/halo_finding/fof/kd.c"],
-              libraries=std_libs),
+              libraries=std_libs,
+              extra_compile_args=omp_args,
+              extra_link_args=omp_args),
     Extension("yt.analysis_modules.halo_finding.hop.EnzoHop",
-              glob.glob("yt/analysis_modules/halo_finding/hop/*.c")),
+              glob.glob("yt/analysis_modules/halo_finding/hop/*.c"),
+              extra_compile_args=omp_args,
+              extra_link_args=omp_args),
     Extension("yt.frontends.artio._artio_caller",
               ["yt/frontends/artio/_artio_caller.pyx"] +
               glob.glob("yt/frontends/artio/artio_headers/*.c"),
               include_dirs=["yt/frontends/artio/artio_headers/",
                             "yt/geometry/",
                             "yt/utilities/lib/"],
-              depends=glob.glob("yt/frontends/artio/artio_headers/*.c")),
+              extra_compile_args=omp_args,
+              extra_link_args=omp_args,
+              depends=glob.glob("yt/frontends/artio/artio_headers/*.c") +
+                      ["yt/utilities/lib/space_filling_curves.h"]),
 ]
 
 # EMBREE
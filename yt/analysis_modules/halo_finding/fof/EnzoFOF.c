@@ -13,25 +13,101 @@
 
 #include "Python.h"
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <signal.h>
 #include <ctype.h>
 #include "kd.h"
 #include "tipsydefs.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "numpy/ndarrayobject.h"
 
 
 static PyObject *_FOFerror;
 
+static PyObject *
+_fof_double(PyObject **opos, double link, double *dPeriod, int nMembers,
+            int num_threads)
+{
+    // Double precision mode: the positions are read in place through the
+    // buffer protocol and distances are taken in double precision.
+    Py_buffer view[3];
+    char *pPos[3];
+    ptrdiff_t iStride[3];
+    int i, k, nview, num_particles;
+    KDFOF kd;
+    int nGroup;
+    npy_intp dims[1];
+    PyArrayObject *particle_group_id;
+    float fPeriod[3];
+
+    nview = 0;
+    num_particles = 0;
+    for (k = 0; k < 3; k++) {
+      if (PyObject_GetBuffer(opos[k], &view[k],
+                             PyBUF_STRIDES | PyBUF_FORMAT) < 0) goto _fail;
+      nview++;
+      if (view[k].ndim != 1 || view[k].itemsize != sizeof(double) ||
+          view[k].format == NULL ||
+          strcmp(view[k].format + (view[k].format[0] == '=' ||
+                                   view[k].format[0] == '@'), "d") != 0) {
+        PyErr_Format(_FOFerror,
+                 "EnzoFOF: positions must be 1-D float64 buffers.");
+        goto _fail;
+      }
+      if (k == 0) num_particles = view[0].shape[0];
+      if (view[k].shape[0] != num_particles) {
+        PyErr_Format(_FOFerror,
+                 "EnzoFOF: xpos, ypos and zpos must be the same length.");
+        goto _fail;
+      }
+      pPos[k] = (char *) view[k].buf;
+      iStride[k] = view[k].strides[0];
+    }
+
+    dims[0] = num_particles;
+    particle_group_id = (PyArrayObject *)
+            PyArray_SimpleNewFromDescr(1, dims,
+                    PyArray_DescrFromType(NPY_INT32));
+    if(!particle_group_id) goto _fail;
+
+    for (k = 0; k < 3; k++) fPeriod[k] = (float) dPeriod[k];
+    kdInitFoF(&kd,16,fPeriod);
+    kdSetPositionsFoFD(kd,num_particles,pPos,iStride,dPeriod);
+    Py_BEGIN_ALLOW_THREADS
+    kdBuildTreeFoFD(kd,num_threads);
+    nGroup = kdFoFD(kd,link,num_threads);
+    nGroup = kdTooSmallFoFD(kd,nMembers);
+    Py_END_ALLOW_THREADS
+    fprintf(stdout, "Number of groups:%d\n", nGroup);
+    for (i = 0; i < num_particles; i++) {
+      *(npy_int32*)(PyArray_GETPTR1(particle_group_id, i)) =
+            (npy_int32) kd->pGroup[i];
+    }
+    kdFinishFoF(kd);
+
+    for (k = 0; k < 3; k++) PyBuffer_Release(&view[k]);
+    return (PyObject *) particle_group_id;
+
+_fail:
+    for (k = 0; k < nview; k++) PyBuffer_Release(&view[k]);
+    return NULL;
+}
+
 static PyObject *
 Py_EnzoFOF(PyObject *obj, PyObject *args)
 {
     PyObject    *oxpos, *oypos, *ozpos;
     PyArrayObject    *xpos, *ypos, *zpos;
-    float link = 0.2;
-    float fPeriod[3] = {1.0, 1.0, 1.0};
+    double link = 0.2;
+    double dPeriod[3] = {1.0, 1.0, 1.0};
+    float fPeriod[3];
 	int nMembers = 8;
+    int num_threads = 1;
+    int use_double = 0;
     int i, num_particles;
 	KDFOF kd;
 	int nBucket,j;
@@ -43,12 +119,26 @@ Py_EnzoFOF(PyObject *obj, PyObject *args)
 
     xpos=ypos=zpos=NULL;
 
-    if (!PyArg_ParseTuple(args, "OOO|f(fff)i",
+    if (!PyArg_ParseTuple(args, "OOO|d(ddd)iii",
         &oxpos, &oypos, &ozpos, &link,
-        &fPeriod[0], &fPeriod[1], &fPeriod[2],
-        &nMembers))
+        &dPeriod[0], &dPeriod[1], &dPeriod[2],
+        &nMembers, &num_threads, &use_double))
     return PyErr_Format(_FOFerror,
             "EnzoFOF: Invalid parameters.");
+    for (i = 0; i < 3; i++) fPeriod[i] = (float) dPeriod[i];
+
+    if (num_threads <= 0) {
+#ifdef _OPENMP
+        num_threads = omp_get_max_threads();
+#else
+        num_threads = 1;
+#endif
+    }
+
+    if (use_double) {
+        PyObject *opos[3] = {oxpos, oypos, ozpos};
+        return _fof_double(opos, link, dPeriod, nMembers, num_threads);
+    }
 
     /* First the regular source arrays */
 
@@ -84,7 +174,7 @@ Py_EnzoFOF(PyObject *obj, PyObject *args)
 	
 	/* linking length */
 	fprintf(stdout, "Link length is %f\n", link);
-	fEps = link;
+	fEps = (float)link;
 	
 	nBucket = 16;
 
@@ -107,9 +197,9 @@ Py_EnzoFOF(PyObject *obj, PyObject *args)
 	  kd->p[i].r[2] = (float)(*(npy_float64*) PyArray_GETPTR1(zpos, i));
 	}
 	
-	kdBuildTreeFoF(kd);
+	kdBuildTreeFoFParallel(kd,num_threads);
 	kdTimeFoF(kd,&sec,&usec);
-	nGroup = kdFoF(kd,fEps);
+	nGroup = kdFoFParallel(kd,fEps,num_threads);
 	kdTimeFoF(kd,&sec,&usec);
 	if (bVerbose) printf("Number of initial groups:%d\n",nGroup);
 	nGroup = kdTooSmallFoF(kd,nMembers);
@@ -165,8 +255,341 @@ _fail:
 
 }
 
+static PyObject *
+Py_EnzoFOFMulti(PyObject *obj, PyObject *args)
+{
+    PyObject    *oxpos, *oypos, *ozpos, *olinks;
+    PyArrayObject    *xpos, *ypos, *zpos, *links;
+    float fPeriod[3] = {1.0, 1.0, 1.0};
+	int nMembers = 8;
+    int num_threads = 1;
+    int i, k, num_particles, num_links;
+	KDFOF kd;
+	float *fEps;
+	npy_intp dims[2];
+	PyArrayObject *particle_group_id;
+
+    xpos=ypos=zpos=links=NULL;
+    fEps=NULL;
+    kd=NULL;
+
+    if (!PyArg_ParseTuple(args, "OOOO|(fff)ii",
+        &oxpos, &oypos, &ozpos, &olinks,
+        &fPeriod[0], &fPeriod[1], &fPeriod[2],
+        &nMembers, &num_threads))
+    return PyErr_Format(_FOFerror,
+            "EnzoFOF: Invalid parameters.");
+
+    xpos    = (PyArrayObject *) PyArray_FromAny(oxpos,
+                    PyArray_DescrFromType(NPY_FLOAT64), 1, 1,
+                    NPY_ARRAY_IN_ARRAY, NULL);
+    if(!xpos){
+    PyErr_Format(_FOFerror,
+             "EnzoFOF: xpos didn't work.");
+    goto _fail;
+    }
+    num_particles = PyArray_SIZE(xpos);
+
+    ypos    = (PyArrayObject *) PyArray_FromAny(oypos,
+                    PyArray_DescrFromType(NPY_FLOAT64), 1, 1,
+                    NPY_ARRAY_IN_ARRAY, NULL);
+    if((!ypos)||(PyArray_SIZE(ypos) != num_particles)) {
+    PyErr_Format(_FOFerror,
+             "EnzoFOF: xpos and ypos must be the same length.");
+    goto _fail;
+    }
+
+    zpos    = (PyArrayObject *) PyArray_FromAny(ozpos,
+                    PyArray_DescrFromType(NPY_FLOAT64), 1, 1,
+                    NPY_ARRAY_IN_ARRAY, NULL);
+    if((!zpos)||(PyArray_SIZE(zpos) != num_particles)) {
+    PyErr_Format(_FOFerror,
+             "EnzoFOF: xpos and zpos must be the same length.");
+    goto _fail;
+    }
+
+    /* The linking lengths, largest first */
+
+    links   = (PyArrayObject *) PyArray_FromAny(olinks,
+                    PyArray_DescrFromType(NPY_FLOAT64), 1, 1,
+                    NPY_ARRAY_IN_ARRAY, NULL);
+    if((!links)||(PyArray_SIZE(links) < 1)) {
+    PyErr_Format(_FOFerror,
+             "EnzoFOF: links must be a non-empty 1-D sequence.");
+    goto _fail;
+    }
+    num_links = PyArray_SIZE(links);
+    fEps = (float *)malloc(num_links*sizeof(float));
+    assert(fEps != NULL);
+    for (k = 0; k < num_links; k++) {
+      fEps[k] = (float)(*(npy_float64*) PyArray_GETPTR1(links, k));
+      if (fEps[k] <= 0.0 || (k > 0 && fEps[k] > fEps[k-1])) {
+        PyErr_Format(_FOFerror,
+                 "EnzoFOF: links must be positive and in descending order.");
+        goto _fail;
+      }
+    }
+
+	kdInitFoF(&kd,16,fPeriod);
+    kd->nActive = num_particles;
+	kd->p = (PARTICLEFOF *)malloc(kd->nActive*sizeof(PARTICLEFOF));
+	assert(kd->p != NULL);
+	for (i = 0; i < num_particles; i++) {
+	  kd->p[i].iOrder = i;
+	  kd->p[i].r[0] = (float)(*(npy_float64*) PyArray_GETPTR1(xpos, i));
+	  kd->p[i].r[1] = (float)(*(npy_float64*) PyArray_GETPTR1(ypos, i));
+	  kd->p[i].r[2] = (float)(*(npy_float64*) PyArray_GETPTR1(zpos, i));
+	}
+
+    if (num_threads <= 0) {
+#ifdef _OPENMP
+        num_threads = omp_get_max_threads();
+#else
+        num_threads = 1;
+#endif
+    }
+	kdBuildTreeFoFParallel(kd,num_threads);
+
+    // One column of group tags per linking length, in the input order
+    dims[0] = num_particles;
+    dims[1] = num_links;
+    particle_group_id = (PyArrayObject *)
+            PyArray_SimpleNewFromDescr(2, dims,
+                    PyArray_DescrFromType(NPY_INT32));
+    if(!particle_group_id) goto _fail;
+	kdFoFMulti(kd,num_links,fEps,nMembers,
+			   (int *)PyArray_DATA(particle_group_id),num_threads);
+
+	kdFinishFoF(kd);
+    free(fEps);
+    Py_DECREF(xpos);
+    Py_DECREF(ypos);
+    Py_DECREF(zpos);
+    Py_DECREF(links);
+
+    return (PyObject *) particle_group_id;
+
+_fail:
+    Py_XDECREF(xpos);
+    Py_XDECREF(ypos);
+    Py_XDECREF(zpos);
+    Py_XDECREF(links);
+    if(fEps!=NULL)free(fEps);
+    if(kd!=NULL)kdFinishFoF(kd);
+
+    return NULL;
+
+}
+
+static PyArrayObject *
+_fof_in_array(PyObject *obj, int type, npy_intp size, const char *name)
+{
+    PyArrayObject *arr;
+
+    arr = (PyArrayObject *) PyArray_FromAny(obj,
+                    PyArray_DescrFromType(type), 1, 1,
+                    NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST, NULL);
+    if((!arr)||(size >= 0 && PyArray_SIZE(arr) != size)) {
+    Py_XDECREF(arr);
+    PyErr_Format(_FOFerror,
+             "EnzoFOF: %s must be 1-D and match the length of tags.", name);
+    return NULL;
+    }
+    return arr;
+}
+
+static PyObject *
+Py_ReduceGroups(PyObject *obj, PyObject *args)
+{
+    PyObject    *otags, *ofield[8];
+    PyArrayObject    *tags, *field[8];
+    PyArrayObject *order, *offsets, *gmass, *gcom, *gvel, *grms, *grad, *gdens;
+    npy_int64 *tag, *ord, *off, *next, *imax;
+    npy_float64 *pos[3], *vel[3], *mass, *dens;
+    npy_float64 LE[3], DW[3];
+    npy_intp dims[2];
+    int num_threads = 1;
+    npy_intp i, n, ngroups;
+    int k;
+    static const char *names[8] = {"x", "y", "z", "vx", "vy", "vz",
+                                   "mass", "densities"};
+    PyObject *return_value;
+
+    tags=NULL;
+    for (k = 0; k < 8; k++) field[k] = NULL;
+    order=offsets=gmass=gcom=gvel=grms=grad=gdens=NULL;
+    next=NULL;
+
+    if (!PyArg_ParseTuple(args, "OOOOOOOOO(ddd)(ddd)|i",
+        &otags, &ofield[0], &ofield[1], &ofield[2],
+        &ofield[3], &ofield[4], &ofield[5], &ofield[6], &ofield[7],
+        &LE[0], &LE[1], &LE[2], &DW[0], &DW[1], &DW[2], &num_threads))
+    return PyErr_Format(_FOFerror,
+            "EnzoFOF: Invalid parameters.");
+
+    tags = _fof_in_array(otags, NPY_INT64, -1, "tags");
+    if(!tags) goto _fail;
+    n = PyArray_SIZE(tags);
+    for (k = 0; k < 8; k++) {
+      field[k] = _fof_in_array(ofield[k], NPY_FLOAT64, n, names[k]);
+      if(!field[k]) goto _fail;
+    }
+    tag = (npy_int64 *) PyArray_DATA(tags);
+    for (k = 0; k < 3; k++) {
+      pos[k] = (npy_float64 *) PyArray_DATA(field[k]);
+      vel[k] = (npy_float64 *) PyArray_DATA(field[k+3]);
+    }
+    mass = (npy_float64 *) PyArray_DATA(field[6]);
+    dens = (npy_float64 *) PyArray_DATA(field[7]);
+
+    /* Tags below zero are particles in no group */
+    ngroups = 0;
+    for (i = 0; i < n; i++) if (tag[i] >= ngroups) ngroups = tag[i] + 1;
+
+    /* Bucket the particles by group, keeping them in order in each */
+    dims[0] = ngroups + 1;
+    offsets = (PyArrayObject *) PyArray_ZEROS(1, dims, NPY_INT64, 0);
+    if(!offsets) goto _fail;
+    off = (npy_int64 *) PyArray_DATA(offsets);
+    for (i = 0; i < n; i++) if (tag[i] >= 0) off[tag[i]+1]++;
+    for (i = 0; i < ngroups; i++) off[i+1] += off[i];
+    dims[0] = off[ngroups];
+    order = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_INT64);
+    next = (npy_int64 *) malloc((ngroups+1)*sizeof(npy_int64));
+    if((!order)||(!next)) goto _fail;
+    ord = (npy_int64 *) PyArray_DATA(order);
+    memcpy(next, off, (ngroups+1)*sizeof(npy_int64));
+    for (i = 0; i < n; i++) if (tag[i] >= 0) ord[next[tag[i]]++] = i;
+
+    dims[0] = ngroups;
+    dims[1] = 3;
+    gmass = (PyArrayObject *) PyArray_ZEROS(1, dims, NPY_FLOAT64, 0);
+    gcom = (PyArrayObject *) PyArray_ZEROS(2, dims, NPY_FLOAT64, 0);
+    gvel = (PyArrayObject *) PyArray_ZEROS(2, dims, NPY_FLOAT64, 0);
+    grms = (PyArrayObject *) PyArray_ZEROS(1, dims, NPY_FLOAT64, 0);
+    grad = (PyArrayObject *) PyArray_ZEROS(1, dims, NPY_FLOAT64, 0);
+    gdens = (PyArrayObject *) PyArray_ZEROS(1, dims, NPY_INT64, 0);
+    if((!gmass)||(!gcom)||(!gvel)||(!grms)||(!grad)||(!gdens)) goto _fail;
+    imax = (npy_int64 *) PyArray_DATA(gdens);
+
+    if (num_threads <= 0) {
+#ifdef _OPENMP
+        num_threads = omp_get_max_threads();
+#else
+        num_threads = 1;
+#endif
+    }
+
+    /*
+     * One pass over each group's members for the extents, one for the
+     * mass-weighted sums and one for the moments about the results.
+     * These follow Halo.center_of_mass, bulk_velocity, rms_velocity and
+     * maximum_radius in halo_objects.py.
+     */
+    Py_BEGIN_ALLOW_THREADS
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic,16) private(k)
+#endif
+    for (i = 0; i < ngroups; i++) {
+      npy_int64 j, p, lo = off[i], hi = off[i+1];
+      npy_float64 cmin[3], cmax[3], shift[3], c, m, msum, dmax;
+      npy_float64 sc[3], sv[3], com[3], bv[3], dv, s, r, r2, rmax;
+      if (lo == hi) continue;
+      for (k = 0; k < 3; k++) {
+        cmin[k] = cmax[k] = pos[k][ord[lo]] - LE[k];
+        sc[k] = sv[k] = 0.0;
+      }
+      for (j = lo; j < hi; j++) {
+        p = ord[j];
+        for (k = 0; k < 3; k++) {
+          c = pos[k][p] - LE[k];
+          if (c < cmin[k]) cmin[k] = c;
+          if (c > cmax[k]) cmax[k] = c;
+        }
+      }
+      /* Groups spanning half the box or more are wrapped around */
+      for (k = 0; k < 3; k++)
+        shift[k] = (cmax[k] - cmin[k] < DW[k]/2.) ? 0.0 : DW[k];
+      msum = 0.0;
+      dmax = dens[ord[lo]];
+      imax[i] = ord[lo];
+      for (j = lo; j < hi; j++) {
+        p = ord[j];
+        m = mass[p];
+        msum += m;
+        for (k = 0; k < 3; k++) {
+          c = pos[k][p] - LE[k];
+          if (c <= DW[k]/2.) c += shift[k];
+          sc[k] += m*c;
+          sv[k] += m*vel[k][p];
+        }
+        if (dens[p] > dmax) {
+          dmax = dens[p];
+          imax[i] = p;
+        }
+      }
+      for (k = 0; k < 3; k++) {
+        com[k] = fmod(sc[k]/msum, DW[k]);
+        if (com[k] < 0.0) com[k] += DW[k];
+        com[k] += LE[k];
+        bv[k] = sv[k]/msum;
+      }
+      s = 0.0;
+      rmax = 0.0;
+      for (j = lo; j < hi; j++) {
+        p = ord[j];
+        r2 = 0.0;
+        for (k = 0; k < 3; k++) {
+          dv = (vel[k][p] - bv[k])*mass[p]/msum;
+          s += dv*dv;
+          r = fabs(pos[k][p] - com[k]);
+          if (DW[k] - r < r) r = DW[k] - r;
+          r2 += r*r;
+        }
+        if (r2 > rmax) rmax = r2;
+      }
+      *(npy_float64*) PyArray_GETPTR1(gmass, i) = msum;
+      for (k = 0; k < 3; k++) {
+        *(npy_float64*) PyArray_GETPTR2(gcom, i, k) = com[k];
+        *(npy_float64*) PyArray_GETPTR2(gvel, i, k) = bv[k];
+      }
+      *(npy_float64*) PyArray_GETPTR1(grms, i) = sqrt(s/(hi-lo))*(hi-lo);
+      *(npy_float64*) PyArray_GETPTR1(grad, i) = sqrt(rmax);
+    }
+    Py_END_ALLOW_THREADS
+
+    free(next);
+    Py_DECREF(tags);
+    for (k = 0; k < 8; k++) Py_DECREF(field[k]);
+
+    return_value = Py_BuildValue("NNNNNNNN", order, offsets, gmass, gcom,
+                                 gvel, grms, grad, gdens);
+    return return_value;
+
+_fail:
+    if(next!=NULL)free(next);
+    Py_XDECREF(tags);
+    for (k = 0; k < 8; k++) Py_XDECREF(field[k]);
+    Py_XDECREF(order);
+    Py_XDECREF(offsets);
+    Py_XDECREF(gmass);
+    Py_XDECREF(gcom);
+    Py_XDECREF(gvel);
+    Py_XDECREF(grms);
+    Py_XDECREF(grad);
+    Py_XDECREF(gdens);
+    if(!PyErr_Occurred())
+    PyErr_Format(_FOFerror,
+             "EnzoFOF: Unable to allocate the group catalog.");
+
+    return NULL;
+
+}
+
 static PyMethodDef _FOFMethods[] = {
     {"RunFOF", Py_EnzoFOF, METH_VARARGS},
+    {"RunFOFMulti", Py_EnzoFOFMulti, METH_VARARGS},
+    {"ReduceGroups", Py_ReduceGroups, METH_VARARGS},
     {NULL, NULL} /* Sentinel */
 };
 
@@ -8,9 +8,19 @@
 #include <sys/time.h>
 #endif
 #include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "kd.h"
 #include "tipsydefs.h"
 
+/*
+ ** Cells with more particles than this are split off as OpenMP tasks by
+ ** kdBuildTreeFoFParallel(); smaller ones are finished by the task that
+ ** reaches them.
+ */
+#define KDFOF_TASK_MIN	16384
+
 
 void kdTimeFoF(KDFOF kd,int *puSecond,int *puMicro)
 {
@@ -58,9 +68,19 @@ int kdInitFoF(KDFOF *pkd,int nBucket,float *fPeriod)
 	kd = (KDFOF)malloc(sizeof(struct kdContext));
 	assert(kd != NULL);
 	kd->nBucket = nBucket;
-	for (j=0;j<3;++j) kd->fPeriod[j] = fPeriod[j];
+	for (j=0;j<3;++j) {
+		kd->fPeriod[j] = fPeriod[j];
+		kd->dPeriod[j] = fPeriod[j];
+		}
 	kd->p = NULL;
 	kd->kdNodes = NULL;
+	for (j=0;j<3;++j) {
+		kd->pPos[j] = NULL;
+		kd->iStride[j] = 0;
+		}
+	kd->pIndex = NULL;
+	kd->pGroup = NULL;
+	kd->kdNodesD = NULL;
 	*pkd = kd;
 	return(1);
 	}
@@ -205,9 +225,12 @@ void kdUpPassFoF(KDFOF kd,int iCell)
 		}
 	}
 
-void kdBuildTreeFoF(KDFOF kd)
+void kdAllocNodesFoF(KDFOF kd)
+/*
+ ** Size and allocate the node array and set up the ROOTFOF node.
+ */
 {
-	int l,n,i,d,m,j,diff;
+	int l,n,i,j;
 	KDNFOF *c;
 	BNDFOF bnd;
 
@@ -246,6 +269,16 @@ void kdBuildTreeFoF(KDFOF kd)
 	c[ROOTFOF].pLower = 0;
 	c[ROOTFOF].pUpper = kd->nActive-1;
 	c[ROOTFOF].bnd = bnd;
+	}
+
+
+void kdBuildTreeFoF(KDFOF kd)
+{
+	int i,d,m,j,diff;
+	KDNFOF *c;
+
+	kdAllocNodesFoF(kd);
+	c = kd->kdNodes;
 	i = ROOTFOF;
 	while (1) {
 		assert(c[i].pUpper - c[i].pLower + 1 > 0);
@@ -283,6 +316,77 @@ void kdBuildTreeFoF(KDFOF kd)
 	}
 
 
+void kdBuildNodeFoF(KDFOF kd,int i)
+/*
+ ** Split cell i and everything below it, then fill in its bounds on the
+ ** way back up.  Each cell is split exactly as kdBuildTreeFoF() splits it
+ ** and only touches its own particles, so the two subtrees can be built
+ ** as independent tasks and the nodes and particle order come out
+ ** identical.
+ */
+{
+	int d,m,j,diff;
+	KDNFOF *c;
+
+	c = kd->kdNodes;
+	assert(c[i].pUpper - c[i].pLower + 1 > 0);
+	if (i >= kd->nSplit || (c[i].pUpper - c[i].pLower) <= 0) {
+		c[i].iDim = -1;
+		kdUpPassFoF(kd,i);
+		return;
+		}
+	d = 0;
+	for (j=1;j<3;++j) {
+		if (c[i].bnd.fMax[j]-c[i].bnd.fMin[j] > 
+			c[i].bnd.fMax[d]-c[i].bnd.fMin[d]) d = j;
+		}
+	c[i].iDim = d;
+
+	m = (c[i].pLower + c[i].pUpper)/2;
+	kdSelectFoF(kd,d,m,c[i].pLower,c[i].pUpper);
+
+	c[i].fSplit = kd->p[m].r[d];
+	c[LOWERFOF(i)].bnd = c[i].bnd;
+	c[LOWERFOF(i)].bnd.fMax[d] = c[i].fSplit;
+	c[LOWERFOF(i)].pLower = c[i].pLower;
+	c[LOWERFOF(i)].pUpper = m;
+	c[UPPERFOF(i)].bnd = c[i].bnd;
+	c[UPPERFOF(i)].bnd.fMin[d] = c[i].fSplit;
+	c[UPPERFOF(i)].pLower = m+1;
+	c[UPPERFOF(i)].pUpper = c[i].pUpper;
+	diff = (m-c[i].pLower+1)-(c[i].pUpper-m);
+	assert(diff == 0 || diff == 1);
+#ifdef _OPENMP
+	#pragma omp task if(c[i].pUpper-c[i].pLower > KDFOF_TASK_MIN)
+#endif
+	kdBuildNodeFoF(kd,LOWERFOF(i));
+	kdBuildNodeFoF(kd,UPPERFOF(i));
+#ifdef _OPENMP
+	#pragma omp taskwait
+#endif
+	kdCombineFoF(&c[LOWERFOF(i)],&c[UPPERFOF(i)],&c[i]);
+	}
+
+
+void kdBuildTreeFoFParallel(KDFOF kd,int nThreads)
+/*
+ ** kdBuildTreeFoF() with the subtrees of large cells built as OpenMP
+ ** tasks on nThreads threads.  The result is the same as kdBuildTreeFoF().
+ */
+{
+	if (nThreads < 2) {
+		kdBuildTreeFoF(kd);
+		return;
+		}
+	kdAllocNodesFoF(kd);
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(nThreads)
+	#pragma omp single
+#endif
+	kdBuildNodeFoF(kd,ROOTFOF);
+	}
+
+
 int kdFoF(KDFOF kd,float fEps)
 {
 	PARTICLEFOF *p;
@@ -378,20 +482,592 @@ int kdFoF(KDFOF kd,float fEps)
 	}
 
 
-int kdTooSmallFoF(KDFOF kd,int nMembers)
+#ifdef _OPENMP
+
+/*
+ ** Lock-free union-find for kdFoFParallel().  A root is only ever hooked
+ ** under a root with a smaller index, so the parent links always point
+ ** downwards and the final root of every group is its lowest index.
+ */
+static int ufFindFoF(int *pParent,int i)
 {
-	int *pnMembers,*pMap;
-	int i,pi,nGroup;
+	int p,gp;
 
-	pnMembers = (int *)malloc(kd->nGroup*sizeof(int));
-	assert(pnMembers != NULL);
-	pMap = (int *)malloc(kd->nGroup*sizeof(int));
-	assert(pMap != NULL);
-	for (i=0;i<kd->nGroup;++i) pnMembers[i] = 0;
-	for (pi=0;pi<kd->nActive;++pi) {
-		++pnMembers[kd->p[pi].iGroup];
+	while (1) {
+		p = __atomic_load_n(&pParent[i],__ATOMIC_RELAXED);
+		if (p == i) return(i);
+		gp = __atomic_load_n(&pParent[p],__ATOMIC_RELAXED);
+		/*
+		 ** Path halving; losing this race only costs a longer path.
+		 */
+		if (gp != p) __sync_bool_compare_and_swap(&pParent[i],p,gp);
+		i = gp;
+		}
+	}
+
+
+static void ufUnionFoF(int *pParent,int i,int j)
+{
+	int t;
+
+	while (1) {
+		i = ufFindFoF(pParent,i);
+		j = ufFindFoF(pParent,j);
+		if (i == j) return;
+		if (i > j) {
+			t = i;
+			i = j;
+			j = t;
+			}
+		if (__sync_bool_compare_and_swap(&pParent[j],j,i)) return;
+		}
+	}
+
+#endif
+
+
+int kdFoFParallel(KDFOF kd,float fEps,int nThreads)
+/*
+ ** kdFoF() on nThreads threads.  Every particle walks the tree with the
+ ** same fEps-ball test as kdFoF(), including its choice of periodic
+ ** image, and links itself to each higher-numbered particle it finds
+ ** through a concurrent union-find.  The roots are then numbered in
+ ** particle order.  kdFoF() numbers a group when the flood fill first
+ ** reaches its lowest particle, so the group numbers come out the same.
+ */
+{
+#ifdef _OPENMP
+	PARTICLEFOF *p;
+	KDNFOF *c;
+	int *pParent,*pCount;
+	int nActive,nRoot;
+	float fEps2,lx,ly,lz;
+
+	if (nThreads < 2) return(kdFoF(kd,fEps));
+	p = kd->p;
+	c = kd->kdNodes;
+	nActive = kd->nActive;
+	lx = kd->fPeriod[0];
+	ly = kd->fPeriod[1];
+	lz = kd->fPeriod[2];
+	fEps2 = fEps*fEps;
+	pParent = (int *)malloc(nActive*sizeof(int));
+	assert(pParent != NULL);
+	pCount = (int *)malloc((nThreads+1)*sizeof(int));
+	assert(pCount != NULL);
+	nRoot = 0;
+#pragma omp parallel num_threads(nThreads)
+	{
+	int pi,pj,cp,i,t,nt,lo,hi,n;
+	float dx,dy,dz,x,y,z,sx,sy,sz,fDist2;
+
+#pragma omp for schedule(static)
+	for (pi=0;pi<nActive;++pi) pParent[pi] = pi;
+#pragma omp for schedule(dynamic,256)
+	for (pi=0;pi<nActive;++pi) {
+		/*
+		 ** Now do an fEps-Ball Gather!
+		 */
+		x = p[pi].r[0];
+		y = p[pi].r[1];
+		z = p[pi].r[2];
+		cp = ROOTFOF;
+		while (1) {
+			INTERSECTFOF(c,cp,fEps2,lx,ly,lz,x,y,z,sx,sy,sz);
+			/*
+			 ** We have an intersection to test.
+			 */
+			if (c[cp].iDim >= 0) {
+				cp = LOWERFOF(cp);
+				continue;
+				}
+			else {
+				for (pj=c[cp].pLower;pj<=c[cp].pUpper;++pj) {
+					if (pj <= pi) continue;
+					dx = sx - p[pj].r[0];
+					dy = sy - p[pj].r[1];
+					dz = sz - p[pj].r[2];
+					fDist2 = dx*dx + dy*dy + dz*dz;
+					if (fDist2 < fEps2) ufUnionFoF(pParent,pi,pj);
+					}
+				SETNEXTFOF(cp);
+				if (cp == ROOTFOF) break;
+				continue;
+				}
+		ContainedCell:
+			for (pj=c[cp].pLower;pj<=c[cp].pUpper;++pj) {
+				if (pj > pi) ufUnionFoF(pParent,pi,pj);
+				}
+		GetNextCell:
+			SETNEXTFOF(cp);
+			if (cp == ROOTFOF) break;
+			}
+		}
+	/*
+	 ** Flatten every path, then number the roots in particle order:
+	 ** count them in a contiguous block per thread and offset each
+	 ** block by the counts of the blocks before it.
+	 */
+#pragma omp for schedule(static)
+	for (pi=0;pi<nActive;++pi) pParent[pi] = ufFindFoF(pParent,pi);
+	nt = omp_get_num_threads();
+	t = omp_get_thread_num();
+	lo = (int)(((long long)nActive*t)/nt);
+	hi = (int)(((long long)nActive*(t+1))/nt);
+	n = 0;
+	for (pi=lo;pi<hi;++pi) if (pParent[pi] == pi) ++n;
+	pCount[t+1] = n;
+#pragma omp barrier
+#pragma omp single
+	{
+	pCount[0] = 0;
+	for (i=1;i<=nt;++i) pCount[i] += pCount[i-1];
+	nRoot = pCount[nt];
+	}
+	n = pCount[t];
+	for (pi=lo;pi<hi;++pi) if (pParent[pi] == pi) p[pi].iGroup = ++n;
+#pragma omp barrier
+#pragma omp for schedule(static)
+	for (pi=0;pi<nActive;++pi) p[pi].iGroup = p[pParent[pi]].iGroup;
+	}
+	free(pCount);
+	free(pParent);
+	kd->nGroup = nRoot+1;
+	return(nRoot);
+#else
+	return(kdFoF(kd,fEps));
+#endif
+	}
+
+
+/*
+ ** Growable list of (pi,pj) pairs for kdFoFMulti().
+ */
+typedef struct pairList {
+	int *pPair;
+	int nPair;
+	int nMaxPair;
+	} PAIRLISTFOF;
+
+static void pairAddFoF(PAIRLISTFOF *pl,int pi,int pj)
+{
+	if (pl->nPair == pl->nMaxPair) {
+		pl->nMaxPair = (pl->nMaxPair)?2*pl->nMaxPair:1024;
+		pl->pPair = (int *)realloc(pl->pPair,2*pl->nMaxPair*sizeof(int));
+		assert(pl->pPair != NULL);
+		}
+	pl->pPair[2*pl->nPair] = pi;
+	pl->pPair[2*pl->nPair+1] = pj;
+	++pl->nPair;
+	}
+
+
+static int ufRootFoF(int *pParent,int i)
+{
+	while (pParent[i] != i) {
+		pParent[i] = pParent[pParent[i]];
+		i = pParent[i];
+		}
+	return(i);
+	}
+
+
+static void ufLinkFoF(int *pParent,int i,int j)
+{
+	i = ufRootFoF(pParent,i);
+	j = ufRootFoF(pParent,j);
+	if (i < j) pParent[j] = i;
+	else if (j < i) pParent[i] = j;
+	}
+
+#ifdef _OPENMP
+#define UNIONFOF(pParent,i,j)	ufUnionFoF(pParent,i,j)
+#else
+#define UNIONFOF(pParent,i,j)	ufLinkFoF(pParent,i,j)
+#endif
+
+
+void kdFoFMulti(KDFOF kd,int nEps,float *fEps,int nMembers,int *pGroup,
+				int nThreads)
+/*
+ ** Friends-of-friends at each of the nEps linking lengths in fEps[],
+ ** which must be in descending order, from one search of the tree.
+ ** Every pair closer than fEps[0] is found once and filed under the
+ ** smallest linking length that still links it.  These lists are then
+ ** fed to a single union-find, smallest length first, and after each
+ ** one the groups are numbered and pruned with kdTooSmallFoF() as they
+ ** would be after kdFoF() at that length.  The group of particle iOrder
+ ** at fEps[k] is left in pGroup[iOrder*nEps+k], and p[].iGroup holds
+ ** the groups at fEps[0].
+ */
+{
+	PARTICLEFOF *p;
+	KDNFOF *c;
+	PAIRLISTFOF *pl;
+	float *fEps2;
+	int *pParent;
+	int nActive,i,j,k,t,pi;
+	float lx,ly,lz;
+
+	p = kd->p;
+	c = kd->kdNodes;
+	nActive = kd->nActive;
+	lx = kd->fPeriod[0];
+	ly = kd->fPeriod[1];
+	lz = kd->fPeriod[2];
+#ifndef _OPENMP
+	nThreads = 1;
+#endif
+	if (nThreads < 1) nThreads = 1;
+	fEps2 = (float *)malloc(nEps*sizeof(float));
+	assert(fEps2 != NULL);
+	for (k=0;k<nEps;++k) fEps2[k] = fEps[k]*fEps[k];
+	pl = (PAIRLISTFOF *)calloc(nThreads*nEps,sizeof(PAIRLISTFOF));
+	assert(pl != NULL);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nThreads)
+#endif
+	{
+	PAIRLISTFOF *plt;
+	int pi,pj,cp,k;
+	float dx,dy,dz,x,y,z,sx,sy,sz,fDist2;
+
+	plt = pl;
+#ifdef _OPENMP
+	plt += omp_get_thread_num()*nEps;
+#pragma omp for schedule(dynamic,256)
+#endif
+	for (pi=0;pi<nActive;++pi) {
+		x = p[pi].r[0];
+		y = p[pi].r[1];
+		z = p[pi].r[2];
+		cp = ROOTFOF;
+		while (1) {
+			INTERSECTFOF(c,cp,fEps2[0],lx,ly,lz,x,y,z,sx,sy,sz);
+			if (c[cp].iDim >= 0) {
+				cp = LOWERFOF(cp);
+				continue;
+				}
+			/*
+			 ** Bucket or contained cell; either way the distances
+			 ** are needed to file the pairs.
+			 */
+		ContainedCell:
+			for (pj=c[cp].pLower;pj<=c[cp].pUpper;++pj) {
+				if (pj <= pi) continue;
+				dx = sx - p[pj].r[0];
+				dy = sy - p[pj].r[1];
+				dz = sz - p[pj].r[2];
+				fDist2 = dx*dx + dy*dy + dz*dz;
+				if (fDist2 < fEps2[0]) {
+					for (k=nEps-1;fDist2 >= fEps2[k];--k);
+					pairAddFoF(&plt[k],pi,pj);
+					}
+				}
+		GetNextCell:
+			SETNEXTFOF(cp);
+			if (cp == ROOTFOF) break;
+			}
+		}
+	}
+	pParent = (int *)malloc(nActive*sizeof(int));
+	assert(pParent != NULL);
+	for (pi=0;pi<nActive;++pi) pParent[pi] = pi;
+	for (k=nEps-1;k>=0;--k) {
+		/*
+		 ** Link the pairs first found at this length, always hooking
+		 ** the higher root under the lower so that every root is the
+		 ** first particle of its group, as in kdFoF().
+		 */
+		for (t=0;t<nThreads;++t) {
+			PAIRLISTFOF *plk = &pl[t*nEps+k];
+			for (pi=0;pi<plk->nPair;++pi) {
+				ufLinkFoF(pParent,plk->pPair[2*pi],plk->pPair[2*pi+1]);
+				}
+			free(plk->pPair);
+			}
+		j = 0;
+		for (pi=0;pi<nActive;++pi) {
+			i = ufRootFoF(pParent,pi);
+			if (i == pi) p[pi].iGroup = ++j;
+			else p[pi].iGroup = p[i].iGroup;
+			}
+		kd->nGroup = j+1;
+		kdTooSmallFoF(kd,nMembers);
+		for (pi=0;pi<nActive;++pi) {
+			pGroup[(size_t)p[pi].iOrder*nEps+k] = p[pi].iGroup;
+			}
+		}
+	free(pParent);
+	free(pl);
+	free(fEps2);
+	}
+
+
+void kdSetPositionsFoFD(KDFOF kd,int n,char **pPos,ptrdiff_t *iStride,
+		double *dPeriod)
+/*
+ ** Switch kd to double precision mode on n particles whose coordinates
+ ** are the float64 values at pPos[j] + i*iStride[j] (strides in bytes),
+ ** in a box of period dPeriod.  The arrays are read in place and must
+ ** outlive kd; kd->p is not used.
+ */
+{
+	int i,j;
+
+	kd->nActive = n;
+	for (j=0;j<3;++j) {
+		kd->pPos[j] = pPos[j];
+		kd->iStride[j] = iStride[j];
+		kd->dPeriod[j] = dPeriod[j];
+		}
+	if (kd->pIndex != NULL) free(kd->pIndex);
+	kd->pIndex = (int *)malloc(n*sizeof(int));
+	assert(kd->pIndex != NULL);
+	for (i=0;i<n;++i) kd->pIndex[i] = i;
+	}
+
+
+void kdSelectFoFD(KDFOF kd,int d,int k,int l,int r)
+/*
+ ** kdSelectFoF() on the permutation pIndex.
+ */
+{
+	int *p,t;
+	double v;
+	int i,j;
+
+	p = kd->pIndex;
+	while (r > l) {
+		v = POSFOFD(kd,p[k],d);
+		t = p[r];
+		p[r] = p[k];
+		p[k] = t;
+		i = l - 1;
+		j = r;
+		while (1) {
+			while (i < j) if (POSFOFD(kd,p[++i],d) >= v) break;
+			while (i < j) if (POSFOFD(kd,p[--j],d) <= v) break;
+			t = p[i];
+			p[i] = p[j];
+			p[j] = t;
+			if (j <= i) break;
+			}
+		p[j] = p[i];
+		p[i] = p[r];
+		p[r] = t;
+		if (i >= k) r = i - 1;
+		if (i <= k) l = i + 1;
+		}
+	}
+
+
+void kdBuildNodeFoFD(KDFOF kd,int i)
+/*
+ ** kdBuildNodeFoF() for the double precision tree.
+ */
+{
+	int d,m,j,pj;
+	KDNFOFD *c;
+	double r;
+
+	c = kd->kdNodesD;
+	if (i >= kd->nSplit || (c[i].pUpper - c[i].pLower) <= 0) {
+		c[i].iDim = -1;
+		for (j=0;j<3;++j) {
+			c[i].bnd.fMin[j] = POSFOFD(kd,kd->pIndex[c[i].pUpper],j);
+			c[i].bnd.fMax[j] = c[i].bnd.fMin[j];
+			}
+		for (pj=c[i].pLower;pj<c[i].pUpper;++pj) {
+			for (j=0;j<3;++j) {
+				r = POSFOFD(kd,kd->pIndex[pj],j);
+				if (r < c[i].bnd.fMin[j]) c[i].bnd.fMin[j] = r;
+				if (r > c[i].bnd.fMax[j]) c[i].bnd.fMax[j] = r;
+				}
+			}
+		return;
+		}
+	d = 0;
+	for (j=1;j<3;++j) {
+		if (c[i].bnd.fMax[j]-c[i].bnd.fMin[j] > 
+			c[i].bnd.fMax[d]-c[i].bnd.fMin[d]) d = j;
+		}
+	c[i].iDim = d;
+
+	m = (c[i].pLower + c[i].pUpper)/2;
+	kdSelectFoFD(kd,d,m,c[i].pLower,c[i].pUpper);
+
+	c[i].fSplit = POSFOFD(kd,kd->pIndex[m],d);
+	c[LOWERFOF(i)].bnd = c[i].bnd;
+	c[LOWERFOF(i)].bnd.fMax[d] = c[i].fSplit;
+	c[LOWERFOF(i)].pLower = c[i].pLower;
+	c[LOWERFOF(i)].pUpper = m;
+	c[UPPERFOF(i)].bnd = c[i].bnd;
+	c[UPPERFOF(i)].bnd.fMin[d] = c[i].fSplit;
+	c[UPPERFOF(i)].pLower = m+1;
+	c[UPPERFOF(i)].pUpper = c[i].pUpper;
+#ifdef _OPENMP
+	#pragma omp task if(c[i].pUpper-c[i].pLower > KDFOF_TASK_MIN)
+#endif
+	kdBuildNodeFoFD(kd,LOWERFOF(i));
+	kdBuildNodeFoFD(kd,UPPERFOF(i));
+#ifdef _OPENMP
+	#pragma omp taskwait
+#endif
+	for (j=0;j<3;++j) {
+		c[i].bnd.fMin[j] = c[LOWERFOF(i)].bnd.fMin[j];
+		if (c[UPPERFOF(i)].bnd.fMin[j] < c[i].bnd.fMin[j])
+			c[i].bnd.fMin[j] = c[UPPERFOF(i)].bnd.fMin[j];
+		c[i].bnd.fMax[j] = c[LOWERFOF(i)].bnd.fMax[j];
+		if (c[UPPERFOF(i)].bnd.fMax[j] > c[i].bnd.fMax[j])
+			c[i].bnd.fMax[j] = c[UPPERFOF(i)].bnd.fMax[j];
+		}
+	}
+
+
+void kdBuildTreeFoFD(KDFOF kd,int nThreads)
+/*
+ ** Build the double precision tree over the positions given to
+ ** kdSetPositionsFoFD(), with large cells split off as OpenMP tasks
+ ** when nThreads > 1.  It has the same shape as the float tree.
+ */
+{
+	int l,n,i,j;
+	KDNFOFD *c;
+	double r;
+
+	n = kd->nActive;
+	kd->nLevels = 1;
+	l = 1;
+	while (n > kd->nBucket) {
+		n = n>>1;
+		l = l<<1;
+		++kd->nLevels;
+		}
+	kd->nSplit = l;
+	kd->nNodes = l<<1;
+	if (kd->kdNodesD != NULL) free(kd->kdNodesD);
+	kd->kdNodesD = (KDNFOFD *)malloc(kd->nNodes*sizeof(KDNFOFD));
+	assert(kd->kdNodesD != NULL);
+	c = kd->kdNodesD;
+	c[ROOTFOF].pLower = 0;
+	c[ROOTFOF].pUpper = kd->nActive-1;
+	for (j=0;j<3;++j) {
+		c[ROOTFOF].bnd.fMin[j] = POSFOFD(kd,0,j);
+		c[ROOTFOF].bnd.fMax[j] = POSFOFD(kd,0,j);
+		}
+	for (i=1;i<kd->nActive;++i) {
+		for (j=0;j<3;++j) {
+			r = POSFOFD(kd,i,j);
+			if (c[ROOTFOF].bnd.fMin[j] > r) c[ROOTFOF].bnd.fMin[j] = r;
+			else if (c[ROOTFOF].bnd.fMax[j] < r) c[ROOTFOF].bnd.fMax[j] = r;
+			}
 		}
-	for (i=1;i<kd->nGroup;++i) {
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(nThreads) if(nThreads > 1)
+	#pragma omp single
+#endif
+	kdBuildNodeFoFD(kd,ROOTFOF);
+	}
+
+
+int kdFoFD(KDFOF kd,double fEps,int nThreads)
+/*
+ ** Friends-of-friends on the double precision tree, with every distance
+ ** taken in double precision.  Particles are linked through the same
+ ** union-find as kdFoFParallel() and the groups are numbered the same
+ ** way, in tree order.  The group of input particle i is left in
+ ** kd->pGroup[i].
+ */
+{
+	KDNFOFD *c;
+	int *pParent,*pIndex,*pGroup;
+	int nActive,pi,nRoot;
+	double fEps2,lx,ly,lz;
+
+	c = kd->kdNodesD;
+	pIndex = kd->pIndex;
+	nActive = kd->nActive;
+	lx = kd->dPeriod[0];
+	ly = kd->dPeriod[1];
+	lz = kd->dPeriod[2];
+	fEps2 = fEps*fEps;
+	if (kd->pGroup != NULL) free(kd->pGroup);
+	kd->pGroup = (int *)malloc(nActive*sizeof(int));
+	assert(kd->pGroup != NULL);
+	pGroup = kd->pGroup;
+	pParent = (int *)malloc(nActive*sizeof(int));
+	assert(pParent != NULL);
+	for (pi=0;pi<nActive;++pi) pParent[pi] = pi;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nThreads) if(nThreads > 1)
+#endif
+	{
+	int pi,pj,cp;
+	double dx,dy,dz,x,y,z,sx,sy,sz,fDist2;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,256)
+#endif
+	for (pi=0;pi<nActive;++pi) {
+		x = POSFOFD(kd,pIndex[pi],0);
+		y = POSFOFD(kd,pIndex[pi],1);
+		z = POSFOFD(kd,pIndex[pi],2);
+		cp = ROOTFOF;
+		while (1) {
+			INTERSECTFOFT(double,c,cp,fEps2,lx,ly,lz,x,y,z,sx,sy,sz);
+			if (c[cp].iDim >= 0) {
+				cp = LOWERFOF(cp);
+				continue;
+				}
+			else {
+				for (pj=c[cp].pLower;pj<=c[cp].pUpper;++pj) {
+					if (pj <= pi) continue;
+					dx = sx - POSFOFD(kd,pIndex[pj],0);
+					dy = sy - POSFOFD(kd,pIndex[pj],1);
+					dz = sz - POSFOFD(kd,pIndex[pj],2);
+					fDist2 = dx*dx + dy*dy + dz*dz;
+					if (fDist2 < fEps2) UNIONFOF(pParent,pi,pj);
+					}
+				SETNEXTFOF(cp);
+				if (cp == ROOTFOF) break;
+				continue;
+				}
+		ContainedCell:
+			for (pj=c[cp].pLower;pj<=c[cp].pUpper;++pj) {
+				if (pj > pi) UNIONFOF(pParent,pi,pj);
+				}
+		GetNextCell:
+			SETNEXTFOF(cp);
+			if (cp == ROOTFOF) break;
+			}
+		}
+	}
+	/*
+	 ** Every root is the first particle of its group in tree order, and
+	 ** comes before the rest of it.
+	 */
+	nRoot = 0;
+	for (pi=0;pi<nActive;++pi) {
+		if (ufRootFoF(pParent,pi) == pi) pGroup[pIndex[pi]] = ++nRoot;
+		else pGroup[pIndex[pi]] = pGroup[pIndex[pParent[pi]]];
+		}
+	free(pParent);
+	kd->nGroup = nRoot+1;
+	return(nRoot);
+	}
+
+
+static int kdGroupMapFoF(int nGroup,int *pnMembers,int nMembers,int *pMap)
+/*
+ ** Given the membership of groups 0..nGroup-1, map every group with
+ ** fewer than nMembers particles to -1 and number the rest from 1,
+ ** leaving group 0 as it is.  Returns the new nGroup.
+ */
+{
+	int i,nNew;
+
+	for (i=1;i<nGroup;++i) {
 		if (pnMembers[i] < nMembers) {
 			pnMembers[i] = 0;
 			}
@@ -400,16 +1076,34 @@ int kdTooSmallFoF(KDFOF kd,int nMembers)
 	 ** Create a remapping!
 	 */
 	pMap[0] = 0;
-	nGroup = 1;
-	for (i=1;i<kd->nGroup;++i) {
-		pMap[i] = nGroup;
+	nNew = 1;
+	for (i=1;i<nGroup;++i) {
+		pMap[i] = nNew;
 		if (pnMembers[i] == 0) {
 			pMap[i] = -1; /* was 0 */
 			}
 		else {
-			++nGroup;
+			++nNew;
 			}
 		}
+	return(nNew);
+	}
+
+
+int kdTooSmallFoF(KDFOF kd,int nMembers)
+{
+	int *pnMembers,*pMap;
+	int i,pi,nGroup;
+
+	pnMembers = (int *)malloc(kd->nGroup*sizeof(int));
+	assert(pnMembers != NULL);
+	pMap = (int *)malloc(kd->nGroup*sizeof(int));
+	assert(pMap != NULL);
+	for (i=0;i<kd->nGroup;++i) pnMembers[i] = 0;
+	for (pi=0;pi<kd->nActive;++pi) {
+		++pnMembers[kd->p[pi].iGroup];
+		}
+	nGroup = kdGroupMapFoF(kd->nGroup,pnMembers,nMembers,pMap);
 	/*
 	 ** Remap the groups.
 	 */
@@ -423,6 +1117,29 @@ int kdTooSmallFoF(KDFOF kd,int nMembers)
 	}
 
 
+int kdTooSmallFoFD(KDFOF kd,int nMembers)
+/*
+ ** kdTooSmallFoF() for the groups left in pGroup[] by kdFoFD().
+ */
+{
+	int *pnMembers,*pMap;
+	int i,nGroup;
+
+	pnMembers = (int *)malloc(kd->nGroup*sizeof(int));
+	assert(pnMembers != NULL);
+	pMap = (int *)malloc(kd->nGroup*sizeof(int));
+	assert(pMap != NULL);
+	for (i=0;i<kd->nGroup;++i) pnMembers[i] = 0;
+	for (i=0;i<kd->nActive;++i) ++pnMembers[kd->pGroup[i]];
+	nGroup = kdGroupMapFoF(kd->nGroup,pnMembers,nMembers,pMap);
+	for (i=0;i<kd->nActive;++i) kd->pGroup[i] = pMap[kd->pGroup[i]];
+	free(pMap);
+	free(pnMembers);
+	kd->nGroup = nGroup;
+	return(nGroup-1);
+	}
+
+
 int CmpParticlesFoF(const void *v1,const void *v2)
 {
 	PARTICLEFOF *p1 = (PARTICLEFOF *)v1;
@@ -465,6 +1182,9 @@ void kdFinishFoF(KDFOF kd)
 {
 	free(kd->p);
 	free(kd->kdNodes);
+	free(kd->pIndex);
+	free(kd->pGroup);
+	free(kd->kdNodesD);
 	free(kd);
 	}
 
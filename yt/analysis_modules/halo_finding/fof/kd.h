@@ -1,6 +1,8 @@
 #ifndef KDFOF_HINCLUDED
 #define KDFOF_HINCLUDED
 
+#include <stddef.h>
+
 #define ROOTFOF		1
 #define LOWERFOF(i)	(i<<1)
 #define UPPERFOF(i)	((i<<1)+1)
@@ -37,6 +39,19 @@ typedef struct kdNode {
 	int pUpper;
 	} KDNFOF;
 
+typedef struct bndBoundD {
+	double fMin[3];
+	double fMax[3];
+	} BNDFOFD;
+
+typedef struct kdNodeD {
+	double fSplit;
+	BNDFOFD bnd;
+	int iDim;
+	int pLower;
+	int pUpper;
+	} KDNFOFD;
+
 typedef struct kdContext {
 	int nBucket;
 	int nParticles;
@@ -57,12 +72,33 @@ typedef struct kdContext {
 	int nGroup;
 	int uSecond;
 	int uMicro;
+	/*
+	 ** Double precision mode, see kdSetPositionsFoFD().  The coordinates
+	 ** are read in place from three strided float64 arrays and the tree
+	 ** holds only the permutation pIndex of the input, and the period is
+	 ** kept in double precision as well.
+	 */
+	double dPeriod[3];
+	char *pPos[3];
+	ptrdiff_t iStride[3];
+	int *pIndex;
+	int *pGroup;
+	KDNFOFD *kdNodesD;
 	} * KDFOF;
 
+#define POSFOFD(kd,i,j)	(*(double *)((kd)->pPos[j]+(i)*(kd)->iStride[j]))
 
+
+/*
+ ** INTERSECTFOFT does its arithmetic in type T, so the same test serves
+ ** the float tree and the double precision one.
+ */
 #define INTERSECTFOF(c,cp,fBall2,lx,ly,lz,x,y,z,sx,sy,sz)\
+	INTERSECTFOFT(float,c,cp,fBall2,lx,ly,lz,x,y,z,sx,sy,sz)
+
+#define INTERSECTFOFT(T,c,cp,fBall2,lx,ly,lz,x,y,z,sx,sy,sz)\
 {\
-	float dx,dy,dz,dx1,dy1,dz1,fDist2,fMax2;\
+	T dx,dy,dz,dx1,dy1,dz1,fDist2,fMax2;\
 	dx = c[cp].bnd.fMin[0]-x;\
 	dx1 = x-c[cp].bnd.fMax[0];\
 	dy = c[cp].bnd.fMin[1]-y;\
@@ -183,8 +219,15 @@ void kdTimeFoF(KDFOF,int *,int *);
 int kdInitFoF(KDFOF *,int,float *);
 void kdReadTipsyFoF(KDFOF,FILE *,int,int,int);
 void kdBuildTreeFoF(KDFOF);
+void kdBuildTreeFoFParallel(KDFOF,int);
 int kdFoF(KDFOF,float);
+int kdFoFParallel(KDFOF,float,int);
+void kdFoFMulti(KDFOF,int,float *,int,int *,int);
 int kdTooSmallFoF(KDFOF,int);
+void kdSetPositionsFoFD(KDFOF,int,char **,ptrdiff_t *,double *);
+void kdBuildTreeFoFD(KDFOF,int);
+int kdFoFD(KDFOF,double,int);
+int kdTooSmallFoFD(KDFOF,int);
 void kdOrderFoF(KDFOF);
 void kdOutGroupFoF(KDFOF,char *);
 void kdFinishFoF(KDFOF);
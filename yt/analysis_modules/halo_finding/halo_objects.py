@@ -24,6 +24,7 @@ from yt.extern.six.moves import zip as izip
 
 from yt.config import ytcfg
 from yt.funcs import mylog, ensure_dir_exists
+from yt.utilities.exceptions import YTFieldNotFound
 from yt.utilities.math_utils import \
     get_rotation_matrix, \
     periodic_dist
@@ -34,7 +35,7 @@ from yt.utilities.physical_ratios import \
     TINY
 
 from .hop.EnzoHop import RunHOP
-from .fof.EnzoFOF import RunFOF
+from .fof.EnzoFOF import RunFOF, ReduceGroups
 
 from yt.utilities.parallel_tools.parallel_analysis_interface import \
     ParallelDummy, \
@@ -261,7 +262,8 @@ class Halo(object):
         --------
         >>> radius = halos[0].maximum_radius()
         """
-        if self.max_radius is not None:
+        # The cached radius is measured from the center of mass.
+        if center_of_mass and self.max_radius is not None:
             return self.max_radius
         if center_of_mass:
             center = self.center_of_mass()
@@ -870,8 +872,24 @@ class HaloList(object):
                     self._data_source[(self.ptype, field)][ii].astype('float64')
             del self._data_source[(self.ptype, field)]
         self._base_indices = np.arange(tot_part)[ii]
+        self._particle_select = ii
         gc.collect()
 
+    def _reduce_field(self, field):
+        # Fields only the catalog reduction needs are read after the
+        # finder has run and are not kept, so the finder's own arrays
+        # and these are never held at the same time.  Returns None if
+        # the particles do not have the field.
+        if field in self.particle_fields:
+            return self.particle_fields[field]
+        try:
+            data = self._data_source[(self.ptype, field)]
+        except YTFieldNotFound:
+            return None
+        data = data[self._particle_select].astype('float64')
+        del self._data_source[(self.ptype, field)]
+        return data
+
     def _get_dm_indices(self):
         if ('io','creation_time') in self._data_source.index.field_list:
             mylog.debug("Differentiating based on creation time")
@@ -884,27 +902,52 @@ class HaloList(object):
             return slice(None)
 
     def _parse_output(self):
-        unique_ids = np.unique(self.tags)
-        counts = np.bincount(self.tags + 1)
-        sort_indices = np.argsort(self.tags)
-        grab_indices = np.indices(self.tags.shape).ravel()[sort_indices]
-        dens = self.densities[sort_indices]
-        cp = 0
-        for i in unique_ids:
-            cp_c = cp + counts[i + 1]
-            if i == -1:
-                cp += counts[i + 1]
-                continue
-            group_indices = grab_indices[cp:cp_c]
+        # The particles are bucketed by tag and every per-halo quantity
+        # that write_out and the sorting need is reduced in one pass in
+        # C, so the halos are created with these values already cached.
+        # Quantities depending on a field the particles do not have are
+        # left to the halos to compute if they are asked for.
+        ds = self._data_source.ds
+        pos = [self.particle_fields["particle_position_%s" % ax]
+               for ax in 'xyz']
+        vel = [self._reduce_field("particle_velocity_%s" % ax)
+               for ax in 'xyz']
+        have_vel = all(v is not None for v in vel)
+        if have_vel:
+            vunits = vel[0].units
+            vel = [v.in_units(vunits).d for v in vel]
+        else:
+            vel = [np.zeros(pos[0].size) for ax in 'xyz']
+        pm = self._reduce_field("particle_mass")
+        have_mass = pm is not None
+        if have_mass:
+            pm = pm.in_units('Msun').d
+        else:
+            pm = np.ones(pos[0].size)
+        order, offsets, mass, com, bulk_vel, rms_vel, max_radius, \
+            max_dens_index = ReduceGroups(self.tags,
+                *([p.in_units('code_length').d for p in pos] + vel +
+                  [pm, self.densities,
+                   tuple(ds.domain_left_edge.in_units('code_length').d),
+                   tuple(ds.domain_width.in_units('code_length').d),
+                   self.num_threads]))
+        counts = np.diff(offsets)
+        for i in np.where(counts > 0)[0]:
+            i = int(i)
+            group_indices = order[offsets[i]:offsets[i + 1]]
+            cached = {}
+            if have_mass:
+                cached["CoM"] = ds.arr(com[i], 'code_length')
+                cached["group_total_mass"] = ds.quan(mass[i], 'Msun')
+                cached["max_radius"] = ds.quan(max_radius[i], 'code_length')
+            if have_mass and have_vel:
+                cached["bulk_vel"] = ds.arr(bulk_vel[i], vunits)
+                cached["rms_vel"] = ds.quan(rms_vel[i], vunits)
             self._groups.append(self._halo_class(self, i, group_indices,
-                                                 ptype=self.ptype))
-            md_i = np.argmax(dens[cp:cp_c])
-            px, py, pz = \
-                [self.particle_fields['particle_position_%s' % ax][group_indices]
-                 for ax in 'xyz']
-            self._max_dens[i] = (dens[cp:cp_c][md_i], px[md_i],
-                py[md_i], pz[md_i])
-            cp += counts[i + 1]
+                size=int(counts[i]), ptype=self.ptype, **cached))
+            md_i = max_dens_index[i]
+            self._max_dens[i] = (self.densities[md_i], pos[0][md_i],
+                pos[1][md_i], pos[2][md_i])
 
     def __len__(self):
         return len(self._groups)
@@ -1016,18 +1059,22 @@ class HOPHaloList(HaloList):
               ["particle_mass"]
 
     def __init__(self, data_source, threshold=160.0, dm_only=True,
-                 ptype=None):
+                 ptype=None, num_threads=1):
         self.threshold = threshold
+        self.num_threads = num_threads
         mylog.info("Initializing HOP")
         HaloList.__init__(self, data_source, dm_only, ptype=ptype)
 
     def _run_finder(self):
-        self.densities, self.tags = \
+        # The merge map, boundaries and saddle densities describe the
+        # pre-merge HOP groups and are kept for inspection.
+        self.densities, self.tags, self.group_merge, \
+            self.group_boundaries, self.saddle_densities = \
             RunHOP(self.particle_fields["particle_position_x"] / self.period[0],
                 self.particle_fields["particle_position_y"] / self.period[1],
                 self.particle_fields["particle_position_z"] / self.period[2],
                 self.particle_fields["particle_mass"].in_units('Msun'),
-                self.threshold)
+                self.threshold, 1.0, self.num_threads, return_merge=True)
         self.particle_fields["densities"] = self.densities
         self.particle_fields["tags"] = self.tags
 
@@ -1055,18 +1102,32 @@ class FOFHaloList(HaloList):
     _halo_class = FOFHalo
 
     def __init__(self, data_source, link=0.2, dm_only=True, redshift=-1,
-                 ptype=None):
+                 ptype=None, num_threads=1, double_precision=False):
         self.link = link
+        self.num_threads = num_threads
+        self.double_precision = double_precision
         mylog.info("Initializing FOF")
         HaloList.__init__(self, data_source, dm_only, redshift=redshift,
                           ptype=ptype)
 
     def _run_finder(self):
-        self.tags = \
-        RunFOF(self.particle_fields["particle_position_x"] / self.period[0],
-               self.particle_fields["particle_position_y"] / self.period[1],
-               self.particle_fields["particle_position_z"] / self.period[2],
-               self.link)
+        pos = [self.particle_fields["particle_position_%s" % ax]
+               for ax in 'xyz']
+        if self.double_precision and np.all(self.period == self.period[0]):
+            # A cubic box can be searched in its own units, so the
+            # positions are passed to RunFOF without a copy.
+            period = float(self.period[0])
+            pos = [p if p.units == self.period.units
+                   else p.in_units(self.period.units) for p in pos]
+            self.tags = RunFOF(pos[0].d, pos[1].d, pos[2].d,
+                               self.link * period, (period,) * 3, 8,
+                               self.num_threads, 1)
+        else:
+            self.tags = RunFOF(pos[0] / self.period[0],
+                               pos[1] / self.period[1],
+                               pos[2] / self.period[2],
+                               self.link, (1.0, 1.0, 1.0), 8,
+                               self.num_threads, int(self.double_precision))
         self.densities = np.ones(self.tags.size, dtype='float64') * -1
         self.particle_fields["densities"] = self.densities
         self.particle_fields["tags"] = self.tags
@@ -1235,7 +1296,10 @@ class GenericHaloFinder(HaloList, ParallelAnalysisInterface):
                     threshold_adjustment
                 max_dens[hi] = [max_dens_temp] + \
                     list(self._max_dens[halo.id])[1:4]
-                groups.append(self._halo_class(self, hi, ptype=self.ptype))
+                groups.append(self._halo_class(self, hi, size=halo.size,
+                    CoM=halo.CoM, group_total_mass=halo.group_total_mass,
+                    max_radius=halo.max_radius, bulk_vel=halo.bulk_vel,
+                    rms_vel=halo.rms_vel, ptype=self.ptype))
                 groups[-1].indices = halo.indices
                 self.comm.claim_object(groups[-1])
                 hi += 1
@@ -1459,6 +1523,10 @@ class HOPHaloFinder(GenericHaloFinder, HOPHaloList):
         mass in the entire volume.
         Default = None, which means the total mass is automatically
         calculated.
+    num_threads : int
+        The number of OpenMP threads used to build the kd-tree and for
+        the density and densest neighbor passes.  Zero or less uses all available threads.
+        Default = 1.
 
     Examples
     --------
@@ -1466,7 +1534,7 @@ class HOPHaloFinder(GenericHaloFinder, HOPHaloList):
     >>> halos = HaloFinder(ds)
     """
     def __init__(self, ds, subvolume=None, threshold=160, dm_only=True,
-                 ptype=None, padding=0.02, total_mass=None):
+                 ptype=None, padding=0.02, total_mass=None, num_threads=1):
         if subvolume is not None:
             ds_LE = np.array(subvolume.left_edge)
             ds_RE = np.array(subvolume.right_edge)
@@ -1532,7 +1600,8 @@ class HOPHaloFinder(GenericHaloFinder, HOPHaloList):
                 self._data_source.quantities.total_quantity(
                     (self.ptype, "particle_mass")).in_units('Msun')
         HOPHaloList.__init__(self, self._data_source,
-            threshold * total_mass / sub_mass, dm_only, ptype=self.ptype)
+            threshold * total_mass / sub_mass, dm_only, ptype=self.ptype,
+            num_threads=num_threads)
         self._parse_halolist(total_mass / sub_mass)
         self._join_halolists()
 
@@ -1577,6 +1646,15 @@ class FOFHaloFinder(GenericHaloFinder, FOFHaloList):
         with duplicated particles for halo finidng to work. This number
         must be no smaller than the radius of the largest halo in the box
         in code units. Default = 0.02.
+    num_threads : int
+        The number of OpenMP threads used to build the kd-tree and to
+        link the groups.  Zero or less uses all available threads.
+        Default = 1.
+    double_precision : bool
+        If True, the positions are searched in double precision, read in
+        place rather than copied to single precision.  Use this for deep
+        zooms where single precision cannot resolve the linking length.
+        Default = False.
 
     Examples
     --------
@@ -1584,7 +1662,8 @@ class FOFHaloFinder(GenericHaloFinder, FOFHaloList):
     >>> halos = FOFHaloFinder(ds)
     """
     def __init__(self, ds, subvolume=None, link=0.2, dm_only=True,
-                 ptype=None, padding=0.02):
+                 ptype=None, padding=0.02, num_threads=1,
+                 double_precision=False):
         if subvolume is not None:
             ds_LE = np.array(subvolume.left_edge)
             ds_RE = np.array(subvolume.right_edge)
@@ -1641,7 +1720,9 @@ class FOFHaloFinder(GenericHaloFinder, FOFHaloList):
         # here is where the FOF halo finder is run
         mylog.info("Using a linking length of %0.3e", linking_length)
         FOFHaloList.__init__(self, self._data_source, linking_length, dm_only,
-                             redshift=self.redshift, ptype=self.ptype)
+                             redshift=self.redshift, ptype=self.ptype,
+                             num_threads=num_threads,
+                             double_precision=double_precision)
         self._parse_halolist(1.)
         self._join_halolists()
 
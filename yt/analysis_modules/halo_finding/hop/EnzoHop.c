@@ -20,6 +20,9 @@
 #include "kd.h"
 #include "hop.h"
 #include "hop_numpy.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "numpy/ndarrayobject.h"
 
@@ -30,8 +33,7 @@
 void PrepareKD(KD kd);
 int kdMedianJst(KD kd, int d, int l, int u);
 void kdUpPass(KD kd, int iCell);
-void initgrouplist(Grouplist *g);
-void hop_main(KD kd, HC *my_comm, float densthres);
+void hop_main(KD kd, HC *my_comm, float densthres, int nThreads);
 void regroup_main(float dens_outer, HC *my_comm);
 static PyObject *_HOPerror;
 
@@ -87,7 +89,7 @@ int convert_particle_arrays(
     
 
 static PyObject *
-Py_EnzoHop(PyObject *obj, PyObject *args)
+Py_EnzoHop(PyObject *obj, PyObject *args, PyObject *kwds)
 {
     PyObject    *oxpos, *oypos, *ozpos,
                 *omass;
@@ -97,18 +99,27 @@ Py_EnzoHop(PyObject *obj, PyObject *args)
     npy_float64 totalmass = 0.0;
     float normalize_to = 1.0;
     float thresh = 160.0;
+    int num_threads = 1;
+    int return_merge = 0;
+    int tree_order = 1;
     int i, num_particles;
-    KD kd;
+    KD kd = NULL;
     int nBucket = 16, kdcount = 0;
     PyArrayObject *particle_density;
     HC my_comm;
-    PyArrayObject *particle_group_id;
+    PyArrayObject *particle_group_id, *group_merge,
+                  *group_boundaries, *saddle_densities;
+    npy_intp dims[2];
     PyObject *return_value;
+    static char *kwlist[] = {"xpos", "ypos", "zpos", "mass",
+                             "thresh", "normalize_to", "num_threads",
+                             "return_merge", "tree_order", NULL};
 
     xpos=ypos=zpos=mass=NULL;
 
-    if (!PyArg_ParseTuple(args, "OOOO|ff",
-        &oxpos, &oypos, &ozpos, &omass, &thresh, &normalize_to))
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OOOO|ffiii", kwlist,
+        &oxpos, &oypos, &ozpos, &omass, &thresh, &normalize_to,
+        &num_threads, &return_merge, &tree_order))
     return PyErr_Format(_HOPerror,
             "EnzoHop: Invalid parameters.");
 
@@ -125,6 +136,7 @@ Py_EnzoHop(PyObject *obj, PyObject *args)
 
   kdInit(&kd, nBucket);
   kd->nActive = num_particles;
+  kd->bTreeOrder = (tree_order != 0);
   kd->p = malloc(sizeof(PARTICLE)*num_particles);
   if (kd->p == NULL) {
     fprintf(stderr, "failed allocating particles.\n");
@@ -145,16 +157,17 @@ Py_EnzoHop(PyObject *obj, PyObject *args)
     kd->totalmass = totalmass;
 	for (i = 0; i < num_particles; i++) kd->p[i].np_index = i;
 
-    my_comm.s = newslice();
-    my_comm.gl = (Grouplist*)malloc(sizeof(Grouplist));
-    if(my_comm.gl == NULL) {
-        fprintf(stderr, "failed allocating Grouplist\n");
-        goto _fail;
-    }
-    initgrouplist(my_comm.gl);
+    inithopcomm(&my_comm);
 
     fprintf(stderr, "Calling hop... %d %0.3e\n",num_particles,thresh);
-    hop_main(kd, &my_comm, thresh);
+    if (num_threads <= 0) {
+#ifdef _OPENMP
+        num_threads = omp_get_max_threads();
+#else
+        num_threads = 1;
+#endif
+    }
+    hop_main(kd, &my_comm, thresh, num_threads);
 
     fprintf(stderr, "Calling regroup...\n");
     regroup_main(thresh, &my_comm);
@@ -165,24 +178,60 @@ Py_EnzoHop(PyObject *obj, PyObject *args)
     // back to the ID in this code, as we can do that back in the python code.
     // All we need to do is provide density and group information.
     
-    // Tags (as per writetagsf77) are in gl.s->ntag+1 and there are gl.s->numlist of them.
+    // Tags are in my_comm.s->ntag+1 and there are my_comm.s->numlist of them.
     particle_group_id = (PyArrayObject *)
             PyArray_SimpleNewFromDescr(1, PyArray_DIMS(xpos),
                     PyArray_DescrFromType(NPY_INT32));
     
     for (i = 0; i < num_particles; i++) {
-      // tag is in gl.s->ntag[i+1]
+      // tag is in my_comm.s->ntag[i+1]
       *(npy_int32*)(PyArray_GETPTR1(particle_group_id, i)) =
             (npy_int32) my_comm.s->ntag[i+1];
     }
 
-	kdFinish(kd);
-    free(my_comm.gl);
-    free_slice(my_comm.s);
-
     PyArray_UpdateFlags(particle_density, NPY_ARRAY_OWNDATA | PyArray_FLAGS(particle_density));
     PyArray_UpdateFlags(particle_group_id, NPY_ARRAY_OWNDATA | PyArray_FLAGS(particle_group_id));
-    return_value = Py_BuildValue("NN", particle_density, particle_group_id);
+
+    if (return_merge) {
+      // The final group of each of the pre-merge groups that the
+      // boundaries below refer to.
+      dims[0] = my_comm.ngroups;
+      group_merge = (PyArrayObject *)
+              PyArray_SimpleNewFromDescr(1, dims,
+                      PyArray_DescrFromType(NPY_INT32));
+      for (i = 0; i < my_comm.ngroups; i++) {
+        *(npy_int32*)(PyArray_GETPTR1(group_merge, i)) =
+              (npy_int32) my_comm.gmerge[i];
+      }
+
+      // The pairs of pre-merge groups sharing a boundary and the saddle
+      // density across it.
+      dims[0] = my_comm.nb;
+      dims[1] = 2;
+      group_boundaries = (PyArrayObject *)
+              PyArray_SimpleNewFromDescr(2, dims,
+                      PyArray_DescrFromType(NPY_INT32));
+      saddle_densities = (PyArrayObject *)
+              PyArray_SimpleNewFromDescr(1, dims,
+                      PyArray_DescrFromType(NPY_FLOAT64));
+      for (i = 0; i < my_comm.nb; i++) {
+        *(npy_int32*)(PyArray_GETPTR2(group_boundaries, i, 0)) =
+              (npy_int32) my_comm.g1vec[i];
+        *(npy_int32*)(PyArray_GETPTR2(group_boundaries, i, 1)) =
+              (npy_int32) my_comm.g2vec[i];
+        *(npy_float64*)(PyArray_GETPTR1(saddle_densities, i)) =
+              (npy_float64) my_comm.fdensity[i];
+      }
+
+      return_value = Py_BuildValue("NNNNN", particle_density,
+                                   particle_group_id, group_merge,
+                                   group_boundaries, saddle_densities);
+    } else {
+      return_value = Py_BuildValue("NN", particle_density, particle_group_id);
+    }
+
+	kdFinish(kd);
+    freehopcomm(&my_comm);
 
     Py_DECREF(xpos);
     Py_DECREF(ypos);
@@ -201,14 +250,14 @@ _fail:
     Py_XDECREF(zpos);
     Py_XDECREF(mass);
 
-    if(kd->p!=NULL)free(kd->p);
+    if(kd != NULL && kd->p!=NULL)free(kd->p);
 
     return NULL;
 
 }
 
 static PyMethodDef _HOPMethods[] = {
-    {"RunHOP", Py_EnzoHop, METH_VARARGS},
+    {"RunHOP", (PyCFunction) Py_EnzoHop, METH_VARARGS | METH_KEYWORDS},
     {NULL, NULL} /* Sentinel */
 };
 
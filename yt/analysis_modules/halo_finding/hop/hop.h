@@ -24,13 +24,20 @@ typedef struct groupliststruct {
 } Grouplist; /* Type Grouplist is defined */
  
 
+/* Everything handed from hop_main() to regroup_main() and back to the
+caller.  All of the vectors are zero-offset and malloc'd. */
 typedef struct hopComm {
-    int ngroups;
-    int nb;
-    float *gdensity;
-    float *g1vec;
-    float *g2vec;
-    float *fdensity;
+    int ngroups;        /* Number of groups before merging */
+    int nb;             /* Number of group boundaries */
+    float *gdensity;    /* Peak density of each group [ngroups] */
+    int *g1vec;         /* The two groups sharing each boundary [nb] */
+    int *g2vec;
+    float *fdensity;    /* Saddle density of each boundary [nb] */
+    int *gmerge;        /* Final group of each pre-merge group, or -1
+                                [ngroups], set by regroup_main() */
     Grouplist *gl;
     Slice *s;
 } HC;
+
+void inithopcomm(HC *my_comm);
+void freehopcomm(HC *my_comm);
@@ -42,6 +42,7 @@ int ReadSimulationFile(KD, FILE *);
 void smDensityTH(SMX smx,int pi,int nSmooth,int *pList,float *fList);
  
 void smHop(SMX smx,int pi,int nSmooth,int *pList,float *fList);
+void smHopMutual(SMX smx);
 void FindGroups(SMX smx);
 void SortGroups(SMX smx);
  
@@ -50,11 +51,11 @@ void smMergeHash(SMX smx,int pi,int nSmooth,int *pList,float *fList);
 void ReSizeSMX(SMX smx, int nSmooth);
  
 void PrepareKD(KD kd);
-void binOutHop(SMX smx, HC *my_comm, float densthres);
-void outGroupMerge(SMX smx, HC *my_comm);
+void smGroupTags(SMX smx, HC *my_comm, float densthres);
+void smGroupBoundaries(SMX smx, HC *my_comm);
 
 /* void main(int argc,char **argv) */
-void hop_main(KD kd, HC *my_comm, float densthres)
+void hop_main(KD kd, HC *my_comm, float densthres, int nThreads)
 {
   /*	KD kd; */
 	SMX smx;
@@ -113,24 +114,26 @@ void hop_main(KD kd, HC *my_comm, float densthres)
 	smx->fDensThresh = fDensThresh;
  
 	INFORM("Building Tree...\n");
-	kdBuildTree(kd);
+	kdBuildTreeParallel(kd,nThreads);
+	if (kd->bTreeOrder) kdTreeOrder(kd);
  
 	if (bDensity) {
 	    INFORM("Finding Densities...\n");
-	    if (bTopHat) smSmooth(smx,smDensityTH);
-	    else if (bSym) smSmooth(smx,smDensitySym);
-	    else smSmooth(smx,smDensity);
+	    if (bTopHat) smSmoothParallel(smx,smDensityTH,nThreads);
+	    else if (bSym) smSmoothParallel(smx,smDensitySym,nThreads);
+	    else smSmoothParallel(smx,smDensity,nThreads);
 	}  /* Else, we've read them */	
 	if (bGroup) {
 	     INFORM("Finding Densest Neighbors...\n");
-	     if (bDensity && nHop<nSmooth) smReSmooth(smx,smHop);
+	     if (bDensity && nHop<nSmooth) smReSmoothParallel(smx,smHop,nThreads);
 	     else {
 		if (nHop>=nSmooth) {
 		    nSmooth = nHop+1;
 		    ReSizeSMX(smx,nSmooth);
 		}
-		smSmooth(smx,smHop);
+		smSmoothParallel(smx,smHop,nThreads);
 	    }
+	    if (nThreads > 1) smHopMutual(smx);
 	}
  
 	INFORM("Grouping...\n");
@@ -142,17 +145,18 @@ void hop_main(KD kd, HC *my_comm, float densthres)
 	    MergeGroupsHash(smx);
 	}
  
+	kdCallerOrder(kd);
 	kdOrder(kd);
-	INFORM("Writing Output...\n");
+	INFORM("Collecting Groups...\n");
  
 	if (bMerge&2) {
 	    smx->nSmooth=nSmooth; /* Restore this for output */
-	    outGroupMerge(smx, my_comm);
+	    smGroupBoundaries(smx, my_comm);
 	}
 	if (bMerge) free(smx->hash);
  
 	if (bGroup&2) {
-	    binOutHop(smx, my_comm, densthres);
+	    smGroupTags(smx, my_comm, densthres);
 	}
 	if (bGroup) {free(smx->densestingroup); free(smx->nmembers);}
 	smFinish(smx);
@@ -232,7 +236,9 @@ sorting below */
     /* check to see if the particle we link to doesn't link back
        to ourselves, pi. If it does, connect this particle (pi) to itself.
        This can only happen if pList[max] < pi*/    
-    if (pList[max] < pi) {
+    /* In parallel pList[max] may not have been visited yet; hop_main
+       makes this check afterwards in smHopMutual() */
+    if (pList[max] < pi && smx->nThreads <= 1) {
         if (smx->kd->p[pList[max]].iHop == -1-pi) {
             smx->kd->p[pi].iHop = -1-pi;
         }
@@ -247,6 +253,24 @@ sorting below */
     return;
 }
  
+void smHopMutual(SMX smx)
+/* The pairs of particles that hop to each other, for when smHop() could
+not check this as it went.  As in the serial pass, the particle with
+the larger index of each pair is linked to itself.  A particle hopping
+to a smaller index is never changed by this, so the iHop values read
+here are the ones smHop() would have seen. */
+{
+    int pi, pj;
+
+    for (pi=0;pi<smx->kd->nActive;++pi) {
+	if (smx->kd->p[pi].iHop >= 0) continue;
+	pj = -1-smx->kd->p[pi].iHop;
+	if (pj < pi && smx->kd->p[pj].iHop == -1-pi)
+	    smx->kd->p[pi].iHop = -1-pi;
+    }
+    return;
+}
+
 /* ----------------------------------------------------------------- */
  
 void FindGroups(SMX smx)
@@ -520,54 +544,52 @@ routines */
     return;
 }
  
-void binOutHop(SMX smx, HC *my_comm, float densthres)
-/* Write Group tag for each particle.  Particles should be ordered. */
-/* Binary file: nActive, nGroups, list of Groups */
+void smGroupTags(SMX smx, HC *my_comm, float densthres)
+/* Copy the group tag of each particle into my_comm->s->ntag[1..nActive],
+removing particles below densthres.  Particles should be ordered. */
 {
-    int j,dummy;
-    /* FILE *blahfp = fopen("Part-PreMergeGroup.txt","w"); *//* S Skory */
+    int j;
     Grouplist *g = my_comm->gl;
     Slice *s = my_comm->s;
     
+    free_tags(s);
     g->npart = s->numlist = s->numpart = smx->kd->nActive;
     g->ngroups = smx->nGroups;
     s->ntag = ivector(1,s->numlist);
-    //s->ID = ivector(1,s->numlist);
     for (j=0;j<smx->kd->nActive;j++) {
-      //s->ID[1+j] = smx->kd->p[j].iID; /* S Skory's addition */
       if (NP_DENS(smx->kd,j) < densthres) s->ntag[j+1] = -1;
       else s->ntag[j+1] = smx->kd->p[j].iHop;
-
     }
-
-    /* Here I'm going to add on the end of the file the real particle IDs for all the particles
-       added above, in the same order as above. S Skory */
     return;
 }
  
 /* ----------------------------------------------------------------- */
  
-void outGroupMerge(SMX smx, HC *my_comm)
-/* Write an ASCII file with information on the groups and group merging */
-/* Start the boundary list with the only ### line */
+void smGroupBoundaries(SMX smx, HC *my_comm)
+/* Hand the peak density of each group and the list of group boundaries
+found by MergeGroupsHash() to regroup through my_comm. */
 /* Groups should be ordered before calling this (else densities will be wrong)*/
 {
     int j, den;
     Boundary *hp;
     int nb = 0;
 
-    my_comm->gdensity = vector(0,smx->nGroups-1);
+    for (j=0, hp=smx->hash;j<smx->nHashLength; j++,hp++)
+	if (hp->nGroup1>=0) nb++;
+    my_comm->ngroups = smx->nGroups;
+    my_comm->nb = nb;
+    /* One extra element keeps the mallocs non-empty */
+    my_comm->gdensity = (float *)malloc((size_t)((smx->nGroups+1)*sizeof(float)));
+    my_comm->g1vec = (int *)malloc((size_t)((nb+1)*sizeof(int)));
+    my_comm->g2vec = (int *)malloc((size_t)((nb+1)*sizeof(int)));
+    my_comm->fdensity = (float *)malloc((size_t)((nb+1)*sizeof(float)));
+    assert(my_comm->gdensity!=NULL && my_comm->g1vec!=NULL &&
+	   my_comm->g2vec!=NULL && my_comm->fdensity!=NULL);
+
     for (j=0;j<smx->nGroups;j++) {
         den = smx->densestingroup[j];
 	    my_comm->gdensity[j]=NP_DENS(smx->kd, den);
     }
-    for (j=0, hp=smx->hash;j<smx->nHashLength; j++,hp++)
-	if (hp->nGroup1>=0)nb++;
-    my_comm->ngroups = smx->nGroups;
-    my_comm->nb = nb;
-    my_comm->g1vec = vector(0,nb);
-    my_comm->g2vec = vector(0,nb);
-    my_comm->fdensity = vector(0,smx->nHashLength);
     nb = 0;
     for (j=0, hp=smx->hash;j<smx->nHashLength; j++,hp++)
 	if (hp->nGroup1>=0){
@@ -583,38 +605,7 @@ void outGroupMerge(SMX smx, HC *my_comm)
 /* ======================= Sorting ================================== */
 /* ================================================================== */
  
-typedef struct index_struct {
-    float value;
-    int index;
-} *ptrindex;
- 
-int cmp_index(const void *a, const void *b)
-{
-    if ( ((ptrindex)a)->value<((ptrindex)b)->value) return -1;
-    else if ( ((ptrindex)a)->value>((ptrindex)b)->value) return 1;
-    else return 0;
-}
- 
-void make_rank_table(int n, int *ivect, int *rank)
-/* Given a vector of integers ivect[1..n], construct a rank table rank[1..n]
-so that rank[j] contains the ordering of element j, with rank[j]=n indicating
-that the jth element was the highest, and rank[j]=1 indicating that it
-was the lowest.  Storage for rank[] should be declared externally */
-/* I don't think this routine is particularly fast, but it's a
-miniscule fraction of the runtime */
-{
-    int j;
-    ptrindex sortvect;
- 
-    sortvect = (ptrindex)malloc(n*sizeof(struct index_struct));
-    for (j=0;j<n;j++) sortvect[j].value = (float)ivect[j+1];
-    for (j=0;j<n;j++) sortvect[j].index = j+1;  /* Label them prior to sort */
-    qsort(sortvect,n,sizeof(struct index_struct),cmp_index);
-    /* Now sortvect is in order (smallest to largest) */
-    for (j=0;j<n;j++) rank[sortvect[j].index]=j+1;
-    free(sortvect);
-    return;
-}
+/* make_rank_table() is in hop_sort.c */
  
 /* DJE -- This is a C-translation of the Slatec FORTRAN routine ssort(). */
 /* I have kept the variable names and program flow unchanged; hence
@@ -19,6 +19,9 @@ the input and output routines. */
 #include <sys/resource.h>
 #endif
 #include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "kd.h"
 #include "hop_numpy.h"
 //#include "macros_and_parameters.h"
@@ -26,6 +29,13 @@ the input and output routines. */
  
  
 #define MAX_ROOT_ITTR	32
+
+/*
+ ** Cells with more particles than this are split off as OpenMP tasks by
+ ** kdBuildTreeParallel(); smaller ones are finished by the task that
+ ** reaches them.
+ */
+#define KD_TASK_MIN	16384
  
  
 void kdTime(KD kd,int *puSecond,int *puMicro)
@@ -74,6 +84,8 @@ int kdInit(KD *pkd,int nBucket)
 	assert(kd != NULL);
 	kd->nBucket = nBucket;
     kd->kdNodes = NULL;
+	kd->bTreeOrder = 0;
+	kd->np_caller_densities = NULL;
 	*pkd = kd;
 	return(1);
 	}
@@ -171,9 +183,12 @@ void kdUpPass(KD kd,int iCell)
 		}
 	}
  
-int kdBuildTree(KD kd)
+void kdAllocNodes(KD kd)
+/*
+ ** Size and allocate the node array and set up the ROOT node.
+ */
 {
-	int l,n,i,d,m,j,ct;
+	int l,n;
 	KDN *c;
  
 	n = kd->nActive;
@@ -195,6 +210,16 @@ int kdBuildTree(KD kd)
 	c[ROOT].pLower = 0;
 	c[ROOT].pUpper = kd->nActive-1;
 	c[ROOT].bnd = kd->bnd;
+	}
+ 
+ 
+int kdBuildTree(KD kd)
+{
+	int i,d,m,j,ct;
+	KDN *c;
+ 
+	kdAllocNodes(kd);
+	c = kd->kdNodes;
 	i = ROOT;
 	ct = ROOT;
 	SETNEXT(ct);
@@ -229,6 +254,132 @@ int kdBuildTree(KD kd)
 	}
  
  
+void kdBuildNode(KD kd,int i)
+/*
+ ** Split cell i and everything below it, then fill in its bounds on the
+ ** way back up.  Each cell is split exactly as kdBuildTree() splits it and
+ ** only touches its own particles, so the two subtrees can be built as
+ ** independent tasks and the nodes and particle order come out identical.
+ */
+{
+	int d,m,j;
+	KDN *c;
+ 
+	c = kd->kdNodes;
+	if (i >= kd->nSplit) {
+		c[i].iDim = -1;
+		kdUpPass(kd,i);
+		return;
+		}
+	d = 0;
+	for (j=1;j<3;++j) {
+		if (c[i].bnd.fMax[j]-c[i].bnd.fMin[j] >
+			c[i].bnd.fMax[d]-c[i].bnd.fMin[d]) d = j;
+		}
+	c[i].iDim = d;
+	m = kdMedianJst(kd,d,c[i].pLower,c[i].pUpper);
+	c[i].fSplit = NP_POS(kd, m, d);
+	c[LOWER(i)].bnd = c[i].bnd;
+	c[LOWER(i)].bnd.fMax[d] = c[i].fSplit;
+	c[LOWER(i)].pLower = c[i].pLower;
+	c[LOWER(i)].pUpper = m-1;
+	c[UPPER(i)].bnd = c[i].bnd;
+	c[UPPER(i)].bnd.fMin[d] = c[i].fSplit;
+	c[UPPER(i)].pLower = m;
+	c[UPPER(i)].pUpper = c[i].pUpper;
+#ifdef _OPENMP
+	#pragma omp task if(c[i].pUpper-c[i].pLower > KD_TASK_MIN)
+#endif
+	kdBuildNode(kd,LOWER(i));
+	kdBuildNode(kd,UPPER(i));
+#ifdef _OPENMP
+	#pragma omp taskwait
+#endif
+	kdCombine(&c[LOWER(i)],&c[UPPER(i)],&c[i]);
+	}
+ 
+ 
+int kdBuildTreeParallel(KD kd,int nThreads)
+/*
+ ** kdBuildTree() with the subtrees of large cells built as OpenMP tasks
+ ** on nThreads threads.  The result is the same as kdBuildTree().
+ */
+{
+	if (nThreads < 2) return(kdBuildTree(kd));
+	kdAllocNodes(kd);
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(nThreads)
+	#pragma omp single
+#endif
+	kdBuildNode(kd,ROOT);
+	return(1);
+	}
+ 
+ 
+void kdTreeOrder(KD kd)
+/*
+ ** Copy the positions, masses and densities into new arrays in tree
+ ** order and point np_index at them, so that the particles of a bucket
+ ** are contiguous for the neighbor searches.  The caller's arrays are
+ ** kept until kdCallerOrder().
+ */
+{
+	npy_float64 *pos[3],*mass,*dens;
+	int i,j,n;
+ 
+	if (kd->np_caller_densities != NULL) return;
+	n = kd->nActive;
+	for (j=0;j<3;++j) {
+		pos[j] = (npy_float64 *)malloc((n+1)*sizeof(npy_float64));
+		assert(pos[j] != NULL);
+		}
+	mass = (npy_float64 *)malloc((n+1)*sizeof(npy_float64));
+	assert(mass != NULL);
+	dens = (npy_float64 *)malloc((n+1)*sizeof(npy_float64));
+	assert(dens != NULL);
+	for (i=0;i<n;++i) {
+		for (j=0;j<3;++j) pos[j][i] = NP_POS(kd, i, j);
+		mass[i] = kd->np_masses[kd->p[i].np_index];
+		dens[i] = NP_DENS(kd, i);
+		kd->p[i].np_index = i;
+		}
+	for (j=0;j<3;++j) {
+		kd->np_caller_pos[j] = kd->np_pos[j];
+		kd->np_pos[j] = pos[j];
+		}
+	kd->np_caller_masses = kd->np_masses;
+	kd->np_masses = mass;
+	kd->np_caller_densities = kd->np_densities;
+	kd->np_densities = dens;
+	}
+ 
+ 
+void kdCallerOrder(KD kd)
+/*
+ ** Undo kdTreeOrder(): scatter the densities back into the caller's
+ ** array, using iOrder, and point np_index at the caller's arrays again.
+ */
+{
+	int i,j;
+ 
+	if (kd->np_caller_densities == NULL) return;
+	for (i=0;i<kd->nActive;++i) {
+		kd->np_caller_densities[kd->p[i].iOrder] =
+			kd->np_densities[kd->p[i].np_index];
+		}
+	for (i=0;i<kd->nActive;++i) kd->p[i].np_index = kd->p[i].iOrder;
+	for (j=0;j<3;++j) {
+		free(kd->np_pos[j]);
+		kd->np_pos[j] = kd->np_caller_pos[j];
+		}
+	free(kd->np_masses);
+	kd->np_masses = kd->np_caller_masses;
+	free(kd->np_densities);
+	kd->np_densities = kd->np_caller_densities;
+	kd->np_caller_densities = NULL;
+	}
+ 
+ 
 int cmpParticles(const void *v1,const void *v2)
 {
 	PARTICLE *p1=(PARTICLE *)v1,*p2=(PARTICLE *)v2;
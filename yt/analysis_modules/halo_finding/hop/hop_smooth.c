@@ -20,6 +20,9 @@ the case of equal mass particles. */
 #endif
 #include <math.h>
 #include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "smooth.h"
 #include "kd.h"
 #include "hop_numpy.h"
@@ -60,6 +63,7 @@ int smInit(SMX *psmx,KD kd,int nSmooth,float *fPeriod)
 	 ** Set for Periodic Boundary Conditions.
 	 */
 	for (j=0;j<3;++j) smx->fPeriod[j] = fPeriod[j];
+	smx->nThreads = 1;
 	/*
 	 ** Initialize arrays for calculated quantities.--DJE
 	 */
@@ -76,6 +80,8 @@ void smFinish(SMX smx)
 {
 	free(smx->pfBall2);
 	free(smx->iMark);
+	free(smx->fList);
+	free(smx->pList);
 	free(smx->pq);
 	free(smx);
 	}
@@ -86,7 +92,7 @@ void smBallSearch(SMX smx,float fBall2,float *ri)
 	KDN *c;
 	PARTICLE *p;
 	int cell,cp,ct,pj;
-	float fDist2,dx,dy,dz,lx,ly,lz,sx,sy,sz,x,y,z;
+	float fDist2,dx,dy,dz,lx,ly,lz,sx,sy,sz,x,y,z,ax,ay,az;
 	PQ *pq;
 	PQ_STATIC;
  
@@ -112,9 +118,13 @@ void smBallSearch(SMX smx,float fBall2,float *ri)
 	 ** Now start the search from the bucket given by cell!
 	 */
 	for (pj=c[cell].pLower;pj<=c[cell].pUpper;++pj) {
+		ax = ay = az = 0.0;
 		dx = x - NP_POS(smx->kd, pj, 0);
 		dy = y - NP_POS(smx->kd, pj, 1);
 		dz = z - NP_POS(smx->kd, pj, 2);
+		MINIMUM_IMAGE(dx,ax,lx);
+		MINIMUM_IMAGE(dy,ay,ly);
+		MINIMUM_IMAGE(dz,az,lz);
 		fDist2 = dx*dx + dy*dy + dz*dz;
 		if (fDist2 < fBall2) {
 			if (smx->iMark[pj]) continue;
@@ -122,9 +132,9 @@ void smBallSearch(SMX smx,float fBall2,float *ri)
 			smx->iMark[pj] = 1;
 			pq->fKey = fDist2;
 			pq->p = pj;
-			pq->ax = 0.0;
-			pq->ay = 0.0;
-			pq->az = 0.0;
+			pq->ax = ax;
+			pq->ay = ay;
+			pq->az = az;
 			PQ_REPLACE(pq);
 			fBall2 = pq->fKey;
 			}
@@ -144,9 +154,13 @@ void smBallSearch(SMX smx,float fBall2,float *ri)
 				}
 			else {
 				for (pj=c[cp].pLower;pj<=c[cp].pUpper;++pj) {
-                    dx = sx - NP_POS(smx->kd, pj, 0);
-                    dy = sy - NP_POS(smx->kd, pj, 1);
-                    dz = sz - NP_POS(smx->kd, pj, 2);
+					ax = ay = az = 0.0;
+                    dx = x - NP_POS(smx->kd, pj, 0);
+                    dy = y - NP_POS(smx->kd, pj, 1);
+                    dz = z - NP_POS(smx->kd, pj, 2);
+					MINIMUM_IMAGE(dx,ax,lx);
+					MINIMUM_IMAGE(dy,ay,ly);
+					MINIMUM_IMAGE(dz,az,lz);
 					fDist2 = dx*dx + dy*dy + dz*dz;
 					if (fDist2 < fBall2) {
 						if (smx->iMark[pj]) continue;
@@ -154,9 +168,9 @@ void smBallSearch(SMX smx,float fBall2,float *ri)
 						smx->iMark[pj] = 1;
 						pq->fKey = fDist2;
 						pq->p = pj;
-						pq->ax = sx - x;
-						pq->ay = sy - y;
-						pq->az = sz - z;
+						pq->ax = ax;
+						pq->ay = ay;
+						pq->az = az;
 						PQ_REPLACE(pq);
 						fBall2 = pq->fKey;
 						}
@@ -224,7 +238,12 @@ int smBallGather(SMX smx,float fBall2,float *ri)
 	}
  
  
-void smSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
+void smSmoothRange(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *),
+	int pLower,int pUpper)
+/* Smooth the particles pLower..pUpper-1, walking them in kd order and
+starting each search from the neighbors of the previous particle.  Only
+the pfBall2 entries of this range are read or written, so disjoint ranges
+can be smoothed concurrently with their own SMX work-space. */
 {
 	KDN *c;
 	PARTICLE *p;
@@ -232,36 +251,32 @@ void smSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
 	PQ_STATIC;
 	int cell;
 	int pi,pin,pj,pNext,nCnt,nSmooth;
-	float dx,dy,dz,x,y,z,h2,ax,ay,az;
+	float dx,dy,dz,x,y,z,h2,lx,ly,lz;
     float temp_ri[3];
  
  
-	for (pi=0;pi<smx->kd->nActive;++pi) {
-		if (IMARK) smx->pfBall2[pi] = -1.0;
-		else smx->pfBall2[pi] = 1.0;	/* pretend it is already done! */
-		}
-	smx->pfBall2[smx->kd->nActive] = -1.0; /* stop condition */
-	for (pi=0;pi<smx->kd->nActive;++pi) {
-		smx->iMark[pi] = 0;
-		}
+	if (pUpper - pLower < 1) return;
 	pqLast = &smx->pq[smx->nSmooth-1];
+	lx = smx->fPeriod[0];
+	ly = smx->fPeriod[1];
+	lz = smx->fPeriod[2];
 	c = smx->kd->kdNodes;
 	p = smx->kd->p;
 	nSmooth = smx->nSmooth;
 	/*
 	 ** Initialize Priority Queue.
 	 */
-	pin = 0;
-	pNext = 1;
-	ax = 0.0;
-	ay = 0.0;
-	az = 0.0;
-	for (pq=smx->pq,pj=0;pq<=pqLast;++pq,++pj) {
+	pin = pLower;
+	pNext = pLower+1;
+	pj = pLower;
+	if (pj > smx->kd->nActive - nSmooth)
+		pj = smx->kd->nActive - nSmooth;
+	for (pq=smx->pq;pq<=pqLast;++pq,++pj) {
 		smx->iMark[pj] = 1;
 		pq->p = pj;
-		pq->ax = ax;
-		pq->ay = ay;
-		pq->az = az;
+		pq->ax = 0.0;
+		pq->ay = 0.0;
+		pq->az = 0.0;
 		}
 	while (1) {
 		if (smx->pfBall2[pin] >= 0) {
@@ -269,11 +284,11 @@ void smSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
 			 ** Find next particle which is not done, and load the
 			 ** priority queue with nSmooth number of particles.
 			 */
-			while (smx->pfBall2[pNext] >= 0) ++pNext;
+			while (pNext < pUpper && smx->pfBall2[pNext] >= 0) ++pNext;
 			/*
 			 ** Check if we are really finished.
 			 */
-			if (pNext == smx->kd->nActive) break;
+			if (pNext == pUpper) break;
 			pi = pNext;
 			++pNext;
 			x = NP_POS(smx->kd, pi, 0);
@@ -304,20 +319,26 @@ void smSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
 				pj = smx->kd->nActive - nSmooth;
 			for (pq=smx->pq;pq<=pqLast;++pq) {
 				smx->iMark[pj] = 1;
+				pq->ax = 0.0;
+				pq->ay = 0.0;
+				pq->az = 0.0;
                 dx = x - NP_POS(smx->kd, pj, 0);
                 dy = y - NP_POS(smx->kd, pj, 1);
                 dz = z - NP_POS(smx->kd, pj, 2);
+				MINIMUM_IMAGE(dx,pq->ax,lx);
+				MINIMUM_IMAGE(dy,pq->ay,ly);
+				MINIMUM_IMAGE(dz,pq->az,lz);
 				pq->fKey = dx*dx + dy*dy + dz*dz;
 				pq->p = pj++;
-				pq->ax = 0.0;
-				pq->ay = 0.0;
-				pq->az = 0.0;
 				}
 			PQ_BUILD(smx->pq,nSmooth,smx->pqHead);
 			}
 		else {
 			/*
 			 ** Calculate the priority queue using the previous particles!
+			 ** The separations are taken afresh to the nearest image, so
+			 ** the keys do not depend on the order of the traversal and
+			 ** each thread of smSmoothParallel gets the serial ones.
 			 */
 			pi = pin;
 			x = NP_POS(smx->kd, pi, 0);
@@ -325,18 +346,18 @@ void smSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
 			z = NP_POS(smx->kd, pi, 2);
 			smx->pqHead = NULL;
 			for (pq=smx->pq;pq<=pqLast;++pq) {
-				pq->ax -= ax;
-				pq->ay -= ay;
-				pq->az -= az;
-				dx = x + pq->ax - NP_POS(smx->kd, pq->p, 0);
-				dy = y + pq->ay - NP_POS(smx->kd, pq->p, 1);
-				dz = z + pq->az - NP_POS(smx->kd, pq->p, 2);
+				pq->ax = 0.0;
+				pq->ay = 0.0;
+				pq->az = 0.0;
+				dx = x - NP_POS(smx->kd, pq->p, 0);
+				dy = y - NP_POS(smx->kd, pq->p, 1);
+				dz = z - NP_POS(smx->kd, pq->p, 2);
+				MINIMUM_IMAGE(dx,pq->ax,lx);
+				MINIMUM_IMAGE(dy,pq->ay,ly);
+				MINIMUM_IMAGE(dz,pq->az,lz);
 				pq->fKey = dx*dx + dy*dy + dz*dz;
 				}
 			PQ_BUILD(smx->pq,nSmooth,smx->pqHead);
-			ax = 0.0;
-			ay = 0.0;
-			az = 0.0;
 			}
         temp_ri[0] = NP_POS(smx->kd, pi, 0);
         temp_ri[1] = NP_POS(smx->kd, pi, 1);
@@ -354,13 +375,11 @@ void smSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
 			if (pq == smx->pqHead) continue;
 			smx->pList[nCnt] = pq->p;
 			smx->fList[nCnt++] = pq->fKey;
+			if (pq->p < pLower || pq->p >= pUpper) continue;
 			if (smx->pfBall2[pq->p] >= 0) continue;
 			if (pq->fKey < h2) {
 				pin = pq->p;
 				h2 = pq->fKey;
-				ax = pq->ax;
-				ay = pq->ay;
-				az = pq->az;
 				}
 			}
 		(*fncSmooth)(smx,pi,nCnt,smx->pList,smx->fList);
@@ -368,6 +387,22 @@ void smSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
 	}
  
  
+void smSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
+{
+	int pi;
+
+	for (pi=0;pi<smx->kd->nActive;++pi) {
+		if (IMARK) smx->pfBall2[pi] = -1.0;
+		else smx->pfBall2[pi] = 1.0;	/* pretend it is already done! */
+		}
+	smx->pfBall2[smx->kd->nActive] = -1.0; /* stop condition */
+	for (pi=0;pi<smx->kd->nActive;++pi) {
+		smx->iMark[pi] = 0;
+		}
+	smSmoothRange(smx,fncSmooth,0,smx->kd->nActive);
+	}
+
+
 void smReSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
 {
 	PARTICLE *p;
@@ -390,6 +425,112 @@ void smReSmooth(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *))
  	}
  
  
+/* Per-thread copy of smx: it shares the tree and pfBall2 but has its own
+priority queue, neighbor marks and neighbor lists. */
+SMX smThreadInit(SMX smx)
+{
+	SMX tsmx;
+	PQ_STATIC;
+
+	tsmx = (SMX)malloc(sizeof(struct smContext));
+	assert(tsmx != NULL);
+	*tsmx = *smx;
+	tsmx->pq = (PQ *)malloc(smx->nSmooth*sizeof(PQ));
+	assert(tsmx->pq != NULL);
+	PQ_INIT(tsmx->pq,smx->nSmooth);
+	tsmx->iMark = (char *)calloc(smx->kd->nActive,sizeof(char));
+	assert(tsmx->iMark != NULL);
+	tsmx->fList = (float *)malloc(smx->nListSize*sizeof(float));
+	assert(tsmx->fList != NULL);
+	tsmx->pList = (int *)malloc(smx->nListSize*sizeof(int));
+	assert(tsmx->pList != NULL);
+	return(tsmx);
+	}
+
+
+void smThreadFinish(SMX tsmx)
+{
+	free(tsmx->fList);
+	free(tsmx->pList);
+	free(tsmx->iMark);
+	free(tsmx->pq);
+	free(tsmx);
+	}
+
+
+/* The particles of thread iThread out of nThreads: a contiguous run of
+kd buckets, so that the warm start of smSmoothRange stays effective. */
+void smThreadRange(SMX smx,int iThread,int nThreads,int *pLower,int *pUpper)
+{
+	KDN *c = smx->kd->kdNodes;
+	int nSplit = smx->kd->nSplit;
+
+	*pLower = c[nSplit + (int)((long)nSplit*iThread/nThreads)].pLower;
+	if (iThread == nThreads-1) *pUpper = smx->kd->nActive;
+	else *pUpper = c[nSplit + (int)((long)nSplit*(iThread+1)/nThreads)].pLower;
+	}
+
+
+void smSmoothParallel(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *),
+	int nThreads)
+{
+	int pi,t;
+
+	if (nThreads < 2) {
+		smSmooth(smx,fncSmooth);
+		return;
+		}
+	for (pi=0;pi<smx->kd->nActive;++pi) {
+		if (IMARK) smx->pfBall2[pi] = -1.0;
+		else smx->pfBall2[pi] = 1.0;
+		}
+	smx->pfBall2[smx->kd->nActive] = -1.0;
+	smx->nThreads = nThreads;
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(nThreads) schedule(static,1)
+#endif
+	for (t=0;t<nThreads;++t) {
+		int pLower,pUpper;
+		SMX tsmx = smThreadInit(smx);
+		smThreadRange(smx,t,nThreads,&pLower,&pUpper);
+		smSmoothRange(tsmx,fncSmooth,pLower,pUpper);
+		smThreadFinish(tsmx);
+		}
+	smx->nThreads = 1;
+	}
+
+
+void smReSmoothParallel(SMX smx,void (*fncSmooth)(SMX,int,int,int *,float *),
+	int nThreads)
+{
+	int t;
+
+	if (nThreads < 2) {
+		smReSmooth(smx,fncSmooth);
+		return;
+		}
+	smx->nThreads = nThreads;
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(nThreads) schedule(static,1)
+#endif
+	for (t=0;t<nThreads;++t) {
+		int pi,pLower,pUpper,nSmooth;
+		float temp_ri[3];
+		SMX tsmx = smThreadInit(smx);
+		smThreadRange(smx,t,nThreads,&pLower,&pUpper);
+		for (pi=pLower;pi<pUpper;++pi) {
+			temp_ri[0] = NP_POS(tsmx->kd, pi, 0);
+			temp_ri[1] = NP_POS(tsmx->kd, pi, 1);
+			temp_ri[2] = NP_POS(tsmx->kd, pi, 2);
+			nSmooth = smBallGather(tsmx,tsmx->pfBall2[pi],temp_ri);
+			(*fncSmooth)(tsmx,pi,nSmooth,tsmx->pList,tsmx->fList);
+			}
+		smThreadFinish(tsmx);
+		}
+	smx->nThreads = 1;
+	}
+
+
 void smDensity(SMX smx,int pi,int nSmooth,int *pList,float *fList)
 {
 	float ih2,r2,rs,fDensity;
@@ -428,6 +569,18 @@ void smDensitySym(SMX smx,int pi,int nSmooth,int *pList,float *fList)
 		else rs = 0.25*rs*rs*rs;
 		rs *= fNorm;
 #ifdef DIFFERENT_MASSES
+		if (smx->nThreads > 1) {
+			/* neighbors may belong to another thread's range */
+#ifdef _OPENMP
+			#pragma omp atomic
+#endif
+			NP_DENS(smx->kd, pi) += rs*NP_MASS(smx->kd, pj);
+#ifdef _OPENMP
+			#pragma omp atomic
+#endif
+			NP_DENS(smx->kd, pj) += rs*NP_MASS(smx->kd, pi);
+			continue;
+			}
         NP_DENS(smx->kd, pi) += rs*NP_MASS(smx->kd, pj);
         NP_DENS(smx->kd, pj) += rs*NP_MASS(smx->kd, pi);
 #else
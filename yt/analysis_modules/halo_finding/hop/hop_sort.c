@@ -0,0 +1,172 @@
+/* SORT.C */
+/* Index and rank tables for HOP and regroup, built with an LSD radix
+sort rather than qsort().  The sort is stable, so equal keys keep their
+input order, which is the order the old qsort()-based tables produced
+with glibc's merge sort. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define RADIX_BITS	8
+#define RADIX_BUCKETS	(1<<RADIX_BITS)
+#define RADIX_PASSES	(32/RADIX_BITS)
+
+/* Below this many keys the histograms are built by one thread */
+#define RADIX_PARALLEL_MIN	65536
+
+void radix_sort_index(int n, unsigned int *key, int *index);
+void make_rank_table(int n, int *ivect, int *rank);
+void make_index_table(int n, float *fvect, int *index);
+
+/* ----------------------------------------------------------------- */
+
+static unsigned int float_to_key(float f)
+/* Map f to an unsigned int with the same ordering.  Positive floats
+just need the sign bit set; negative ones have every bit flipped so that
+larger magnitudes come first. */
+{
+    union { float f; unsigned int u; } v;
+
+    v.f = (f == 0.0) ? 0.0 : f;		/* Send -0 to +0, as they compare equal */
+    if (v.u & 0x80000000u) return ~v.u;
+    return v.u | 0x80000000u;
+}
+
+void radix_sort_index(int n, unsigned int *key, int *index)
+/* Sort key[0..n-1] into increasing order, carrying index[] along.  Both
+arrays are zero-offset and are sorted in place. */
+/* Each pass makes a histogram of one digit per thread over a contiguous
+block of keys, turns these into scatter offsets ordered by (digit, thread),
+and has each thread scatter its own block.  That keeps every pass stable.
+A pass whose digit is the same for every key is skipped. */
+{
+    unsigned int *key2, *kin, *kout, *kt;
+    int *index2, *iin, *iout, *it;
+    int *count, pass, nThreads, nt, skip;
+
+    if (n < 2) return;
+    key2 = (unsigned int *)malloc((size_t)n*sizeof(unsigned int));
+    index2 = (int *)malloc((size_t)n*sizeof(int));
+    assert(key2 != NULL && index2 != NULL);
+
+    nThreads = 1;
+#ifdef _OPENMP
+    if (n >= RADIX_PARALLEL_MIN) nThreads = omp_get_max_threads();
+#endif
+    count = (int *)malloc((size_t)nThreads*RADIX_BUCKETS*sizeof(int));
+    assert(count != NULL);
+
+    kin = key; kout = key2;
+    iin = index; iout = index2;
+    for (pass=0; pass<RADIX_PASSES; pass++) {
+	int shift = pass*RADIX_BITS;
+	nt = 1;
+	skip = 0;
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(nThreads)
+#endif
+	{
+	    int t = 0, i, b, lo, hi, sum, c, *hist;
+#ifdef _OPENMP
+	    #pragma omp single
+	    nt = omp_get_num_threads();
+	    t = omp_get_thread_num();
+#endif
+	    lo = (int)(((long long)n*t)/nt);
+	    hi = (int)(((long long)n*(t+1))/nt);
+	    hist = count + t*RADIX_BUCKETS;
+	    for (b=0; b<RADIX_BUCKETS; b++) hist[b] = 0;
+	    for (i=lo; i<hi; i++) hist[(kin[i]>>shift)&(RADIX_BUCKETS-1)]++;
+#ifdef _OPENMP
+	    #pragma omp barrier
+	    #pragma omp single
+#endif
+	    {
+		sum = 0;
+		for (b=0; b<RADIX_BUCKETS; b++) {
+		    /* The digit is shared by every key only if the counts
+		    of all threads add up to n */
+		    for (i=0, c=0; i<nt; i++) c += count[i*RADIX_BUCKETS+b];
+		    if (c == n) skip = 1;
+		    for (i=0; i<nt; i++) {
+			c = count[i*RADIX_BUCKETS+b];
+			count[i*RADIX_BUCKETS+b] = sum;
+			sum += c;
+		    }
+		}
+	    }
+	    if (!skip) {
+		for (i=lo; i<hi; i++) {
+		    c = hist[(kin[i]>>shift)&(RADIX_BUCKETS-1)]++;
+		    kout[c] = kin[i];
+		    iout[c] = iin[i];
+		}
+	    }
+	}
+	if (skip) continue;
+	kt = kin; kin = kout; kout = kt;
+	it = iin; iin = iout; iout = it;
+    }
+    if (kin != key) {
+	memcpy(key, kin, (size_t)n*sizeof(unsigned int));
+	memcpy(index, iin, (size_t)n*sizeof(int));
+    }
+    free(count);
+    free(key2);
+    free(index2);
+    return;
+}
+
+/* ----------------------------------------------------------------- */
+
+void make_rank_table(int n, int *ivect, int *rank)
+/* Given a vector of integers ivect[1..n], construct a rank table rank[1..n]
+so that rank[j] contains the ordering of element j, with rank[j]=n indicating
+that the jth element was the highest, and rank[j]=1 indicating that it
+was the lowest.  Storage for rank[] should be declared externally */
+/* The values are compared as floats, as they always have been, so very
+large counts that round to the same float tie. */
+{
+    int j, *index;
+    unsigned int *key;
+
+    if (n < 1) return;
+    key = (unsigned int *)malloc((size_t)n*sizeof(unsigned int));
+    index = (int *)malloc((size_t)n*sizeof(int));
+    assert(key != NULL && index != NULL);
+    for (j=0;j<n;j++) {
+	key[j] = float_to_key((float)ivect[j+1]);
+	index[j] = j+1;		/* Label them prior to sort */
+    }
+    radix_sort_index(n, key, index);
+    /* Now index is in order (smallest to largest) */
+    for (j=0;j<n;j++) rank[index[j]]=j+1;
+    free(key);
+    free(index);
+    return;
+}
+
+void make_index_table(int n, float *fvect, int *index)
+/* Given a vector of floats fvect[1..n], construct a index table index[1..n]
+so that index[j] contains the ID number of the jth lowest element.
+Storage for index[] should be declared externally */
+{
+    int j;
+    unsigned int *key;
+
+    if (n < 1) return;
+    key = (unsigned int *)malloc((size_t)n*sizeof(unsigned int));
+    assert(key != NULL);
+    for (j=0;j<n;j++) {
+	key[j] = float_to_key(fvect[j+1]);
+	index[j+1] = j+1;	/* Label them prior to sort */
+    }
+    radix_sort_index(n, key, index+1);
+    free(key);
+    return;
+}
@@ -95,6 +95,15 @@ typedef struct kdContext {
     npy_float64 *np_pos[3];
     npy_float64 *np_masses;
     float totalmass;
+	/*
+	 ** With bTreeOrder set, hop_main() copies the arrays above into tree
+	 ** order after the build (see kdTreeOrder()); the caller's arrays are
+	 ** kept here until kdCallerOrder() scatters the densities back.
+	 */
+	int bTreeOrder;
+    npy_float64 *np_caller_densities;
+    npy_float64 *np_caller_pos[3];
+    npy_float64 *np_caller_masses;
 	} * KD;
 
 
@@ -197,6 +206,9 @@ int kdInit(KD *,int);
 int kdReadTipsy(KD,FILE *,int,int,int);
 void kdInMark(KD,char *);
 int kdBuildTree(KD);
+int kdBuildTreeParallel(KD,int);
+void kdTreeOrder(KD);
+void kdCallerOrder(KD);
 void kdOrder(KD);
 void kdFinish(KD);
 
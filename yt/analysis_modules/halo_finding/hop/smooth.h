@@ -62,6 +62,7 @@ typedef struct smContext {
 	int nHashLength;	/* The length of the hash table */
 	Boundary *hash;		/* The hash table for boundaries */
 	float fDensThresh;	/* Density Threshold for group finding */
+	int nThreads;		/* > 1 while the smoothing runs in parallel */
 	} * SMX;
 
 #define PQ_STATIC	PQ *PQ_t,*PQ_lt;int PQ_j,PQ_i
@@ -113,6 +114,25 @@ typedef struct smContext {
 	}
 
 
+/*
+ ** Move the separation d = x + a - r (a the offset of the periodic image
+ ** of x) to the nearest image, so that every queue entry holds its
+ ** particle at its closest image whatever order the particles are
+ ** smoothed in.
+ */
+#define MINIMUM_IMAGE(d,a,l)\
+{\
+	if ((d) > 0.5*(l)) {\
+		(d) -= (l);\
+		(a) -= (l);\
+		}\
+	else if ((d) < -0.5*(l)) {\
+		(d) += (l);\
+		(a) += (l);\
+		}\
+	}
+
+
 
 int smInit(SMX *,KD,int,float *);
 void smFinish(SMX);
@@ -120,6 +140,8 @@ void smBallSearch(SMX,float,float *);
 int  smBallGather(SMX,float,float *);
 void smSmooth(SMX,void (*)(SMX,int,int,int *,float *));
 void smReSmooth(SMX,void (*)(SMX,int,int,int *,float *));
+void smSmoothParallel(SMX,void (*)(SMX,int,int,int *,float *),int);
+void smReSmoothParallel(SMX,void (*)(SMX,int,int,int *,float *),int);
 void smDensity(SMX,int,int,int *,float *);
 void smDensitySym(SMX,int,int,int *,float *);
 void smMeanVel(SMX,int,int,int *,float *);
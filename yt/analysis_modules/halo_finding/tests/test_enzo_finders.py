@@ -0,0 +1,382 @@
+"""
+Tests for the threaded and alternate paths of the HOP and FOF extensions.
+
+
+
+"""
+
+#-----------------------------------------------------------------------------
+# Copyright (c) 2018, yt Development Team.
+#
+# Distributed under the terms of the Modified BSD License.
+#
+# The full license is in the file COPYING.txt, distributed with this software.
+#-----------------------------------------------------------------------------
+
+import numpy as np
+
+from yt.frontends.stream.api import load_particles
+from yt.testing import \
+    assert_allclose_units, \
+    assert_equal, \
+    assert_raises, \
+    assert_rel_equal
+from yt.analysis_modules.halo_finding.halo_objects import \
+    FOFHalo, \
+    FOFHaloFinder, \
+    HOPHaloFinder
+from yt.analysis_modules.halo_finding.fof import EnzoFOF
+from yt.analysis_modules.halo_finding.fof.EnzoFOF import \
+    RunFOF, \
+    RunFOFMulti
+from yt.analysis_modules.halo_finding.hop.EnzoHop import \
+    RunHOP
+
+
+def clustered_particles(n, nclusters=12, seed=0x4d3d3d3, lo=0.25, hi=0.75):
+    # Gaussian clumps on a uniform background, all kept inside [lo, hi) so
+    # that no neighbour search reaches a periodic image.
+    prng = np.random.RandomState(seed)
+    centers = prng.uniform(lo + 0.05, hi - 0.05, size=(nclusters, 3))
+    widths = prng.uniform(0.005, 0.02, size=nclusters)
+    nb = n // 4
+    which = prng.randint(0, nclusters, size=n - nb)
+    pos = centers[which] + prng.normal(size=(n - nb, 3)) * widths[which, None]
+    pos = np.concatenate([pos, prng.uniform(lo, hi, size=(nb, 3))])
+    pos = np.clip(pos, lo, np.nextafter(hi, lo))
+    return [np.ascontiguousarray(pos[:, i]) for i in range(3)]
+
+def test_hop_threads():
+    # The threaded density and hop passes must give the serial group tags,
+    # also for clumps wrapped around the periodic boundary; the densities
+    # differ only by the order of the atomic symmetric updates.
+    for lo, hi in ((0.25, 0.75), (0.0, 1.0)):
+        x, y, z = clustered_particles(20000, lo=lo, hi=hi)
+        if hi - lo == 1.0:
+            x, y, z = [np.mod(p + 0.5, 1.0) for p in (x, y, z)]
+        mass = np.ones(x.size, dtype="float64")
+        dens0, tags0 = RunHOP(x, y, z, mass, 160.0, 1.0, 1)
+        for num_threads in (2, 3, 4):
+            dens, tags = RunHOP(x, y, z, mass, 160.0, 1.0, num_threads)
+            assert_rel_equal(dens, dens0, 10)
+            assert_equal(tags, tags0)
+
+def nested_particles(n, seed=0x4d3d3d3):
+    # Clumps of sub-clumps of very different widths on a uniform
+    # background, wrapped around the periodic boundary.  With n well above
+    # the task cutoff of the threaded kd builds, several levels of the
+    # tree are built as tasks and the cells split very unevenly.
+    prng = np.random.RandomState(seed)
+    parents = prng.uniform(0.0, 1.0, size=(6, 3))
+    subs = parents[prng.randint(0, 6, size=30)] + \
+        0.05 * prng.normal(size=(30, 3))
+    widths = 10.0**prng.uniform(-3.5, -1.5, size=30)
+    nb = n // 5
+    which = prng.randint(0, 30, size=n - nb)
+    pos = subs[which] + prng.normal(size=(n - nb, 3)) * widths[which, None]
+    pos = np.concatenate([pos, prng.uniform(0.0, 1.0, size=(nb, 3))])
+    pos = np.mod(pos, 1.0)
+    return [np.ascontiguousarray(pos[:, i]) for i in range(3)]
+
+def test_threaded_kd_build():
+    # The threaded kd builds must hand the searches the tree the serial
+    # builds make, so the threaded runs give the serial groups.
+    n = 150000
+    x, y, z = nested_particles(n)
+    mass = np.ones(n, dtype="float64")
+    dens0, tags0 = RunHOP(x, y, z, mass, 160.0, 1.0, 1)
+    assert tags0.max() > 0
+    link = 0.2 * n**(-1.0 / 3.0)
+    fof0 = RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8, 1)
+    fofd0 = RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8, 1, 1)
+    assert fof0.max() > 0
+    for num_threads in (2, 4):
+        dens, tags = RunHOP(x, y, z, mass, 160.0, 1.0, num_threads)
+        assert_rel_equal(dens, dens0, 10)
+        assert_equal(tags, tags0)
+        assert_equal(RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8,
+                            num_threads), fof0)
+        _assert_same_partition(RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8,
+                                      num_threads, 1), fofd0)
+
+    # And through the halo finders
+    data = {"particle_position_%s" % ax: (p, "cm")
+            for ax, p in zip("xyz", (x, y, z))}
+    data["particle_mass"] = (mass, "Msun")
+    bbox = np.array([[0.0, 1.0], [0.0, 1.0], [0.0, 1.0]])
+    ds = load_particles(data, 1.0, bbox=bbox)
+    for finder, kwargs in ((HOPHaloFinder, {}),
+                           (FOFHaloFinder, {"link": 0.2})):
+        ref = finder(ds, dm_only=False, padding=0.0, num_threads=1, **kwargs)
+        assert len(ref) > 1
+        halos = finder(ds, dm_only=False, padding=0.0, num_threads=4,
+                       **kwargs)
+        assert_equal(len(halos), len(ref))
+        for halo, rhalo in zip(halos, ref):
+            assert_equal(np.sort(halo.indices), np.sort(rhalo.indices))
+            assert_equal(halo.total_mass(), rhalo.total_mass())
+
+def test_hop_tree_order():
+    # Streaming the searches from tree-ordered copies of the arrays only
+    # changes where the values are read from.
+    for lo, hi in ((0.25, 0.75), (0.0, 1.0)):
+        x, y, z = clustered_particles(20000, lo=lo, hi=hi)
+        prng = np.random.RandomState(0x4d3d3d3)
+        mass = prng.uniform(1.0, 2.0, size=x.size)
+        for num_threads in (1, 4):
+            dens0, tags0 = RunHOP(x, y, z, mass, 160.0, 1.0, num_threads,
+                                  tree_order=0)
+            dens, tags = RunHOP(x, y, z, mass, 160.0, 1.0, num_threads,
+                                tree_order=1)
+            if num_threads == 1:
+                assert_equal(dens, dens0)
+            else:
+                assert_rel_equal(dens, dens0, 10)
+            assert_equal(tags, tags0)
+
+def two_clumps(separation, n=2000, width=0.01, seed=0x4d3d3d3):
+    # Two equal Gaussian clumps along x on a uniform background; the
+    # first 2*n particles are the clumps.
+    prng = np.random.RandomState(seed)
+    pos = 0.5 + width * prng.normal(size=(2 * n, 3))
+    pos[:n, 0] -= 0.5 * separation
+    pos[n:, 0] += 0.5 * separation
+    pos = np.concatenate([pos, prng.uniform(0.25, 0.75, size=(n, 3))])
+    return [np.ascontiguousarray(pos[:, i]) for i in range(3)]
+
+def test_hop_merge_outputs():
+    # regroup merges two pre-merge groups whose peaks exceed 3 times the
+    # threshold when their saddle exceeds 2.5 times the threshold.
+    thresh = 160.0
+    for separation, merged in ((0.2, False), (0.03, True)):
+        x, y, z = two_clumps(separation)
+        n = x.size // 3
+        mass = np.ones(x.size, dtype="float64")
+        dens, tags = RunHOP(x, y, z, mass, thresh, 1.0, 1)
+        out = RunHOP(x, y, z, mass, thresh, 1.0, 1, return_merge=True)
+        assert_equal(len(out), 5)
+        assert_equal(out[0], dens)
+        assert_equal(out[1], tags)
+        group_merge, boundaries, saddles = out[2:]
+
+        assert_equal(set(group_merge[group_merge >= 0]),
+                     set(tags[tags >= 0]))
+        assert_equal(boundaries.shape, (saddles.size, 2))
+        assert np.all((boundaries >= 0) & (boundaries < group_merge.size))
+        assert np.all((saddles > 0) & (saddles <= dens.max()))
+
+        peaks = [tags[np.argmax(dens[:n])], tags[n + np.argmax(dens[n:2*n])]]
+        assert peaks[0] >= 0 and peaks[1] >= 0
+        final = group_merge[boundaries]
+        if merged:
+            assert_equal(peaks[0], peaks[1])
+            inner = np.all(final == peaks[0], axis=1)
+            assert saddles[inner].max() >= 2.5 * thresh
+        else:
+            assert peaks[0] != peaks[1]
+            cross = (final[:, 0] != final[:, 1]) & \
+                    np.all(np.in1d(final, peaks).reshape(final.shape), axis=1)
+            assert np.all(saddles[cross] < 2.5 * thresh)
+
+def test_hop_group_order():
+    # Both the pre-merge and the final groups are numbered from the
+    # largest down through the rank and index tables.
+    x, y, z = clustered_particles(20000)
+    mass = np.ones(x.size, dtype="float64")
+    dens, tags = RunHOP(x, y, z, mass, 160.0, 1.0, 1)
+    sizes = np.bincount(tags[tags >= 0])
+    assert sizes.size > 1
+    assert np.all(sizes[:-1] >= sizes[1:])
+    assert sizes.min() >= 10
+
+    # Identical clumps on the corners of a cube tie in size; each still
+    # gets a group of its own.
+    prng = np.random.RandomState(0x4d3d3d3)
+    offsets = 0.01 * prng.normal(size=(1000, 3))
+    corners = 0.25 + 0.5 * np.mgrid[0:2, 0:2, 0:2].reshape(3, -1).T
+    pos = (corners[:, None, :] + offsets[None, :, :]).reshape(-1, 3)
+    x, y, z = [np.ascontiguousarray(pos[:, i]) for i in range(3)]
+    mass = np.ones(x.size, dtype="float64")
+    dens, tags = RunHOP(x, y, z, mass, 160.0, 1.0, 1)
+    tags = tags.reshape(corners.shape[0], -1)
+    clump_tags = [np.unique(t[t >= 0]) for t in tags]
+    assert all(t.size == 1 for t in clump_tags)
+    assert_equal(np.sort(np.concatenate(clump_tags)),
+                 np.arange(corners.shape[0]))
+    sizes = (tags >= 0).sum(axis=1)
+    assert_equal(sizes, sizes[0])
+
+def test_fof_threads():
+    # The union-find search numbers groups by their first tree-order
+    # particle, so the tags match the serial kdFoF exactly, periodic
+    # images included.
+    n = 20000
+    link = 0.2 * n**(-1.0 / 3.0)
+    for lo, hi in ((0.25, 0.75), (0.0, 1.0)):
+        x, y, z = clustered_particles(n, lo=lo, hi=hi)
+        tags0 = RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8, 1)
+        assert tags0.max() > 0
+        for num_threads in (2, 3, 4):
+            tags = RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8, num_threads)
+            assert_equal(tags, tags0)
+
+def test_fof_multi():
+    n = 20000
+    mean_sep = n**(-1.0 / 3.0)
+    links = np.array([0.3, 0.2, 0.15, 0.1]) * mean_sep
+    for lo, hi in ((0.25, 0.75), (0.0, 1.0)):
+        x, y, z = clustered_particles(n, lo=lo, hi=hi)
+        for num_threads in (1, 4):
+            tags = RunFOFMulti(x, y, z, links, (1.0, 1.0, 1.0), 8,
+                               num_threads)
+            assert_equal(tags.shape, (n, links.size))
+            for i, link in enumerate(links):
+                ref = RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8, 1)
+                assert_equal(tags[:, i], ref)
+    x, y, z = clustered_particles(100)
+    assert_raises(EnzoFOF.error, RunFOFMulti, x, y, z,
+                  np.array([0.01, 0.02]))
+    assert_raises(EnzoFOF.error, RunFOFMulti, x, y, z,
+                  np.array([0.02, 0.0]))
+
+def _assert_same_partition(tags, ref):
+    # Group numbers may differ; membership may not.  Tags of zero or less
+    # are particles left out of every group.
+    assert_equal(tags > 0, ref > 0)
+    pairs = np.unique(np.column_stack([tags, ref])[ref > 0], axis=0)
+    assert_equal(pairs.shape[0], np.unique(ref[ref > 0]).size)
+    assert_equal(pairs.shape[0], np.unique(tags[tags > 0]).size)
+
+def _brute_force_fof(x, y, z, link, nMembers):
+    n = x.size
+    parent = np.arange(n)
+    def root(i):
+        while parent[i] != i:
+            i = parent[i]
+        return i
+    for i in range(n):
+        d2 = (x[i + 1:] - x[i])**2 + (y[i + 1:] - y[i])**2 + \
+             (z[i + 1:] - z[i])**2
+        for j in np.where(d2 < link * link)[0] + i + 1:
+            ri, rj = root(i), root(j)
+            if ri != rj:
+                parent[max(ri, rj)] = min(ri, rj)
+    roots = np.array([root(i) for i in range(n)])
+    counts = np.bincount(roots, minlength=n)
+    return np.where(counts[roots] >= nMembers, roots + 1, -1)
+
+def test_fof_double():
+    n = 20000
+    link = 0.2 * n**(-1.0 / 3.0)
+    # On float32-representable positions the double search links the same
+    # pairs as the float one.
+    x, y, z = [p.astype("float32").astype("float64")
+               for p in clustered_particles(n, lo=0.0, hi=1.0)]
+    ref = RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8, 1, 0)
+    for num_threads in (1, 4):
+        tags = RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8, num_threads, 1)
+        _assert_same_partition(tags, ref)
+    # Strided views are read in place.
+    pos = np.column_stack([x, y, z])
+    tags = RunFOF(pos[:, 0], pos[:, 1], pos[:, 2], link,
+                  (1.0, 1.0, 1.0), 8, 1, 1)
+    _assert_same_partition(tags, ref)
+    # Below float32 resolution only the double search can tell the
+    # particles apart.
+    prng = np.random.RandomState(0x4d3d3d3)
+    x, y, z = [0.5 + prng.normal(size=400) * 1e-9 for i in range(3)]
+    link = 2e-10
+    tags = RunFOF(x, y, z, link, (1.0, 1.0, 1.0), 8, 1, 1)
+    _assert_same_partition(tags, _brute_force_fof(x, y, z, link, 8))
+
+def test_fof_halos_double_precision():
+    # A box whose width float32 cannot hold: a clump straddling the
+    # boundary is only joined up through the period in double precision.
+    L = 2.0**24 + 1.0
+    prng = np.random.RandomState(0x4d3d3d3)
+    n = 100
+    x = np.concatenate([prng.uniform(0.0, 0.4, size=n),
+                        L - prng.uniform(0.0, 0.4, size=n),
+                        0.5 * L + prng.uniform(-0.2, 0.2, size=n)])
+    y, z = [0.5 * L + prng.uniform(-0.05, 0.05, size=3 * n)
+            for i in range(2)]
+    data = {"particle_position_x": (x, "cm"),
+            "particle_position_y": (y, "cm"),
+            "particle_position_z": (z, "cm"),
+            "particle_mass": (np.ones(3 * n), "Msun")}
+    bbox = np.array([[0.0, L], [0.0, L], [0.0, L]])
+    ds = load_particles(data, 1.0, bbox=bbox)
+    # a negative link is the linking length itself, as a fraction of the box
+    halos = FOFHaloFinder(ds, link=-0.2 / L, dm_only=False, padding=0.0,
+                          double_precision=True)
+    assert_equal(len(halos), 2)
+    assert_equal(sorted(halo.get_size() for halo in halos), [n, 2 * n])
+    for halo in halos:
+        hx = halo["particle_position_x"].in_units("cm").d
+        if halo.get_size() == 2 * n:
+            assert_equal((hx < 1.0).sum(), n)
+            assert_equal((hx > L - 1.0).sum(), n)
+        else:
+            assert np.all(np.abs(hx - 0.5 * L) < 1.0)
+
+def _clustered_ds(n, velocities=True):
+    # Clumps wrapped around the periodic boundary, in a unit box
+    x, y, z = [np.mod(p + 0.5, 1.0) for p in
+               clustered_particles(n, lo=0.0, hi=1.0)]
+    prng = np.random.RandomState(0x4d3d3d3)
+    data = {"particle_position_x": (x, "cm"),
+            "particle_position_y": (y, "cm"),
+            "particle_position_z": (z, "cm"),
+            "particle_mass": (prng.uniform(1.0, 2.0, size=n), "Msun")}
+    if velocities:
+        for ax in "xyz":
+            data["particle_velocity_%s" % ax] = \
+                (prng.normal(size=n) * 1e5, "cm/s")
+    bbox = np.array([[0.0, 1.0], [0.0, 1.0], [0.0, 1.0]])
+    return load_particles(data, 1.0, bbox=bbox)
+
+def _lazy_halo(halo):
+    # The same halo with nothing cached, so every quantity is computed
+    # from its particles by the Halo methods.
+    lazy = FOFHalo(halo.halo_list, halo.id, ptype=halo.ptype)
+    lazy.indices = halo.indices
+    return lazy
+
+def _assert_close(actual, desired, scale):
+    # scale is a float in the units of actual
+    assert_allclose_units(actual, desired.in_units(actual.units),
+                          rtol=1e-10, atol=1e-10 * scale)
+
+def test_reduce_groups():
+    # The catalog quantities ReduceGroups caches must be those the Halo
+    # methods compute, for halos straddling the boundary as well.
+    ds = _clustered_ds(8000)
+    for num_threads in (1, 4):
+        halos = FOFHaloFinder(ds, link=0.2, dm_only=False, padding=0.0,
+                              num_threads=num_threads)
+        assert len(halos) > 1
+        for halo in halos:
+            lazy = _lazy_halo(halo)
+            assert_equal(halo.get_size(), lazy.indices.size)
+            mass = lazy.total_mass()
+            _assert_close(halo.total_mass(), mass, float(mass))
+            _assert_close(halo.center_of_mass(), lazy.center_of_mass(), 1.0)
+            _assert_close(halo.maximum_radius(), lazy.maximum_radius(), 1.0)
+            _assert_close(halo.bulk_velocity(), lazy.bulk_velocity(), 1e5)
+            _assert_close(halo.rms_velocity(), lazy.rms_velocity(),
+                          1e5 * halo.get_size())
+
+def test_reduce_groups_no_velocities():
+    # Without velocities the velocity moments are left to the halos, and
+    # the rest of the catalog is unchanged.
+    ds = _clustered_ds(8000, velocities=False)
+    halos = FOFHaloFinder(ds, link=0.2, dm_only=False, padding=0.0)
+    ref = FOFHaloFinder(_clustered_ds(8000), link=0.2, dm_only=False,
+                        padding=0.0)
+    assert_equal(len(halos), len(ref))
+    for halo, rhalo in zip(halos, ref):
+        assert halo.bulk_vel is None and halo.rms_vel is None
+        assert_equal(halo.indices, rhalo.indices)
+        assert_equal(halo.center_of_mass(), rhalo.center_of_mass())
+        assert_equal(halo.total_mass(), rhalo.total_mass())
+        assert_equal(halo.maximum_radius(), rhalo.maximum_radius())
@@ -392,14 +392,23 @@ class AMRGridPatch(YTSelectionContainer):
         if self._cache_mask and hash(selector) == self._last_selector_id:
             mask = self._last_mask
         else:
-            mask = selector.fill_mask(self)
+            # The index keeps the masks of recent selections, so that every
+            # field read through the same selector reuses them.
+            cached = None
+            if self._cache_mask:
+                cache = self._index._get_mask_cache()
+                cached = cache.get(selector, self.id)
+            if cached is not None:
+                mask, count = cached
+            else:
+                mask = selector.fill_mask(self)
+                count = 0 if mask is None else mask.sum()
+                if self._cache_mask:
+                    cache.add(selector, self.id, mask, count)
             if self._cache_mask:
                 self._last_mask = mask
             self._last_selector_id = hash(selector)
-            if mask is None:
-                self._last_count = 0
-            else:
-                self._last_count = mask.sum()
+            self._last_count = count
         return mask
 
     def select(self, selector, source, dest, offset):
@@ -111,12 +111,29 @@ class OctreeSubset(YTSelectionContainer):
 
     _domain_ind = None
 
-    def mask_refinement(self, selector):
+    @property
+    def _mask_cache_key(self):
+        # Identifies the octs this subset covers for the life of the index.
+        # Frontends whose subsets share a domain_id but not an oct_handler
+        # must override this.
+        return ("oct", self.domain_id)
+
+    def _get_selector_mask(self, selector):
+        cache = self.index._get_mask_cache()
+        key = self._mask_cache_key
+        cached = cache.get(selector, key)
+        if cached is not None:
+            return cached[0]
         mask = self.oct_handler.mask(selector, domain_id = self.domain_id)
+        cache.add(selector, key, mask, mask.shape[0])
+        return mask
+
+    def mask_refinement(self, selector):
+        mask = self._get_selector_mask(selector)
         return mask
 
     def select_blocks(self, selector):
-        mask = self.oct_handler.mask(selector, domain_id = self.domain_id)
+        mask = self._get_selector_mask(selector)
         slicer = OctreeSubsetBlockSlice(self)
         for i, sl in slicer:
             yield sl, np.atleast_3d(mask[i,...])
@@ -161,12 +161,17 @@ class UnstructuredMesh(YTSelectionContainer):
         if hash(selector) == self._last_selector_id:
             mask = self._last_mask
         else:
-            self._last_mask = mask = selector.fill_mesh_cell_mask(self)
-            self._last_selector_id = hash(selector)
-            if mask is None:
-                self._last_count = 0
+            cache = self._index._get_mask_cache()
+            cached = cache.get(selector, ("mesh", self.mesh_id))
+            if cached is not None:
+                mask, count = cached
             else:
-                self._last_count = mask.sum()
+                mask = selector.fill_mesh_cell_mask(self)
+                count = 0 if mask is None else mask.sum()
+                cache.add(selector, ("mesh", self.mesh_id), mask, count)
+            self._last_mask = mask
+            self._last_selector_id = hash(selector)
+            self._last_count = count
         return mask
 
     def select_fcoords_vertex(self, dobj = None):
@@ -219,12 +224,17 @@ class SemiStructuredMesh(UnstructuredMesh):
         if hash(selector) == self._last_selector_id:
             mask = self._last_mask
         else:
-            self._last_mask = mask = selector.fill_mesh_cell_mask(self)
-            self._last_selector_id = hash(selector)
-            if mask is None:
-                self._last_count = 0
+            cache = self._index._get_mask_cache()
+            cached = cache.get(selector, ("mesh", self.mesh_id))
+            if cached is not None:
+                mask, count = cached
             else:
-                self._last_count = mask.sum()
+                mask = selector.fill_mesh_cell_mask(self)
+                count = 0 if mask is None else mask.sum()
+                cache.add(selector, ("mesh", self.mesh_id), mask, count)
+            self._last_mask = mask
+            self._last_selector_id = hash(selector)
+            self._last_count = count
         return mask
 
     def select(self, selector, source, dest, offset):
@@ -11,10 +11,11 @@ from yt.geometry.oct_container cimport \
 from yt.geometry.oct_visitors cimport Oct
 from yt.geometry.particle_deposit cimport \
     ParticleDepositOperation
-from libc.stdlib cimport malloc, free
+from libc.stdlib cimport malloc, realloc, free
 from libc.string cimport memcpy
 import data_structures
 from yt.utilities.lib.misc_utilities import OnceIndirect
+from yt.utilities.logger import ytLogger as mylog
 
 cdef extern from "platform_dep.h":
     ctypedef int int32_t
@@ -61,6 +62,8 @@ cdef extern from "artio.h":
     cdef int ARTIO_OPEN_HEADER "ARTIO_OPEN_HEADER"
     cdef int ARTIO_OPEN_GRID "ARTIO_OPEN_GRID"
     cdef int ARTIO_OPEN_PARTICLES "ARTIO_OPEN_PARTICLES"
+    cdef int ARTIO_OPEN_MMAP "ARTIO_OPEN_MMAP"
+    cdef int ARTIO_OPEN_PREFETCH "ARTIO_OPEN_PREFETCH"
 
     # parameter constants
     cdef int ARTIO_TYPE_STRING "ARTIO_TYPE_STRING"
@@ -94,11 +97,19 @@ cdef extern from "artio.h":
 
     int artio_fileset_has_grid( artio_fileset_handle *handle )
     int artio_fileset_has_particles( artio_fileset_handle *handle )
+    int artio_fileset_open_index( artio_fileset_handle *handle )
 
     # selection functions
     artio_selection *artio_selection_allocate( artio_fileset_handle *handle )
     artio_selection *artio_select_all( artio_fileset_handle *handle )
     artio_selection *artio_select_volume( artio_fileset_handle *handle, double lpos[3], double rpos[3] )
+    ctypedef int (*artio_selection_volume_test)( double left[3], double right[3], void *params ) nogil
+    cdef int ARTIO_SELECT_OUTSIDE "ARTIO_SELECT_OUTSIDE"
+    cdef int ARTIO_SELECT_PARTIAL "ARTIO_SELECT_PARTIAL"
+    artio_selection *artio_select_region( artio_fileset_handle *handle,
+            artio_selection_volume_test test, void *params, int max_ranges )
+    int artio_grid_set_volume_test( artio_fileset_handle *handle,
+            artio_selection_volume_test test, void *params )
     int artio_selection_add_root_cell( artio_selection *selection, int coords[3] )
     int artio_selection_destroy( artio_selection *selection )
     int artio_selection_iterator( artio_selection *selection,
@@ -122,6 +133,8 @@ cdef extern from "artio.h":
         double *pos, float *variables,
         int *num_tree_levels, int *num_octs_per_level)
     int artio_grid_read_root_cell_end(artio_fileset_handle *handle)
+    int artio_grid_read_root_cell_levels(artio_fileset_handle *handle, int64_t sfc,
+        int *num_tree_levels, int *num_octs_per_level)
 
     int artio_grid_read_level_begin(artio_fileset_handle *handle, int level )
     int artio_grid_read_level_end(artio_fileset_handle *handle)
@@ -132,22 +145,35 @@ cdef extern from "artio.h":
     int artio_grid_count_octs_in_sfc_range(artio_fileset_handle *handle,
             int64_t start, int64_t end, int64_t *num_octs)
 
+    ctypedef void (*artio_grid_callback)(int64_t sfc_index, int level,
+            double *pos, float *variables, int *refined, void *params) nogil
+    int artio_grid_read_sfc_range_levels_threaded(artio_fileset_handle *handle,
+            int64_t sfc1, int64_t sfc2,
+            int min_level_to_read, int max_level_to_read,
+            int options, int num_threads,
+            artio_grid_callback callback, void **params) nogil
+    int artio_grid_max_threads()
+
     #particle functions
     int artio_fileset_open_particles(artio_fileset_handle *handle)
     int artio_particle_read_root_cell_begin(artio_fileset_handle *handle, int64_t sfc,
-                        int * num_particle_per_species)
-    int artio_particle_read_root_cell_end(artio_fileset_handle *handle)
+                        int * num_particle_per_species) nogil
+    int artio_particle_read_root_cell_end(artio_fileset_handle *handle) nogil
     int artio_particle_read_particle(artio_fileset_handle *handle, int64_t *pid, int *subspecies,
-                        double *primary_variables, float *secondary_variables)
+                        double *primary_variables, float *secondary_variables) nogil
+    int artio_particle_read_root_cell_counts(artio_fileset_handle *handle, int64_t sfc,
+                        int *num_particles_per_species)
     int artio_particle_cache_sfc_range(artio_fileset_handle *handle, int64_t sfc_start, int64_t sfc_end)
     int artio_particle_clear_sfc_cache(artio_fileset_handle *handle)
-    int artio_particle_read_species_begin(artio_fileset_handle *handle, int species)
-    int artio_particle_read_species_end(artio_fileset_handle *handle)
+    int artio_particle_read_species_begin(artio_fileset_handle *handle, int species) nogil
+    int artio_particle_read_species_end(artio_fileset_handle *handle) nogil
 
 
 cdef extern from "artio_internal.h":
     np.int64_t artio_sfc_index( artio_fileset_handle *handle, int coords[3] ) nogil
     void artio_sfc_coords( artio_fileset_handle *handle, int64_t index, int coords[3] ) nogil
+    int artio_sfc_index_array( artio_fileset_handle *handle, int64_t count, int *coords, int64_t *indices ) nogil
+    int artio_sfc_coords_array( artio_fileset_handle *handle, int64_t count, int64_t *indices, int *coords ) nogil
 
 cdef void check_artio_status(int status, char *fname="[unknown]"):
     if status != ARTIO_SUCCESS:
@@ -157,6 +183,109 @@ cdef void check_artio_status(int status, char *fname="[unknown]"):
         nline = sys._getframe().f_lineno
         raise RuntimeError('failure with status', status, 'in function',fname,'from caller', callername, nline)
 
+# Every thread of a threaded grid read opens its own copy of the data files,
+# so the default thread count only grows with the size of the sfc range.
+DEF MIN_SFC_PER_THREAD = 64
+
+cdef int range_threads(int num_threads, np.int64_t num_sfc):
+    if num_threads <= 0:
+        num_threads = artio_grid_max_threads()
+        if num_threads > num_sfc // MIN_SFC_PER_THREAD:
+            num_threads = num_sfc // MIN_SFC_PER_THREAD
+    if num_threads > num_sfc:
+        num_threads = num_sfc
+    if num_threads < 1:
+        num_threads = 1
+    return num_threads
+
+cdef struct grid_cell_buffer:
+    # Leaf cells collected by one reader thread
+    np.int64_t count
+    np.int64_t size
+    int num_fields
+    int *field_order
+    np.float64_t *pos
+    int *level
+    np.float64_t *data
+    int error
+
+cdef int grow_buffer(void **ptr, size_t size) nogil:
+    cdef void *tmp = realloc(ptr[0], size)
+    if tmp == NULL: return 1
+    ptr[0] = tmp
+    return 0
+
+cdef void collect_grid_cells(int64_t sfc_index, int level, double *pos,
+                             float *variables, int *refined,
+                             void *params) nogil:
+    cdef int i
+    cdef np.int64_t size
+    cdef grid_cell_buffer *buf = <grid_cell_buffer *> params
+    if buf.error: return
+    if buf.count == buf.size:
+        size = imax(1024, 2*buf.size)
+        if grow_buffer(<void **> &buf.pos, sizeof(np.float64_t)*3*size) or \
+           grow_buffer(<void **> &buf.level, sizeof(int)*size) or \
+           grow_buffer(<void **> &buf.data,
+                       sizeof(np.float64_t)*(buf.num_fields*size + 1)):
+            buf.error = 1
+            return
+        buf.size = size
+    for i in range(3):
+        buf.pos[3*buf.count+i] = pos[i]
+    buf.level[buf.count] = level
+    for i in range(buf.num_fields):
+        buf.data[buf.num_fields*buf.count+i] = variables[buf.field_order[i]]
+    buf.count += 1
+
+cdef struct oct_position_buffer:
+    # Oct positions collected by one mesh construction thread
+    np.int64_t count
+    np.int64_t size
+    np.float64_t *pos
+    np.int64_t *sfc
+    int *level
+    # Root cell variables are stored straight into the range's cache
+    int num_fields
+    np.int64_t sfc_start
+    float **root_mesh_data
+    int error
+
+cdef void collect_oct_positions(int64_t sfc_index, int level, double *pos,
+                                float *variables, int *refined,
+                                void *params) nogil:
+    cdef int i
+    cdef np.int64_t size
+    cdef oct_position_buffer *buf = <oct_position_buffer *> params
+    if buf.error: return
+    if level == 0:
+        if buf.root_mesh_data != NULL:
+            for i in range(buf.num_fields):
+                buf.root_mesh_data[i][sfc_index - buf.sfc_start] = \
+                    variables[i]
+        return
+    if buf.count == buf.size:
+        size = imax(1024, 2*buf.size)
+        if grow_buffer(<void **> &buf.pos, sizeof(np.float64_t)*3*size) or \
+           grow_buffer(<void **> &buf.sfc, sizeof(np.int64_t)*size) or \
+           grow_buffer(<void **> &buf.level, sizeof(int)*size):
+            buf.error = 1
+            return
+        buf.size = size
+    for i in range(3):
+        buf.pos[3*buf.count+i] = pos[i]
+    buf.sfc[buf.count] = sfc_index
+    buf.level[buf.count] = level
+    buf.count += 1
+
+cdef int selector_volume_test(double left[3], double right[3],
+                              void *params) nogil:
+    # select_bbox cannot tell whether a node lies entirely inside the
+    # selector, so intersecting nodes are refined down to root cells
+    if (<SelectorObject> params).select_bbox(left, right):
+        return ARTIO_SELECT_PARTIAL
+    return ARTIO_SELECT_OUTSIDE
+
 cdef class artio_fileset :
     cdef public object parameters
     cdef artio_fileset_handle *handle
@@ -185,10 +314,18 @@ cdef class artio_fileset :
     cdef double *primary_variables
     cdef float *secondary_variables
 
-    def __init__(self, char *file_prefix) :
+    def __init__(self, char *file_prefix, int use_mmap = 0, int use_index = 0,
+                 int use_prefetch = 0) :
         cdef int artio_type = ARTIO_OPEN_HEADER
         cdef int64_t num_root
 
+        # Memory mapping applies to the grid and particle files opened below
+        if use_mmap :
+            artio_type |= ARTIO_OPEN_MMAP
+        # Otherwise cached sfc ranges can be read ahead on a background thread
+        if use_prefetch :
+            artio_type |= ARTIO_OPEN_PREFETCH
+
         self.handle = artio_fileset_open( file_prefix, artio_type, artio_context_global )
         if not self.handle :
             raise RuntimeError
@@ -270,6 +407,16 @@ cdef class artio_fileset :
         else:
             self.has_particles = 0
 
+        # Per root cell offsets and counts from the sidecar index, so mesh
+        # construction does not need to visit every root cell on disk.  The
+        # index only speeds things up, so without it the offset tables in
+        # the data files are read as usual.
+        if use_index and (self.has_grid or self.has_particles):
+            status = artio_fileset_open_index(self.handle)
+            if status != ARTIO_SUCCESS:
+                mylog.warning("Could not load or build the ARTIO sfc index "
+                              "(error %d), reading without it.", status)
+
     def __dealloc__(self) :
         if self.num_octs_per_level : free(self.num_octs_per_level)
         if self.grid_variables : free(self.grid_variables)
@@ -432,214 +579,123 @@ cdef class artio_fileset :
         else:
             return tcode*self.tcode_to_years
 
-#    @cython.boundscheck(False)
-    @cython.wraparound(False)
-    @cython.cdivision(True)
     def read_particle_chunk(self, SelectorObject selector, int64_t sfc_start, int64_t sfc_end, fields) :
-        cdef int i
-        cdef int status
-        cdef int subspecies
-        cdef int64_t pid
-
-        cdef int num_fields = len(fields)
-        cdef np.float64_t pos[3]
-
         # since RuntimeErrors are not fatal, ensure no artio_particles* functions
         # called if fileset lacks particles
         if not self.has_particles: return
+        return read_selected_particles(self, selector, sfc_start, sfc_end,
+                                       fields)
 
-        data = {}
-        accessed_species = np.zeros( self.num_species, dtype="int")
-        selected_mass = [ None for i in range(self.num_species)]
-        selected_pid = [ None for i in range(self.num_species)]
-        selected_species = [ None for i in range(self.num_species)]
-        selected_primary = [ [] for i in range(self.num_species)]
-        selected_secondary = [ [] for i in range(self.num_species)]
-
-        for species,field in fields :
-            if species < 0 or species > self.num_species :
-                raise RuntimeError("Invalid species provided to read_particle_chunk")
-            accessed_species[species] = 1
-
-            if self.parameters["num_primary_variables"][species] > 0 and \
-                    field in self.parameters["species_%02u_primary_variable_labels"%(species,)] :
-                selected_primary[species].append((self.parameters["species_%02u_primary_variable_labels"%(species,)].index(field),(species,field)))
-                data[(species,field)] = np.empty(0,dtype="float64")
-            elif self.parameters["num_secondary_variables"][species] > 0 and \
-                    field in self.parameters["species_%02u_secondary_variable_labels"%(species,)] :
-                selected_secondary[species].append((self.parameters["species_%02u_secondary_variable_labels"%(species,)].index(field),(species,field)))
-                data[(species,field)] = np.empty(0,dtype="float64")
-            elif field == "MASS" :
-                selected_mass[species] = (species,field)
-                data[(species,field)] = np.empty(0,dtype="float64")
-            elif field == "PID" :
-                selected_pid[species] = (species,field)
-                data[(species,field)] = np.empty(0,dtype="int64")
-            elif field == "SPECIES" :
-                selected_species[species] = (species,field)
-                data[(species,field)] = np.empty(0,dtype="int8")
-            else :
-                raise RuntimeError("invalid field name provided to read_particle_chunk")
-
-        # cache the range
-        status = artio_particle_cache_sfc_range( self.handle, self.sfc_min, self.sfc_max )
-        check_artio_status(status)
-
-        for sfc in range( sfc_start, sfc_end+1 ) :
-            status = artio_particle_read_root_cell_begin( self.handle, sfc,
-                    self.num_particles_per_species )
-            check_artio_status(status)
-
-            for ispec in range(self.num_species) :
-                if accessed_species[ispec] :
-                    status = artio_particle_read_species_begin(self.handle, ispec)
-                    check_artio_status(status)
-
-                    for particle in range( self.num_particles_per_species[ispec] ) :
-                        status = artio_particle_read_particle(self.handle,
-                                &pid, &subspecies, self.primary_variables,
-                                self.secondary_variables)
-                        check_artio_status(status)
-
-                        for i in range(3) :
-                            pos[i] = self.primary_variables[self.particle_position_index[3*ispec+i]]
-
-                        if selector.select_point(pos) :
-                            # loop over primary variables
-                            for i,field in selected_primary[ispec] :
-                                count = len(data[field])
-                                data[field].resize(count+1)
-                                data[field][count] = self.primary_variables[i]
-
-                            # loop over secondary variables
-                            for i,field in selected_secondary[ispec] :
-                                count = len(data[field])
-                                data[field].resize(count+1)
-                                data[field][count] = self.secondary_variables[i]
-
-                            # add particle id
-                            if selected_pid[ispec] :
-                                count = len(data[selected_pid[ispec]])
-                                data[selected_pid[ispec]].resize(count+1)
-                                data[selected_pid[ispec]][count] = pid
-
-                            # add mass if requested
-                            if selected_mass[ispec] :
-                                count = len(data[selected_mass[ispec]])
-                                data[selected_mass[ispec]].resize(count+1)
-                                data[selected_mass[ispec]][count] = self.parameters["particle_species_mass"][ispec]
-
-                    status = artio_particle_read_species_end( self.handle )
-                    check_artio_status(status)
-
-            status = artio_particle_read_root_cell_end( self.handle )
-            check_artio_status(status)
-
-        return data
-
-    #@cython.boundscheck(False)
+    @cython.boundscheck(False)
     @cython.wraparound(False)
     @cython.cdivision(True)
-    def read_grid_chunk(self, SelectorObject selector, int64_t sfc_start, int64_t sfc_end, fields ):
-        cdef int i
-        cdef int level
-        cdef int num_oct_levels
-        cdef int refined[8]
-        cdef int status
-        cdef int64_t count
-        cdef int64_t max_octs
-        cdef double dpos[3]
+    def read_grid_chunk(self, SelectorObject selector, int64_t sfc_start, int64_t sfc_end, fields,
+                        int num_threads = 0):
+        cdef int i, t, status
+        cdef np.int64_t j, n, count
+        cdef np.float64_t dds
         cdef np.float64_t left[3]
         cdef np.float64_t right[3]
-        cdef np.float64_t dds[3]
+        cdef grid_cell_buffer *buffers
+        cdef grid_cell_buffer *buf
+        cdef void **params
+        cdef np.ndarray[np.float64_t, ndim=2] fcoords
+        cdef np.ndarray[np.int64_t, ndim=1] ires
+        cdef np.ndarray[np.float64_t, ndim=2] field_data
 
         cdef int *field_order
         cdef int num_fields  = len(fields)
-        field_order = <int*>malloc(sizeof(int)*num_fields)
 
         # translate fields from ARTIO names to indices
         var_labels = self.parameters['grid_variable_labels']
-        for i, f in enumerate(fields):
+        for f in fields:
             if f not in var_labels:
                 raise RuntimeError("Field",f,"is not known to ARTIO")
-            field_order[i] = var_labels.index(f)
 
-        status = artio_grid_cache_sfc_range( self.handle, self.sfc_min, self.sfc_max )
-        check_artio_status(status)
+        num_threads = range_threads(num_threads, sfc_end - sfc_start + 1)
 
-        # determine max number of cells we could hit (optimize later)
-        #status = artio_grid_count_octs_in_sfc_range( self.handle,
-        #        sfc_start, sfc_end, &max_octs )
-        #check_artio_status(status)
-        #max_cells = sfc_end-sfc_start+1 + max_octs*8
-
-        # allocate space for _fcoords, _icoords, _fwidth, _ires
-        #fcoords = np.empty((max_cells, 3), dtype="float64")
-        #ires = np.empty(max_cells, dtype="int64")
-        fcoords = np.empty((0, 3), dtype="float64")
-        ires = np.empty(0, dtype="int64")
-
-        #data = [ np.empty(max_cells, dtype="float32") for i in range(num_fields) ]
-        data = [ np.empty(0,dtype="float64") for i in range(num_fields)]
-
-        count = 0
-        for sfc in range( sfc_start, sfc_end+1 ) :
-            status = artio_grid_read_root_cell_begin( self.handle, sfc,
-                    dpos, self.grid_variables, &num_oct_levels, self.num_octs_per_level )
+        field_order = <int*>malloc(sizeof(int)*num_fields)
+        buffers = <grid_cell_buffer *>malloc(
+            sizeof(grid_cell_buffer)*num_threads)
+        params = <void **>malloc(sizeof(void *)*num_threads)
+        for i, f in enumerate(fields):
+            field_order[i] = var_labels.index(f)
+        for t in range(num_threads):
+            buffers[t].count = buffers[t].size = 0
+            buffers[t].num_fields = num_fields
+            buffers[t].field_order = field_order
+            buffers[t].pos = NULL
+            buffers[t].level = NULL
+            buffers[t].data = NULL
+            buffers[t].error = 0
+            params[t] = &buffers[t]
+
+        try:
+            # Each thread decodes its slice of the range into its own
+            # buffer; the slices are in sfc order so the buffers are too.
+            # Subtrees whose extent the selector rejects are not decoded.
+            status = artio_grid_set_volume_test(self.handle,
+                        selector_volume_test, <void *> selector)
             check_artio_status(status)
-
-            if num_oct_levels == 0 :
-                for i in range(num_fields) :
-                    data[i].resize(count+1)
-                    data[i][count] = self.grid_variables[field_order[i]]
-                fcoords.resize((count+1,3))
-                for i in range(3) :
-                    fcoords[count][i] = dpos[i]
-                ires.resize(count+1)
-                ires[count] = 0
-                count += 1
-
-            for level in range(1,num_oct_levels+1) :
-                status = artio_grid_read_level_begin( self.handle, level )
-                check_artio_status(status)
-
-                for i in range(3) :
-                    dds[i] = 2.**-level
-
-                for oct in range(self.num_octs_per_level[level-1]) :
-                    status = artio_grid_read_oct( self.handle, dpos, self.grid_variables, refined )
-                    check_artio_status(status)
-
-                    for child in range(8) :
-                        if not refined[child] :
-                            for i in range(3) :
-                                left[i] = (dpos[i]-dds[i]) if (child & (i<<1)) else dpos[i]
-                                right[i] = left[i] + dds[i]
-
-                            if selector.select_bbox(left,right) :
-                                fcoords.resize((count+1, 3))
-                                for i in range(3) :
-                                    fcoords[count][i] = left[i]+0.5*dds[i]
-                                ires.resize(count+1)
-                                ires[count] = level
-                                for i in range(num_fields) :
-                                    data[i].resize(count+1)
-                                    data[i][count] = self.grid_variables[self.num_grid_variables*child+field_order[i]]
-                                count += 1
-                status = artio_grid_read_level_end( self.handle )
-                check_artio_status(status)
-
-            status = artio_grid_read_root_cell_end( self.handle )
+            with nogil:
+                status = artio_grid_read_sfc_range_levels_threaded(
+                    self.handle, sfc_start, sfc_end, 0, self.max_level,
+                    ARTIO_READ_LEAFS | ARTIO_RETURN_CELLS, num_threads,
+                    collect_grid_cells, params)
             check_artio_status(status)
+            for t in range(num_threads):
+                if buffers[t].error:
+                    raise MemoryError
 
-        free(field_order)
-
-        #fcoords.resize((count,3))
-        #ires.resize(count)
-        #
-        #for i in range(num_fields) :
-        #    data[i].resize(count)
-
+            # Compact each buffer down to the selected leaf cells
+            count = 0
+            with nogil:
+                for t in range(num_threads):
+                    buf = &buffers[t]
+                    n = 0
+                    for j in range(buf.count):
+                        dds = 1.0/(1 << buf.level[j])
+                        for i in range(3):
+                            left[i] = buf.pos[3*j+i] - 0.5*dds
+                            right[i] = left[i] + dds
+                        if selector.select_bbox(left, right) == 0:
+                            continue
+                        if n != j:
+                            for i in range(3):
+                                buf.pos[3*n+i] = buf.pos[3*j+i]
+                            buf.level[n] = buf.level[j]
+                            for i in range(num_fields):
+                                buf.data[num_fields*n+i] = \
+                                    buf.data[num_fields*j+i]
+                        n += 1
+                    buf.count = n
+                    count += n
+
+            fcoords = np.empty((count, 3), dtype="float64")
+            ires = np.empty(count, dtype="int64")
+            field_data = np.empty((num_fields, count), dtype="float64")
+            n = 0
+            for t in range(num_threads):
+                buf = &buffers[t]
+                if buf.count == 0: continue
+                memcpy(&fcoords[n, 0], buf.pos,
+                       sizeof(np.float64_t)*3*buf.count)
+                for j in range(buf.count):
+                    ires[n+j] = buf.level[j]
+                    for i in range(num_fields):
+                        field_data[i, n+j] = buf.data[num_fields*j+i]
+                n += buf.count
+        finally:
+            artio_grid_set_volume_test(self.handle, NULL, NULL)
+            for t in range(num_threads):
+                free(buffers[t].pos)
+                free(buffers[t].level)
+                free(buffers[t].data)
+            free(buffers)
+            free(params)
+            free(field_order)
+
+        data = [field_data[i] for i in range(num_fields)]
         return (fcoords, ires, data)
 
     def root_sfc_ranges_all(self, int max_range_size = 1024) :
@@ -657,34 +713,19 @@ cdef class artio_fileset :
         return sfc_ranges
 
     def root_sfc_ranges(self, SelectorObject selector,
-                        int max_range_size = 1024):
-        cdef int coords[3]
+                        int max_range_size = 1024, int max_ranges = 0):
         cdef int64_t sfc_start, sfc_end
-        cdef np.float64_t left[3]
-        cdef np.float64_t right[3]
-        cdef np.float64_t dds[3]
         cdef artio_selection *selection
-        cdef int i, j, k
 
-        sfc_ranges=[]
-        selection = artio_selection_allocate(self.handle)
-        for i in range(self.num_grid) :
-            # stupid cython
-            coords[0] = i
-            left[0] = coords[0]
-            right[0] = left[0] + 1.0
-            for j in range(self.num_grid) :
-                coords[1] = j
-                left[1] = coords[1]
-                right[1] = left[1] + 1.0
-                for k in range(self.num_grid) :
-                    coords[2] = k
-                    left[2] = coords[2]
-                    right[2] = left[2] + 1.0
-                    if selector.select_bbox(left,right) :
-                        status = artio_selection_add_root_cell(selection, coords)
-                        check_artio_status(status)
+        # Only octree nodes the selector's bounding box test touches are
+        # visited.  A positive max_ranges merges the closest ranges,
+        # trading a few unselected root cells for fewer chunks.
+        selection = artio_select_region(self.handle, selector_volume_test,
+                                        <void *> selector, max_ranges)
+        if selection == NULL :
+            raise RuntimeError
 
+        sfc_ranges=[]
         while artio_selection_iterator(selection, max_range_size,
                 &sfc_start, &sfc_end) == ARTIO_SUCCESS :
             sfc_ranges.append([sfc_start, sfc_end])
@@ -777,20 +818,20 @@ cdef class ARTIOSFCRangeHandler:
     @cython.boundscheck(False)
     @cython.wraparound(False)
     @cython.cdivision(True)
-    def construct_mesh(self):
-        cdef int status, level, ngv
-        cdef np.int64_t sfc, oc, i
-        cdef double dpos[3]
+    def construct_mesh(self, int num_threads = 0):
+        cdef int status, level, ngv, t
+        cdef np.int64_t sfc, oc, i, j, k
         cdef int num_oct_levels
         cdef int max_level = self.artio_handle.max_level
         cdef int *num_octs_per_level = <int *>malloc(
             (max_level + 1)*sizeof(int))
         cdef int num_species = self.artio_handle.num_species
         cdef int *num_particles_per_species
+        cdef oct_position_buffer *buffers
+        cdef oct_position_buffer *buf
+        cdef void **params
         cdef ARTIOOctreeContainer octree
         ngv = self.nvars[1]
-        cdef float *grid_variables = <float *>malloc(
-            ngv * sizeof(float))
         self.octree_handler = octree = ARTIOOctreeContainer(self)
         if self.cache_root_mesh == 1:
             self.root_mesh_data = <float **>malloc(sizeof(float *) * ngv)
@@ -804,27 +845,67 @@ cdef class ARTIOSFCRangeHandler:
         octree.allocate_domains([], self.sfc_end - self.sfc_start + 1)
         cdef np.ndarray[np.int64_t, ndim=1] oct_count
         oct_count = np.zeros(self.sfc_end - self.sfc_start + 1, dtype="int64")
-        status = artio_grid_cache_sfc_range(self.handle, self.sfc_start,
-                                            self.sfc_end)
-        check_artio_status(status)
-        for sfc in range(self.sfc_start, self.sfc_end + 1):
-            status = artio_grid_read_root_cell_begin( self.handle,
-                sfc, dpos, grid_variables, &num_oct_levels,
-                num_octs_per_level)
-            check_artio_status(status)
-            for i in range(ngv * self.cache_root_mesh):
-                self.root_mesh_data[i][sfc - self.sfc_start] = \
-                    grid_variables[i]
-            if num_oct_levels > 0:
-                oc = 0
-                for level in range(num_oct_levels):
-                    oc += num_octs_per_level[level]
-                self.total_octs += oc
-                oct_count[sfc - self.sfc_start] = oc
-                octree.initialize_local_mesh(oc, num_oct_levels,
-                    num_octs_per_level, sfc)
-            status = artio_grid_read_root_cell_end(self.handle)
+
+        num_threads = range_threads(num_threads,
+                                    self.sfc_end - self.sfc_start + 1)
+        buffers = <oct_position_buffer *>malloc(
+            sizeof(oct_position_buffer)*num_threads)
+        params = <void **>malloc(sizeof(void *)*num_threads)
+        for t in range(num_threads):
+            buffers[t].count = buffers[t].size = 0
+            buffers[t].pos = NULL
+            buffers[t].sfc = NULL
+            buffers[t].level = NULL
+            buffers[t].num_fields = ngv
+            buffers[t].sfc_start = self.sfc_start
+            buffers[t].root_mesh_data = self.root_mesh_data
+            buffers[t].error = 0
+            params[t] = &buffers[t]
+
+        try:
+            # Each thread reads the octs of its own slice of the range
+            # through a private cursor; the root level is only visited when
+            # the root mesh is cached.
+            with nogil:
+                status = artio_grid_read_sfc_range_levels_threaded(
+                    self.handle, self.sfc_start, self.sfc_end,
+                    1 - self.cache_root_mesh, max_level,
+                    ARTIO_READ_ALL | ARTIO_RETURN_OCTS, num_threads,
+                    collect_oct_positions, params)
             check_artio_status(status)
+            for t in range(num_threads):
+                if buffers[t].error:
+                    raise MemoryError
+
+            # The slices are in sfc order, and so are the octs within each,
+            # so the octree is built up exactly as a serial read would.
+            for t in range(num_threads):
+                buf = &buffers[t]
+                j = 0
+                while j < buf.count:
+                    sfc = buf.sfc[j]
+                    for level in range(max_level + 1):
+                        num_octs_per_level[level] = 0
+                    num_oct_levels = 0
+                    k = j
+                    while k < buf.count and buf.sfc[k] == sfc:
+                        num_octs_per_level[buf.level[k] - 1] += 1
+                        num_oct_levels = imax(num_oct_levels, buf.level[k])
+                        k += 1
+                    oc = k - j
+                    self.total_octs += oc
+                    oct_count[sfc - self.sfc_start] = oc
+                    octree.initialize_local_mesh(oc, num_oct_levels,
+                        num_octs_per_level, sfc, buf.pos + 3*j)
+                    j = k
+        finally:
+            for t in range(num_threads):
+                free(buffers[t].pos)
+                free(buffers[t].sfc)
+                free(buffers[t].level)
+            free(buffers)
+            free(params)
+
         status = artio_grid_clear_sfc_cache(self.handle)
         check_artio_status(status)
         if self.artio_handle.has_particles:
@@ -837,7 +918,7 @@ cdef class ARTIOSFCRangeHandler:
             check_artio_status(status)
             for sfc in range(self.sfc_start, self.sfc_end + 1):
                 # Now particles
-                status = artio_particle_read_root_cell_begin(self.handle,
+                status = artio_particle_read_root_cell_counts(self.handle,
                         sfc, num_particles_per_species)
                 check_artio_status(status)
 
@@ -845,15 +926,11 @@ cdef class ARTIOSFCRangeHandler:
                     self.pcount[i][sfc - self.sfc_start] = \
                         num_particles_per_species[i]
 
-                status = artio_particle_read_root_cell_end(self.handle)
-                check_artio_status(status)
-
             status = artio_particle_clear_sfc_cache(self.handle)
             check_artio_status(status)
 
             free(num_particles_per_species)
 
-        free(grid_variables)
         free(num_octs_per_level)
         self.oct_count = oct_count
         self.doct_count = <np.int64_t *> oct_count.data
@@ -931,21 +1008,14 @@ cdef class ARTIOOctreeContainer(SparseOctreeContainer):
     @cython.cdivision(True)
     cdef void initialize_local_mesh(self, np.int64_t oct_count,
                               int num_oct_levels, int *num_octs_per_level,
-                              np.int64_t sfc):
+                              np.int64_t sfc, np.float64_t *oct_pos):
         # We actually will not be initializing the root mesh here, we will be
         # initializing the entire mesh between sfc_start and sfc_end.
-        cdef np.int64_t oct_ind, tot_octs, ipos, nadded
-        cdef int i, status, level, num_root, num_octs
-        cdef int num_level_octs
-        cdef artio_fileset_handle *handle = self.artio_handle.handle
-        cdef int coords[3]
-        cdef int max_level = self.artio_handle.max_level
-        cdef double dpos[3]
-        cdef np.float64_t f64pos[3]
-        cdef np.float64_t dds[3]
+        # oct_pos holds the positions of the octs of this root cell, level by
+        # level, as they were read from the file.
+        cdef np.int64_t oct_ind, ipos, nadded
+        cdef int level
         cdef np.ndarray[np.float64_t, ndim=2] pos
-        # NOTE: We do not cache any SFC ranges here, as we should only ever be
-        # called from within a pre-cached operation in the SFC handler.
 
         # We only allow one root oct.
         self.append_domain(oct_count)
@@ -960,18 +1030,11 @@ cdef class ARTIOOctreeContainer(SparseOctreeContainer):
         pos = np.empty((oct_ind, 3), dtype="float64")
 
         # Now we initialize
-        # Note that we also assume we have already started reading the level.
         ipos = 0
         for level in range(num_oct_levels):
-            status = artio_grid_read_level_begin(handle, level + 1)
-            check_artio_status(status)
-            for oct_ind in range(num_octs_per_level[level]):
-                status = artio_grid_read_oct(handle, dpos, NULL, NULL)
-                for i in range(3):
-                    pos[oct_ind, i] = dpos[i]
-                check_artio_status(status)
-            status = artio_grid_read_level_end(handle)
-            check_artio_status(status)
+            memcpy(<np.float64_t *> pos.data, oct_pos + 3*ipos,
+                   sizeof(np.float64_t)*3*num_octs_per_level[level])
+            ipos += num_octs_per_level[level]
             nadded = self.add(self.num_domains, level, pos[:num_octs_per_level[level],:])
             if nadded != num_octs_per_level[level]:
                 raise RuntimeError
@@ -1081,6 +1144,13 @@ cdef class ARTIOOctreeContainer(SparseOctreeContainer):
                                 self.range_handler.pcount)
         return rv
 
+    def fill_sfc_particles_selected(self, SelectorObject selector, fields):
+        # Only the selected particles of the root cells that have octs
+        if not self.artio_handle.has_particles: return {}
+        return read_selected_particles(self.artio_handle, selector,
+                                       self.sfc_start, self.sfc_end, fields,
+                                       0, self.range_handler.doct_count)
+
 @cython.boundscheck(False)
 @cython.wraparound(False)
 @cython.cdivision(True)
@@ -1255,6 +1325,190 @@ cdef read_sfc_particles(artio_fileset artio_handle,
     free(secondary_variables)
     return data
 
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef int scan_selected_particles(artio_fileset_handle *handle,
+                                 SelectorObject selector,
+                                 np.int64_t sfc_start, np.int64_t sfc_end,
+                                 int num_species, int *accessed_species,
+                                 int *position_index,
+                                 int *num_particles_per_species,
+                                 double *primary_variables,
+                                 float *secondary_variables,
+                                 particle_var_pointers *vpoints,
+                                 int fill, int read_unrefined,
+                                 np.int64_t *doct_count) nogil:
+    # Walks every particle of the accessed species in the SFC range and
+    # tests it against the selector.  With fill == 0 this only counts the
+    # selected particles into vpoints[ispec].count; with fill == 1 the
+    # variables of each selected particle are written into the preallocated
+    # columns at position vpoints[ispec].count.  As in read_sfc_particles,
+    # read_unrefined == 1 (0) keeps only root cells without (with) octs,
+    # according to doct_count; -1 keeps every root cell.
+    cdef int status, ispec, subspecies, i
+    cdef np.int64_t sfc, particle, pid, ind, c
+    cdef np.float64_t pos[3]
+    cdef particle_var_pointers *vp
+    for sfc in range(sfc_start, sfc_end + 1):
+        if read_unrefined != -1:
+            c = doct_count[sfc - sfc_start]
+            if read_unrefined == 1 and c > 0: continue
+            if read_unrefined == 0 and c == 0: continue
+        status = artio_particle_read_root_cell_begin(handle, sfc,
+                num_particles_per_species)
+        if status != ARTIO_SUCCESS: return status
+        for ispec in range(num_species):
+            if accessed_species[ispec] == 0: continue
+            if num_particles_per_species[ispec] == 0: continue
+            status = artio_particle_read_species_begin(handle, ispec)
+            if status != ARTIO_SUCCESS: return status
+            vp = &vpoints[ispec]
+            for particle in range(num_particles_per_species[ispec]):
+                status = artio_particle_read_particle(handle,
+                        &pid, &subspecies, primary_variables,
+                        secondary_variables)
+                if status != ARTIO_SUCCESS: return status
+                for i in range(3):
+                    pos[i] = primary_variables[position_index[3*ispec+i]]
+                if selector.select_point(pos) == 0: continue
+                if fill == 1:
+                    ind = vp.count
+                    for i in range(vp.n_p):
+                        vp.pvars[i][ind] = primary_variables[vp.p_ind[i]]
+                    for i in range(vp.n_s):
+                        vp.svars[i][ind] = secondary_variables[vp.s_ind[i]]
+                    if vp.n_pid:
+                        vp.pid[ind] = pid
+                vp.count += 1
+            status = artio_particle_read_species_end(handle)
+            if status != ARTIO_SUCCESS: return status
+        status = artio_particle_read_root_cell_end(handle)
+        if status != ARTIO_SUCCESS: return status
+    return ARTIO_SUCCESS
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef read_selected_particles(artio_fileset artio_handle,
+                             SelectorObject selector,
+                             np.int64_t sfc_start, np.int64_t sfc_end,
+                             fields, int read_unrefined = -1,
+                             np.int64_t *doct_count = NULL):
+    # Two passes over the SFC range: the first counts the particles of each
+    # species accepted by the selector, the second fills contiguous arrays
+    # of exactly that size.  Both passes run without the GIL.
+    cdef int status, ispec
+    cdef int num_species = artio_handle.num_species
+    cdef artio_fileset_handle *handle = artio_handle.handle
+    cdef int *position_index = artio_handle.particle_position_index
+    cdef int *num_particles_per_species = artio_handle.num_particles_per_species
+    cdef double *primary_variables = artio_handle.primary_variables
+    cdef float *secondary_variables = artio_handle.secondary_variables
+    cdef int *accessed_species
+    cdef particle_var_pointers *vpoints
+    cdef particle_var_pointers *vp
+    cdef np.int64_t tp
+
+    cdef np.ndarray[np.int8_t, ndim=1] npi8arr
+    cdef np.ndarray[np.int64_t, ndim=1] npi64arr
+    cdef np.ndarray[np.float64_t, ndim=1] npf64arr
+
+    params = artio_handle.parameters
+    npri_vars = params["num_primary_variables"]
+    nsec_vars = params["num_secondary_variables"]
+
+    for species, field in fields:
+        if species < 0 or species >= num_species:
+            raise RuntimeError("Invalid species provided to read_particle_chunk")
+
+    accessed_species = <int *>malloc(sizeof(int)*num_species)
+    vpoints = <particle_var_pointers *> malloc(
+        sizeof(particle_var_pointers)*num_species)
+    try:
+        for ispec in range(num_species):
+            accessed_species[ispec] = 0
+            vpoints[ispec].count = 0
+            vpoints[ispec].n_mass = 0
+            vpoints[ispec].n_pid = 0
+            vpoints[ispec].n_species = 0
+            vpoints[ispec].n_p = 0
+            vpoints[ispec].n_s = 0
+        for species, field in fields:
+            accessed_species[species] = 1
+
+        status = artio_particle_cache_sfc_range(handle, sfc_start, sfc_end)
+        check_artio_status(status)
+
+        with nogil:
+            status = scan_selected_particles(handle, selector,
+                sfc_start, sfc_end, num_species, accessed_species,
+                position_index, num_particles_per_species,
+                primary_variables, secondary_variables, vpoints, 0,
+                read_unrefined, doct_count)
+        check_artio_status(status)
+
+        # Allocate each column at its final size and wire it into vpoints
+        data = {}
+        for species, field in fields:
+            pri_vars = params.get(
+                "species_%02u_primary_variable_labels" % (species,), [])
+            sec_vars = params.get(
+                "species_%02u_secondary_variable_labels" % (species,), [])
+            vp = &vpoints[species]
+            tp = vp.count
+            if npri_vars[species] > 0 and field in pri_vars:
+                if vp.n_p == 16:
+                    raise RuntimeError("Too many primary variables requested")
+                data[(species, field)] = np.empty(tp, dtype="float64")
+                npf64arr = data[(species, field)]
+                vp.p_ind[vp.n_p] = pri_vars.index(field)
+                vp.pvars[vp.n_p] = <np.float64_t *> npf64arr.data
+                vp.n_p += 1
+            elif nsec_vars[species] > 0 and field in sec_vars:
+                if vp.n_s == 16:
+                    raise RuntimeError("Too many secondary variables requested")
+                data[(species, field)] = np.empty(tp, dtype="float64")
+                npf64arr = data[(species, field)]
+                vp.s_ind[vp.n_s] = sec_vars.index(field)
+                vp.svars[vp.n_s] = <np.float64_t *> npf64arr.data
+                vp.n_s += 1
+            elif field == "MASS":
+                vp.n_mass = 1
+                # We fill this *now*
+                data[(species, field)] = np.full(tp,
+                    params["particle_species_mass"][species], dtype="float64")
+                npf64arr = data[(species, field)]
+                vp.mass = <np.float64_t*> npf64arr.data
+            elif field == "PID":
+                vp.n_pid = 1
+                data[(species, field)] = np.empty(tp, dtype="int64")
+                npi64arr = data[(species, field)]
+                vp.pid = <np.int64_t*> npi64arr.data
+            elif field == "SPECIES":
+                vp.n_species = 1
+                # We fill this *now*
+                data[(species, field)] = np.full(tp, species, dtype="int8")
+                npi8arr = data[(species, field)]
+                vp.species = <np.int8_t*> npi8arr.data
+            else:
+                raise RuntimeError("invalid field name provided to read_particle_chunk")
+
+        for ispec in range(num_species):
+            vpoints[ispec].count = 0
+
+        with nogil:
+            status = scan_selected_particles(handle, selector,
+                sfc_start, sfc_end, num_species, accessed_species,
+                position_index, num_particles_per_species,
+                primary_variables, secondary_variables, vpoints, 1,
+                read_unrefined, doct_count)
+        check_artio_status(status)
+    finally:
+        free(accessed_species)
+        free(vpoints)
+    return data
+
 cdef class ARTIORootMeshContainer:
     cdef public artio_fileset artio_handle
     cdef np.float64_t DLE[3]
@@ -1471,18 +1725,29 @@ cdef class ARTIORootMeshContainer:
     def mask(self, SelectorObject selector, np.int64_t num_cells = -1,
              int domain_id = -1):
         # We take a domain_id here to avoid subclassing
-        cdef int i
+        cdef int i, status
         cdef np.float64_t pos[3]
         cdef np.int64_t sfc, sfci = -1
+        cdef np.int64_t nroot = self.sfc_end - self.sfc_start + 1
         if self._last_selector_id == hash(selector):
             return self._last_mask
         cdef np.ndarray[np.uint8_t, ndim=1] mask
         mask = np.zeros((self.nsfc), dtype="uint8")
         self._last_mask_sum = 0
+        # Decode the coordinates of the whole range in one batch.
+        cdef np.ndarray[np.int64_t, ndim=1] sfcs
+        cdef np.ndarray[np.int32_t, ndim=2] coords
+        sfcs = np.arange(self.sfc_start, self.sfc_end + 1, dtype="int64")
+        coords = np.empty((nroot, 3), dtype="int32")
+        status = artio_sfc_coords_array(self.handle, nroot,
+                    <int64_t *> sfcs.data, <int *> coords.data)
+        check_artio_status(status)
         for sfc in range(self.sfc_start, self.sfc_end + 1):
             if self.sfc_mask[sfc - self.sfc_start] == 0: continue
             sfci += 1
-            self.sfc_to_pos(sfc, pos)
+            for i in range(3):
+                pos[i] = self.DLE[i] + \
+                    (coords[sfc - self.sfc_start, i] + 0.5) * self.dds[i]
             if selector.select_cell(pos, self.dds) == 0: continue
             mask[sfci] = 1
             self._last_mask_sum += 1
@@ -1498,6 +1763,13 @@ cdef class ARTIORootMeshContainer:
                                 self.range_handler.pcount)
         return rv
 
+    def fill_sfc_particles_selected(self, SelectorObject selector, fields):
+        # Only the selected particles of the root cells without octs
+        if not self.artio_handle.has_particles: return {}
+        return read_selected_particles(self.artio_handle, selector,
+                                       self.sfc_start, self.sfc_end, fields,
+                                       1, self.range_handler.doct_count)
+
     @cython.boundscheck(False)
     @cython.wraparound(False)
     @cython.cdivision(True)
@@ -78,6 +78,9 @@ artio_fileset *artio_fileset_open(char * file_prefix, int type, const artio_cont
 		return NULL;
 	}
 
+	/* data files share the byte order detected from the header */
+	handle->endian_swap = artio_file_get_endian_swap_tag(head_fh);
+
 	artio_file_fclose(head_fh);
 
 	/* check versions */
@@ -115,6 +118,14 @@ artio_fileset *artio_fileset_open(char * file_prefix, int type, const artio_cont
 	handle->proc_sfc_begin = 0;
 	handle->proc_sfc_end = handle->num_root_cells-1;
 
+	if ( type & ARTIO_OPEN_MMAP ) {
+		handle->use_mmap = 1;
+	}
+
+	if ( type & ARTIO_OPEN_PREFETCH ) {
+		handle->use_prefetch = 1;
+	}
+
 	/* open data files */
 	if (type & ARTIO_OPEN_PARTICLES) {
 		ret = artio_fileset_open_particles(handle);
@@ -132,6 +143,15 @@ artio_fileset *artio_fileset_open(char * file_prefix, int type, const artio_cont
 		}
 	}
 
+	if ( (type & ARTIO_OPEN_INDEX) && 
+			(type & (ARTIO_OPEN_GRID | ARTIO_OPEN_PARTICLES)) ) {
+		ret = artio_fileset_open_index(handle);
+		if ( ret != ARTIO_SUCCESS ) {
+			artio_fileset_destroy(handle);
+			return NULL;
+		}
+	}
+
 	return handle;
 }
 
@@ -243,6 +263,8 @@ artio_fileset *artio_fileset_allocate( char *file_prefix, int mode,
 		handle->rank = my_rank;
 		handle->num_procs = num_procs;
 		handle->endian_swap = 0;
+		handle->use_mmap = 0;
+		handle->use_prefetch = 0;
 
 		handle->proc_sfc_index = NULL;
 		handle->proc_sfc_begin = -1;
@@ -251,6 +273,7 @@ artio_fileset *artio_fileset_allocate( char *file_prefix, int mode,
 		
 		handle->grid = NULL;
 		handle->particle = NULL;
+		handle->index = NULL;
 	}	
 	return handle;
 }
@@ -259,6 +282,10 @@ void artio_fileset_destroy( artio_fileset *handle ) {
 	if ( handle == NULL ) return;
 
 	if ( handle->proc_sfc_index != NULL ) free( handle->proc_sfc_index );
+
+	if ( handle->index != NULL ) {
+		artio_fileset_close_index(handle);
+	}
 	
 	if ( handle->grid != NULL ) {
         artio_fileset_close_grid(handle);
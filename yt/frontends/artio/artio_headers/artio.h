@@ -40,6 +40,9 @@ typedef __int32 int32_t;
 #define ARTIO_OPEN_HEADER					0
 #define ARTIO_OPEN_PARTICLES                1
 #define ARTIO_OPEN_GRID                     2
+#define ARTIO_OPEN_MMAP                     4
+#define ARTIO_OPEN_INDEX                    8
+#define ARTIO_OPEN_PREFETCH                 16
 
 #define ARTIO_READ_LEAFS                    1
 #define ARTIO_READ_REFINED                  2
@@ -134,7 +137,13 @@ extern const artio_context *artio_context_global;
  * Description: Open the file
  *
  *  filename		The file prefix
- *  type			combination of ARTIO_OPEN_PARTICLES and ARTIO_OPEN_GRID flags
+ *  type			combination of ARTIO_OPEN_PARTICLES and ARTIO_OPEN_GRID flags,
+ *  				optionally with ARTIO_OPEN_MMAP to memory map the data files
+ *  				(also applies to components opened later on this handle)
+ *  				and ARTIO_OPEN_INDEX to attach the sfc index of the opened
+ *  				components (see artio_fileset_open_index).  ARTIO_OPEN_PREFETCH
+ *  				reads the cached sfc range ahead on a background thread
+ *  				(ignored for memory mapped files and under MPI)
  */
 artio_fileset *artio_fileset_open( char * file_name, int type, const artio_context *context);
 
@@ -158,6 +167,21 @@ int artio_fileset_set_buffer_size( int buffer_size );
 int artio_fileset_has_grid( artio_fileset *handle );
 int artio_fileset_has_particles( artio_fileset *handle );
 
+/*
+ * Description:	Attach the sfc index of the open grid and particle files
+ *
+ *  The index holds the byte offset of every root cell together with its
+ *  oct counts per level and particle counts per species.  It is read from
+ *  <prefix>.sfc_index (memory mapped where possible) if that file matches
+ *  the size and modification time of each data file, and is otherwise
+ *  rebuilt by scanning the root cells and written back for the next open.
+ *  Failing to write the sidecar is not an error.  While attached, caching
+ *  sfc ranges and counting octs or particles no longer touch the data
+ *  files.  Not available with ARTIO_MPI.
+ */
+int artio_fileset_open_index( artio_fileset *handle );
+int artio_fileset_close_index( artio_fileset *handle );
+
 /* public parameter interface */
 int artio_parameter_iterate( artio_fileset *handle, char *key, int *type, int *length );
 int artio_parameter_get_array_length(artio_fileset *handle, const char * key, int *length);
@@ -307,6 +331,13 @@ int artio_grid_read_level_end(artio_fileset *handle);
 int artio_grid_read_oct(artio_fileset *handle, double *pos, 
 		float *variables, int *refined);
 
+/*
+ * Description:	Read only the oct counts of a root cell, from the sfc index
+ *              if attached and otherwise from the cached sfc range
+ */
+int artio_grid_read_root_cell_levels(artio_fileset *handle, int64_t sfc,
+		int *num_tree_levels, int *num_octs_per_level);
+
 int artio_grid_cache_sfc_range(artio_fileset *handle, int64_t sfc_start, int64_t sfc_end);
 int artio_grid_clear_sfc_cache(artio_fileset *handle );
 
@@ -330,6 +361,34 @@ int artio_grid_read_sfc_range_levels(artio_fileset *handle,
 		int options, artio_grid_callback callback,
 		void *params );
 
+/*
+ * Description:	Read a segment of oct nodes using several threads
+ *
+ *  The sfc range is split into num_threads contiguous slices and each
+ *  thread reads its slice through its own file handles and cursor, so
+ *  the callback is invoked concurrently.  Thread t passes params[t] to
+ *  the callback and visits its slice in sfc order, so concatenating the
+ *  per-thread results in thread order preserves sfc order.  Without
+ *  OpenMP (or with ARTIO_MPI) the slices are read one after another.
+ *  A range cached with artio_grid_cache_sfc_range is still cached on
+ *  return.  Every slice opens its own copies of the data files.
+ *
+ *  num_threads		the number of slices (at most one per root cell), and
+ *  			the length of params
+ *  params		one pointer of user-defined data per slice
+ */
+int artio_grid_read_sfc_range_levels_threaded(artio_fileset *handle,
+		int64_t sfc1, int64_t sfc2,
+		int min_level_to_read, int max_level_to_read,
+		int options, int num_threads,
+		artio_grid_callback callback,
+		void **params );
+
+/*
+ * Description:	Default number of threads for the threaded readers
+ */
+int artio_grid_max_threads(void);
+
 int artio_grid_read_sfc_range(artio_fileset *handle,
         int64_t sfc1, int64_t sfc2, int options,
         artio_grid_callback callback,
@@ -439,6 +498,13 @@ int artio_particle_read_species_end(artio_fileset *handle);
 int artio_particle_read_particle(artio_fileset *handle, int64_t *pid, int *subspecies,
 			double *primary_variables, float *secondary_variables);
 
+/*
+ * Description:	Read only the particle counts of a root cell, from the sfc
+ *              index if attached and otherwise from the cached sfc range
+ */
+int artio_particle_read_root_cell_counts(artio_fileset *handle, int64_t sfc,
+			int *num_particles_per_species);
+
 int artio_particle_cache_sfc_range(artio_fileset *handle, int64_t sfc_start, int64_t sfc_end);
 int artio_particle_clear_sfc_cache(artio_fileset *handle );                                                          
 
@@ -481,6 +547,40 @@ artio_selection *artio_selection_allocate( artio_fileset *handle );
 artio_selection *artio_select_all( artio_fileset *handle );
 artio_selection *artio_select_volume( artio_fileset *handle, double lpos[3], double rpos[3] );
 artio_selection *artio_select_cube( artio_fileset *handle, double center[3], double size );
+artio_selection *artio_select_sphere( artio_fileset *handle, double center[3], 
+		double radius, int max_ranges );
+
+/*
+ * Description:	Select the root cells touched by an arbitrary region
+ *
+ *  test			classifies the box [left,right) (in root cell units) as
+ *  				ARTIO_SELECT_OUTSIDE, ARTIO_SELECT_PARTIAL or
+ *  				ARTIO_SELECT_INSIDE the region.  Boxes are aligned octree
+ *  				nodes and only partial nodes are refined, down to single
+ *  				root cells which are kept unless they are outside.
+ *  max_ranges		if positive, the closest ranges are merged until at most
+ *  				max_ranges remain, adding unselected cells in between
+ */
+#define ARTIO_SELECT_OUTSIDE	0
+#define ARTIO_SELECT_PARTIAL	1
+#define ARTIO_SELECT_INSIDE		2
+
+typedef int (* artio_selection_volume_test)( double left[3], double right[3], void *params );
+
+artio_selection *artio_select_region( artio_fileset *handle,
+		artio_selection_volume_test test, void *params, int max_ranges );
+
+/*
+ * Description:	Restrict the grid sfc range readers to a volume
+ *
+ *  Root cells and octs whose extent test returns ARTIO_SELECT_OUTSIDE are
+ *  not passed to the callback, and the levels below a level with no octs
+ *  left are not read at all.  The test may be called from several 
+ *  threads at once by the threaded reader.  A NULL test reads everything.
+ */
+int artio_grid_set_volume_test( artio_fileset *handle,
+		artio_selection_volume_test test, void *params );
+int artio_selection_coarsen( artio_selection *selection, int max_ranges );
 int artio_selection_add_root_cell( artio_selection *selection, int coords[3] );                   
 int artio_selection_destroy( artio_selection *selection );
 void artio_selection_print( artio_selection *selection );
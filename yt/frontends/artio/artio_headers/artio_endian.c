@@ -22,87 +22,165 @@
 
 #include "artio_endian.h"
 
+#include <stddef.h>
+#include <string.h>
 #ifdef _WIN32
 typedef __int64 int64_t;
 typedef __int32 int32_t;
+typedef unsigned __int64 uint64_t;
+typedef unsigned __int32 uint32_t;
 #else
 #include <stdint.h>
 #endif
 
-void artio_int_swap(int32_t *src, int count) {
-	int i;
-	union {
-		int32_t f;
-		unsigned char c[4];
-	} d1, d2;
+/* runtime selected SSSE3/AVX2 byte shuffles on x86 gcc/clang builds */
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) ) && \
+		( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) || defined(__clang__) )
+#define ARTIO_SWAP_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*artio_swap_kernel)(void *dst, const void *src, int64_t count);
+
+static uint32_t artio_bswap32(uint32_t x) {
+	return ( x >> 24 ) | ( ( x >> 8 ) & 0xff00 ) |
+		( ( x << 8 ) & 0xff0000 ) | ( x << 24 );
+}
+
+static uint64_t artio_bswap64(uint64_t x) {
+	return ( (uint64_t)artio_bswap32( (uint32_t)x ) << 32 ) |
+		artio_bswap32( (uint32_t)( x >> 32 ) );
+}
+
+/* portable kernels, memcpy keeps unaligned buffers well defined */
+static void artio_swap_copy_4_generic(void *dst, const void *src, int64_t count) {
+	int64_t i;
+	uint32_t v;
 
 	for ( i = 0; i < count; i++ ) {
-		d1.f = src[i];
-		d2.c[0] = d1.c[3];
-		d2.c[1] = d1.c[2];
-		d2.c[2] = d1.c[1];
-		d2.c[3] = d1.c[0];
-		src[i] = d2.f;
+		memcpy( &v, (const char *)src + 4*i, 4 );
+		v = artio_bswap32(v);
+		memcpy( (char *)dst + 4*i, &v, 4 );
 	}
 }
 
-void artio_float_swap(float *src, int count) {
-	int i;
-	union {
-		float f;
-		unsigned char c[4];
-	} d1, d2;
+static void artio_swap_copy_8_generic(void *dst, const void *src, int64_t count) {
+	int64_t i;
+	uint64_t v;
 
 	for ( i = 0; i < count; i++ ) {
-		d1.f = src[i];
-		d2.c[0] = d1.c[3];
-		d2.c[1] = d1.c[2];
-		d2.c[2] = d1.c[1];
-		d2.c[3] = d1.c[0];
-		src[i] = d2.f;
+		memcpy( &v, (const char *)src + 8*i, 8 );
+		v = artio_bswap64(v);
+		memcpy( (char *)dst + 8*i, &v, 8 );
 	}
 }
 
-void artio_double_swap(double *src, int count) {	
-	int i;
-	union
-	{
-		double d;
-		unsigned char c[8];
-	} d1, d2;
+#ifdef ARTIO_SWAP_X86
+__attribute__((target("ssse3")))
+static void artio_swap_copy_4_ssse3(void *dst, const void *src, int64_t count) {
+	int64_t i;
+	const __m128i mask = _mm_set_epi8( 12, 13, 14, 15, 8, 9, 10, 11,
+			4, 5, 6, 7, 0, 1, 2, 3 );
 
-	for ( i = 0; i < count; i++ ) {
-		d1.d = src[i];
-		d2.c[0] = d1.c[7];
-		d2.c[1] = d1.c[6];
-		d2.c[2] = d1.c[5];
-		d2.c[3] = d1.c[4];
-		d2.c[4] = d1.c[3];
-		d2.c[5] = d1.c[2];
-		d2.c[6] = d1.c[1];
-		d2.c[7] = d1.c[0];
-		src[i] = d2.d;
+	for ( i = 0; i + 4 <= count; i += 4 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)( (const char *)src + 4*i ) );
+		_mm_storeu_si128( (__m128i *)( (char *)dst + 4*i ), _mm_shuffle_epi8( v, mask ) );
 	}
+	artio_swap_copy_4_generic( (char *)dst + 4*i, (const char *)src + 4*i, count - i );
 }
 
-void artio_long_swap(int64_t *src, int count) {
-	int i;
-	union
-	{
-		int64_t d;
-		unsigned char c[8];
-	} d1, d2;
+__attribute__((target("ssse3")))
+static void artio_swap_copy_8_ssse3(void *dst, const void *src, int64_t count) {
+	int64_t i;
+	const __m128i mask = _mm_set_epi8( 8, 9, 10, 11, 12, 13, 14, 15,
+			0, 1, 2, 3, 4, 5, 6, 7 );
 
-	for ( i = 0; i < count; i++ ) {
-		d1.d = src[i];
-		d2.c[0] = d1.c[7];
-		d2.c[1] = d1.c[6];
-		d2.c[2] = d1.c[5];
-		d2.c[3] = d1.c[4];
-		d2.c[4] = d1.c[3];
-		d2.c[5] = d1.c[2];
-		d2.c[6] = d1.c[1];
-		d2.c[7] = d1.c[0];
-		src[i] = d2.d;
+	for ( i = 0; i + 2 <= count; i += 2 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)( (const char *)src + 8*i ) );
+		_mm_storeu_si128( (__m128i *)( (char *)dst + 8*i ), _mm_shuffle_epi8( v, mask ) );
+	}
+	artio_swap_copy_8_generic( (char *)dst + 8*i, (const char *)src + 8*i, count - i );
+}
+
+/* vpshufb shuffles within each 128-bit lane, so the lane mask is repeated */
+__attribute__((target("avx2")))
+static void artio_swap_copy_4_avx2(void *dst, const void *src, int64_t count) {
+	int64_t i;
+	const __m256i mask = _mm256_set_epi8( 12, 13, 14, 15, 8, 9, 10, 11,
+			4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11,
+			4, 5, 6, 7, 0, 1, 2, 3 );
+
+	for ( i = 0; i + 8 <= count; i += 8 ) {
+		__m256i v = _mm256_loadu_si256( (const __m256i *)( (const char *)src + 4*i ) );
+		_mm256_storeu_si256( (__m256i *)( (char *)dst + 4*i ), _mm256_shuffle_epi8( v, mask ) );
 	}
+	artio_swap_copy_4_generic( (char *)dst + 4*i, (const char *)src + 4*i, count - i );
+}
+
+__attribute__((target("avx2")))
+static void artio_swap_copy_8_avx2(void *dst, const void *src, int64_t count) {
+	int64_t i;
+	const __m256i mask = _mm256_set_epi8( 8, 9, 10, 11, 12, 13, 14, 15,
+			0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+			0, 1, 2, 3, 4, 5, 6, 7 );
+
+	for ( i = 0; i + 4 <= count; i += 4 ) {
+		__m256i v = _mm256_loadu_si256( (const __m256i *)( (const char *)src + 8*i ) );
+		_mm256_storeu_si256( (__m256i *)( (char *)dst + 8*i ), _mm256_shuffle_epi8( v, mask ) );
+	}
+	artio_swap_copy_8_generic( (char *)dst + 8*i, (const char *)src + 8*i, count - i );
+}
+#endif /* ARTIO_SWAP_X86 */
+
+static artio_swap_kernel artio_swap_copy_4_kernel = NULL;
+static artio_swap_kernel artio_swap_copy_8_kernel = NULL;
+
+static void artio_swap_select_kernels(void) {
+	artio_swap_kernel k4 = artio_swap_copy_4_generic;
+	artio_swap_kernel k8 = artio_swap_copy_8_generic;
+
+#ifdef ARTIO_SWAP_X86
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") ) {
+		k4 = artio_swap_copy_4_avx2;
+		k8 = artio_swap_copy_8_avx2;
+	} else if ( __builtin_cpu_supports("ssse3") ) {
+		k4 = artio_swap_copy_4_ssse3;
+		k8 = artio_swap_copy_8_ssse3;
+	}
+#endif /* ARTIO_SWAP_X86 */
+
+	/* every thread selects the same kernels, so racing here is harmless */
+	artio_swap_copy_8_kernel = k8;
+	artio_swap_copy_4_kernel = k4;
+}
+
+void artio_swap_copy_4(void *dst, const void *src, int64_t count) {
+	if ( artio_swap_copy_4_kernel == NULL ) {
+		artio_swap_select_kernels();
+	}
+	artio_swap_copy_4_kernel( dst, src, count );
+}
+
+void artio_swap_copy_8(void *dst, const void *src, int64_t count) {
+	if ( artio_swap_copy_8_kernel == NULL ) {
+		artio_swap_select_kernels();
+	}
+	artio_swap_copy_8_kernel( dst, src, count );
+}
+
+void artio_int_swap(int32_t *src, int count) {
+	artio_swap_copy_4( src, src, count );
+}
+
+void artio_float_swap(float *src, int count) {
+	artio_swap_copy_4( src, src, count );
+}
+
+void artio_double_swap(double *src, int count) {	
+	artio_swap_copy_8( src, src, count );
+}
+
+void artio_long_swap(int64_t *src, int count) {
+	artio_swap_copy_8( src, src, count );
 }
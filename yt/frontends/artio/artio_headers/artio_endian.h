@@ -35,4 +35,8 @@ void artio_float_swap(float *src, int count);
 void artio_double_swap(double *src, int count);
 void artio_long_swap(int64_t *src, int count);
 
+/* byte swap count 4 or 8 byte elements from src into dst (which may equal src) */
+void artio_swap_copy_4(void *dst, const void *src, int64_t count);
+void artio_swap_copy_8(void *dst, const void *src, int64_t count);
+
 #endif /* __ARTIO_ENDIAN_H__ */
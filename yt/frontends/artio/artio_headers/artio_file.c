@@ -112,6 +112,51 @@ int artio_file_fread(artio_fh *handle, void *buf, int64_t count, int type ) {
 	return status;
 }
 
+int artio_file_fread_direct(artio_fh *handle, void **buf, int64_t count, int type ) {
+	int status;
+#ifdef ARTIO_DEBUG
+	printf( "artio_file_fread_direct( handle=%p, buf=%p, count=%ld, type=%d )\n",
+			handle, buf, count, type ); fflush(stdout);
+#endif /* ARTIO_DEBUG */
+	status = artio_file_fread_direct_i(handle,buf,count,type);
+#ifdef ARTIO_DEBUG
+	if ( status != ARTIO_SUCCESS ) {
+		printf( "artio_file_fread_direct(%p) = %d", handle, status );
+	}
+#endif /* ARTIO_DEBUG */
+	return status;
+}
+
+int artio_file_advise(artio_fh *handle, int64_t offset, int64_t length, int advice ) {
+	int status;
+#ifdef ARTIO_DEBUG
+	printf( "artio_file_advise( handle=%p, offset=%ld, length=%ld, advice=%d )\n",
+			handle, offset, length, advice ); fflush(stdout);
+#endif /* ARTIO_DEBUG */
+	status = artio_file_advise_i(handle,offset,length,advice);
+#ifdef ARTIO_DEBUG
+	if ( status != ARTIO_SUCCESS ) {
+		printf( "artio_file_advise(%p) = %d\n", handle, status ); fflush(stdout);
+	}
+#endif /* ARTIO_DEBUG */
+	return status;
+}
+
+int artio_file_prefetch(artio_fh *handle, int64_t offset, int64_t length ) {
+	int status;
+#ifdef ARTIO_DEBUG
+	printf( "artio_file_prefetch( handle=%p, offset=%ld, length=%ld )\n",
+			handle, offset, length ); fflush(stdout);
+#endif /* ARTIO_DEBUG */
+	status = artio_file_prefetch_i(handle,offset,length);
+#ifdef ARTIO_DEBUG
+	if ( status != ARTIO_SUCCESS ) {
+		printf( "artio_file_prefetch(%p) = %d\n", handle, status ); fflush(stdout);
+	}
+#endif /* ARTIO_DEBUG */
+	return status;
+}
+
 int artio_file_ftell(artio_fh *handle, int64_t *offset) {
 	int status;
 #ifdef ARTIO_DEBUG
@@ -159,3 +204,7 @@ int artio_file_fclose(artio_fh *handle) {
 void artio_file_set_endian_swap_tag(artio_fh *handle) {
 	artio_file_set_endian_swap_tag_i(handle);
 }
+
+int artio_file_get_endian_swap_tag(artio_fh *handle) {
+	return artio_file_get_endian_swap_tag_i(handle);
+}
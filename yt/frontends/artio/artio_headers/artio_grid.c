@@ -25,8 +25,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef _WIN32
 typedef __int64 int64_t;
 typedef __int32 int32_t;
@@ -37,6 +42,8 @@ typedef __int32 int32_t;
 int artio_grid_find_file(artio_grid_file *ghandle, int start, int end, int64_t sfc);
 artio_grid_file *artio_grid_file_allocate(void);
 void artio_grid_file_destroy(artio_grid_file *ghandle);
+artio_grid_file *artio_grid_file_clone_range(artio_fileset *handle,
+		int64_t start, int64_t end);
 
 const double oct_pos_offsets[8][3] = {
 	{ -0.5, -0.5, -0.5 }, {  0.5, -0.5, -0.5 }, 
@@ -123,6 +130,10 @@ int artio_fileset_open_grid(artio_fileset *handle) {
 			mode |= ARTIO_MODE_ENDIAN_SWAP;
 		}
 
+		if (handle->use_mmap) {
+			mode |= ARTIO_MODE_MMAP;
+		}
+
 		ghandle->ffh[i] = artio_file_fopen(filename, mode, handle->context);
 		if ( ghandle->ffh[i] == NULL ) {
 			artio_grid_file_destroy(ghandle);
@@ -352,6 +363,7 @@ artio_grid_file *artio_grid_file_allocate(void) {
 		ghandle->cache_sfc_begin = -1;
 		ghandle->cache_sfc_end = -1;
 		ghandle->sfc_offset_table = NULL;
+		ghandle->sfc_offset_table_borrowed = 0;
 		ghandle->file_max_level = -1;
 		ghandle->cur_file = -1;
 		ghandle->cur_num_levels = -1;
@@ -369,6 +381,9 @@ artio_grid_file *artio_grid_file_allocate(void) {
 		ghandle->cur_level_pos = NULL;
 		ghandle->next_level_oct = -1;
 
+		ghandle->volume_test = NULL;
+		ghandle->volume_params = NULL;
+
 		ghandle->buffer_size = artio_fh_buffer_size;
 		ghandle->buffer = malloc(ghandle->buffer_size);
 		if ( ghandle->buffer == NULL ) {
@@ -392,7 +407,10 @@ void artio_grid_file_destroy(artio_grid_file *ghandle) {
 		free(ghandle->ffh);
 	}
 
-	if ( ghandle->sfc_offset_table != NULL ) free(ghandle->sfc_offset_table);
+	if ( ghandle->sfc_offset_table != NULL &&
+			!ghandle->sfc_offset_table_borrowed ) {
+		free(ghandle->sfc_offset_table);
+	}
 	if ( ghandle->octs_per_level != NULL ) free(ghandle->octs_per_level);
 	if ( ghandle->file_sfc_index != NULL ) free(ghandle->file_sfc_index);
 	if ( ghandle->next_level_pos != NULL ) free(ghandle->next_level_pos);
@@ -452,7 +470,17 @@ int artio_grid_count_octs_in_sfc_range(artio_fileset *handle,
 
 	*num_octs_in_range = 0;
 
-	if ( 8*ghandle->num_grid_variables <= ghandle->file_max_level ) {
+	if ( handle->index != NULL && handle->index->grid_octs_per_level != NULL ) {
+		/* the sfc index already holds the counts, and the levels of
+		 * consecutive root cells are stored contiguously */
+		if ( start < 0 || end >= handle->index->num_root_cells ) {
+			return ARTIO_ERR_INVALID_SFC_RANGE;
+		}
+		for ( offset = handle->index->grid_level_offset[start];
+				offset < handle->index->grid_level_offset[end+1]; offset++ ) {
+			*num_octs_in_range += handle->index->grid_octs_per_level[offset];
+		}
+	} else if ( 8*ghandle->num_grid_variables <= ghandle->file_max_level ) {
 		/* we can't compute the number of octs through the offset table */
 		ret = artio_grid_cache_sfc_range( handle, start, end );
 		if ( ret != ARTIO_SUCCESS ) return ret;
@@ -477,7 +505,6 @@ int artio_grid_count_octs_in_sfc_range(artio_fileset *handle,
 
 		free( num_octs_per_level );
 	} else {
-		/* TODO: add optimization if sfc range already cached */
 		file = artio_grid_find_file(ghandle, 0, ghandle->num_grid_files, start);
 		first = MAX( 0, start - ghandle->file_sfc_index[file] );
 
@@ -523,11 +550,44 @@ int artio_grid_count_octs_in_sfc_range(artio_fileset *handle,
 	return ARTIO_SUCCESS;
 }
 
+static void artio_grid_prefetch_sfc_range(artio_fileset *handle,
+		int64_t start, int64_t end) {
+	int i;
+	int first_file, last_file;
+	int64_t first, last, offset, length;
+	artio_grid_file *ghandle = handle->grid;
+
+	if ( ghandle->cur_file != -1 ) {
+		/* buffered handles are not switched to read-ahead */
+		artio_file_detach_buffer( ghandle->ffh[ghandle->cur_file] );
+		ghandle->cur_file = -1;
+	}
+
+	first_file = artio_grid_find_file(ghandle, 0, ghandle->num_grid_files, start);
+	last_file = artio_grid_find_file(ghandle, first_file, ghandle->num_grid_files, end);
+
+	for ( i = first_file; i <= last_file; i++ ) {
+		first = MAX( start, ghandle->file_sfc_index[i] );
+		last = MIN( end, ghandle->file_sfc_index[i+1] - 1 );
+		offset = ghandle->sfc_offset_table[first - ghandle->cache_sfc_begin];
+
+		if ( last+1 < ghandle->file_sfc_index[i+1] && last+1 <= ghandle->cache_sfc_end ) {
+			length = ghandle->sfc_offset_table[last+1 - ghandle->cache_sfc_begin] - offset;
+		} else {
+			/* read ahead to the end of the file */
+			length = -1;
+		}
+
+		artio_file_prefetch( ghandle->ffh[i], offset, length );
+	}
+}
+
 int artio_grid_cache_sfc_range(artio_fileset *handle, int64_t start, int64_t end) {
 	int i;
 	int ret;
 	int first_file, last_file;
 	int64_t first, count, cur;
+	int64_t next_offset, length;
 	artio_grid_file *ghandle;
 
 	if ( handle == NULL ) {
@@ -550,11 +610,31 @@ int artio_grid_cache_sfc_range(artio_fileset *handle, int64_t start, int64_t end
 	/* check if we've already cached the range */
 	if ( start >= ghandle->cache_sfc_begin &&
 			end <= ghandle->cache_sfc_end ) {
+		if ( handle->use_prefetch ) {
+			artio_grid_prefetch_sfc_range(handle, start, end);
+		}
 		return ARTIO_SUCCESS;
 	}
 
 	artio_grid_clear_sfc_cache(handle);
 
+	if ( ghandle->cur_file != -1 ) {
+		artio_file_detach_buffer( ghandle->ffh[ghandle->cur_file]);
+		ghandle->cur_file = -1;
+	}
+
+	if ( handle->index != NULL && handle->index->grid_sfc_offset != NULL ) {
+		/* borrow the offsets of every root cell from the sfc index */
+		ghandle->cache_sfc_begin = 0;
+		ghandle->cache_sfc_end = handle->num_root_cells - 1;
+		ghandle->sfc_offset_table = handle->index->grid_sfc_offset;
+		ghandle->sfc_offset_table_borrowed = 1;
+		if ( handle->use_prefetch ) {
+			artio_grid_prefetch_sfc_range(handle, start, end);
+		}
+		return ARTIO_SUCCESS;
+	}
+
 	first_file = artio_grid_find_file(ghandle, 0, ghandle->num_grid_files, start);
 	last_file = artio_grid_find_file(ghandle, first_file, ghandle->num_grid_files, end);
 
@@ -565,11 +645,6 @@ int artio_grid_cache_sfc_range(artio_fileset *handle, int64_t start, int64_t end
 		return ARTIO_ERR_MEMORY_ALLOCATION;
 	}
 
-	if ( ghandle->cur_file != -1 ) {
-		artio_file_detach_buffer( ghandle->ffh[ghandle->cur_file]);
-		ghandle->cur_file = -1;
-	}
-
 	cur = 0;
 	for (i = first_file; i <= last_file; i++) {
 		first = MAX( 0, start - ghandle->file_sfc_index[i] );
@@ -588,10 +663,27 @@ int artio_grid_cache_sfc_range(artio_fileset *handle, int64_t start, int64_t end
 				count, ARTIO_TYPE_LONG);
 		if ( ret != ARTIO_SUCCESS ) return ret;
 
+		if ( handle->use_mmap ) {
+			/* hint the byte range backing the cached root cells */
+			if ( end+1 < ghandle->file_sfc_index[i+1] ) {
+				ret = artio_file_fread(ghandle->ffh[i], &next_offset, 1, ARTIO_TYPE_LONG);
+				if ( ret != ARTIO_SUCCESS ) return ret;
+				length = next_offset - ghandle->sfc_offset_table[cur];
+			} else {
+				length = -1;
+			}
+			artio_file_advise( ghandle->ffh[i], ghandle->sfc_offset_table[cur],
+					length, ARTIO_ADVISE_WILLNEED );
+		}
+
 		artio_file_detach_buffer( ghandle->ffh[i] );
 		cur += count;
 	}
 
+	if ( handle->use_prefetch ) {
+		artio_grid_prefetch_sfc_range(handle, start, end);
+	}
+
 	return ARTIO_SUCCESS;
 }
 
@@ -611,8 +703,11 @@ int artio_grid_clear_sfc_cache( artio_fileset *handle ) {
     ghandle = handle->grid;
 
 	if ( ghandle->sfc_offset_table != NULL ) {
-		free(ghandle->sfc_offset_table);
+		if ( !ghandle->sfc_offset_table_borrowed ) {
+			free(ghandle->sfc_offset_table);
+		}
 		ghandle->sfc_offset_table = NULL;
+		ghandle->sfc_offset_table_borrowed = 0;
 	}
 
     ghandle->cache_sfc_begin = -1;
@@ -945,6 +1040,44 @@ int artio_grid_read_root_cell_begin(artio_fileset *handle, int64_t sfc,
 	return ARTIO_SUCCESS;
 }
 
+int artio_grid_read_root_cell_levels(artio_fileset *handle, int64_t sfc,
+		int *num_oct_levels, int *num_octs_per_level) {
+	int i;
+	int ret;
+	int64_t first;
+	artio_index_file *ihandle;
+
+	if ( handle == NULL ) {
+		return ARTIO_ERR_INVALID_HANDLE;
+	}
+
+	if (handle->open_mode != ARTIO_FILESET_READ || 
+			!(handle->open_type & ARTIO_OPEN_GRID) ||
+			handle->grid == NULL ) {
+		return ARTIO_ERR_INVALID_FILESET_MODE;
+	}
+
+	ihandle = handle->index;
+	if ( ihandle != NULL && ihandle->grid_level_offset != NULL ) {
+		if ( sfc < 0 || sfc >= handle->num_root_cells ) {
+			return ARTIO_ERR_INVALID_SFC;
+		}
+
+		first = ihandle->grid_level_offset[sfc];
+		*num_oct_levels = (int)(ihandle->grid_level_offset[sfc+1] - first);
+		for ( i = 0; i < *num_oct_levels; i++ ) {
+			num_octs_per_level[i] = ihandle->grid_octs_per_level[first + i];
+		}
+		return ARTIO_SUCCESS;
+	}
+
+	ret = artio_grid_read_root_cell_begin( handle, sfc, NULL, NULL,
+			num_oct_levels, num_octs_per_level );
+	if ( ret != ARTIO_SUCCESS ) return ret;
+
+	return artio_grid_read_root_cell_end( handle );
+}
+
 int artio_grid_read_oct(artio_fileset *handle, 
 		double *pos,
 		float *variables,
@@ -952,6 +1085,7 @@ int artio_grid_read_oct(artio_fileset *handle,
 	int i, j;
 	int ret;
 	int local_refined[8];
+	int *oct_refined = local_refined;
 	artio_grid_file *ghandle;
 
 	if ( handle == NULL ) {
@@ -988,7 +1122,10 @@ int artio_grid_read_oct(artio_fileset *handle,
 		ret = artio_file_fseek(ghandle->ffh[ghandle->cur_file],
 				8*sizeof(int), ARTIO_SEEK_CUR );
 		if ( ret != ARTIO_SUCCESS ) return ret;
-	} else {
+	} else if ( artio_file_fread_direct(ghandle->ffh[ghandle->cur_file],
+				(void **)&oct_refined, 8, ARTIO_TYPE_INT) != ARTIO_SUCCESS ) {
+		/* not mapped, read a private copy */
+		oct_refined = local_refined;
 		ret = artio_file_fread(ghandle->ffh[ghandle->cur_file], 
 				local_refined, 8, ARTIO_TYPE_INT);
 		if ( ret != ARTIO_SUCCESS ) return ret;
@@ -996,7 +1133,7 @@ int artio_grid_read_oct(artio_fileset *handle,
 
 	if ( refined != NULL ) {
 		for ( i = 0; i < 8; i++ ) {
-			refined[i] = local_refined[i];
+			refined[i] = oct_refined[i];
 		}
 	}
 
@@ -1008,7 +1145,7 @@ int artio_grid_read_oct(artio_fileset *handle,
 		}
 
 		for ( i = 0; i < 8; i++ ) {
-			if ( local_refined[i] ) {
+			if ( oct_refined[i] ) {
 				if ( ghandle->next_level_oct >= ghandle->next_level_size ) {
 					return ARTIO_ERR_INVALID_STATE;
 				}
@@ -1168,8 +1305,10 @@ int artio_grid_read_sfc_range_levels(artio_fileset *handle,
 	int refined;
 	int oct_refined[8];
 	int root_tree_levels;
+	int prune, selected;
 	float *variables = NULL;
 	double pos[3], cell_pos[3];
+	double left[3], right[3];
 
 	artio_grid_file *ghandle;
 
@@ -1223,6 +1362,23 @@ int artio_grid_read_sfc_range_levels(artio_fileset *handle,
 			return ret;
 		}
 
+		/* skip root cells, and below them whole levels, whose extent
+		 * the volume test rejects: every oct at a deeper level lies
+		 * inside an oct of the level above */
+		prune = 0;
+		if ( ghandle->volume_test != NULL ) {
+			for ( j = 0; j < 3; j++ ) {
+				left[j] = pos[j] - 0.5;
+				right[j] = pos[j] + 0.5;
+			}
+			prune = ghandle->volume_test( left, right, ghandle->volume_params );
+			if ( prune == ARTIO_SELECT_OUTSIDE ) {
+				artio_grid_read_root_cell_end(handle);
+				continue;
+			}
+			prune = ( prune == ARTIO_SELECT_PARTIAL );
+		}
+
 		if (min_level_to_read == 0 && 
 				((options & ARTIO_READ_REFINED && root_tree_levels > 0) || 
 				(options & ARTIO_READ_LEAFS && root_tree_levels == 0)) ) {
@@ -1239,7 +1395,29 @@ int artio_grid_read_sfc_range_levels(artio_fileset *handle,
 				return ret;
 			}
 
+			selected = 0;
 			for (oct = 0; oct < octs_per_level[level - 1]; oct++) {
+				if ( prune ) {
+					/* octs are 2 cells of this level across */
+					for ( j = 0; j < 3; j++ ) {
+						left[j] = ghandle->cur_level_pos[3*oct + j] - ghandle->cell_size_level;
+						right[j] = ghandle->cur_level_pos[3*oct + j] + ghandle->cell_size_level;
+					}
+					if ( ghandle->volume_test( left, right, 
+							ghandle->volume_params ) == ARTIO_SELECT_OUTSIDE ) {
+						/* the refined flags are still needed to place 
+						 * the next level */
+						ret = artio_grid_read_oct(handle, pos, NULL, oct_refined);
+						if ( ret != ARTIO_SUCCESS ) {
+							free(octs_per_level);
+							free(variables);
+							return ret;
+						}
+						continue;
+					}
+				}
+				selected++;
+
 				ret = artio_grid_read_oct(handle, pos, variables, oct_refined);
 				if ( ret != ARTIO_SUCCESS ) {
 					free(octs_per_level);
@@ -1264,6 +1442,10 @@ int artio_grid_read_sfc_range_levels(artio_fileset *handle,
 				}
 			}
 			artio_grid_read_level_end(handle);
+
+			if ( selected == 0 ) {
+				break;
+			}
 		}
 		artio_grid_read_root_cell_end(handle);
 	}
@@ -1276,6 +1458,224 @@ int artio_grid_read_sfc_range_levels(artio_fileset *handle,
 	return ARTIO_SUCCESS;
 }
 
+int artio_grid_set_volume_test(artio_fileset *handle,
+		artio_selection_volume_test test, void *params ) {
+	if ( handle == NULL ) {
+		return ARTIO_ERR_INVALID_HANDLE;
+	}
+
+	if (handle->open_mode != ARTIO_FILESET_READ ||
+			!(handle->open_type & ARTIO_OPEN_GRID) ||
+			handle->grid == NULL ) {
+		return ARTIO_ERR_INVALID_FILESET_MODE;
+	}
+
+	handle->grid->volume_test = test;
+	handle->grid->volume_params = params;
+
+	return ARTIO_SUCCESS;
+}
+
+int artio_grid_max_threads(void) {
+#if defined(_OPENMP) && !defined(ARTIO_MPI)
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+/*
+ * Builds a private grid component for reading [start,end] alongside the
+ * grid of handle: it shares no file handles, buffers or cursor state with
+ * the parent, and holds its own copy of the slice of the parent's cached
+ * sfc offset table.
+ */
+artio_grid_file *artio_grid_file_clone_range(artio_fileset *handle,
+		int64_t start, int64_t end) {
+	int i;
+	int mode;
+	int first_file, last_file;
+	char filename[256];
+	artio_grid_file *ghandle = handle->grid;
+	artio_grid_file *thandle;
+
+	thandle = artio_grid_file_allocate();
+	if ( thandle == NULL ) {
+		return NULL;
+	}
+
+	thandle->num_grid_variables = ghandle->num_grid_variables;
+	thandle->num_grid_files = ghandle->num_grid_files;
+	thandle->file_max_level = ghandle->file_max_level;
+	thandle->volume_test = ghandle->volume_test;
+	thandle->volume_params = ghandle->volume_params;
+
+	thandle->file_sfc_index = (int64_t *)malloc(sizeof(int64_t) * (thandle->num_grid_files + 1));
+	thandle->octs_per_level = (int *)malloc(thandle->file_max_level * sizeof(int));
+	thandle->ffh = (artio_fh **)malloc(thandle->num_grid_files * sizeof(artio_fh *));
+	thandle->sfc_offset_table = (int64_t *)malloc(sizeof(int64_t) * (size_t)(end - start + 1));
+	if ( thandle->file_sfc_index == NULL || thandle->octs_per_level == NULL ||
+			thandle->ffh == NULL || thandle->sfc_offset_table == NULL ) {
+		artio_grid_file_destroy(thandle);
+		return NULL;
+	}
+
+	memcpy( thandle->file_sfc_index, ghandle->file_sfc_index,
+			sizeof(int64_t) * (thandle->num_grid_files + 1) );
+	memcpy( thandle->sfc_offset_table,
+			&ghandle->sfc_offset_table[start - ghandle->cache_sfc_begin],
+			sizeof(int64_t) * (size_t)(end - start + 1) );
+	thandle->cache_sfc_begin = start;
+	thandle->cache_sfc_end = end;
+
+	for ( i = 0; i < thandle->num_grid_files; i++ ) {
+		thandle->ffh[i] = NULL;
+	}
+
+	first_file = artio_grid_find_file(thandle, 0, thandle->num_grid_files, start);
+	last_file = artio_grid_find_file(thandle, first_file, thandle->num_grid_files, end);
+
+	for ( i = first_file; i <= last_file; i++ ) {
+		snprintf(filename, sizeof(filename), "%s.g%03d", handle->file_prefix, i);
+
+		mode = ARTIO_MODE_READ | ARTIO_MODE_ACCESS;
+		if ( handle->endian_swap ) {
+			mode |= ARTIO_MODE_ENDIAN_SWAP;
+		}
+		if ( handle->use_mmap ) {
+			mode |= ARTIO_MODE_MMAP;
+		}
+
+		thandle->ffh[i] = artio_file_fopen(filename, mode, handle->context);
+		if ( thandle->ffh[i] == NULL ) {
+			artio_grid_file_destroy(thandle);
+			return NULL;
+		}
+	}
+
+	return thandle;
+}
+
+int artio_grid_read_sfc_range_levels_threaded(artio_fileset *handle,
+		int64_t sfc1, int64_t sfc2,
+		int min_level_to_read, int max_level_to_read,
+		int options, int num_threads,
+		artio_grid_callback callback,
+		void **params ) {
+	int t;
+	int ret;
+	int64_t num_sfc;
+#ifndef ARTIO_MPI
+	int *thread_ret;
+	int use_prefetch;
+	int64_t cache_begin, cache_end;
+#endif
+
+	if ( handle == NULL ) {
+		return ARTIO_ERR_INVALID_HANDLE;
+	}
+
+	if (handle->open_mode != ARTIO_FILESET_READ ||
+			!(handle->open_type & ARTIO_OPEN_GRID) ||
+			handle->grid == NULL ) {
+		return ARTIO_ERR_INVALID_FILESET_MODE;
+	}
+
+	if ( num_threads < 1 ) {
+		return ARTIO_ERR_INVALID_STATE;
+	}
+
+	if ( sfc1 > sfc2 ) {
+		return ARTIO_ERR_INVALID_SFC_RANGE;
+	}
+
+	num_sfc = sfc2 - sfc1 + 1;
+	if ( num_threads > num_sfc ) {
+		num_threads = (int)num_sfc;
+	}
+
+#ifdef ARTIO_MPI
+	/* file opens are collective, so slices reuse the shared handles */
+	for ( t = 0; t < num_threads; t++ ) {
+		if ( sfc1 + num_sfc*t/num_threads <= sfc1 + num_sfc*(t+1)/num_threads - 1 ) {
+			ret = artio_grid_read_sfc_range_levels( handle,
+					sfc1 + num_sfc*t/num_threads,
+					sfc1 + num_sfc*(t+1)/num_threads - 1,
+					min_level_to_read, max_level_to_read,
+					options, callback, params[t] );
+			if ( ret != ARTIO_SUCCESS ) return ret;
+		}
+	}
+	return ARTIO_SUCCESS;
+#else
+	/* read the offsets once, each slice copies its part; a range the
+	 * caller has cached is put back afterwards */
+	cache_begin = handle->grid->cache_sfc_begin;
+	cache_end = handle->grid->cache_sfc_end;
+	/* slices read ahead on their own cloned handles, not the parent's */
+	use_prefetch = handle->use_prefetch;
+	handle->use_prefetch = 0;
+	ret = artio_grid_cache_sfc_range(handle, sfc1, sfc2);
+	handle->use_prefetch = use_prefetch;
+	if ( ret != ARTIO_SUCCESS ) return ret;
+
+	thread_ret = (int *)malloc(num_threads * sizeof(int));
+	if ( thread_ret == NULL ) {
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(num_threads) schedule(static,1)
+#endif
+	for ( t = 0; t < num_threads; t++ ) {
+		int64_t start = sfc1 + num_sfc*t/num_threads;
+		int64_t end = sfc1 + num_sfc*(t+1)/num_threads - 1;
+		artio_fileset thread_handle;
+
+		thread_ret[t] = ARTIO_SUCCESS;
+		if ( start > end ) continue;
+
+		/* shallow copy of the fileset with a private grid cursor */
+		thread_handle = *handle;
+		thread_handle.grid = artio_grid_file_clone_range(handle, start, end);
+		if ( thread_handle.grid == NULL ) {
+			thread_ret[t] = ARTIO_ERR_MEMORY_ALLOCATION;
+			continue;
+		}
+
+		thread_ret[t] = artio_grid_read_sfc_range_levels( &thread_handle,
+				start, end, min_level_to_read, max_level_to_read,
+				options, callback, params[t] );
+
+		artio_grid_file_destroy(thread_handle.grid);
+	}
+
+	ret = ARTIO_SUCCESS;
+	for ( t = 0; t < num_threads; t++ ) {
+		if ( thread_ret[t] != ARTIO_SUCCESS ) {
+			ret = thread_ret[t];
+			break;
+		}
+	}
+	free(thread_ret);
+
+	if ( cache_begin == -1 ) {
+		artio_grid_clear_sfc_cache(handle);
+	} else if ( handle->grid->cache_sfc_begin != cache_begin ||
+			handle->grid->cache_sfc_end != cache_end ) {
+		use_prefetch = handle->use_prefetch;
+		handle->use_prefetch = 0;
+		if ( artio_grid_cache_sfc_range(handle, cache_begin, cache_end)
+				!= ARTIO_SUCCESS ) {
+			artio_grid_clear_sfc_cache(handle);
+		}
+		handle->use_prefetch = use_prefetch;
+	}
+
+	return ret;
+#endif /* ARTIO_MPI */
+}
+
 int artio_grid_read_sfc_range(artio_fileset *handle,
         int64_t sfc1, int64_t sfc2,
 		int options,
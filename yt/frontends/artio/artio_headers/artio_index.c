@@ -0,0 +1,580 @@
+/**********************************************************************
+ * Copyright (c) 2012-2013, Douglas H. Rudd
+ * All rights reserved.
+ *
+ * This file is part of the artio library.
+ *
+ * artio is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * artio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * Copies of the GNU Lesser General Public License and the GNU General
+ * Public License are available in the file LICENSE, included with this
+ * distribution.  If you failed to receive a copy of this file, see
+ * <http://www.gnu.org/licenses/>
+ **********************************************************************/
+
+#include "artio.h"
+#include "artio_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+typedef __int64 int64_t;
+typedef __int32 int32_t;
+#else
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/*
+ * Sidecar layout (native byte order, every section 8-byte aligned):
+ *
+ *   artio_index_header
+ *   int64_t file_info[2*num_files]      size and mtime (ns) of each data file
+ *   int64_t grid_sfc_offset[N]                      } ARTIO_OPEN_GRID
+ *   int64_t grid_level_offset[N+1]                  }
+ *   int64_t particle_sfc_offset[N]                  } ARTIO_OPEN_PARTICLES
+ *   int32_t particle_num_particles[N*num_species]   }
+ *   int32_t grid_octs_per_level[L]                    ARTIO_OPEN_GRID
+ *
+ * where N is the number of root cells.  Only the levels a root cell
+ * actually has are stored: the oct counts of root cell sfc are
+ * grid_octs_per_level[grid_level_offset[sfc] .. grid_level_offset[sfc+1]-1],
+ * and L = grid_level_offset[N] is the total number of levels.  They come
+ * last since L is only known once every root cell has been read.  A
+ * sidecar written on a machine of different endianness fails the magic
+ * check and is rebuilt.
+ */
+#define ARTIO_INDEX_MAGIC		0x5844494f49545241LL	/* "ARTIOIDX" */
+#define ARTIO_INDEX_VERSION		2
+
+#define ARTIO_INDEX_ALIGN(x)	(((x) + 7) & ~(int64_t)7)
+
+typedef struct artio_index_header_struct {
+	int64_t magic;
+	int64_t version;
+	int64_t components;
+	int64_t num_root_cells;
+	int64_t num_levels;
+	int64_t num_species;
+	int64_t num_files;
+	int64_t num_grid_levels;
+} artio_index_header;
+
+/* modification time with the sub-second part where the platform has it */
+#if defined(_WIN32)
+#define ARTIO_INDEX_MTIME_NS(st)	((int64_t)(st).st_mtime*1000000000LL)
+#elif defined(__APPLE__)
+#define ARTIO_INDEX_MTIME_NS(st)	((int64_t)(st).st_mtimespec.tv_sec*1000000000LL + \
+		(int64_t)(st).st_mtimespec.tv_nsec)
+#else
+#define ARTIO_INDEX_MTIME_NS(st)	((int64_t)(st).st_mtim.tv_sec*1000000000LL + \
+		(int64_t)(st).st_mtim.tv_nsec)
+#endif
+
+int artio_index_file_info( artio_fileset *handle, int components,
+		int64_t **file_info, int *num_files );
+int64_t artio_index_layout( artio_index_file *ihandle, int64_t num_root_cells,
+		int num_files, int64_t num_grid_levels, char *base );
+char *artio_index_filename( artio_fileset *handle, const char *suffix );
+int artio_index_load( artio_fileset *handle, artio_index_file *ihandle,
+		char *filename, int64_t *file_info, int num_files );
+int artio_index_build( artio_fileset *handle, artio_index_file *ihandle,
+		int64_t *file_info, int num_files );
+int artio_index_write( artio_index_file *ihandle, char *filename );
+
+/*
+ * Size and modification time of the header and of every data file
+ * belonging to the indexed components, used to detect stale sidecars.
+ */
+int artio_index_file_info( artio_fileset *handle, int components,
+		int64_t **file_info, int *num_files ) {
+	int i, n;
+	size_t length;
+	char *filename;
+	struct stat st;
+
+	n = 1;
+	if ( components & ARTIO_OPEN_GRID ) {
+		n += handle->grid->num_grid_files;
+	}
+	if ( components & ARTIO_OPEN_PARTICLES ) {
+		n += handle->particle->num_particle_files;
+	}
+
+	*file_info = (int64_t *)malloc( 2*n*sizeof(int64_t) );
+	if ( *file_info == NULL ) {
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+	*num_files = n;
+
+	/* room for the prefix, ".p" and any int */
+	length = strlen( handle->file_prefix ) + 16;
+	filename = (char *)malloc( length );
+	if ( filename == NULL ) {
+		free( *file_info );
+		*file_info = NULL;
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		if ( i == 0 ) {
+			snprintf( filename, length, "%s.art", handle->file_prefix );
+		} else if ( (components & ARTIO_OPEN_GRID) &&
+				i <= handle->grid->num_grid_files ) {
+			snprintf( filename, length, "%s.g%03d", handle->file_prefix, i-1 );
+		} else {
+			snprintf( filename, length, "%s.p%03d", handle->file_prefix,
+				i - 1 - ((components & ARTIO_OPEN_GRID) ?
+					handle->grid->num_grid_files : 0) );
+		}
+
+		if ( stat( filename, &st ) != 0 ) {
+			free( filename );
+			free( *file_info );
+			*file_info = NULL;
+			return ARTIO_ERR_INVALID_FILE_MODE;
+		}
+		(*file_info)[2*i] = (int64_t)st.st_size;
+		(*file_info)[2*i+1] = ARTIO_INDEX_MTIME_NS(st);
+	}
+
+	free( filename );
+	return ARTIO_SUCCESS;
+}
+
+/*
+ * The file prefix with suffix appended, or NULL if it cannot be allocated.
+ */
+char *artio_index_filename( artio_fileset *handle, const char *suffix ) {
+	size_t length;
+	char *filename;
+
+	length = strlen( handle->file_prefix ) + strlen( suffix ) + 1;
+	filename = (char *)malloc( length );
+	if ( filename == NULL ) {
+		return NULL;
+	}
+	if ( snprintf( filename, length, "%s%s", handle->file_prefix, suffix )
+			!= (int)(length - 1) ) {
+		free( filename );
+		return NULL;
+	}
+	return filename;
+}
+
+/*
+ * Point the index arrays into base (which may be NULL to only compute
+ * the size) and return the total size of the block.
+ */
+int64_t artio_index_layout( artio_index_file *ihandle, int64_t num_root_cells,
+		int num_files, int64_t num_grid_levels, char *base ) {
+	int64_t size;
+
+	size = sizeof(artio_index_header) + 2*num_files*sizeof(int64_t);
+
+	ihandle->num_root_cells = num_root_cells;
+	ihandle->grid_sfc_offset = NULL;
+	ihandle->grid_level_offset = NULL;
+	ihandle->grid_octs_per_level = NULL;
+	ihandle->particle_sfc_offset = NULL;
+	ihandle->particle_num_particles = NULL;
+
+	if ( ihandle->components & ARTIO_OPEN_GRID ) {
+		if ( base != NULL ) ihandle->grid_sfc_offset = (int64_t *)(base + size);
+		size += num_root_cells*sizeof(int64_t);
+		if ( base != NULL ) ihandle->grid_level_offset = (int64_t *)(base + size);
+		size += (num_root_cells+1)*sizeof(int64_t);
+	}
+
+	if ( ihandle->components & ARTIO_OPEN_PARTICLES ) {
+		if ( base != NULL ) ihandle->particle_sfc_offset = (int64_t *)(base + size);
+		size += num_root_cells*sizeof(int64_t);
+		if ( base != NULL ) ihandle->particle_num_particles = (int32_t *)(base + size);
+		size += ARTIO_INDEX_ALIGN( num_root_cells*ihandle->num_species*sizeof(int32_t) );
+	}
+
+	if ( ihandle->components & ARTIO_OPEN_GRID ) {
+		if ( base != NULL ) ihandle->grid_octs_per_level = (int32_t *)(base + size);
+		size += ARTIO_INDEX_ALIGN( num_grid_levels*sizeof(int32_t) );
+	}
+
+	return size;
+}
+
+int artio_index_load( artio_fileset *handle, artio_index_file *ihandle,
+		char *filename, int64_t *file_info, int num_files ) {
+	int64_t size;
+	artio_index_header header;
+	FILE *fh;
+	char *data;
+
+	fh = fopen( filename, "rb" );
+	if ( fh == NULL ) {
+		return ARTIO_ERR_INVALID_FILE_MODE;
+	}
+
+	if ( fread( &header, sizeof(artio_index_header), 1, fh ) != 1 ||
+			header.magic != ARTIO_INDEX_MAGIC ||
+			header.version != ARTIO_INDEX_VERSION ||
+			header.components != ihandle->components ||
+			header.num_root_cells != handle->num_root_cells ||
+			header.num_levels != ihandle->num_levels ||
+			header.num_species != ihandle->num_species ||
+			header.num_files != num_files ||
+			header.num_grid_levels < 0 ||
+			header.num_grid_levels > handle->num_root_cells*ihandle->num_levels ) {
+		fclose(fh);
+		return ARTIO_ERR_INVALID_FILE_MODE;
+	}
+
+	size = artio_index_layout( ihandle, handle->num_root_cells, num_files,
+			header.num_grid_levels, NULL );
+
+#ifdef _WIN32
+	data = (char *)malloc( size );
+	if ( data == NULL ) {
+		fclose(fh);
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+	if ( fseek( fh, 0, SEEK_SET ) != 0 ||
+			fread( data, 1, size, fh ) != (size_t)size ||
+			fgetc( fh ) != EOF ) {
+		free(data);
+		fclose(fh);
+		return ARTIO_ERR_INVALID_FILE_MODE;
+	}
+	fclose(fh);
+	ihandle->mapped = 0;
+#else
+	{
+		struct stat st;
+		if ( fstat( fileno(fh), &st ) != 0 || (int64_t)st.st_size != size ) {
+			fclose(fh);
+			return ARTIO_ERR_INVALID_FILE_MODE;
+		}
+	}
+
+	data = (char *)mmap( NULL, size, PROT_READ, MAP_SHARED, fileno(fh), 0 );
+	fclose(fh);
+	if ( data == MAP_FAILED ) {
+		return ARTIO_ERR_INVALID_FILE_MODE;
+	}
+	ihandle->mapped = 1;
+#endif /* _WIN32 */
+
+	/* stale if any data file changed since the sidecar was written */
+	if ( memcmp( data + sizeof(artio_index_header), file_info,
+			2*num_files*sizeof(int64_t) ) != 0 ) {
+#ifdef _WIN32
+		free(data);
+#else
+		munmap(data, size);
+#endif
+		return ARTIO_ERR_INVALID_FILE_MODE;
+	}
+
+	ihandle->data = data;
+	ihandle->size = size;
+	artio_index_layout( ihandle, handle->num_root_cells, num_files,
+			header.num_grid_levels, data );
+
+	return ARTIO_SUCCESS;
+}
+
+int artio_index_build( artio_fileset *handle, artio_index_file *ihandle,
+		int64_t *file_info, int num_files ) {
+	int i, ret;
+	int num_levels;
+	int64_t sfc, size;
+	int64_t num_grid_levels, levels_size;
+	int *num_octs_per_level = NULL;
+	int32_t *octs_per_level = NULL;
+	int32_t *tmp;
+	artio_index_header *header;
+	char *data, *tmp_data;
+
+	/* everything but the compact oct counts, whose size is not known yet */
+	size = artio_index_layout( ihandle, handle->num_root_cells, num_files, 0, NULL );
+	data = (char *)malloc( size );
+	if ( data == NULL ) {
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+	memset( data, 0, size );
+	artio_index_layout( ihandle, handle->num_root_cells, num_files, 0, data );
+
+	num_grid_levels = 0;
+	if ( ihandle->components & ARTIO_OPEN_GRID ) {
+		num_octs_per_level = (int *)malloc( (ihandle->num_levels+1)*sizeof(int) );
+		levels_size = 1024;
+		octs_per_level = (int32_t *)malloc( levels_size*sizeof(int32_t) );
+		if ( num_octs_per_level == NULL || octs_per_level == NULL ) {
+			ret = ARTIO_ERR_MEMORY_ALLOCATION;
+			goto fail;
+		}
+
+		ret = artio_grid_cache_sfc_range( handle, 0, handle->num_root_cells-1 );
+		if ( ret != ARTIO_SUCCESS ) goto fail;
+
+		memcpy( ihandle->grid_sfc_offset, handle->grid->sfc_offset_table,
+				handle->num_root_cells*sizeof(int64_t) );
+
+		ihandle->grid_level_offset[0] = 0;
+		for ( sfc = 0; sfc < handle->num_root_cells; sfc++ ) {
+			ret = artio_grid_read_root_cell_begin( handle, sfc, NULL, NULL,
+					&num_levels, num_octs_per_level );
+			if ( ret != ARTIO_SUCCESS ) goto fail;
+			ret = artio_grid_read_root_cell_end( handle );
+			if ( ret != ARTIO_SUCCESS ) goto fail;
+
+			if ( num_grid_levels + num_levels > levels_size ) {
+				levels_size = 2*(num_grid_levels + num_levels);
+				tmp = (int32_t *)realloc( octs_per_level, levels_size*sizeof(int32_t) );
+				if ( tmp == NULL ) {
+					ret = ARTIO_ERR_MEMORY_ALLOCATION;
+					goto fail;
+				}
+				octs_per_level = tmp;
+			}
+			for ( i = 0; i < num_levels; i++ ) {
+				octs_per_level[num_grid_levels++] = num_octs_per_level[i];
+			}
+			ihandle->grid_level_offset[sfc+1] = num_grid_levels;
+		}
+
+		artio_grid_clear_sfc_cache( handle );
+	}
+
+	if ( ihandle->components & ARTIO_OPEN_PARTICLES ) {
+		ret = artio_particle_cache_sfc_range( handle, 0, handle->num_root_cells-1 );
+		if ( ret != ARTIO_SUCCESS ) goto fail;
+
+		memcpy( ihandle->particle_sfc_offset, handle->particle->sfc_offset_table,
+				handle->num_root_cells*sizeof(int64_t) );
+
+		for ( sfc = 0; sfc < handle->num_root_cells; sfc++ ) {
+			ret = artio_particle_read_root_cell_begin( handle, sfc,
+					&ihandle->particle_num_particles[sfc*ihandle->num_species] );
+			if ( ret != ARTIO_SUCCESS ) goto fail;
+
+			ret = artio_particle_read_root_cell_end( handle );
+			if ( ret != ARTIO_SUCCESS ) goto fail;
+		}
+
+		artio_particle_clear_sfc_cache( handle );
+	}
+
+	/* append the compact oct counts */
+	size = artio_index_layout( ihandle, handle->num_root_cells, num_files,
+			num_grid_levels, NULL );
+	tmp_data = (char *)realloc( data, size );
+	if ( tmp_data == NULL ) {
+		ret = ARTIO_ERR_MEMORY_ALLOCATION;
+		goto fail;
+	}
+	data = tmp_data;
+	artio_index_layout( ihandle, handle->num_root_cells, num_files,
+			num_grid_levels, data );
+	if ( ihandle->components & ARTIO_OPEN_GRID ) {
+		/* zero the alignment padding as well */
+		memset( ihandle->grid_octs_per_level, 0,
+				data + size - (char *)ihandle->grid_octs_per_level );
+		memcpy( ihandle->grid_octs_per_level, octs_per_level,
+				num_grid_levels*sizeof(int32_t) );
+	}
+	free( num_octs_per_level );
+	free( octs_per_level );
+
+	header = (artio_index_header *)data;
+	header->magic = ARTIO_INDEX_MAGIC;
+	header->version = ARTIO_INDEX_VERSION;
+	header->components = ihandle->components;
+	header->num_root_cells = handle->num_root_cells;
+	header->num_levels = ihandle->num_levels;
+	header->num_species = ihandle->num_species;
+	header->num_files = num_files;
+	header->num_grid_levels = num_grid_levels;
+	memcpy( data + sizeof(artio_index_header), file_info,
+			2*num_files*sizeof(int64_t) );
+
+	ihandle->data = data;
+	ihandle->size = size;
+	ihandle->mapped = 0;
+
+	return ARTIO_SUCCESS;
+
+fail:
+	free( num_octs_per_level );
+	free( octs_per_level );
+	free( data );
+	return ret;
+}
+
+/*
+ * Write through a temporary file so readers never see a partial sidecar.
+ */
+int artio_index_write( artio_index_file *ihandle, char *filename ) {
+	size_t length;
+	char *tmpname;
+	FILE *fh;
+	int ret = ARTIO_SUCCESS;
+
+	length = strlen( filename ) + 5;
+	tmpname = (char *)malloc( length );
+	if ( tmpname == NULL ) {
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+	snprintf( tmpname, length, "%s.tmp", filename );
+
+	fh = fopen( tmpname, "wb" );
+	if ( fh == NULL ) {
+		free( tmpname );
+		return ARTIO_ERR_FILE_CREATE;
+	}
+
+	if ( fwrite( ihandle->data, 1, ihandle->size, fh ) != (size_t)ihandle->size ) {
+		fclose(fh);
+		remove(tmpname);
+		ret = ARTIO_ERR_IO_WRITE;
+	} else if ( fclose(fh) != 0 || rename( tmpname, filename ) != 0 ) {
+		remove(tmpname);
+		ret = ARTIO_ERR_IO_WRITE;
+	}
+
+	free( tmpname );
+	return ret;
+}
+
+int artio_fileset_open_index( artio_fileset *handle ) {
+#ifdef ARTIO_MPI
+	return ARTIO_ERR_INVALID_FILESET_MODE;
+#else
+	int ret;
+	int num_files;
+	int64_t *file_info;
+	char *filename;
+	artio_index_file *ihandle;
+
+	if ( handle == NULL ) {
+		return ARTIO_ERR_INVALID_HANDLE;
+	}
+
+	if ( handle->open_mode != ARTIO_FILESET_READ ||
+			!(handle->open_type & (ARTIO_OPEN_GRID | ARTIO_OPEN_PARTICLES)) ) {
+		return ARTIO_ERR_INVALID_FILESET_MODE;
+	}
+
+	/* re-index if components were opened since the last call */
+	if ( handle->index != NULL ) {
+		artio_fileset_close_index( handle );
+	}
+
+	ihandle = (artio_index_file *)malloc( sizeof(artio_index_file) );
+	if ( ihandle == NULL ) {
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+	ihandle->data = NULL;
+	ihandle->size = 0;
+	ihandle->mapped = 0;
+	ihandle->num_root_cells = 0;
+	ihandle->components = handle->open_type & (ARTIO_OPEN_GRID | ARTIO_OPEN_PARTICLES);
+	ihandle->num_levels = ( handle->grid != NULL ) ? handle->grid->file_max_level : 0;
+	ihandle->num_species = ( handle->particle != NULL ) ? handle->particle->num_species : 0;
+
+	ret = artio_index_file_info( handle, ihandle->components, &file_info, &num_files );
+	if ( ret != ARTIO_SUCCESS ) {
+		free(ihandle);
+		return ret;
+	}
+
+	filename = artio_index_filename( handle, ".sfc_index" );
+	if ( filename == NULL ) {
+		free( ihandle );
+		free( file_info );
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+
+	if ( artio_index_load( handle, ihandle, filename, file_info, num_files ) != ARTIO_SUCCESS ) {
+		ret = artio_index_build( handle, ihandle, file_info, num_files );
+		if ( ret != ARTIO_SUCCESS ) {
+			/* leave the fileset as it was, reading its own offsets */
+			if ( handle->grid != NULL ) {
+				artio_grid_clear_sfc_cache( handle );
+			}
+			if ( handle->particle != NULL ) {
+				artio_particle_clear_sfc_cache( handle );
+			}
+			free( ihandle );
+			free( file_info );
+			free( filename );
+			return ret;
+		}
+
+		/* keep the in-memory index if the directory is read-only */
+		artio_index_write( ihandle, filename );
+	}
+
+	free( file_info );
+	free( filename );
+	handle->index = ihandle;
+
+	/* later caches borrow their offsets from the index */
+	if ( handle->grid != NULL ) {
+		artio_grid_clear_sfc_cache( handle );
+	}
+	if ( handle->particle != NULL ) {
+		artio_particle_clear_sfc_cache( handle );
+	}
+
+	return ARTIO_SUCCESS;
+#endif /* ARTIO_MPI */
+}
+
+int artio_fileset_close_index( artio_fileset *handle ) {
+	artio_index_file *ihandle;
+
+	if ( handle == NULL ) {
+		return ARTIO_ERR_INVALID_HANDLE;
+	}
+
+	if ( handle->index == NULL ) {
+		return ARTIO_ERR_INVALID_FILESET_MODE;
+	}
+
+	/* drop any tables still borrowed from the index */
+	if ( handle->grid != NULL && handle->grid->sfc_offset_table_borrowed ) {
+		artio_grid_clear_sfc_cache( handle );
+	}
+	if ( handle->particle != NULL && handle->particle->sfc_offset_table_borrowed ) {
+		artio_particle_clear_sfc_cache( handle );
+	}
+
+	ihandle = handle->index;
+	if ( ihandle->data != NULL ) {
+#ifndef _WIN32
+		if ( ihandle->mapped ) {
+			munmap( ihandle->data, ihandle->size );
+		} else
+#endif
+		{
+			free( ihandle->data );
+		}
+	}
+	free( ihandle );
+	handle->index = NULL;
+
+	return ARTIO_SUCCESS;
+}
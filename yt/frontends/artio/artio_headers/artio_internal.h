@@ -76,6 +76,7 @@ typedef struct artio_particle_file_struct {
 	int64_t cache_sfc_begin;
 	int64_t cache_sfc_end;
 	int64_t *sfc_offset_table;
+	int sfc_offset_table_borrowed;
 
 	/* maintained for consistency and user-error detection */
 	int num_species;
@@ -100,6 +101,7 @@ typedef struct artio_grid_file_struct {
 	int64_t cache_sfc_begin;
 	int64_t cache_sfc_end;
 	int64_t *sfc_offset_table;
+	int sfc_offset_table_borrowed;
 
 	int file_max_level;
 	/* maintained for consistency and user-error detection */
@@ -118,9 +120,35 @@ typedef struct artio_grid_file_struct {
 	double *next_level_pos;
 	double *cur_level_pos;
 	int next_level_oct;
+
+	/* prunes the sfc range readers, see artio_grid_set_volume_test */
+	artio_selection_volume_test volume_test;
+	void *volume_params;
 	
 } artio_grid_file;
 
+/*
+ * Per root cell summary of the open grid and particle files, kept in the
+ * <prefix>.sfc_index sidecar.  The arrays point into a single block that
+ * is either the mapped sidecar or a malloc'd copy laid out identically.
+ */
+typedef struct artio_index_file_struct {
+	void *data;
+	int64_t size;
+	int mapped;
+
+	int components;
+	int num_levels;
+	int num_species;
+	int64_t num_root_cells;
+
+	int64_t *grid_sfc_offset;
+	int64_t *grid_level_offset;
+	int32_t *grid_octs_per_level;
+	int64_t *particle_sfc_offset;
+	int32_t *particle_num_particles;
+} artio_index_file;
+
 typedef struct parameter_struct {
 	int key_length;
 	char key[64];
@@ -150,6 +178,8 @@ struct artio_fileset_struct {
 	int64_t proc_sfc_begin;
 	int64_t proc_sfc_end;
 	int64_t num_root_cells;
+	int use_mmap;
+	int use_prefetch;
 	int sfc_type;
 	int nBitsPerDim;
 	int num_grid;
@@ -157,6 +187,7 @@ struct artio_fileset_struct {
 	parameter_list *parameters;
 	artio_grid_file *grid;
 	artio_particle_file *particle;
+	artio_index_file *index;
 };
 
 struct artio_selection_struct {
@@ -175,11 +206,23 @@ struct artio_selection_struct {
 #define ARTIO_MODE_WRITE        2
 #define ARTIO_MODE_ACCESS       4
 #define ARTIO_MODE_ENDIAN_SWAP  8
+#define ARTIO_MODE_MMAP         16
 
 #define ARTIO_SEEK_SET          0
 #define ARTIO_SEEK_CUR          1
 #define ARTIO_SEEK_END			2
 
+/* access pattern hints for artio_file_advise */
+#define ARTIO_ADVISE_NORMAL     0
+#define ARTIO_ADVISE_SEQUENTIAL 1
+#define ARTIO_ADVISE_WILLNEED   2
+#define ARTIO_ADVISE_DONTNEED   3
+
+/* size of each of the two read-ahead windows used by artio_file_prefetch */
+#ifndef ARTIO_PREFETCH_WINDOW
+#define ARTIO_PREFETCH_WINDOW   (1<<20)
+#endif
+
 /* wrapper functions for profiling and debugging */
 artio_fh *artio_file_fopen( char * filename, int amode, const artio_context *context );
 int artio_file_attach_buffer( artio_fh *handle, void *buf, int buf_size );
@@ -189,8 +232,14 @@ int artio_file_ftell( artio_fh *handle, int64_t *offset );
 int artio_file_fflush(artio_fh *handle);
 int artio_file_fseek(artio_fh *ffh, int64_t offset, int whence);
 int artio_file_fread(artio_fh *handle, void *buf, int64_t count, int type );
+/* hands out a pointer into a memory mapped file instead of copying; only the
+ * oct refinement flags are read this way, variables and particles are copied */
+int artio_file_fread_direct(artio_fh *handle, void **buf, int64_t count, int type );
+int artio_file_advise(artio_fh *handle, int64_t offset, int64_t length, int advice );
+int artio_file_prefetch(artio_fh *handle, int64_t offset, int64_t length );
 int artio_file_fclose(artio_fh *handle);
 void artio_file_set_endian_swap_tag(artio_fh *handle);
+int artio_file_get_endian_swap_tag(artio_fh *handle);
 
 /* internal versions */
 artio_fh *artio_file_fopen_i( char * filename, int amode, const artio_context *context );
@@ -201,8 +250,12 @@ int artio_file_ftell_i( artio_fh *handle, int64_t *offset );
 int artio_file_fflush_i(artio_fh *handle);
 int artio_file_fseek_i(artio_fh *ffh, int64_t offset, int whence);
 int artio_file_fread_i(artio_fh *handle, void *buf, int64_t count, int type );
+int artio_file_fread_direct_i(artio_fh *handle, void **buf, int64_t count, int type );
+int artio_file_advise_i(artio_fh *handle, int64_t offset, int64_t length, int advice );
+int artio_file_prefetch_i(artio_fh *handle, int64_t offset, int64_t length );
 int artio_file_fclose_i(artio_fh *handle);
 void artio_file_set_endian_swap_tag_i(artio_fh *handle);
+int artio_file_get_endian_swap_tag_i(artio_fh *handle);
 
 #define ARTIO_ENDIAN_MAGIC	0x1234
 
@@ -235,5 +288,7 @@ int artio_parameter_list_unpack(parameter_list *parameters, const char *key, int
 int64_t artio_sfc_index_position( artio_fileset *handle, double position[nDim] );
 int64_t artio_sfc_index( artio_fileset *handle, int coords[nDim] );
 void artio_sfc_coords( artio_fileset *handle, int64_t index, int coords[nDim] );
+int artio_sfc_index_array( artio_fileset *handle, int64_t count, const int *coords, int64_t *indices );
+int artio_sfc_coords_array( artio_fileset *handle, int64_t count, const int64_t *indices, int *coords );
 
 #endif /* __ARTIO_INTERNAL_H__ */
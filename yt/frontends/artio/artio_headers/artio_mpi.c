@@ -292,27 +292,31 @@ int artio_file_fread_i(artio_fh *handle, void *buf, int64_t count, int type ) {
 	}
 
 	if(handle->mode & ARTIO_MODE_ENDIAN_SWAP){
-		switch (type) {
-			case ARTIO_TYPE_INT :
-				artio_int_swap( (int32_t *)buf, count );
-				break;
-			case ARTIO_TYPE_FLOAT :
-				artio_float_swap( (float *)buf, count );
-				break;
-			case ARTIO_TYPE_DOUBLE :
-				artio_double_swap( (double *)buf, count );
-				break;
-			case ARTIO_TYPE_LONG :
-				artio_long_swap( (int64_t *)buf, count );
-				break;
-			default :
-				return ARTIO_ERR_INVALID_DATATYPE;
+		/* strings are never swapped */
+		if ( size == 4 ) {
+			artio_swap_copy_4( buf, buf, count );
+		} else if ( size == 8 ) {
+			artio_swap_copy_8( buf, buf, count );
 		}
 	}
 
 	return ARTIO_SUCCESS;
 }
 
+int artio_file_fread_direct_i(artio_fh *handle, void **buf, int64_t count, int type ) {
+	/* MPI-IO files are never memory mapped */
+	return ARTIO_ERR_INVALID_FILE_MODE;
+}
+
+int artio_file_advise_i(artio_fh *handle, int64_t offset, int64_t length, int advice ) {
+	return ARTIO_SUCCESS;
+}
+
+int artio_file_prefetch_i(artio_fh *handle, int64_t offset, int64_t length ) {
+	/* collective MPI-IO reads are not prefetched */
+	return ARTIO_SUCCESS;
+}
+
 int artio_file_ftell_i(artio_fh *handle, int64_t *offset) {
 	MPI_Offset current;
 	MPI_File_get_position( handle->fh, &current );
@@ -398,4 +402,8 @@ void artio_file_set_endian_swap_tag_i(artio_fh *handle) {
 	handle->mode |= ARTIO_MODE_ENDIAN_SWAP;
 }
 
+int artio_file_get_endian_swap_tag_i(artio_fh *handle) {
+	return ( handle->mode & ARTIO_MODE_ENDIAN_SWAP ) ? 1 : 0;
+}
+
 #endif /* MPI */
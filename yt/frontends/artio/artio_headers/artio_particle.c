@@ -128,6 +128,9 @@ int artio_fileset_open_particles(artio_fileset *handle) {
 		if (handle->endian_swap) {
 			mode |= ARTIO_MODE_ENDIAN_SWAP;
 		}
+		if (handle->use_mmap) {
+			mode |= ARTIO_MODE_MMAP;
+		}
 
 		phandle->ffh[i] = artio_file_fopen(filename, mode, handle->context);
 		if ( phandle->ffh[i] == NULL ) {
@@ -408,6 +411,7 @@ artio_particle_file *artio_particle_file_allocate(void) {
 		phandle->cache_sfc_begin = -1;
 		phandle->cache_sfc_end = -1;
 		phandle->sfc_offset_table = NULL;
+		phandle->sfc_offset_table_borrowed = 0;
 		phandle->num_species = -1;
 		phandle->cur_particle = -1;
 		phandle->cur_sfc = -1;
@@ -439,7 +443,9 @@ void artio_particle_file_destroy( artio_particle_file *phandle ) {
 	    free(phandle->ffh);
 	}
 
-    if (phandle->sfc_offset_table != NULL) free(phandle->sfc_offset_table);
+    if (phandle->sfc_offset_table != NULL && !phandle->sfc_offset_table_borrowed) {
+		free(phandle->sfc_offset_table);
+	}
     if (phandle->num_particles_per_species != NULL) free(phandle->num_particles_per_species);
 	if (phandle->num_primary_variables != NULL) free(phandle->num_primary_variables);
 	if (phandle->num_secondary_variables != NULL) free(phandle->num_secondary_variables);
@@ -463,12 +469,45 @@ int artio_fileset_close_particles(artio_fileset *handle) {
 	return ARTIO_SUCCESS;
 }
 
+static void artio_particle_prefetch_sfc_range(artio_fileset *handle,
+		int64_t start, int64_t end) {
+	int i;
+	int first_file, last_file;
+	int64_t first, last, offset, length;
+	artio_particle_file *phandle = handle->particle;
+
+	if ( phandle->cur_file != -1 ) {
+		/* buffered handles are not switched to read-ahead */
+		artio_file_detach_buffer( phandle->ffh[phandle->cur_file] );
+		phandle->cur_file = -1;
+	}
+
+	first_file = artio_particle_find_file(phandle, 0, phandle->num_particle_files, start);
+	last_file = artio_particle_find_file(phandle, first_file, phandle->num_particle_files, end);
+
+	for ( i = first_file; i <= last_file; i++ ) {
+		first = MAX( start, phandle->file_sfc_index[i] );
+		last = MIN( end, phandle->file_sfc_index[i+1] - 1 );
+		offset = phandle->sfc_offset_table[first - phandle->cache_sfc_begin];
+
+		if ( last+1 < phandle->file_sfc_index[i+1] && last+1 <= phandle->cache_sfc_end ) {
+			length = phandle->sfc_offset_table[last+1 - phandle->cache_sfc_begin] - offset;
+		} else {
+			/* read ahead to the end of the file */
+			length = -1;
+		}
+
+		artio_file_prefetch( phandle->ffh[i], offset, length );
+	}
+}
+
 int artio_particle_cache_sfc_range(artio_fileset *handle, 
 		int64_t start, int64_t end) {
 	int i;
 	int ret;
 	int first_file, last_file;
 	int64_t min, count, cur;
+	int64_t next_offset, length;
 	artio_particle_file *phandle;
 
 	if ( handle == NULL ) {
@@ -491,10 +530,30 @@ int artio_particle_cache_sfc_range(artio_fileset *handle,
 	/* check if we've already cached the range */
 	if ( start >= phandle->cache_sfc_begin &&
 			end <= phandle->cache_sfc_end ) {
+		if ( handle->use_prefetch ) {
+			artio_particle_prefetch_sfc_range(handle, start, end);
+		}
 		return ARTIO_SUCCESS;
 	}
 
-	artio_grid_clear_sfc_cache(handle);
+	artio_particle_clear_sfc_cache(handle);
+
+	if ( phandle->cur_file != -1 ) {
+		artio_file_detach_buffer( phandle->ffh[phandle->cur_file]);
+		phandle->cur_file = -1;
+	}
+
+	if ( handle->index != NULL && handle->index->particle_sfc_offset != NULL ) {
+		/* borrow the offsets of every root cell from the sfc index */
+		phandle->cache_sfc_begin = 0;
+		phandle->cache_sfc_end = handle->num_root_cells - 1;
+		phandle->sfc_offset_table = handle->index->particle_sfc_offset;
+		phandle->sfc_offset_table_borrowed = 1;
+		if ( handle->use_prefetch ) {
+			artio_particle_prefetch_sfc_range(handle, start, end);
+		}
+		return ARTIO_SUCCESS;
+	}
 
 	first_file = artio_particle_find_file(phandle, 0, 
 			phandle->num_particle_files, start);
@@ -508,11 +567,6 @@ int artio_particle_cache_sfc_range(artio_fileset *handle,
 		return ARTIO_ERR_MEMORY_ALLOCATION;
 	}
 
-	if ( phandle->cur_file != -1 ) {
-		artio_file_detach_buffer( phandle->ffh[phandle->cur_file]);
-		phandle->cur_file = -1;
-	}
-
 	cur = 0;
 	for (i = first_file; i <= last_file; i++) {
 		min = MAX( 0, start - phandle->file_sfc_index[i] );
@@ -532,10 +586,27 @@ int artio_particle_cache_sfc_range(artio_fileset *handle,
 				count, ARTIO_TYPE_LONG);
 		if ( ret != ARTIO_SUCCESS ) return ret;
 
+		if ( handle->use_mmap ) {
+			/* hint the byte range backing the cached root cells */
+			if ( end+1 < phandle->file_sfc_index[i+1] ) {
+				ret = artio_file_fread(phandle->ffh[i], &next_offset, 1, ARTIO_TYPE_LONG);
+				if ( ret != ARTIO_SUCCESS ) return ret;
+				length = next_offset - phandle->sfc_offset_table[cur];
+			} else {
+				length = -1;
+			}
+			artio_file_advise( phandle->ffh[i], phandle->sfc_offset_table[cur],
+					length, ARTIO_ADVISE_WILLNEED );
+		}
+
 		artio_file_detach_buffer( phandle->ffh[i] );
 		cur += count;
 	}
 
+	if ( handle->use_prefetch ) {
+		artio_particle_prefetch_sfc_range(handle, start, end);
+	}
+
 	return ARTIO_SUCCESS;
 }
 
@@ -547,16 +618,19 @@ int artio_particle_clear_sfc_cache( artio_fileset *handle ) {
 	}
 
 	if (handle->open_mode != ARTIO_FILESET_READ ||
-			!(handle->open_type & ARTIO_OPEN_GRID) ||
-			handle->grid == NULL ) {
+			!(handle->open_type & ARTIO_OPEN_PARTICLES) ||
+			handle->particle == NULL ) {
 		return ARTIO_ERR_INVALID_FILESET_MODE;
 	}
 
 	phandle = handle->particle;
 
 	if ( phandle->sfc_offset_table != NULL ) {
-		free(phandle->sfc_offset_table);
+		if ( !phandle->sfc_offset_table_borrowed ) {
+			free(phandle->sfc_offset_table);
+		}
 		phandle->sfc_offset_table = NULL;
+		phandle->sfc_offset_table_borrowed = 0;
 	}
 
 	phandle->cache_sfc_begin = -1;
@@ -835,6 +909,42 @@ int artio_particle_read_root_cell_begin(artio_fileset *handle, int64_t sfc,
 	return ARTIO_SUCCESS;
 }
 
+int artio_particle_read_root_cell_counts(artio_fileset *handle, int64_t sfc,
+		int * num_particles_per_species) {
+	int i;
+	int ret;
+	artio_index_file *ihandle;
+
+	if ( handle == NULL ) {
+		return ARTIO_ERR_INVALID_HANDLE;
+	}
+
+	if (handle->open_mode != ARTIO_FILESET_READ || 
+			!(handle->open_type & ARTIO_OPEN_PARTICLES) ||
+			handle->particle == NULL ) {
+		return ARTIO_ERR_INVALID_FILESET_MODE;
+	}
+
+	ihandle = handle->index;
+	if ( ihandle != NULL && ihandle->particle_num_particles != NULL ) {
+		if ( sfc < 0 || sfc >= handle->num_root_cells ) {
+			return ARTIO_ERR_INVALID_SFC;
+		}
+
+		for ( i = 0; i < ihandle->num_species; i++ ) {
+			num_particles_per_species[i] = 
+				ihandle->particle_num_particles[sfc*ihandle->num_species + i];
+		}
+		return ARTIO_SUCCESS;
+	}
+
+	ret = artio_particle_read_root_cell_begin( handle, sfc, 
+			num_particles_per_species );
+	if ( ret != ARTIO_SUCCESS ) return ret;
+
+	return artio_particle_read_root_cell_end( handle );
+}
+
 /* Description  */
 int artio_particle_read_particle(artio_fileset *handle, int64_t * pid, int *subspecies,
 		double * primary_variables, float * secondary_variables) {
@@ -34,8 +34,44 @@ typedef __int64 int64_t;
 typedef __int32 int32_t;
 #else
 #include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #endif
 
+#define ARTIO_PREFETCH_EMPTY    0
+#define ARTIO_PREFETCH_FILLING  1
+#define ARTIO_PREFETCH_READY    2
+
+#ifndef _WIN32
+/* read-ahead state (see artio_file_prefetch_i) */
+typedef struct artio_prefetch_window_struct {
+	char *data;
+	int64_t offset;
+	int64_t length;
+	int state;
+	int64_t generation;
+} artio_prefetch_window;
+
+typedef struct artio_prefetch_struct {
+	int fd;
+	int64_t file_size;
+	int64_t pos;		/* logical position of the reader */
+	int64_t begin;		/* start of the hinted byte range */
+	int64_t next;		/* next offset to be filled by the thread */
+	int64_t limit;		/* end of the hinted byte range */
+	int64_t generation;	/* bumped whenever the range is retargeted */
+	int stop;
+	int error;
+	artio_prefetch_window window[2];
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} artio_prefetch;
+#endif /* _WIN32 */
+
 struct ARTIO_FH {
 	FILE *fh;
 	int mode;
@@ -43,6 +79,16 @@ struct ARTIO_FH {
 	int bfptr;
 	int bfsize;
 	int bfend;
+
+	/* read-only mapping of the entire file (ARTIO_MODE_MMAP) */
+	char *map;
+	int64_t map_size;
+	int64_t map_ptr;
+
+#ifndef _WIN32
+	/* background double-buffered reader (artio_file_prefetch) */
+	artio_prefetch *pf;
+#endif
 };
 
 #ifdef _WIN32
@@ -52,9 +98,249 @@ struct ARTIO_FH {
 #define FOPEN_FLAGS ""
 #endif
 
+static void artio_file_swap_i( void *dst, const void *src, int64_t count, size_t size ) {
+	if ( size == 4 ) {
+		artio_swap_copy_4( dst, src, count );
+	} else if ( size == 8 ) {
+		artio_swap_copy_8( dst, src, count );
+	} else if ( dst != src ) {
+		memcpy( dst, src, (size_t)count*size );
+	}
+}
+
 artio_context artio_context_global_struct = { 0 };
 const artio_context *artio_context_global = &artio_context_global_struct;
 
+static int artio_file_map_i( artio_fh *handle, char *filename ) {
+#ifdef _WIN32
+	return ARTIO_ERR_INVALID_FILE_MODE;
+#else
+	int fd;
+	struct stat st;
+	void *map;
+
+	fd = open( filename, O_RDONLY );
+	if ( fd < 0 ) {
+		return ARTIO_ERR_IO_READ;
+	}
+
+	if ( fstat( fd, &st ) != 0 || st.st_size <= 0 ) {
+		/* empty files cannot be mapped */
+		close( fd );
+		return ARTIO_ERR_IO_READ;
+	}
+
+	map = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( map == MAP_FAILED ) {
+		return ARTIO_ERR_IO_READ;
+	}
+
+	handle->map = (char *)map;
+	handle->map_size = (int64_t)st.st_size;
+	handle->map_ptr = 0;
+
+	return ARTIO_SUCCESS;
+#endif /* _WIN32 */
+}
+
+/* 
+ * copy n bytes of a read from src to buf + *done, byte swapping elements
+ * of size swap on the way (swap == 1 is a plain copy).  Reads arrive in
+ * pieces that need not end on an element boundary, so a straddling element
+ * is completed and swapped in place once its last byte arrives.
+ */
+static void artio_file_copy_swap_i( char *buf, int64_t *done,
+		const char *src, int64_t n, size_t swap ) {
+	char *dst = buf + *done;
+	int64_t phase, head, whole;
+
+	*done += n;
+
+	if ( swap == 1 ) {
+		memcpy( dst, src, (size_t)n );
+		return;
+	}
+
+	phase = ( *done - n ) % (int64_t)swap;
+	if ( phase > 0 ) {
+		head = MIN( n, (int64_t)swap - phase );
+		memcpy( dst, src, (size_t)head );
+		dst += head;
+		src += head;
+		n -= head;
+		if ( phase + head == (int64_t)swap ) {
+			artio_file_swap_i( dst - swap, dst - swap, 1, swap );
+		}
+	}
+
+	whole = n / (int64_t)swap;
+	artio_file_swap_i( dst, src, whole, swap );
+	memcpy( dst + whole*swap, src + whole*swap, (size_t)(n - whole*swap) );
+}
+
+#ifndef _WIN32
+static void *artio_prefetch_thread( void *arg ) {
+	artio_prefetch *pf = (artio_prefetch *)arg;
+	artio_prefetch_window *w;
+	int64_t generation, done;
+	ssize_t nread;
+	int i;
+
+	pthread_mutex_lock( &pf->lock );
+	while ( !pf->stop ) {
+		w = NULL;
+		if ( !pf->error && pf->next < pf->limit ) {
+			for ( i = 0; i < 2; i++ ) {
+				if ( pf->window[i].state == ARTIO_PREFETCH_EMPTY ) {
+					w = &pf->window[i];
+					break;
+				}
+			}
+		}
+
+		if ( w == NULL ) {
+			pthread_cond_wait( &pf->cond, &pf->lock );
+			continue;
+		}
+
+		w->state = ARTIO_PREFETCH_FILLING;
+		w->offset = pf->next;
+		w->length = MIN( ARTIO_PREFETCH_WINDOW, pf->file_size - pf->next );
+		w->generation = generation = pf->generation;
+		pf->next += w->length;
+		pthread_mutex_unlock( &pf->lock );
+
+		/* the window is owned by this thread until it is marked ready */
+		done = 0;
+		while ( done < w->length ) {
+			nread = pread( pf->fd, w->data + done, 
+					(size_t)(w->length - done), (off_t)(w->offset + done) );
+			if ( nread <= 0 ) {
+				break;
+			}
+			done += nread;
+		}
+
+		pthread_mutex_lock( &pf->lock );
+		if ( generation != pf->generation ) {
+			/* range was retargeted while reading, discard */
+			w->state = ARTIO_PREFETCH_EMPTY;
+		} else if ( done < w->length ) {
+			w->state = ARTIO_PREFETCH_EMPTY;
+			pf->error = 1;
+		} else {
+			w->state = ARTIO_PREFETCH_READY;
+		}
+		pthread_cond_broadcast( &pf->cond );
+	}
+	pthread_mutex_unlock( &pf->lock );
+
+	return NULL;
+}
+
+static void artio_prefetch_retarget( artio_prefetch *pf, int64_t offset ) {
+	int i;
+
+	for ( i = 0; i < 2; i++ ) {
+		if ( pf->window[i].state == ARTIO_PREFETCH_READY ) {
+			pf->window[i].state = ARTIO_PREFETCH_EMPTY;
+		}
+	}
+	pf->next = offset;
+	pf->generation++;
+}
+
+static int artio_prefetch_read( artio_prefetch *pf, char *p, int64_t remain, 
+		size_t swap ) {
+	artio_prefetch_window *w;
+	int64_t count, done;
+	ssize_t nread;
+	int i;
+
+	if ( pf->pos < 0 || pf->pos + remain > pf->file_size ) {
+		return ARTIO_ERR_INSUFFICIENT_DATA;
+	}
+
+	if ( pf->pos < pf->begin || pf->pos >= pf->limit ) {
+		/* stray reads (e.g. of the sfc offset table) leave the windows alone */
+		count = remain;
+		for ( done = 0; done < count; done += nread ) {
+			nread = pread( pf->fd, p + done, (size_t)(count - done), (off_t)pf->pos );
+			if ( nread <= 0 ) {
+				return ARTIO_ERR_INSUFFICIENT_DATA;
+			}
+			pf->pos += nread;
+		}
+		artio_file_swap_i( p, p, count / swap, swap );
+		return ARTIO_SUCCESS;
+	}
+
+	done = 0;
+	pthread_mutex_lock( &pf->lock );
+	while ( remain > 0 ) {
+		if ( pf->error ) {
+			pthread_mutex_unlock( &pf->lock );
+			return ARTIO_ERR_IO_READ;
+		}
+
+		w = NULL;
+		for ( i = 0; i < 2; i++ ) {
+			if ( pf->window[i].state == ARTIO_PREFETCH_READY &&
+					pf->window[i].offset + pf->window[i].length <= pf->pos ) {
+				/* skipped over by the reader */
+				pf->window[i].state = ARTIO_PREFETCH_EMPTY;
+				pthread_cond_broadcast( &pf->cond );
+			} else if ( pf->window[i].state != ARTIO_PREFETCH_EMPTY &&
+					pf->window[i].generation == pf->generation &&
+					pf->window[i].offset <= pf->pos &&
+					pf->pos < pf->window[i].offset + pf->window[i].length ) {
+				w = &pf->window[i];
+			}
+		}
+
+		if ( w != NULL && w->state == ARTIO_PREFETCH_READY ) {
+			count = MIN( remain, w->offset + w->length - pf->pos );
+			artio_file_copy_swap_i( p, &done, w->data + (pf->pos - w->offset),
+					count, swap );
+			remain -= count;
+			pf->pos += count;
+
+			if ( pf->pos == w->offset + w->length ) {
+				w->state = ARTIO_PREFETCH_EMPTY;
+				pthread_cond_broadcast( &pf->cond );
+			}
+		} else if ( w != NULL || 
+				( pf->pos == pf->next && pf->next < pf->limit ) ) {
+			/* data is (about to be) in flight */
+			pthread_cond_wait( &pf->cond, &pf->lock );
+		} else {
+			/* reader left the prefetched range, follow it */
+			artio_prefetch_retarget( pf, pf->pos );
+			pf->limit = MAX( pf->limit, pf->pos + remain );
+			pthread_cond_broadcast( &pf->cond );
+		}
+	}
+	pthread_mutex_unlock( &pf->lock );
+
+	return ARTIO_SUCCESS;
+}
+
+static void artio_prefetch_destroy( artio_prefetch *pf ) {
+	pthread_mutex_lock( &pf->lock );
+	pf->stop = 1;
+	pthread_cond_broadcast( &pf->cond );
+	pthread_mutex_unlock( &pf->lock );
+	pthread_join( pf->thread, NULL );
+
+	pthread_cond_destroy( &pf->cond );
+	pthread_mutex_destroy( &pf->lock );
+	free( pf->window[0].data );
+	free( pf->window[1].data );
+	free( pf );
+}
+#endif /* _WIN32 */
+
 artio_fh *artio_file_fopen_i( char * filename, int mode, const artio_context *not_used ) {
 	artio_fh *ffh;
 	/* check for invalid combination of mode parameter */
@@ -73,8 +359,22 @@ artio_fh *artio_file_fopen_i( char * filename, int mode, const artio_context *no
 	ffh->bfend = -1;
 	ffh->bfptr = -1;
 	ffh->data = NULL;
+	ffh->fh = NULL;
+	ffh->map = NULL;
+	ffh->map_size = 0;
+	ffh->map_ptr = 0;
+#ifndef _WIN32
+	ffh->pf = NULL;
+#endif
 
 	if ( mode & ARTIO_MODE_ACCESS ) {
+		if ( mode & ARTIO_MODE_MMAP && mode & ARTIO_MODE_READ &&
+				artio_file_map_i( ffh, filename ) == ARTIO_SUCCESS ) {
+			return ffh;
+		}
+
+		/* fall back to stdio if the file could not be mapped */
+		ffh->mode &= ~ARTIO_MODE_MMAP;
 		ffh->fh = fopen( filename, ( mode & ARTIO_MODE_WRITE ) ? "w"FOPEN_FLAGS : "r"FOPEN_FLAGS );
 		if ( ffh->fh == NULL ) {
 			free( ffh );
@@ -93,6 +393,18 @@ int artio_file_attach_buffer_i( artio_fh *handle, void *buf, int buf_size ) {
 	if ( handle->data != NULL ) {
 		return ARTIO_ERR_BUFFER_EXISTS;
 	}
+
+	if ( handle->map != NULL ) {
+		/* mapped files are read in place and never need a buffer */
+		return ARTIO_SUCCESS;
+	}
+
+#ifndef _WIN32
+	if ( handle->pf != NULL ) {
+		/* reads are served from the prefetch windows */
+		return ARTIO_SUCCESS;
+	}
+#endif
 	
 	handle->bfsize = buf_size;
 	handle->bfend = -1;
@@ -202,8 +514,12 @@ int artio_file_fflush_i(artio_fh *handle) {
 }
 
 int artio_file_fread_i(artio_fh *handle, void *buf, int64_t count, int type ) {
-	size_t size, avail, remain;
+	size_t size, avail, remain, swap;
+	int64_t done;
 	int size32;
+#ifndef _WIN32
+	int ret;
+#endif
 	char *p;
 
 	if ( !(handle->mode & ARTIO_MODE_READ) ) {
@@ -219,10 +535,29 @@ int artio_file_fread_i(artio_fh *handle, void *buf, int64_t count, int type ) {
 		return ARTIO_ERR_IO_OVERFLOW;
 	}
 
+	/* element size to byte swap while copying (strings are never swapped) */
+	swap = ( handle->mode & ARTIO_MODE_ENDIAN_SWAP ) ? size : 1;
+
 	remain = size*count;
 	p = (char *)buf;
+	done = 0;
 
-	if ( handle->data == NULL ) {
+	if ( handle->map != NULL ) {
+		if ( handle->map_ptr < 0 || 
+				handle->map_ptr + (int64_t)remain > handle->map_size ) {
+			return ARTIO_ERR_INSUFFICIENT_DATA;
+		}
+		artio_file_copy_swap_i( p, &done, handle->map + handle->map_ptr, 
+				remain, swap );
+		handle->map_ptr += remain;
+#ifndef _WIN32
+	} else if ( handle->pf != NULL ) {
+		ret = artio_prefetch_read( handle->pf, p, (int64_t)remain, swap );
+		if ( ret != ARTIO_SUCCESS ) {
+			return ret;
+		}
+#endif
+	} else if ( handle->data == NULL ) {
 		while ( remain > 0 ) {
 			size32 = MIN( ARTIO_IO_MAX, remain );
 			if ( fread( p, 1, size32, handle->fh) != size32 ) {
@@ -231,6 +566,9 @@ int artio_file_fread_i(artio_fh *handle, void *buf, int64_t count, int type ) {
 			remain -= size32;
 			p += size32;
 		}
+
+		/* data lands directly in buf, so it has to be swapped in place */
+		artio_file_swap_i( buf, buf, count, swap );
 	} else {
 		if ( handle->bfend == -1 ) {
 			/* load initial data into buffer */
@@ -243,8 +581,8 @@ int artio_file_fread_i(artio_fh *handle, void *buf, int64_t count, int type ) {
 				handle->bfend > 0 && 
 				handle->bfptr + remain >= handle->bfend ) {
 			avail = handle->bfend - handle->bfptr;
-			memcpy( p, handle->data + handle->bfptr, avail );
-			p += avail;
+			artio_file_copy_swap_i( p, &done, handle->data + handle->bfptr, 
+					avail, swap );
 			remain -= avail;
 
 			/* refill buffer */
@@ -258,35 +596,200 @@ int artio_file_fread_i(artio_fh *handle, void *buf, int64_t count, int type ) {
 				return ARTIO_ERR_INSUFFICIENT_DATA;
 			}
 
-			memcpy( p, handle->data + handle->bfptr, (size_t)remain );
+			artio_file_copy_swap_i( p, &done, handle->data + handle->bfptr, 
+					remain, swap );
 			handle->bfptr += (int)remain;
 		}
 	}
 
-	if(handle->mode & ARTIO_MODE_ENDIAN_SWAP) {
-		switch (type) {
-			case ARTIO_TYPE_INT :
-				artio_int_swap( (int32_t *)buf, count );
-				break;
-			case ARTIO_TYPE_FLOAT :
-				artio_float_swap( (float *)buf, count );
-				break;
-			case ARTIO_TYPE_DOUBLE :
-				artio_double_swap( (double *)buf, count );
-				break;
-			case ARTIO_TYPE_LONG :
-				artio_long_swap( (int64_t *)buf, count );
-				break;
-			default :
-				return ARTIO_ERR_INVALID_DATATYPE;
+    return ARTIO_SUCCESS;
+}
+
+int artio_file_fread_direct_i(artio_fh *handle, void **buf, int64_t count, int type ) {
+	size_t size;
+
+	if ( !(handle->mode & ARTIO_MODE_READ) || handle->map == NULL ||
+			handle->mode & ARTIO_MODE_ENDIAN_SWAP ) {
+		/* only possible when the data can be used as stored on disk */
+		return ARTIO_ERR_INVALID_FILE_MODE;
+	}
+
+	size = artio_type_size( type );
+	if ( size == (size_t)-1 ) {
+		return ARTIO_ERR_INVALID_DATATYPE;
+	}
+
+	if ( count > ARTIO_INT64_MAX / size ) {
+		return ARTIO_ERR_IO_OVERFLOW;
+	}
+
+	if ( handle->map_ptr < 0 ||
+			handle->map_ptr + (int64_t)(size*count) > handle->map_size ) {
+		return ARTIO_ERR_INSUFFICIENT_DATA;
+	}
+
+	if ( handle->map_ptr % size != 0 ) {
+		/* caller would be handed a misaligned pointer */
+		return ARTIO_ERR_INVALID_FILE_MODE;
+	}
+
+	*buf = handle->map + handle->map_ptr;
+	handle->map_ptr += size*count;
+
+	return ARTIO_SUCCESS;
+}
+
+int artio_file_advise_i(artio_fh *handle, int64_t offset, int64_t length, int advice ) {
+#ifndef _WIN32
+	long page_size;
+	int64_t start, end;
+	int flag;
+
+	if ( handle->map == NULL ) {
+		/* hints are only meaningful for mapped files */
+		return ARTIO_SUCCESS;
+	}
+
+	switch ( advice ) {
+		case ARTIO_ADVISE_NORMAL :
+			flag = MADV_NORMAL;
+			break;
+		case ARTIO_ADVISE_SEQUENTIAL :
+			flag = MADV_SEQUENTIAL;
+			break;
+		case ARTIO_ADVISE_WILLNEED :
+			flag = MADV_WILLNEED;
+			break;
+		case ARTIO_ADVISE_DONTNEED :
+			flag = MADV_DONTNEED;
+			break;
+		default :
+			return ARTIO_ERR_INVALID_STATE;
+	}
+
+	if ( length < 0 ) {
+		length = handle->map_size - offset;
+	}
+
+	/* madvise requires a page aligned start address */
+	page_size = sysconf( _SC_PAGESIZE );
+	start = MAX( 0, offset );
+	start -= start % page_size;
+	end = MIN( handle->map_size, offset + length );
+
+	if ( end > start ) {
+		/* hints are advisory, so failures are not reported to the caller */
+		madvise( handle->map + start, (size_t)(end - start), flag );
+	}
+#endif /* _WIN32 */
+
+	return ARTIO_SUCCESS;
+}
+
+int artio_file_prefetch_i(artio_fh *handle, int64_t offset, int64_t length ) {
+#ifndef _WIN32
+	artio_prefetch *pf;
+	struct stat st;
+	int64_t pos, limit;
+	int i, covered;
+
+	if ( handle->map != NULL || handle->data != NULL ||
+			!(handle->mode & ARTIO_MODE_READ) ||
+			!(handle->mode & ARTIO_MODE_ACCESS) ) {
+		/* read-ahead only replaces unbuffered stdio reads */
+		return ARTIO_SUCCESS;
+	}
+
+	if ( handle->pf == NULL ) {
+		if ( artio_file_ftell_i( handle, &pos ) != ARTIO_SUCCESS ||
+				fstat( fileno(handle->fh), &st ) != 0 ) {
+			return ARTIO_ERR_IO_READ;
+		}
+
+		pf = (artio_prefetch *)malloc(sizeof(artio_prefetch));
+		if ( pf == NULL ) {
+			return ARTIO_ERR_MEMORY_ALLOCATION;
 		}
+
+		pf->fd = fileno( handle->fh );
+		pf->file_size = (int64_t)st.st_size;
+		pf->pos = pos;
+		pf->begin = offset;
+		pf->next = offset;
+		pf->limit = offset;
+		pf->generation = 0;
+		pf->stop = 0;
+		pf->error = 0;
+		pf->window[0].data = (char *)malloc(ARTIO_PREFETCH_WINDOW);
+		pf->window[1].data = (char *)malloc(ARTIO_PREFETCH_WINDOW);
+		pf->window[0].state = pf->window[1].state = ARTIO_PREFETCH_EMPTY;
+
+		if ( pf->window[0].data == NULL || pf->window[1].data == NULL ) {
+			free( pf->window[0].data );
+			free( pf->window[1].data );
+			free( pf );
+			return ARTIO_ERR_MEMORY_ALLOCATION;
+		}
+
+		pthread_mutex_init( &pf->lock, NULL );
+		pthread_cond_init( &pf->cond, NULL );
+
+		if ( pthread_create( &pf->thread, NULL, artio_prefetch_thread, pf ) != 0 ) {
+			/* continue with ordinary reads */
+			pthread_cond_destroy( &pf->cond );
+			pthread_mutex_destroy( &pf->lock );
+			free( pf->window[0].data );
+			free( pf->window[1].data );
+			free( pf );
+			return ARTIO_SUCCESS;
+		}
+
+		handle->pf = pf;
 	}
 
-    return ARTIO_SUCCESS;
+	pf = handle->pf;
+
+	limit = ( length < 0 ) ? pf->file_size : MIN( pf->file_size, offset + length );
+
+	pthread_mutex_lock( &pf->lock );
+	covered = ( offset == pf->next );
+	for ( i = 0; i < 2; i++ ) {
+		if ( pf->window[i].state != ARTIO_PREFETCH_EMPTY &&
+				pf->window[i].generation == pf->generation &&
+				pf->window[i].offset <= offset && offset <= pf->next ) {
+			covered = 1;
+		}
+	}
+	if ( !covered || pf->error ) {
+		/* keep windows already read for this range, otherwise start over */
+		artio_prefetch_retarget( pf, offset );
+	}
+	pf->begin = offset;
+	pf->limit = limit;
+	pf->error = 0;
+	pthread_cond_broadcast( &pf->cond );
+	pthread_mutex_unlock( &pf->lock );
+#endif /* _WIN32 */
+
+	return ARTIO_SUCCESS;
 }
 
 int artio_file_ftell_i( artio_fh *handle, int64_t *offset ) {
-	size_t current = ftell( handle->fh );
+	size_t current;
+
+	if ( handle->map != NULL ) {
+		*offset = handle->map_ptr;
+		return ARTIO_SUCCESS;
+	}
+
+#ifndef _WIN32
+	if ( handle->pf != NULL ) {
+		*offset = handle->pf->pos;
+		return ARTIO_SUCCESS;
+	}
+#endif
+
+	current = ftell( handle->fh );
 
 	if ( handle->bfend > 0 ) {
 		current -= handle->bfend;
@@ -302,6 +805,43 @@ int artio_file_ftell_i( artio_fh *handle, int64_t *offset ) {
 int artio_file_fseek_i(artio_fh *handle, int64_t offset, int whence ) {
 	size_t current;
 
+	if ( handle->map != NULL ) {
+		switch ( whence ) {
+			case ARTIO_SEEK_SET :
+				handle->map_ptr = offset;
+				break;
+			case ARTIO_SEEK_CUR :
+				handle->map_ptr += offset;
+				break;
+			case ARTIO_SEEK_END :
+				handle->map_ptr = handle->map_size + offset;
+				break;
+			default :
+				return ARTIO_ERR_INVALID_SEEK;
+		}
+		return ARTIO_SUCCESS;
+	}
+
+#ifndef _WIN32
+	if ( handle->pf != NULL ) {
+		/* the prefetch thread follows the reader on the next read */
+		switch ( whence ) {
+			case ARTIO_SEEK_SET :
+				handle->pf->pos = offset;
+				break;
+			case ARTIO_SEEK_CUR :
+				handle->pf->pos += offset;
+				break;
+			case ARTIO_SEEK_END :
+				handle->pf->pos = handle->pf->file_size + offset;
+				break;
+			default :
+				return ARTIO_ERR_INVALID_SEEK;
+		}
+		return ARTIO_SUCCESS;
+	}
+#endif
+
 	if ( handle->mode & ARTIO_MODE_ACCESS ) {
 		if ( whence == ARTIO_SEEK_CUR ) {
 			if ( offset == 0 ) {
@@ -355,6 +895,19 @@ int artio_file_fseek_i(artio_fh *handle, int64_t offset, int whence ) {
 }
 
 int artio_file_fclose_i(artio_fh *handle) {
+#ifndef _WIN32
+	if ( handle->map != NULL ) {
+		munmap( handle->map, (size_t)handle->map_size );
+		free(handle);
+		return ARTIO_SUCCESS;
+	}
+
+	if ( handle->pf != NULL ) {
+		artio_prefetch_destroy( handle->pf );
+		handle->pf = NULL;
+	}
+#endif /* _WIN32 */
+
 	if ( handle->mode & ARTIO_MODE_ACCESS ) {
 		artio_file_fflush(handle);
 		fclose(handle->fh);
@@ -368,4 +921,8 @@ void artio_file_set_endian_swap_tag_i(artio_fh *handle) {
 	handle->mode |= ARTIO_MODE_ENDIAN_SWAP;
 }
 
+int artio_file_get_endian_swap_tag_i(artio_fh *handle) {
+	return ( handle->mode & ARTIO_MODE_ENDIAN_SWAP ) ? 1 : 0;
+}
+
 #endif /* ifndef ARTIO_MPI */
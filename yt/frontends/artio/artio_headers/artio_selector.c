@@ -245,54 +245,346 @@ artio_selection *artio_select_all( artio_fileset *handle ) {
 	return selection;
 }
 
-artio_selection *artio_select_volume( artio_fileset *handle, double lpos[3], double rpos[3] ) {
-	int i;
-	int64_t sfc;
+/*
+ * Root cell decomposition of a region into sfc ranges.  An aligned node of
+ * 2^k root cells on a side covers the contiguous hilbert indices
+ * [base, base+8^k-1] with base a multiple of 8^k, so nodes entirely inside
+ * the region are emitted as a single range and only nodes straddling its
+ * boundary are refined.  Slab orderings are only contiguous along their
+ * fastest axis, so inside nodes are emitted as one range per row instead.
+ */
+typedef struct artio_range_list_struct {
+	int64_t *list;
+	int num_ranges;
+	int size;
+} artio_range_list;
+
+static int artio_range_list_append( artio_range_list *ranges, int64_t start, int64_t end ) {
+	int64_t *new_list;
+
+	if ( ranges->num_ranges == ranges->size ) {
+		new_list = (int64_t *)realloc( ranges->list, 4*ranges->size*sizeof(int64_t) );
+		if ( new_list == NULL ) {
+			return ARTIO_ERR_MEMORY_ALLOCATION;
+		}
+		ranges->list = new_list;
+		ranges->size *= 2;
+	}
+
+	ranges->list[2*ranges->num_ranges] = start;
+	ranges->list[2*ranges->num_ranges+1] = end;
+	ranges->num_ranges++;
+
+	return ARTIO_SUCCESS;
+}
+
+static int artio_range_compare( const void *a, const void *b ) {
+	int64_t sa = *(const int64_t *)a;
+	int64_t sb = *(const int64_t *)b;
+	return ( sa > sb ) - ( sa < sb );
+}
+
+static int artio_select_emit_node( artio_fileset *handle, artio_range_list *ranges,
+		int origin[3], int size ) {
+	int ret;
+	int fast, slow1, slow2;
 	int coords[3];
-	int lcoords[3];
-	int rcoords[3];
-	artio_selection *selection;
+	int64_t base, cells;
 
-	if ( handle == NULL ) {
-		return NULL;
+	if ( handle->sfc_type == ARTIO_SFC_HILBERT ) {
+		cells = (int64_t)size*size*size;
+		base = artio_sfc_index( handle, origin );
+		base -= base % cells;
+		return artio_range_list_append( ranges, base, base + cells - 1 );
 	}
 
-	for ( i = 0; i < 3; i++ ) {
-		if ( lpos[i] < 0.0 || lpos[i] >= rpos[i] ) {
-			return NULL;
+	if ( handle->sfc_type != ARTIO_SFC_SLAB_X &&
+			handle->sfc_type != ARTIO_SFC_SLAB_Y &&
+			handle->sfc_type != ARTIO_SFC_SLAB_Z ) {
+		return ARTIO_ERR_INVALID_SFC;
+	}
+
+	/* slab orderings, see artio_slab_index */
+	fast = ( handle->sfc_type == ARTIO_SFC_SLAB_Z ) ? 1 : 2;
+	slow1 = ( handle->sfc_type == ARTIO_SFC_SLAB_X ) ? 1 : 0;
+	slow2 = 3 - fast - slow1;
+
+	coords[fast] = origin[fast];
+	for ( coords[slow1] = origin[slow1]; coords[slow1] < origin[slow1] + size; coords[slow1]++ ) {
+		for ( coords[slow2] = origin[slow2]; coords[slow2] < origin[slow2] + size; coords[slow2]++ ) {
+			base = artio_sfc_index( handle, coords );
+			ret = artio_range_list_append( ranges, base, base + size - 1 );
+			if ( ret != ARTIO_SUCCESS ) return ret;
 		}
 	}
 
+	return ARTIO_SUCCESS;
+}
+
+static int artio_select_region_node( artio_fileset *handle, artio_range_list *ranges,
+		artio_selection_volume_test test, void *params, int origin[3], int size ) {
+	int i, ret, status;
+	int child[3];
+	double left[3], right[3];
+
 	for ( i = 0; i < 3; i++ ) {
-		lcoords[i] = (int)lpos[i];
-		rcoords[i] = (int)rpos[i];
+		left[i] = origin[i];
+		right[i] = origin[i] + size;
+	}
+
+	status = test( left, right, params );
+	if ( status == ARTIO_SELECT_OUTSIDE ) {
+		return ARTIO_SUCCESS;
+	} else if ( status == ARTIO_SELECT_INSIDE || size == 1 ) {
+		return artio_select_emit_node( handle, ranges, origin, size );
+	}
+
+	size /= 2;
+	for ( i = 0; i < 8; i++ ) {
+		child[0] = origin[0] + ( (i>>2) & 1 )*size;
+		child[1] = origin[1] + ( (i>>1) & 1 )*size;
+		child[2] = origin[2] + ( i & 1 )*size;
+
+		ret = artio_select_region_node( handle, ranges, test, params, child, size );
+		if ( ret != ARTIO_SUCCESS ) return ret;
+	}
+
+	return ARTIO_SUCCESS;
+}
+
+int artio_selection_coarsen( artio_selection *selection, int max_ranges ) {
+	int i, j, num_merge, num_equal;
+	int64_t gap, threshold;
+	int64_t *gaps;
+
+	if ( selection == NULL ) {
+		return ARTIO_ERR_INVALID_SELECTION;
+	}
+
+	if ( max_ranges <= 0 || selection->num_ranges <= max_ranges ) {
+		return ARTIO_SUCCESS;
+	}
+
+	/* merge the num_merge smallest gaps between neighbouring ranges */
+	num_merge = selection->num_ranges - max_ranges;
+	gaps = (int64_t *)malloc( (selection->num_ranges-1)*sizeof(int64_t) );
+	if ( gaps == NULL ) {
+		return ARTIO_ERR_MEMORY_ALLOCATION;
+	}
+
+	for ( i = 0; i < selection->num_ranges-1; i++ ) {
+		gaps[i] = selection->list[2*i+2] - selection->list[2*i+1];
+	}
+	qsort( gaps, selection->num_ranges-1, sizeof(int64_t), artio_range_compare );
+	threshold = gaps[num_merge-1];
+
+	num_equal = num_merge;
+	for ( i = 0; i < num_merge; i++ ) {
+		if ( gaps[i] < threshold ) {
+			num_equal--;
+		}
+	}
+	free(gaps);
+
+	j = 0;
+	for ( i = 1; i < selection->num_ranges; i++ ) {
+		gap = selection->list[2*i] - selection->list[2*j+1];
+		if ( gap < threshold || ( gap == threshold && num_equal-- > 0 ) ) {
+			selection->list[2*j+1] = selection->list[2*i+1];
+		} else {
+			j++;
+			selection->list[2*j] = selection->list[2*i];
+			selection->list[2*j+1] = selection->list[2*i+1];
+		}
+	}
+	selection->num_ranges = j+1;
+
+	return ARTIO_SUCCESS;
+}
+
+artio_selection *artio_select_region( artio_fileset *handle,
+		artio_selection_volume_test test, void *params, int max_ranges ) {
+	int i, j;
+	int origin[3] = { 0, 0, 0 };
+	artio_range_list ranges;
+	artio_selection *selection;
+
+	if ( handle == NULL || test == NULL || handle->num_grid <= 0 ) {
+		return NULL;
+	}
+
+	ranges.size = ARTIO_SELECTION_LIST_SIZE;
+	ranges.num_ranges = 0;
+	ranges.list = (int64_t *)malloc(2*ranges.size*sizeof(int64_t));
+	if ( ranges.list == NULL ) {
+		return NULL;
+	}
+
+	if ( artio_select_region_node( handle, &ranges, test, params, 
+			origin, handle->num_grid ) != ARTIO_SUCCESS ) {
+		free( ranges.list );
+		return NULL;
 	}
 
+	/* sort and join ranges emitted by neighbouring nodes */
+	qsort( ranges.list, ranges.num_ranges, 2*sizeof(int64_t), artio_range_compare );
+
+	j = -1;
+	for ( i = 0; i < ranges.num_ranges; i++ ) {
+		if ( j >= 0 && ranges.list[2*i] == ranges.list[2*j+1]+1 ) {
+			ranges.list[2*j+1] = ranges.list[2*i+1];
+		} else {
+			j++;
+			ranges.list[2*j] = ranges.list[2*i];
+			ranges.list[2*j+1] = ranges.list[2*i+1];
+		}
+	}
+	ranges.num_ranges = j+1;
+
 	selection = artio_selection_allocate( handle );
 	if ( selection == NULL ) {
+		free( ranges.list );
+		return NULL;
+	}
+
+	free( selection->list );
+	selection->list = ranges.list;
+	selection->size = ranges.size;
+	selection->num_ranges = ranges.num_ranges;
+
+	if ( artio_selection_coarsen( selection, max_ranges ) != ARTIO_SUCCESS ) {
+		artio_selection_destroy( selection );
 		return NULL;
 	}
 
-	for ( coords[0] = lcoords[0]; coords[0] <= rcoords[0]; coords[0]++ ) {
-		for ( coords[1] = lcoords[1]; coords[1] <= rcoords[1]; coords[1]++ ) {
-			for ( coords[2] = lcoords[2]; coords[2] <= rcoords[2]; coords[2]++ ) {
-				sfc = artio_sfc_index( handle, coords );
-				if ( artio_selection_add_range( selection, sfc, sfc ) != ARTIO_SUCCESS ) {
-					artio_selection_destroy(selection);
-					return NULL;
+	return selection;
+}
+
+/* 
+ * periodic box of root cells [lo,hi] per axis (inclusive, lo may be
+ * negative and hi may exceed num_grid to wrap around)
+ */
+typedef struct artio_select_box_struct {
+	int lo[3];
+	int hi[3];
+	int num_grid;
+} artio_select_box;
+
+static int artio_select_box_test( double left[3], double right[3], void *params ) {
+	int i, t;
+	int a, b, lo, hi;
+	int inside = 1, overlap;
+	artio_select_box *box = (artio_select_box *)params;
+
+	for ( i = 0; i < 3; i++ ) {
+		a = (int)left[i];
+		b = (int)right[i] - 1;
+		if ( box->hi[i] - box->lo[i] + 1 >= box->num_grid ) {
+			continue;
+		}
+
+		overlap = 0;
+		for ( t = -1; t <= 1; t++ ) {
+			lo = box->lo[i] + t*box->num_grid;
+			hi = box->hi[i] + t*box->num_grid;
+			if ( a >= lo && b <= hi ) {
+				overlap = 2;
+			} else if ( a <= hi && b >= lo && overlap == 0 ) {
+				overlap = 1;
+			}
+		}
+
+		if ( overlap == 0 ) {
+			return ARTIO_SELECT_OUTSIDE;
+		} else if ( overlap == 1 ) {
+			inside = 0;
+		}
+	}
+
+	return inside ? ARTIO_SELECT_INSIDE : ARTIO_SELECT_PARTIAL;
+}
+
+typedef struct artio_select_sphere_struct {
+	double center[3];
+	double radius;
+	double num_grid;
+} artio_select_sphere_params;
+
+static int artio_select_sphere_test( double left[3], double right[3], void *params ) {
+	int i, t;
+	double c, d, dmin, dmax;
+	double dmin2 = 0.0, dmax2 = 0.0;
+	artio_select_sphere_params *sphere = (artio_select_sphere_params *)params;
+
+	for ( i = 0; i < 3; i++ ) {
+		/* closest and farthest periodic image distances along this axis */
+		dmin = sphere->num_grid;
+		for ( t = -1; t <= 1; t++ ) {
+			c = sphere->center[i] + t*sphere->num_grid;
+			if ( c >= left[i] && c <= right[i] ) {
+				d = 0.0;
+			} else {
+				d = MIN( fabs( left[i] - c ), fabs( right[i] - c ) );
+			}
+			dmin = MIN( dmin, d );
+		}
+
+		dmax = 0.0;
+		for ( t = 0; t < 3; t++ ) {
+			/* endpoints and the antipode of the center bound the maximum */
+			c = ( t == 0 ) ? left[i] : ( t == 1 ) ? right[i] :
+				sphere->center[i] + 0.5*sphere->num_grid;
+			if ( t == 2 ) {
+				c -= sphere->num_grid*floor( c / sphere->num_grid );
+				if ( c < left[i] || c > right[i] ) {
+					continue;
 				}
 			}
+			d = fabs( c - sphere->center[i] );
+			d -= sphere->num_grid*floor( d / sphere->num_grid );
+			d = MIN( d, sphere->num_grid - d );
+			dmax = MAX( dmax, d );
 		}
-	} 
 
-	return selection;
+		dmin2 += dmin*dmin;
+		dmax2 += dmax*dmax;
+	}
+
+	if ( dmin2 > sphere->radius*sphere->radius ) {
+		return ARTIO_SELECT_OUTSIDE;
+	} else if ( dmax2 <= sphere->radius*sphere->radius ) {
+		return ARTIO_SELECT_INSIDE;
+	} else {
+		return ARTIO_SELECT_PARTIAL;
+	}
+}
+
+artio_selection *artio_select_volume( artio_fileset *handle, double lpos[3], double rpos[3] ) {
+	int i;
+	artio_select_box box;
+
+	if ( handle == NULL ) {
+		return NULL;
+	}
+
+	for ( i = 0; i < 3; i++ ) {
+		if ( lpos[i] < 0.0 || lpos[i] >= rpos[i] ) {
+			return NULL;
+		}
+	}
+
+	box.num_grid = handle->num_grid;
+	for ( i = 0; i < 3; i++ ) {
+		box.lo[i] = (int)lpos[i];
+		box.hi[i] = MIN( (int)rpos[i], handle->num_grid-1 );
+	}
+
+	return artio_select_region( handle, artio_select_box_test, &box, 0 );
 }
 
 artio_selection *artio_select_cube( artio_fileset *handle, double center[3], double size ) {
-	int i, j, k, dx;
-    int64_t sfc;
-    int coords[3], coords2[3];
-	artio_selection *selection;
+	int i, dx;
+	artio_select_box box;
 
 	if ( handle == NULL ) {
 		return NULL;
@@ -303,32 +595,36 @@ artio_selection *artio_select_cube( artio_fileset *handle, double center[3], dou
 	}
 	dx = (int)(center[0] + 0.5*size) - (int)(center[0] - 0.5*size) + 1;
 
+	box.num_grid = handle->num_grid;
 	for ( i = 0; i < 3; i++ ) {
 		if ( center[i] < 0.0 || center[i] >= handle->num_grid ) {
 			return NULL;
 		}
-		coords[i] = (int)(center[i] - 0.5*size + handle->num_grid) % handle->num_grid;
+		box.lo[i] = (int)(center[i] - 0.5*size + handle->num_grid) % handle->num_grid;
+		box.hi[i] = box.lo[i] + dx;
+		box.lo[i] -= dx;
 	}
 
-	selection = artio_selection_allocate( handle );
-	if ( selection == NULL ) {
+	return artio_select_region( handle, artio_select_box_test, &box, 0 );
+}
+
+artio_selection *artio_select_sphere( artio_fileset *handle, double center[3], 
+		double radius, int max_ranges ) {
+	int i;
+	artio_select_sphere_params sphere;
+
+	if ( handle == NULL || radius <= 0.0 ) {
 		return NULL;
 	}
 
-	for ( i = coords[0]-dx; i <= coords[0]+dx; i++ ) {
-		coords2[0] = (i + handle->num_grid) % handle->num_grid;
-		for ( j = coords[1]-dx; j <= coords[1]+dx; j++ ) {
-			coords2[1] = (j + handle->num_grid) % handle->num_grid;
-			for ( k = coords[2]-dx; k <= coords[2]+dx; k++ ) {
-				coords2[2] = (k + handle->num_grid) % handle->num_grid;
-				sfc = artio_sfc_index( handle, coords2 );
-				if ( artio_selection_add_range( selection, sfc, sfc ) != ARTIO_SUCCESS ) {
-					artio_selection_destroy(selection);
-					return NULL;
-				}
-			}
+	for ( i = 0; i < 3; i++ ) {
+		if ( center[i] < 0.0 || center[i] >= handle->num_grid ) {
+			return NULL;
 		}
+		sphere.center[i] = center[i];
 	}
- 			
-	return selection;
-} 
+	sphere.radius = radius;
+	sphere.num_grid = handle->num_grid;
+
+	return artio_select_region( handle, artio_select_sphere_test, &sphere, max_ranges );
+}
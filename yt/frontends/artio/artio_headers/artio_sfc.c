@@ -27,8 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#define rollLeft(x,y,mask) ((x<<y) | (x>>(nDim-y))) & mask
-#define rollRight(x,y,mask) ((x>>y) | (x<<(nDim-y))) & mask
+#include "space_filling_curves.h"
 
 /*******************************************************
  * morton_index
@@ -36,23 +35,9 @@
 int64_t artio_morton_index( artio_fileset *handle, int coords[nDim] ) 
 /* purpose: interleaves the bits of the nDim integer
  * 	coordinates, normally called Morton or z-ordering
- *
- * 	Used by the hilbert curve algorithm
  */
 {
-	int i, d;
-	int64_t mortonnumber = 0;
-	int64_t bitMask = 1L << (handle->nBitsPerDim - 1);
-	
-	/* interleave bits of coordinates */
-	for ( i = handle->nBitsPerDim; i > 0; i-- ) {
-		for ( d = 0; d < nDim; d++ ) {
-			mortonnumber |= ( coords[d] & bitMask ) << (((nDim - 1) * i ) - d );
-		}
-		bitMask >>= 1;
-	}
-
-	return mortonnumber;
+	return (int64_t)sfc_morton_encode( coords[0], coords[1], coords[2] );
 }
 
 /*******************************************************
@@ -62,90 +47,14 @@ int64_t artio_hilbert_index( artio_fileset *handle, int coords[nDim] )
 /* purpose: calculates the 1-d space-filling-curve index
  * 	corresponding to the nDim set of coordinates
  *
- * 	Uses the Hilbert curve algorithm given in
- * 	Alternative Algorithm for Hilbert's Space-
- * 	Filling Curve, A.R. Butz, IEEE Trans on Comp.,
- * 	p. 424, 1971
+ * 	This is the curve of A.R. Butz, IEEE Trans on Comp.,
+ * 	p. 424, 1971, evaluated two levels at a time with the 
+ * 	state tables in space_filling_curves.h, whose curve 
+ * 	matches it with the axes taken in (1,2,0) order
  */
 {
-	int i, j;
-	int64_t hilbertnumber;
-	int64_t singleMask;
-	int64_t dimMask;
-	int64_t numberShifts;
-	int principal;
-	int64_t o;
-	int64_t rho;
-	int64_t w;
-	int64_t interleaved;
-
-	/* begin by transposing bits */
-	interleaved = artio_morton_index( handle, coords );
-
-	/* mask out nDim and 1 bit blocks starting 
-	 * at highest order bits */
-	singleMask = 1L << ((handle->nBitsPerDim - 1) * nDim);
-	
-	dimMask = singleMask;
-	for ( i = 1; i < nDim; i++ ) {
-		dimMask |= singleMask << i;
-	}
-
-	w = 0;
-	numberShifts = 0;
-	hilbertnumber = 0;
-
-	while (singleMask) {
-		o = (interleaved ^ w) & dimMask;
-		o = rollLeft( o, numberShifts, dimMask );
-
-		rho = o;
-		for ( j = 1; j < nDim; j++ ) {
-			rho ^= (o>>j) & dimMask;
-		}
-
-		hilbertnumber |= rho;
-
-		/* break out early (we already have complete number
-		 * no need to calculate other numbers) */
-		if ( singleMask == 1 ) {
-			break;
-		}
-
-		/* calculate principal position */
-		principal = 0;
-		for ( i = 1; i < nDim; i++ ) {
-			if ( (hilbertnumber & singleMask) != ((hilbertnumber>>i) & singleMask)) {
-				principal = i; 
-				break;
-			}
-		}
-
-		/* complement lowest bit position */
-		o ^= singleMask;
-
-		/* force even parity by complementing at principal position if necessary 
-		 * Note: lowest order bit of hilbertnumber gives you parity of o at this
-		 * point due to xor operations of previous steps */
-		if ( !(hilbertnumber & singleMask) ) {
-			o ^= singleMask << principal;
-		}
-
-		/* rotate o right by numberShifts */
-		o = rollRight( o, numberShifts, dimMask );
-
-		/* find next numberShifts */
-		numberShifts += (nDim - 1) - principal;
-		numberShifts %= nDim;
-
-		w ^= o;
-		w >>= nDim;
-
-		singleMask >>= nDim;
-		dimMask >>= nDim;
-	}
-
-	return hilbertnumber;
+	return (int64_t)sfc_hilbert_encode( handle->nBitsPerDim, 
+			coords[1], coords[2], coords[0] );
 }
 
 /*******************************************************
@@ -159,75 +68,12 @@ void artio_hilbert_coords( artio_fileset *handle, int64_t index, int coords[nDim
  * returns: the coordinates in coords
  */
 {
-	int i, j;
-	int64_t dimMask;
-	int64_t singleMask;
-	int64_t sigma;
-	int64_t sigma_;
-	int64_t tau;
-	int64_t tau_;
-	int num_shifts;
-	int principal;
-	int64_t w;
-	int64_t x = 0;
-
-	w = 0;
-	sigma_ = 0;
-	num_shifts = 0;
-
-	singleMask = 1L << ((handle->nBitsPerDim - 1) * nDim);
-
-	dimMask = singleMask;
-	for ( i = 1; i < nDim; i++ ) {
-		dimMask |= singleMask << i;
-	}
-
-	for ( i = 0; i < handle->nBitsPerDim; i++ ) {
-		sigma = ((index & dimMask) ^ ( (index & dimMask) >> 1 )) & dimMask;
-		sigma_ |= rollRight( sigma, num_shifts, dimMask );
-
-		principal = nDim - 1;
-		for ( j = 1; j < nDim; j++ ) {
-			if ( (index & singleMask) != ((index >> j) & singleMask) ) {
-				principal = nDim - j - 1;
-				break;
-			}
-		}
-
-		/* complement nth bit */
-		tau = sigma ^ singleMask;
-
-		/* if even parity, complement in principal bit position */
-		if ( !(index & singleMask) ) {
-			tau ^= singleMask << ( nDim - principal - 1 ); 
-		}
-
-		tau_ = rollRight( tau, num_shifts, dimMask );
-
-		num_shifts += principal;
-		num_shifts %= nDim;
-
-		w |= ((w & dimMask) ^ tau_) >> nDim;
-
-		dimMask >>= nDim;
-		singleMask >>= nDim;
-	}
+	uint64_t p[nDim];
 
-	x = w ^ sigma_;
-
-	/* undo bit interleaving to get coordinates */
-	for ( i = 0; i < nDim; i++ ) {
-		coords[i] = 0;
-
-		singleMask = 1L << (nDim*handle->nBitsPerDim - 1 - i);
-
-		for ( j = 0; j < handle->nBitsPerDim; j++ ) {
-			if ( x & singleMask ) {
-				coords[i] |= 1 << (handle->nBitsPerDim-j-1);
-			}
-			singleMask >>= nDim;
-		}
-	}
+	sfc_hilbert_decode( handle->nBitsPerDim, index, &p[0], &p[1], &p[2] );
+	coords[0] = (int)p[2];
+	coords[1] = (int)p[0];
+	coords[2] = (int)p[1];
 }
 
 int64_t artio_slab_index( artio_fileset *handle, int coords[nDim], int slab_dim ) {
@@ -314,3 +160,80 @@ void artio_sfc_coords( artio_fileset *handle, int64_t index, int coords[nDim] )
 			break;
 	}
 }
+
+/*******************************************************
+ * sfc_index_array
+ ******************************************************/
+int artio_sfc_index_array( artio_fileset *handle, int64_t count, 
+		const int *coords, int64_t *indices ) 
+/* purpose: computes the sfc index of count root cells 
+ * 	given as consecutive (x,y,z) triples in coords
+ */
+{
+	int64_t i;
+	int c[nDim];
+
+	switch ( handle->sfc_type ) {
+		case ARTIO_SFC_HILBERT:
+#ifdef _OPENMP
+			#pragma omp parallel for schedule(static) if (count >= SFC_PARALLEL_MIN)
+#endif
+			for ( i = 0; i < count; i++ ) {
+				indices[i] = (int64_t)sfc_hilbert_encode( handle->nBitsPerDim,
+						coords[nDim*i+1], coords[nDim*i+2], coords[nDim*i] );
+			}
+			break;
+		case ARTIO_SFC_SLAB_X:
+		case ARTIO_SFC_SLAB_Y:
+		case ARTIO_SFC_SLAB_Z:
+			for ( i = 0; i < count; i++ ) {
+				c[0] = coords[nDim*i];
+				c[1] = coords[nDim*i+1];
+				c[2] = coords[nDim*i+2];
+				indices[i] = artio_sfc_index( handle, c );
+			}
+			break;
+		default:
+			return ARTIO_ERR_INVALID_SFC;
+	}
+
+	return ARTIO_SUCCESS;
+}
+
+/*******************************************************
+ * sfc_coords_array
+ ******************************************************/
+int artio_sfc_coords_array( artio_fileset *handle, int64_t count, 
+		const int64_t *indices, int *coords ) 
+/* purpose: inverse of artio_sfc_index_array
+ */
+{
+	int64_t i;
+	uint64_t p[nDim];
+
+	switch ( handle->sfc_type ) {
+		case ARTIO_SFC_HILBERT:
+#ifdef _OPENMP
+			#pragma omp parallel for schedule(static) private(p) if (count >= SFC_PARALLEL_MIN)
+#endif
+			for ( i = 0; i < count; i++ ) {
+				sfc_hilbert_decode( handle->nBitsPerDim, indices[i], 
+						&p[0], &p[1], &p[2] );
+				coords[nDim*i] = (int)p[2];
+				coords[nDim*i+1] = (int)p[0];
+				coords[nDim*i+2] = (int)p[1];
+			}
+			break;
+		case ARTIO_SFC_SLAB_X:
+		case ARTIO_SFC_SLAB_Y:
+		case ARTIO_SFC_SLAB_Z:
+			for ( i = 0; i < count; i++ ) {
+				artio_sfc_coords( handle, indices[i], &coords[nDim*i] );
+			}
+			break;
+		default:
+			return ARTIO_ERR_INVALID_SFC;
+	}
+
+	return ARTIO_SUCCESS;
+}
@@ -74,6 +74,11 @@ class ARTIOOctreeSubset(OctreeSubset):
     def max_ind(self):
         return self.sfc_end
 
+    @property
+    def _mask_cache_key(self):
+        # The index keeps one range handler per sfc range.
+        return (self._type_name, self.sfc_start, self.sfc_end)
+
     def fill(self, fields, selector):
         if len(fields) == 0: return []
         handle = self.oct_handler.artio_handle
@@ -97,6 +102,21 @@ class ARTIOOctreeSubset(OctreeSubset):
         art_fields = [(ptype_indices.index(ptype), fname) for
                       ptype, fname in fields]
         species_data = self.oct_handler.fill_sfc_particles(art_fields)
+        return self._species_to_fields(fields, species_data)
+
+    def fill_particles_selected(self, fields, selector):
+        # Like fill_particles, but the selector is applied while reading so
+        # that unselected particles are never copied out.
+        if len(fields) == 0: return {}
+        ptype_indices = self.ds.particle_types
+        art_fields = [(ptype_indices.index(ptype), fname) for
+                      ptype, fname in fields]
+        species_data = self.oct_handler.fill_sfc_particles_selected(
+            selector, art_fields)
+        return self._species_to_fields(fields, species_data)
+
+    def _species_to_fields(self, fields, species_data):
+        ptype_indices = self.ds.particle_types
         tr = defaultdict(dict)
         # Now we need to sum things up and then fill
         for s, f in fields:
@@ -335,7 +355,8 @@ class ARTIODataset(Dataset):
 
     def __init__(self, filename, dataset_type='artio',
                  storage_filename=None, max_range = 1024,
-                 units_override=None, unit_system="cgs"):
+                 units_override=None, unit_system="cgs", use_mmap = False,
+                 use_index = False, use_prefetch = False):
         from sys import version
         if self._handle is not None:
             return
@@ -344,9 +365,15 @@ class ARTIODataset(Dataset):
         self._filename = filename
         self._fileset_prefix = filename[:-4]
         if version < '3':
-            self._handle = artio_fileset(self._fileset_prefix)
+            self._handle = artio_fileset(self._fileset_prefix,
+                                         use_mmap = use_mmap,
+                                         use_index = use_index,
+                                         use_prefetch = use_prefetch)
         else:
-            self._handle = artio_fileset(bytes(self._fileset_prefix,'utf-8'))
+            self._handle = artio_fileset(bytes(self._fileset_prefix,'utf-8'),
+                                         use_mmap = use_mmap,
+                                         use_index = use_index,
+                                         use_prefetch = use_prefetch)
         self.artio_parameters = self._handle.parameters
         # Here we want to initiate a traceback, if the reader is not built.
         Dataset.__init__(self, filename, dataset_type,
@@ -50,23 +50,16 @@ class IOHandlerARTIO(BaseIOHandler):
                     rv.pop(ptype)
 
     def _read_particle_fields(self, chunks, ptf, selector):
-        pn = "POSITION_%s"
         chunks = list(chunks)
         fields = [(ptype, fname) for ptype, field_list in ptf.items()
                                  for fname in field_list]
-        for ptype, field_list in sorted(ptf.items()):
-            for ax in 'XYZ':
-                if pn % ax not in field_list:
-                    fields.append((ptype, pn % ax))
         for chunk in chunks: # These should be organized by grid filename
             for subset in chunk.objs:
-                rv = dict(**subset.fill_particles(fields))
+                # The selector is applied as the particles are read
+                rv = dict(**subset.fill_particles_selected(fields, selector))
                 for ptype, field_list in sorted(ptf.items()):
-                    x, y, z = (np.asarray(rv[ptype][pn % ax], dtype="=f8")
-                               for ax in 'XYZ')
-                    mask = selector.select_points(x, y, z, 0.0)
-                    if mask is None: continue
+                    if rv[ptype][field_list[0]].size == 0: continue
                     for field in field_list:
                         data = np.asarray(rv[ptype][field], "=f8")
-                        yield (ptype, field), data[mask]
+                        yield (ptype, field), data
                     rv.pop(ptype)
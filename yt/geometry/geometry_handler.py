@@ -17,6 +17,7 @@ Geometry container base class.
 import os
 from yt.extern.six.moves import cPickle
 import weakref
+from collections import OrderedDict
 from yt.utilities.on_demand_imports import _h5py as h5py
 import numpy as np
 
@@ -25,6 +26,7 @@ from yt.funcs import iterable
 from yt.units.yt_array import \
     YTArray, uconcatenate
 from yt.utilities.io_handler import io_registry
+from yt.utilities.lib.bitarray import bitarray
 from yt.utilities.logger import ytLogger as mylog
 from yt.utilities.parallel_tools.parallel_analysis_interface import \
     ParallelAnalysisInterface, parallel_root_only
@@ -57,6 +59,15 @@ class Index(ParallelAnalysisInterface):
         mylog.debug("Detecting fields.")
         self._detect_output_fields()
 
+    _mask_cache = None
+
+    def _get_mask_cache(self):
+        # Created on first use, as some indexes set up their own state.
+        if self._mask_cache is None:
+            self._mask_cache = SelectionMaskCache(
+                ytcfg.getint("yt", "mask_cache_bytes"))
+        return self._mask_cache
+
     def _initialize_state_variables(self):
         self._parallel_locking = False
         self._data_file = None
@@ -412,6 +423,64 @@ class YTDataChunk(object):
         return ci
 
 
+class SelectionMaskCache(object):
+    """
+    A least recently used cache of selection masks, keyed by the hash of the
+    selector and an id for the grid, octree domain or mesh the mask covers.
+    Masks are stored one bit per cell, and the oldest are dropped once the
+    stored bits exceed max_bytes; a max_bytes of zero disables the cache.
+    """
+    # Charged to every entry, so selections of nothing are bounded too.
+    _entry_bytes = 64
+
+    def __init__(self, max_bytes):
+        self.max_bytes = max_bytes
+        self.nbytes = 0
+        self._masks = OrderedDict()
+
+    def get(self, selector, obj_id):
+        # Returns (mask, count), or None if we do not have this selection.
+        # A mask of None means nothing was selected.
+        key = (hash(selector), obj_id)
+        entry = self._masks.pop(key, None)
+        if entry is None: return None
+        self._masks[key] = entry
+        shape, count, bits, nbytes = entry
+        if bits is None: return None, 0
+        return bits.as_bool_array().reshape(shape), count
+
+    def contains(self, selector, obj_id):
+        # Whether the selection is cached, without unpacking its mask or
+        # refreshing its place in the queue.
+        return (hash(selector), obj_id) in self._masks
+
+    def __contains__(self, key):
+        selector, obj_id = key
+        return self.contains(selector, obj_id)
+
+    def add(self, selector, obj_id, mask, count):
+        if self.max_bytes <= 0: return
+        if mask is None:
+            shape, bits, nbytes = None, None, self._entry_bytes
+        else:
+            shape = mask.shape
+            bits = bitarray(arr = mask.ravel())
+            nbytes = bits.ibuf.nbytes + self._entry_bytes
+            if nbytes > self.max_bytes: return
+        key = (hash(selector), obj_id)
+        old = self._masks.pop(key, None)
+        if old is not None:
+            self.nbytes -= old[3]
+        self._masks[key] = (shape, count, bits, nbytes)
+        self.nbytes += nbytes
+        while self.nbytes > self.max_bytes:
+            key, old = self._masks.popitem(last = False)
+            self.nbytes -= old[3]
+
+    def clear(self):
+        self._masks.clear()
+        self.nbytes = 0
+
 class ChunkDataCache(object):
     def __init__(self, base_iter, preload_fields, geometry_handler,
                  max_length = 256):
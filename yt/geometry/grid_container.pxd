@@ -35,13 +35,27 @@ cdef class GridTree:
     cdef void setup_data(self, GridVisitorData *data)
     cdef void visit_grids(self, GridVisitorData *data,
                           grid_visitor_function *func,
-                          SelectorObject selector)
+                          SelectorObject selector) except *
     cdef void recursively_visit_grid(self,
                           GridVisitorData *data,
                           grid_visitor_function *func,
                           SelectorObject selector,
                           GridTreeNode *grid,
-                          np.uint8_t *buf = ?)
+                          np.uint8_t *buf = ?) except *
+
+cdef class GridBVH:
+    cdef public int num_grids
+    cdef public int num_nodes
+    cdef int leaf_size
+    cdef np.float64_t[:,:] grid_left_edge
+    cdef np.float64_t[:,:] grid_right_edge
+    cdef np.int32_t[:,:] grid_levels
+    cdef np.float64_t[:,:] node_left_edge
+    cdef np.float64_t[:,:] node_right_edge
+    cdef np.int64_t[:] node_start
+    cdef np.int64_t[:] node_end
+    cdef np.int64_t[:] node_child
+    cdef np.int64_t[:] order
 
 cdef class MatchPointsToGrids:
 
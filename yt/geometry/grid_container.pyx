@@ -159,7 +159,7 @@ cdef class GridTree:
 
     cdef void visit_grids(self, GridVisitorData *data,
                           grid_visitor_function *func,
-                          SelectorObject selector):
+                          SelectorObject selector) except *:
         # This iterates over all root grids, given a selector+data, and then
         # visits each one and its children.
         cdef int i
@@ -169,16 +169,18 @@ cdef class GridTree:
         cdef np.uint8_t *buf = NULL
         if self.mask is not None:
             buf = self.mask.buf
-        for i in range(self.num_root_grids):
-            grid = &self.root_grids[i]
-            self.recursively_visit_grid(data, func, selector, grid, buf)
-        grid_visitors.free_tuples(data)
+        try:
+            for i in range(self.num_root_grids):
+                grid = &self.root_grids[i]
+                self.recursively_visit_grid(data, func, selector, grid, buf)
+        finally:
+            grid_visitors.free_tuples(data)
 
     cdef void recursively_visit_grid(self, GridVisitorData *data,
                                      grid_visitor_function *func,
                                      SelectorObject selector,
                                      GridTreeNode *grid,
-                                     np.uint8_t *buf = NULL):
+                                     np.uint8_t *buf = NULL) except *:
         # Visit this grid and all of its child grids, with a given grid visitor
         # function.  We early terminate if we are not selected by the selector.
         cdef int i
@@ -268,6 +270,115 @@ cdef class GridTree:
         self.visit_grids(&data, grid_visitors.fwidth_cells, selector)
         return fwidth
     
+cdef class GridBVH:
+    """A bounding volume hierarchy over the edges of every grid in an index.
+
+    The grids are split recursively at the median of their centers along the
+    longest axis, so the tree is balanced and its depth is ~log2(num_grids).
+    Each node stores the box enclosing all of its grids; a selector prunes a
+    whole subtree when ``select_bbox`` rejects that box, and only the grids in
+    the surviving leaves are passed to ``select_grid``.
+    """
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def __init__(self, left_edges, right_edges, levels, int leaf_size = 8):
+        cdef np.ndarray[np.float64_t, ndim=2] le, re, centers
+        cdef np.ndarray[np.float64_t, ndim=2] nle, nre
+        cdef np.ndarray[np.int64_t, ndim=1] order, nstart, nend, nchild
+        cdef np.int64_t n, s, e, mid, nn
+        cdef int ax
+        le = np.ascontiguousarray(_ensure_code(left_edges), dtype="float64")
+        re = np.ascontiguousarray(_ensure_code(right_edges), dtype="float64")
+        self.num_grids = le.shape[0]
+        self.leaf_size = max(leaf_size, 1)
+        self.grid_left_edge = le
+        self.grid_right_edge = re
+        self.grid_levels = np.ascontiguousarray(levels, dtype="int32").reshape(
+            (self.num_grids, -1))
+        centers = 0.5 * (le + re)
+        order = np.arange(self.num_grids, dtype="int64")
+        # A median split tree with leaves of at least one grid has fewer
+        # than 2 * num_grids nodes.
+        nn = max(2 * self.num_grids, 1)
+        nle = np.zeros((nn, 3), dtype="float64")
+        nre = np.zeros((nn, 3), dtype="float64")
+        nstart = np.zeros(nn, dtype="int64")
+        nend = np.zeros(nn, dtype="int64")
+        nchild = np.empty(nn, dtype="int64")
+        nchild[:] = -1
+        self.num_nodes = 1
+        stack = [(0, 0, self.num_grids)]
+        while len(stack) > 0:
+            n, s, e = stack.pop()
+            nstart[n] = s
+            nend[n] = e
+            if e == s: continue
+            sub = order[s:e]
+            nle[n, :] = le[sub].min(axis=0)
+            nre[n, :] = re[sub].max(axis=0)
+            if e - s <= self.leaf_size:
+                continue
+            ax = int(np.argmax(centers[sub].ptp(axis=0)))
+            mid = (e - s) // 2
+            order[s:e] = sub[np.argpartition(centers[sub, ax], mid)]
+            nchild[n] = self.num_nodes
+            self.num_nodes += 2
+            stack.append((nchild[n] + 1, s + mid, e))
+            stack.append((nchild[n], s, s + mid))
+        self.node_left_edge = nle
+        self.node_right_edge = nre
+        self.node_start = nstart
+        self.node_end = nend
+        self.node_child = nchild
+        self.order = order
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    def select_grids(self, SelectorObject selector):
+        """Return the same grid mask as ``selector.select_grids`` would for
+        the grids this hierarchy was built over."""
+        # Selectors that pick grids by something other than their extent
+        # (grid ids, octree domains, compositions) are asked directly.
+        if type(selector).select_grids is not SelectorObject.select_grids:
+            return selector.select_grids(np.asarray(self.grid_left_edge),
+                                         np.asarray(self.grid_right_edge),
+                                         np.asarray(self.grid_levels))
+        cdef np.ndarray[np.uint8_t, ndim=1] gridi
+        gridi = np.zeros(self.num_grids, dtype="uint8")
+        cdef np.int64_t stack[128]
+        cdef np.float64_t LE[3]
+        cdef np.float64_t RE[3]
+        cdef np.int64_t n, k, g
+        cdef int i, sp
+        if self.num_grids == 0:
+            return gridi.astype("bool")
+        with nogil:
+            sp = 1
+            stack[0] = 0
+            while sp > 0:
+                sp -= 1
+                n = stack[sp]
+                for i in range(3):
+                    LE[i] = self.node_left_edge[n, i]
+                    RE[i] = self.node_right_edge[n, i]
+                if selector.select_bbox(LE, RE) == 0:
+                    continue
+                if self.node_child[n] >= 0:
+                    stack[sp] = self.node_child[n] + 1
+                    stack[sp + 1] = self.node_child[n]
+                    sp += 2
+                    continue
+                for k in range(self.node_start[n], self.node_end[n]):
+                    g = self.order[k]
+                    for i in range(3):
+                        LE[i] = self.grid_left_edge[g, i]
+                        RE[i] = self.grid_right_edge[g, i]
+                    gridi[g] = selector.select_grid(LE, RE,
+                                                    self.grid_levels[g, 0])
+        return gridi.astype("bool")
+
 cdef class MatchPointsToGrids:
 
     @cython.boundscheck(False)
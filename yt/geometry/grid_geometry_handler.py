@@ -23,13 +23,15 @@ from collections import defaultdict
 from yt.arraytypes import blankRecordArray
 from yt.config import ytcfg
 from yt.funcs import \
-    ensure_list, ensure_numpy_array
+    ensure_list, ensure_numpy_array, get_num_threads
 from yt.geometry.geometry_handler import \
     Index, YTDataChunk, ChunkDataCache
 from yt.utilities.definitions import MAXLEVEL
 from yt.utilities.logger import ytLogger as mylog
 from .grid_container import \
-    GridTree, MatchPointsToGrids
+    GridTree, GridBVH, MatchPointsToGrids
+from .selection_routines import \
+    SelectorObject
 
 
 class GridIndex(Index):
@@ -277,6 +279,18 @@ class GridIndex(Index):
         return GridTree(self.num_grids, left_edge, right_edge, dimensions,
                         parent_ind, level, num_children)
 
+    _grid_bvh = None
+
+    def _get_grid_bvh(self):
+        # Built once over the grid edges and reused by every selection; it
+        # is only rebuilt if the number of grids changes.
+        if self._grid_bvh is None or \
+           self._grid_bvh.num_grids != self.num_grids:
+            self._grid_bvh = GridBVH(self.grid_left_edge,
+                                     self.grid_right_edge,
+                                     self.grid_levels)
+        return self._grid_bvh
+
     def convert(self, unit):
         return self.dataset.conversion_factors[unit]
 
@@ -290,9 +304,7 @@ class GridIndex(Index):
             dobj._chunk_info = np.empty(1, dtype='object')
             dobj._chunk_info[0] = weakref.proxy(dobj)
         elif getattr(dobj, "_grids", None) is None:
-            gi = dobj.selector.select_grids(self.grid_left_edge,
-                                            self.grid_right_edge,
-                                            self.grid_levels)
+            gi = self._get_grid_bvh().select_grids(dobj.selector)
             grids = list(sorted(self.grids[gi], key = _gsort))
             dobj._chunk_info = np.empty(len(grids), dtype='object')
             for i, g in enumerate(grids):
@@ -311,9 +323,43 @@ class GridIndex(Index):
         if fast_index is not None:
             return fast_index.count(dobj.selector)
         if grids is None: grids = dobj._chunk_info
+        self._fill_selector_masks(dobj.selector, grids)
         count = sum((g.count(dobj.selector) for g in grids))
         return count
 
+    def _fill_selector_masks(self, selector, grids):
+        # Selectors that keep the generic fill_mask can compute the masks of
+        # many grids in one parallel call; the grids then pick them up as if
+        # they had filled them one at a time.
+        if type(selector).fill_mask is not SelectorObject.fill_mask:
+            return
+        sid = hash(selector)
+        cache = self._get_mask_cache()
+        todo = [g for g in grids if getattr(g, "_cache_mask", False)
+                and g._last_selector_id != sid
+                and not cache.contains(selector, g.id)]
+        if len(todo) < 2: return
+        masks, offsets, counts = selector.fill_masks(
+            np.array([g.LeftEdge.d for g in todo]),
+            np.array([g.RightEdge.d for g in todo]),
+            np.array([g.ActiveDimensions for g in todo]),
+            np.array([g.Level for g in todo]),
+            [g.child_mask for g in todo],
+            dds = np.array([g.dds.d for g in todo]),
+            num_threads = int(get_num_threads()))
+        for i, g in enumerate(todo):
+            count = counts[i]
+            mask = None
+            if count > 0:
+                # A copy, so one grid's mask does not keep the whole
+                # batch alive.
+                mask = masks[offsets[i]:offsets[i+1]].reshape(
+                    g.ActiveDimensions).copy()
+            cache.add(selector, g.id, mask, count)
+            g._last_mask = mask
+            g._last_selector_id = sid
+            g._last_count = count
+
     def _chunk_all(self, dobj, cache = True, fast_index = None):
         gobjs = getattr(dobj._current_chunk, "objs", dobj._chunk_info)
         fast_index = fast_index or getattr(dobj._current_chunk, "_fast_index",
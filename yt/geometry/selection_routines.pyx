@@ -19,6 +19,7 @@ cimport numpy as np
 cimport cython
 from cython cimport floating
 from libc.stdlib cimport malloc, free
+from cython.parallel import prange
 from yt.utilities.lib.fnv_hash cimport c_fnv_hash as fnv_hash
 from yt.utilities.lib.fp_utils cimport fclip, iclip, fmax, fmin, imin, imax
 from .oct_container cimport OctreeContainer, Oct
@@ -46,6 +47,10 @@ cdef extern from "math.h":
 cdef np.float64_t grid_eps = np.finfo(np.float64).eps
 grid_eps = 0.0
 
+# Composite selectors work through a row of cells in blocks of this many, so
+# their scratch masks can live on the stack.
+DEF ROW_BLOCK = 64
+
 # These routines are separated into a couple different categories:
 #
 #   * Routines for identifying intersections of an object with a bounding box
@@ -110,6 +115,55 @@ def mask_fill(np.ndarray[np.float64_t, ndim=1] out,
     else:
         raise RuntimeError
 
+cdef inline void _cell_row_centers(np.float64_t start, np.float64_t dz,
+                                   int n, np.float64_t *zpos) nogil:
+    # The centers along a row are accumulated just as the cell loops always
+    # have, so that cells on a selector boundary are decided the same way.
+    cdef int k
+    for k in range(n):
+        zpos[k] = start
+        start += dz
+
+cdef inline void _pad_bbox(np.float64_t left_edge[3],
+                           np.float64_t right_edge[3],
+                           np.float64_t ple[3], np.float64_t pre[3]) nogil:
+    # Cell edges are found from accumulated centers and can round just past
+    # the edges of their grid, so a grid is only rejected outright if a
+    # slightly larger box around it is.
+    cdef int i
+    cdef np.float64_t pad
+    for i in range(3):
+        pad = 1e-3 * (right_edge[i] - left_edge[i])
+        ple[i] = left_edge[i] - pad
+        pre[i] = right_edge[i] + pad
+
+cdef inline int _corners_selected(SelectorObject sel,
+                                  np.float64_t left_edge[3],
+                                  np.float64_t right_edge[3],
+                                  np.float64_t center[3]) nogil:
+    # For a convex selector around center: if all eight corners of the box
+    # are selected, so is every cell center inside it.  Along a periodic
+    # axis the distance is only convex up to half a domain from the center,
+    # so boxes reaching that far are not accepted.
+    cdef int i, j, k
+    cdef np.float64_t *arr[2]
+    cdef np.float64_t pos[3]
+    for i in range(3):
+        if sel.periodicity[i] and \
+           (fabs(left_edge[i] - center[i]) >= 0.5 * sel.domain_width[i] or
+            fabs(right_edge[i] - center[i]) >= 0.5 * sel.domain_width[i]):
+            return 0
+    arr[0] = left_edge
+    arr[1] = right_edge
+    for i in range(2):
+        pos[0] = arr[i][0]
+        for j in range(2):
+            pos[1] = arr[j][1]
+            for k in range(2):
+                pos[2] = arr[k][2]
+                if sel.select_point(pos) == 0: return 0
+    return 1
+
 cdef class SelectorObject:
 
     def __cinit__(self, dobj, *args):
@@ -336,6 +390,35 @@ cdef class SelectorObject:
                                np.float64_t right_edge[3]) nogil:
         return 0
 
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        # Classify a whole grid before its cells are visited: 0 if none of
+        # its cells can be selected, 2 if every one of them is, and 1 if
+        # they have to be checked.  Only selectors that can tell cheaply and
+        # conservatively return anything but 1.
+        return 1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        # Evaluate select_cell for the n cells centered at
+        # (pos[0], pos[1], zpos[k]).  Cells with cmask[k] == 0 are covered
+        # by a child and their out[k] is ignored by the caller, so we skip
+        # them here; selectors with a cheap cell test override this with a
+        # straight loop over the whole row that the compiler can vectorize.
+        cdef int k
+        cdef np.float64_t cpos[3]
+        cpos[0] = pos[0]
+        cpos[1] = pos[1]
+        for k in range(n):
+            out[k] = 0
+            if cmask[k] == 0: continue
+            cpos[2] = zpos[k]
+            out[k] = self.select_cell(cpos, dds)
+
     @cython.boundscheck(False)
     @cython.wraparound(False)
     @cython.cdivision(True)
@@ -443,9 +526,66 @@ cdef class SelectorObject:
         cdef int total
         total = self.fill_mask_selector(left_edge, right_edge, dds, dim,
                                         child_mask, mask, level)
+        if total < 0: raise MemoryError
         if total == 0: return None
         return mask.astype("bool")
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    def fill_masks(self, left_edges, right_edges, dims, levels, child_masks,
+                   dds = None, int num_threads = 0):
+        """Fill the selection masks of a batch of grids at once.
+
+        The masks are written, in order, into one flat buffer; the mask of
+        grid n is ``masks[offsets[n]:offsets[n+1]]`` in C order with shape
+        ``dims[n]``, and ``counts[n]`` is its number of selected cells.  The
+        grids are processed in parallel without the GIL.
+        """
+        cdef np.float64_t[:,:] le = np.ascontiguousarray(left_edges,
+                                                         dtype="float64")
+        cdef np.float64_t[:,:] re = np.ascontiguousarray(right_edges,
+                                                         dtype="float64")
+        cdef np.int32_t[:,:] dim = np.ascontiguousarray(dims, dtype="int32")
+        cdef np.int32_t[:] lev = np.ascontiguousarray(levels,
+                                        dtype="int32").reshape(-1)
+        cdef int ng = dim.shape[0]
+        if dds is None:
+            dds = (np.asarray(re) - np.asarray(le)) / np.asarray(dim)
+        cdef np.float64_t[:,:] dd = np.ascontiguousarray(dds, dtype="float64")
+        if le.shape[0] != ng or re.shape[0] != ng or dd.shape[0] != ng \
+           or lev.shape[0] != ng or len(child_masks) != ng:
+            raise RuntimeError("fill_masks needs one entry per grid")
+        cdef np.int64_t[:] offsets = np.zeros(ng + 1, dtype="int64")
+        offsets[1:] = np.cumsum(np.prod(np.asarray(dim), axis=1,
+                                        dtype="int64"))
+        # Hold on to contiguous copies of the child masks while their
+        # addresses are used below.
+        cms = []
+        cdef np.intp_t[:] cptr = np.zeros(ng, dtype="intp")
+        cdef np.ndarray[np.uint8_t, ndim=1] cm
+        cdef int n
+        for n in range(ng):
+            cm = np.ascontiguousarray(child_masks[n]).view("uint8").reshape(-1)
+            if cm.shape[0] != offsets[n + 1] - offsets[n]:
+                raise RuntimeError("child mask %s does not match its dims" % n)
+            cms.append(cm)
+            cptr[n] = <np.intp_t> cm.data
+        masks = np.zeros(offsets[ng], dtype="uint8")
+        cdef np.uint8_t[:] mbuf = masks
+        cdef np.int64_t[:] counts = np.zeros(ng, dtype="int64")
+        for n in prange(ng, nogil=True, schedule="dynamic",
+                        num_threads=num_threads):
+            if offsets[n + 1] == offsets[n]:
+                continue
+            counts[n] = self.fill_mask_cells(&le[n, 0], &re[n, 0], &dd[n, 0],
+                                             <int *> &dim[n, 0],
+                                             <np.uint8_t *> cptr[n],
+                                             &mbuf[offsets[n]], lev[n])
+        if ng > 0 and np.asarray(counts).min() < 0:
+            raise MemoryError
+        return masks.view("bool"), np.asarray(offsets), np.asarray(counts)
+
     @cython.boundscheck(False)
     @cython.wraparound(False)
     @cython.cdivision(True)
@@ -455,26 +595,68 @@ cdef class SelectorObject:
                                 np.ndarray[np.uint8_t, ndim=3, cast=True] child_mask,
                                 np.ndarray[np.uint8_t, ndim=3] mask,
                                 int level):
-        cdef int i, j, k
+        cdef np.ndarray[np.uint8_t, ndim=3] cm
+        cm = np.ascontiguousarray(child_mask).view("uint8")
+        if not mask.flags["C_CONTIGUOUS"]:
+            raise RuntimeError("fill_mask_selector needs a C-contiguous mask")
+        return self.fill_mask_cells(left_edge, right_edge, dds, dim,
+                                    <np.uint8_t *> cm.data,
+                                    <np.uint8_t *> mask.data, level)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef int fill_mask_cells(self, np.float64_t left_edge[3],
+                             np.float64_t right_edge[3],
+                             np.float64_t dds[3], int dim[3],
+                             np.uint8_t *child_mask, np.uint8_t *mask,
+                             int level) nogil:
+        # child_mask and mask are C-ordered arrays of shape dim.  Returns
+        # the number of cells selected, or -1 if the row buffers could not
+        # be allocated.
+        cdef int i, j, k, edge
+        cdef np.int64_t off
         cdef int total = 0, this_level = 0
         cdef np.float64_t pos[3]
+        cdef np.float64_t *zpos
+        cdef np.uint8_t *cmask
+        cdef np.uint8_t *row
         if level < self.min_level or level > self.max_level:
             return 0
         if level == self.max_level:
             this_level = 1
-        with nogil:
-            pos[0] = left_edge[0] + dds[0] * 0.5
-            for i in range(dim[0]):
-                pos[1] = left_edge[1] + dds[1] * 0.5
-                for j in range(dim[1]):
-                    pos[2] = left_edge[2] + dds[2] * 0.5
+        edge = self.select_bbox_edge(left_edge, right_edge)
+        if edge == 0 or dim[2] <= 0:
+            return 0
+        zpos = <np.float64_t *> malloc(sizeof(np.float64_t) * dim[2])
+        cmask = <np.uint8_t *> malloc(sizeof(np.uint8_t) * dim[2] * 2)
+        if zpos == NULL or cmask == NULL:
+            free(zpos)
+            free(cmask)
+            return -1
+        row = cmask + dim[2]
+        _cell_row_centers(left_edge[2] + dds[2] * 0.5, dds[2], dim[2], zpos)
+        pos[0] = left_edge[0] + dds[0] * 0.5
+        for i in range(dim[0]):
+            pos[1] = left_edge[1] + dds[1] * 0.5
+            for j in range(dim[1]):
+                off = (<np.int64_t> i * dim[1] + j) * dim[2]
+                for k in range(dim[2]):
+                    cmask[k] = (child_mask[off + k] == 1 or this_level == 1)
+                if edge == 2:
                     for k in range(dim[2]):
-                        if child_mask[i, j, k] == 1 or this_level == 1:
-                            mask[i, j, k] = self.select_cell(pos, dds)
-                            total += mask[i, j, k]
-                        pos[2] += dds[2]
-                    pos[1] += dds[1]
-                pos[0] += dds[0]
+                        row[k] = 1
+                else:
+                    self.select_cells_row(pos, dds, zpos, dim[2],
+                                          cmask, row)
+                for k in range(dim[2]):
+                    if cmask[k] == 1:
+                        mask[off + k] = row[k]
+                        total += row[k]
+                pos[1] += dds[1]
+            pos[0] += dds[0]
+        free(zpos)
+        free(cmask)
         return total
 
     @cython.boundscheck(False)
@@ -482,7 +664,7 @@ cdef class SelectorObject:
     @cython.cdivision(True)
     cdef void visit_grid_cells(self, GridVisitorData *data,
                               grid_visitor_function *func,
-                              np.uint8_t *cached_mask = NULL):
+                              np.uint8_t *cached_mask = NULL) except *:
         # This function accepts a grid visitor function, the data that
         # corresponds to the current grid being examined (the most important
         # aspect of which is the .grid attribute, along with index values and
@@ -492,52 +674,74 @@ cdef class SelectorObject:
         cdef np.float64_t right_edge[3]
         cdef np.float64_t dds[3]
         cdef int dim[3]
-        cdef int this_level = 0, level, i
+        cdef int this_level = 0, level, i, j, k, edge = 1
         cdef np.float64_t pos[3]
+        cdef np.float64_t *zpos
+        cdef np.uint8_t *cmask
+        cdef np.uint8_t *row
         level = data.grid.level
         if level < self.min_level or level > self.max_level:
             return
         if level == self.max_level:
             this_level = 1
-        cdef np.uint8_t child_masked, selected
+        cdef np.uint8_t selected
         for i in range(3):
             left_edge[i] = data.grid.left_edge[i]
             right_edge[i] = data.grid.right_edge[i]
             dds[i] = (right_edge[i] - left_edge[i])/data.grid.dims[i]
             dim[i] = data.grid.dims[i]
+        if cached_mask == NULL:
+            edge = self.select_bbox_edge(left_edge, right_edge)
+        zpos = <np.float64_t *> malloc(sizeof(np.float64_t) * (dim[2] + 1))
+        cmask = <np.uint8_t *> malloc(sizeof(np.uint8_t) * (dim[2] + 1) * 2)
+        if zpos == NULL or cmask == NULL:
+            free(zpos)
+            free(cmask)
+            raise MemoryError
+        row = cmask + dim[2] + 1
         with nogil:
+            _cell_row_centers(left_edge[2] + dds[2] * 0.5, dds[2], dim[2], zpos)
             pos[0] = left_edge[0] + dds[0] * 0.5
             data.pos[0] = 0
             for i in range(dim[0]):
                 pos[1] = left_edge[1] + dds[1] * 0.5
                 data.pos[1] = 0
                 for j in range(dim[1]):
-                    pos[2] = left_edge[2] + dds[2] * 0.5
+                    # We short-circuit if we have a cache; if we don't, we
+                    # only set selected to true if it's *not* masked by a
+                    # child and it *is* selected.  The child mask is found
+                    # first, so the whole row can be evaluated at once.
+                    if cached_mask == NULL and edge != 0:
+                        for k in range(dim[2]):
+                            data.pos[2] = k
+                            if this_level == 1:
+                                cmask[k] = 1
+                            else:
+                                cmask[k] = (check_child_masked(data) == 0)
+                        if edge == 2:
+                            for k in range(dim[2]):
+                                row[k] = cmask[k]
+                        else:
+                            self.select_cells_row(pos, dds, zpos, dim[2],
+                                                  cmask, row)
                     data.pos[2] = 0
                     for k in range(dim[2]):
-                        # We short-circuit if we have a cache; if we don't, we
-                        # only set selected to true if it's *not* masked by a
-                        # child and it *is* selected.
                         if cached_mask != NULL:
                             selected = ba_get_value(cached_mask,
                                                     data.global_index)
+                        elif edge == 0 or cmask[k] == 0:
+                            selected = 0
                         else:
-                            if this_level == 1:
-                                child_masked = 0
-                            else:
-                                child_masked = check_child_masked(data)
-                            if child_masked == 0:
-                                selected = self.select_cell(pos, dds)
-                            else:
-                                selected = 0
+                            selected = row[k]
                         func(data, selected)
                         data.global_index += 1
-                        pos[2] += dds[2]
                         data.pos[2] += 1
                     pos[1] += dds[1]
                     data.pos[1] += 1
                 pos[0] += dds[0]
                 data.pos[0] += 1
+        free(zpos)
+        free(cmask)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
@@ -788,6 +992,53 @@ cdef class SphereSelector(SelectorObject):
             if dist > self.radius2: return 0
         return 1
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        cdef np.float64_t ple[3]
+        cdef np.float64_t pre[3]
+        _pad_bbox(left_edge, right_edge, ple, pre)
+        if self.select_bbox(ple, pre) == 0: return 0
+        if _corners_selected(self, left_edge, right_edge, self.center): return 2
+        return 1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        # select_cell with everything that depends only on x and y hoisted
+        # out of the loop.  Skipping the early exits of select_point does
+        # not change its answer, since the partial sums only grow.
+        cdef int i, k
+        cdef np.uint8_t in_xy, box_xy, box_z
+        cdef np.float64_t dist, dist2_xy, z
+        in_xy = (pos[0] - 0.5*dds[0] <= self.center[0]) & \
+                (self.center[0] <= pos[0]+0.5*dds[0]) & \
+                (pos[1] - 0.5*dds[1] <= self.center[1]) & \
+                (self.center[1] <= pos[1]+0.5*dds[1])
+        box_xy = 1
+        dist2_xy = 0
+        for i in range(2):
+            if self.check_box[i] and \
+              (pos[i] < self.bbox[i][0] or pos[i] > self.bbox[i][1]):
+                box_xy = 0
+            dist = _periodic_dist(pos[i], self.center[i], self.domain_width[i],
+                                  self.periodicity[i])
+            dist2_xy += dist*dist
+        for k in range(n):
+            z = zpos[k]
+            dist = _periodic_dist(z, self.center[2], self.domain_width[2],
+                                  self.periodicity[2])
+            box_z = (self.check_box[2] == 0) | \
+                    ((z >= self.bbox[2][0]) & (z <= self.bbox[2][1]))
+            out[k] = (in_xy & (z - 0.5*dds[2] <= self.center[2]) &
+                      (self.center[2] <= z + 0.5*dds[2])) | \
+                     (box_xy & box_z & (dist2_xy + dist*dist <= self.radius2))
+
     def _hash_vals(self):
         return (("radius", self.radius),
                 ("radius2", self.radius2),
@@ -879,6 +1130,56 @@ cdef class RegionSelector(SelectorObject):
                 return 0
         return 1
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        cdef np.float64_t ple[3]
+        cdef np.float64_t pre[3]
+        cdef int i
+        _pad_bbox(left_edge, right_edge, ple, pre)
+        if self.select_bbox(ple, pre) == 0: return 0
+        for i in range(3):
+            if left_edge[i] < self.left_edge[i] or \
+               right_edge[i] > self.right_edge[i]:
+                return 1
+        return 2
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        cdef int i, k
+        cdef np.uint8_t ok_xy = 1
+        cdef np.float64_t z, zl, zr
+        cdef np.float64_t L = self.left_edge[2]
+        cdef np.float64_t R = self.right_edge[2]
+        cdef np.float64_t S = self.right_edge_shift[2]
+        for i in range(2):
+            if self.loose_selection:
+                if (pos[i] + dds[i]*0.5 < self.left_edge[i] and
+                    pos[i] - dds[i]*0.5 >= self.right_edge_shift[i]) or \
+                    pos[i] - dds[i]*0.5 >= self.right_edge[i]:
+                    ok_xy = 0
+            elif (self.right_edge_shift[i] <= pos[i] < self.left_edge[i]) or \
+                 pos[i] >= self.right_edge[i]:
+                ok_xy = 0
+        if ok_xy == 0:
+            for k in range(n):
+                out[k] = 0
+        elif self.loose_selection:
+            for k in range(n):
+                zl = zpos[k] - dds[2]*0.5
+                zr = zpos[k] + dds[2]*0.5
+                out[k] = (((zr >= L) | (zl < S)) & (zl < R))
+        else:
+            for k in range(n):
+                z = zpos[k]
+                out[k] = (((z < S) | (z >= L)) & (z < R))
+
     @cython.boundscheck(False)
     @cython.wraparound(False)
     @cython.cdivision(True)
@@ -907,21 +1208,28 @@ cdef class RegionSelector(SelectorObject):
     @cython.boundscheck(False)
     @cython.wraparound(False)
     @cython.cdivision(True)
-    cdef int fill_mask_selector(self, np.float64_t left_edge[3],
-                                np.float64_t right_edge[3],
-                                np.float64_t dds[3], int dim[3],
-                                np.ndarray[np.uint8_t, ndim=3, cast=True] child_mask,
-                                np.ndarray[np.uint8_t, ndim=3] mask,
-                                int level):
+    cdef int fill_mask_cells(self, np.float64_t left_edge[3],
+                             np.float64_t right_edge[3],
+                             np.float64_t dds[3], int dim[3],
+                             np.uint8_t *child_mask, np.uint8_t *mask,
+                             int level) nogil:
         cdef int i, j, k
+        cdef np.int64_t off
         cdef int total = 0, this_level = 0
         cdef np.float64_t pos[3]
+        cdef np.int64_t si[3]
+        cdef np.int64_t ei[3]
+        cdef int n, edge
+        cdef np.float64_t *zpos
+        cdef np.uint8_t *cmask
+        cdef np.uint8_t *row
         if level < self.min_level or level > self.max_level:
             return 0
         if level == self.max_level:
             this_level = 1
-        cdef np.int64_t si[3]
-        cdef np.int64_t ei[3]
+        edge = self.select_bbox_edge(left_edge, right_edge)
+        if edge == 0:
+            return 0
         if not self.check_period:
             for i in range(3):
                 si[i] = <np.int64_t> ((self.left_edge[i] - left_edge[i])/dds[i])
@@ -932,19 +1240,38 @@ cdef class RegionSelector(SelectorObject):
             for i in range(3):
                 si[i] = 0
                 ei[i] = dim[i]
-        with nogil:
-            pos[0] = left_edge[0] + (si[0] + 0.5) * dds[0]
-            for i in range(si[0], ei[0]):
-                pos[1] = left_edge[1] + (si[1] + 0.5) * dds[1]
-                for j in range(si[1], ei[1]):
-                    pos[2] = left_edge[2] + (si[2] + 0.5) * dds[2]
-                    for k in range(si[2], ei[2]):
-                        if child_mask[i, j, k] == 1 or this_level == 1:
-                            mask[i, j, k] = self.select_cell(pos, dds)
-                            total += mask[i, j, k]
-                        pos[2] += dds[2]
-                    pos[1] += dds[1]
-                pos[0] += dds[0]
+        n = ei[2] - si[2]
+        if n <= 0:
+            return 0
+        zpos = <np.float64_t *> malloc(sizeof(np.float64_t) * n)
+        cmask = <np.uint8_t *> malloc(sizeof(np.uint8_t) * n * 2)
+        if zpos == NULL or cmask == NULL:
+            free(zpos)
+            free(cmask)
+            return -1
+        row = cmask + n
+        _cell_row_centers(left_edge[2] + (si[2] + 0.5) * dds[2], dds[2],
+                          n, zpos)
+        pos[0] = left_edge[0] + (si[0] + 0.5) * dds[0]
+        for i in range(si[0], ei[0]):
+            pos[1] = left_edge[1] + (si[1] + 0.5) * dds[1]
+            for j in range(si[1], ei[1]):
+                off = (<np.int64_t> i * dim[1] + j) * dim[2] + si[2]
+                for k in range(n):
+                    cmask[k] = (child_mask[off + k] == 1 or this_level == 1)
+                if edge == 2:
+                    for k in range(n):
+                        row[k] = 1
+                else:
+                    self.select_cells_row(pos, dds, zpos, n, cmask, row)
+                for k in range(n):
+                    if cmask[k] == 1:
+                        mask[off + k] = row[k]
+                        total += row[k]
+                pos[1] += dds[1]
+            pos[0] += dds[0]
+        free(zpos)
+        free(cmask)
         return total
 
 
@@ -1094,6 +1421,50 @@ cdef class DiskSelector(SelectorObject):
         # if all_over == 0 and all_under == 0 and any_radius == 1: return 1
         # return 0
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        # Every selected point lies within sqrt(radius**2 + height**2) of
+        # the center, which is enough to throw out distant grids.
+        cdef np.float64_t ple[3]
+        cdef np.float64_t pre[3]
+        cdef np.float64_t box_center, relcenter, closest, edge, dist = 0
+        cdef int i
+        _pad_bbox(left_edge, right_edge, ple, pre)
+        for i in range(3):
+            box_center = (pre[i] + ple[i])/2.0
+            relcenter = self.difference(box_center, self.center[i], i)
+            edge = pre[i] - ple[i]
+            closest = relcenter - fclip(relcenter, -edge/2.0, edge/2.0)
+            dist += closest*closest
+        if dist > self.radius2 + self.height*self.height: return 0
+        if _corners_selected(self, left_edge, right_edge, self.center): return 2
+        return 1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        # select_point, with the x and y terms of h and d summed once per row
+        # in the same order as there.
+        cdef int i, k
+        cdef np.float64_t h_xy = 0, d_xy = 0, h, d, temp
+        for i in range(2):
+            temp = _periodic_dist(pos[i], self.center[i], self.domain_width[i],
+                                  self.periodicity[i])
+            h_xy += temp * self.norm_vec[i]
+            d_xy += temp*temp
+        for k in range(n):
+            temp = _periodic_dist(zpos[k], self.center[2],
+                                  self.domain_width[2], self.periodicity[2])
+            h = h_xy + temp * self.norm_vec[2]
+            d = d_xy + temp*temp
+            out[k] = (fabs(h) <= self.height) & (d - h*h <= self.radius2)
+
     def _hash_vals(self):
         return (("norm_vec[0]", self.norm_vec[0]),
                 ("norm_vec[1]", self.norm_vec[1]),
@@ -1179,6 +1550,46 @@ cdef class CuttingPlaneSelector(SelectorObject):
             return 0
         return 1
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        cdef np.float64_t ple[3]
+        cdef np.float64_t pre[3]
+        _pad_bbox(left_edge, right_edge, ple, pre)
+        return self.select_bbox(ple, pre)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        # select_bbox on each cell.  The four x, y corner sums are shared by
+        # the whole row; per cell we only add the two z faces and compare.
+        # As there, the low corner only counts as over or under the plane
+        # if it is strictly off it.
+        cdef int i, j, k
+        cdef np.float64_t gxy[4]
+        cdef np.float64_t zl, zr, g0, gl, gr, gmin, gmax
+        for i in range(2):
+            for j in range(2):
+                gxy[i*2+j] = self.d
+                gxy[i*2+j] += (pos[0] + (i - 0.5)*dds[0]) * self.norm_vec[0]
+                gxy[i*2+j] += (pos[1] + (j - 0.5)*dds[1]) * self.norm_vec[1]
+        for k in range(n):
+            zl = (zpos[k] - 0.5*dds[2]) * self.norm_vec[2]
+            zr = (zpos[k] + 0.5*dds[2]) * self.norm_vec[2]
+            g0 = gxy[0] + zl
+            gmin = gmax = gxy[0] + zr
+            for i in range(1, 4):
+                gl = gxy[i] + zl
+                gr = gxy[i] + zr
+                gmin = fmin(gmin, fmin(gl, gr))
+                gmax = fmax(gmax, fmax(gl, gr))
+            out[k] = (((g0 > 0) & (gmin >= 0)) | ((g0 < 0) & (gmax <= 0))) == 0
+
     def _hash_vals(self):
         return (("norm_vec[0]", self.norm_vec[0]),
                 ("norm_vec[1]", self.norm_vec[1]),
@@ -1745,6 +2156,47 @@ cdef class EllipsoidSelector(SelectorObject):
             return 1
         return 0
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        cdef np.float64_t ple[3]
+        cdef np.float64_t pre[3]
+        _pad_bbox(left_edge, right_edge, ple, pre)
+        if self.select_bbox(ple, pre) == 0: return 0
+        if _corners_selected(self, left_edge, right_edge, self.center): return 2
+        return 1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        # select_point, with the x and y parts of the rotated dot products
+        # summed once per row in the same order as there.
+        cdef np.float64_t dot_xy[3]
+        cdef np.float64_t mag2[3]
+        cdef np.float64_t dist, e0, e1, e2
+        cdef int i, j, k
+        dot_xy[0] = dot_xy[1] = dot_xy[2] = 0
+        for i in range(2):
+            dist = _periodic_dist(pos[i], self.center[i], self.domain_width[i],
+                                  self.periodicity[i])
+            for j in range(3):
+                dot_xy[j] += dist * self.vec[j][i]
+        for j in range(3):
+            mag2[j] = self.mag[j] * self.mag[j]
+        for k in range(n):
+            dist = _periodic_dist(zpos[k], self.center[2],
+                                  self.domain_width[2], self.periodicity[2])
+            e0 = dot_xy[0] + dist * self.vec[0][2]
+            e1 = dot_xy[1] + dist * self.vec[1][2]
+            e2 = dot_xy[2] + dist * self.vec[2][2]
+            out[k] = ((e0*e0)/mag2[0] + (e1*e1)/mag2[1] + (e2*e2)/mag2[2]
+                      <= 1.0)
+
     def _hash_vals(self):
         return (("vec[0][0]", self.vec[0][0]),
                 ("vec[0][1]", self.vec[0][1]),
@@ -2150,10 +2602,37 @@ cdef class BooleanANDSelector(BooleanSelector):
         if rv2 == 0: return 0
         return 1
 
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        cdef int rv1 = self.sel1.select_bbox_edge(left_edge, right_edge)
+        if rv1 == 0: return 0
+        cdef int rv2 = self.sel2.select_bbox_edge(left_edge, right_edge)
+        if rv2 == 0: return 0
+        if rv1 == 2 and rv2 == 2: return 2
+        return 1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        # The second selector is only asked about the cells the first picked.
+        cdef np.uint8_t m2[ROW_BLOCK]
+        cdef np.uint8_t r2[ROW_BLOCK]
+        cdef int b, k, nb
+        for b in range(0, n, ROW_BLOCK):
+            nb = imin(n - b, ROW_BLOCK)
+            self.sel1.select_cells_row(pos, dds, zpos + b, nb, cmask + b,
+                                       out + b)
+            for k in range(nb):
+                m2[k] = (cmask[b + k] != 0) & (out[b + k] != 0)
+            self.sel2.select_cells_row(pos, dds, zpos + b, nb, m2, r2)
+            for k in range(nb):
+                out[b + k] = m2[k] & (r2[k] != 0)
+
     def _hash_vals(self):
-        return (self.sel1._hash_vals() +
-                ("and",) +
-                self.sel2._hash_vals())
+        return ("and", hash(self.sel1), hash(self.sel2))
 
 cdef class BooleanORSelector(BooleanSelector):
     cdef int select_bbox(self, np.float64_t left_edge[3],
@@ -2194,10 +2673,37 @@ cdef class BooleanORSelector(BooleanSelector):
         if rv2 == 1: return 1
         return 0
 
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        cdef int rv1 = self.sel1.select_bbox_edge(left_edge, right_edge)
+        if rv1 == 2: return 2
+        cdef int rv2 = self.sel2.select_bbox_edge(left_edge, right_edge)
+        if rv2 == 2: return 2
+        if rv1 == 0 and rv2 == 0: return 0
+        return 1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        # The second selector is only asked about the cells the first missed.
+        cdef np.uint8_t m2[ROW_BLOCK]
+        cdef np.uint8_t r2[ROW_BLOCK]
+        cdef int b, k, nb
+        for b in range(0, n, ROW_BLOCK):
+            nb = imin(n - b, ROW_BLOCK)
+            self.sel1.select_cells_row(pos, dds, zpos + b, nb, cmask + b,
+                                       out + b)
+            for k in range(nb):
+                m2[k] = (cmask[b + k] != 0) & (out[b + k] == 0)
+            self.sel2.select_cells_row(pos, dds, zpos + b, nb, m2, r2)
+            for k in range(nb):
+                out[b + k] = (out[b + k] != 0) | (m2[k] & (r2[k] != 0))
+
     def _hash_vals(self):
-        return (self.sel1._hash_vals() +
-                ("or",) +
-                self.sel2._hash_vals())
+        return ("or", hash(self.sel1), hash(self.sel2))
 
 cdef class BooleanNOTSelector(BooleanSelector):
     cdef int select_bbox(self, np.float64_t left_edge[3],
@@ -2226,9 +2732,23 @@ cdef class BooleanNOTSelector(BooleanSelector):
         if rv1 == 0: return 1
         return 0
 
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        return 2 - self.sel1.select_bbox_edge(left_edge, right_edge)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        cdef int k
+        self.sel1.select_cells_row(pos, dds, zpos, n, cmask, out)
+        for k in range(n):
+            out[k] = (out[k] == 0)
+
     def _hash_vals(self):
-        return (self.sel1._hash_vals() +
-                ("not",))
+        return ("not", hash(self.sel1))
 
 cdef class BooleanXORSelector(BooleanSelector):
 
@@ -2261,10 +2781,33 @@ cdef class BooleanXORSelector(BooleanSelector):
         if rv1 == rv2: return 0
         return 1
 
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        cdef int rv1 = self.sel1.select_bbox_edge(left_edge, right_edge)
+        if rv1 == 1: return 1
+        cdef int rv2 = self.sel2.select_bbox_edge(left_edge, right_edge)
+        if rv2 == 1: return 1
+        if rv1 == rv2: return 0
+        return 2
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        cdef np.uint8_t r2[ROW_BLOCK]
+        cdef int b, k, nb
+        for b in range(0, n, ROW_BLOCK):
+            nb = imin(n - b, ROW_BLOCK)
+            self.sel1.select_cells_row(pos, dds, zpos + b, nb, cmask + b,
+                                       out + b)
+            self.sel2.select_cells_row(pos, dds, zpos + b, nb, cmask + b, r2)
+            for k in range(nb):
+                out[b + k] = (out[b + k] != 0) != (r2[k] != 0)
+
     def _hash_vals(self):
-        return (self.sel1._hash_vals() +
-                ("xor",) +
-                self.sel2._hash_vals())
+        return ("xor", hash(self.sel1), hash(self.sel2))
 
 cdef class BooleanNEGSelector(BooleanSelector):
 
@@ -2300,150 +2843,111 @@ cdef class BooleanNEGSelector(BooleanSelector):
         if rv2 == 1: return 0
         return 1
 
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        cdef int rv1 = self.sel1.select_bbox_edge(left_edge, right_edge)
+        if rv1 == 0: return 0
+        cdef int rv2 = self.sel2.select_bbox_edge(left_edge, right_edge)
+        if rv2 == 2: return 0
+        if rv1 == 2 and rv2 == 0: return 2
+        return 1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        # The second selector is only asked about the cells the first picked.
+        cdef np.uint8_t m2[ROW_BLOCK]
+        cdef np.uint8_t r2[ROW_BLOCK]
+        cdef int b, k, nb
+        for b in range(0, n, ROW_BLOCK):
+            nb = imin(n - b, ROW_BLOCK)
+            self.sel1.select_cells_row(pos, dds, zpos + b, nb, cmask + b,
+                                       out + b)
+            for k in range(nb):
+                m2[k] = (cmask[b + k] != 0) & (out[b + k] != 0)
+            self.sel2.select_cells_row(pos, dds, zpos + b, nb, m2, r2)
+            for k in range(nb):
+                out[b + k] = m2[k] & (r2[k] == 0)
+
     def _hash_vals(self):
-        return (self.sel1._hash_vals() +
-                ("neg",) +
-                self.sel2._hash_vals())
+        return ("neg", hash(self.sel1), hash(self.sel2))
+
+class _BooleanPair(object):
+    # Stands in for a YTBooleanContainer when a chained selector nests its
+    # children into binary boolean selectors.
+    def __init__(self, sel1, sel2):
+        self.dobj1 = sel1
+        self.dobj2 = sel2
 
 cdef class ChainedBooleanSelector(SelectorObject):
     cdef int n_obj
     cdef np.ndarray selectors
+    cdef SelectorObject tree
     def __init__(self, dobj):
         # These are data objects, not selectors
         self.n_obj = len(dobj.data_objects)
+        if self.n_obj == 0:
+            raise RuntimeError("A chained selector needs at least one "
+                               "data object.")
         self.selectors = np.empty(self.n_obj, dtype="object")
         for i in range(self.n_obj):
             self.selectors[i] = dobj.data_objects[i].selector
+        # The children are nested right to left into binary selectors of
+        # the same kind, so they are called without taking the GIL and still
+        # in order, stopping at the first one that decides the answer.
+        tree = self.selectors[self.n_obj - 1]
+        for i in range(self.n_obj - 2, -1, -1):
+            tree = self._pair(self.selectors[i], tree)
+        self.tree = tree
+
+    def _pair(self, sel1, sel2):
+        raise NotImplementedError
 
-cdef class ChainedBooleanANDSelector(ChainedBooleanSelector):
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
     cdef int select_bbox(self, np.float64_t left_edge[3],
                          np.float64_t right_edge[3]) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_bbox(
-                        left_edge, right_edge) == 0:
-                    return 0
-        return 1
+        return self.tree.select_bbox(left_edge, right_edge)
+
+    cdef int select_bbox_edge(self, np.float64_t left_edge[3],
+                               np.float64_t right_edge[3]) nogil:
+        return self.tree.select_bbox_edge(left_edge, right_edge)
 
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
     cdef int select_grid(self, np.float64_t left_edge[3],
                          np.float64_t right_edge[3], np.int32_t level,
                          Oct *o = NULL) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_grid(
-                        left_edge, right_edge, level, o) == 0:
-                    return 0
-        return 1
+        return self.tree.select_grid(left_edge, right_edge, level, o)
 
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
     cdef int select_cell(self, np.float64_t pos[3], np.float64_t dds[3]) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_cell(
-                        pos, dds) == 0:
-                    return 0
-        return 1
+        return self.tree.select_cell(pos, dds)
+
+    cdef void select_cells_row(self, np.float64_t pos[3], np.float64_t dds[3],
+                               np.float64_t *zpos, int n,
+                               np.uint8_t *cmask, np.uint8_t *out) nogil:
+        self.tree.select_cells_row(pos, dds, zpos, n, cmask, out)
 
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
     cdef int select_point(self, np.float64_t pos[3]) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_point(pos) == 0:
-                    return 0
-        return 1
+        return self.tree.select_point(pos)
 
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
     cdef int select_sphere(self, np.float64_t pos[3], np.float64_t radius) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_sphere(
-                        pos, radius) == 0:
-                    return 0
-        return 1
+        return self.tree.select_sphere(pos, radius)
+
+cdef class ChainedBooleanANDSelector(ChainedBooleanSelector):
+    def _pair(self, sel1, sel2):
+        return BooleanANDSelector(_BooleanPair(sel1, sel2))
 
     def _hash_vals(self):
-        v = ("chained_and",)
-        for s in self.selectors:
-            v += s._hash_vals()
-        return v
+        return ("chained_and",) + tuple(hash(s) for s in self.selectors)
 
 intersection_selector = ChainedBooleanANDSelector
 
 cdef class ChainedBooleanORSelector(ChainedBooleanSelector):
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
-    cdef int select_bbox(self, np.float64_t left_edge[3],
-                         np.float64_t right_edge[3]) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_bbox(
-                        left_edge, right_edge) == 1:
-                    return 1
-        return 0
-
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
-    cdef int select_grid(self, np.float64_t left_edge[3],
-                         np.float64_t right_edge[3], np.int32_t level,
-                         Oct *o = NULL) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_grid(
-                        left_edge, right_edge, level, o) == 1:
-                    return 1
-        return 0
-
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
-    cdef int select_cell(self, np.float64_t pos[3], np.float64_t dds[3]) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_cell(
-                        pos, dds) == 1:
-                    return 1
-        return 0
-
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
-    cdef int select_point(self, np.float64_t pos[3]) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_point(pos) == 1:
-                    return 1
-        return 0
-
-    @cython.cdivision(True)
-    @cython.boundscheck(False)
-    @cython.wraparound(False)
-    cdef int select_sphere(self, np.float64_t pos[3], np.float64_t radius) nogil:
-        with gil:
-            for i in range(self.n_obj):
-                if (<SelectorObject>self.selectors[i]).select_sphere(
-                        pos, radius) == 1:
-                    return 1
-        return 0
+    def _pair(self, sel1, sel2):
+        return BooleanORSelector(_BooleanPair(sel1, sel2))
 
     def _hash_vals(self):
-        v = ("chained_or",)
-        for s in self.selectors:
-            v += s._hash_vals()
-        return v
+        return ("chained_or",) + tuple(hash(s) for s in self.selectors)
 
 union_selector = ChainedBooleanORSelector
 
@@ -16,9 +16,11 @@ import numpy as np
 import random
 
 from yt.testing import \
-    assert_equal, assert_raises
+    assert_equal, assert_raises, fake_amr_ds, fake_random_ds
 from yt.frontends.stream.api import \
     load_amr_grids
+from yt.geometry.grid_container import \
+    GridBVH
 
 
 def setup_test_ds():
@@ -124,3 +126,27 @@ def test_grid_arrays_view():
     assert_equal(grid_arr['right_edge'], ds.index.grid_right_edge)
     assert_equal(grid_arr['dims'], ds.index.grid_dimensions)
     assert_equal(grid_arr['level'], ds.index.grid_levels[:,0])
+
+def _bvh_test_objects(ds):
+    sp = ds.sphere([0.5, 0.5, 0.5], 0.25)
+    # This one wraps around the periodic boundary.
+    sp_edge = ds.sphere([0.05, 0.5, 0.95], 0.2)
+    reg = ds.region([0.3, 0.3, 0.3], [0.1, 0.2, 0.15], [0.6, 0.45, 0.7])
+    ray = ds.ray([0.1, 0.2, 0.3], [0.9, 0.7, 0.4])
+    cut = ds.cutting([0.2, 0.3, 0.9], [0.5, 0.5, 0.5])
+    return [sp, sp_edge, reg, ray, cut,
+            sp & reg, sp | ray, sp_edge - reg, ~sp,
+            ds.intersection([sp, reg, sp_edge])]
+
+def test_grid_bvh_select_grids():
+    for ds in (fake_amr_ds(), fake_random_ds(64, nprocs=64)):
+        index = ds.index
+        for leaf_size in (1, 8):
+            bvh = GridBVH(index.grid_left_edge, index.grid_right_edge,
+                          index.grid_levels, leaf_size=leaf_size)
+            for dobj in _bvh_test_objects(ds):
+                selector = dobj.selector
+                gi = selector.select_grids(index.grid_left_edge,
+                                           index.grid_right_edge,
+                                           index.grid_levels)
+                assert_equal(bvh.select_grids(selector), gi)
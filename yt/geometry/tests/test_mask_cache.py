@@ -0,0 +1,141 @@
+"""
+Tests for the per-index selection mask cache
+
+
+
+"""
+
+#-----------------------------------------------------------------------------
+# Copyright (c) 2018, yt Development Team.
+#
+# Distributed under the terms of the Modified BSD License.
+#
+# The full license is in the file COPYING.txt, distributed with this software.
+#-----------------------------------------------------------------------------
+import numpy as np
+
+from yt.config import ytcfg
+from yt.testing import \
+    assert_equal, fake_amr_ds, fake_random_ds
+from yt.geometry.geometry_handler import \
+    SelectionMaskCache
+
+
+def _random_mask(prng, shape):
+    return prng.random_sample(shape) > 0.5
+
+def test_mask_cache_hits():
+    ds = fake_random_ds(16)
+    sp1 = ds.sphere([0.5, 0.5, 0.5], 0.25).selector
+    sp2 = ds.sphere([0.5, 0.5, 0.5], 0.3).selector
+    prng = np.random.RandomState(0x4d3d3d3)
+    mask = _random_mask(prng, (8, 8, 8))
+    cache = SelectionMaskCache(1 << 20)
+    assert cache.get(sp1, 0) is None
+    assert not cache.contains(sp1, 0)
+    cache.add(sp1, 0, mask, mask.sum())
+    assert cache.contains(sp1, 0)
+    assert (sp1, 0) in cache
+    cached, count = cache.get(sp1, 0)
+    assert_equal(cached, mask)
+    assert_equal(count, mask.sum())
+    # Other objects and other selectors miss.
+    assert cache.get(sp1, 1) is None
+    assert cache.get(sp2, 0) is None
+    # An empty selection is remembered as such.
+    cache.add(sp2, 0, None, 0)
+    assert (sp2, 0) in cache
+    assert_equal(cache.get(sp2, 0), (None, 0))
+    # Replacing an entry does not count it twice.
+    nbytes = cache.nbytes
+    cache.add(sp1, 0, mask, mask.sum())
+    assert_equal(cache.nbytes, nbytes)
+    cache.clear()
+    assert cache.get(sp1, 0) is None
+    assert (sp1, 0) not in cache
+    assert_equal(cache.nbytes, 0)
+
+def test_mask_cache_eviction():
+    ds = fake_random_ds(16)
+    sel = ds.sphere([0.5, 0.5, 0.5], 0.25).selector
+    prng = np.random.RandomState(0x4d3d3d3)
+    masks = [_random_mask(prng, (16, 16, 16)) for i in range(4)]
+    cache = SelectionMaskCache(1 << 20)
+    cache.add(sel, 0, masks[0], masks[0].sum())
+    entry_bytes = cache.nbytes
+    # Room for two masks but not three.
+    cache = SelectionMaskCache(2 * entry_bytes + entry_bytes // 2)
+    cache.add(sel, 0, masks[0], masks[0].sum())
+    cache.add(sel, 1, masks[1], masks[1].sum())
+    # Touching 0 makes 1 the least recently used.
+    assert cache.get(sel, 0) is not None
+    cache.add(sel, 2, masks[2], masks[2].sum())
+    assert cache.nbytes <= cache.max_bytes
+    assert cache.get(sel, 1) is None
+    assert_equal(cache.get(sel, 0)[0], masks[0])
+    assert_equal(cache.get(sel, 2)[0], masks[2])
+    # A mask larger than the whole budget is not stored at all.
+    small = SelectionMaskCache(entry_bytes // 2)
+    small.add(sel, 0, masks[3], masks[3].sum())
+    assert small.get(sel, 0) is None
+    assert_equal(small.nbytes, 0)
+
+def test_mask_cache_disabled():
+    ds = fake_random_ds(16)
+    sel = ds.sphere([0.5, 0.5, 0.5], 0.25).selector
+    mask = np.ones((4, 4, 4), dtype="bool")
+    cache = SelectionMaskCache(0)
+    cache.add(sel, 0, mask, mask.sum())
+    cache.add(sel, 1, None, 0)
+    assert cache.get(sel, 0) is None
+    assert cache.get(sel, 1) is None
+    assert_equal(cache.nbytes, 0)
+
+def test_index_mask_cache():
+    old = ytcfg.get("yt", "mask_cache_bytes")
+    try:
+        ytcfg["yt", "mask_cache_bytes"] = "0"
+        ds = fake_amr_ds()
+        sp = ds.sphere([0.5, 0.5, 0.5], 0.25)
+        ref = sp["index", "ones"].size
+        cache = ds.index._get_mask_cache()
+        assert_equal(cache.max_bytes, 0)
+        assert_equal(len(cache._masks), 0)
+        ytcfg["yt", "mask_cache_bytes"] = str(1 << 26)
+        ds = fake_amr_ds()
+        sp = ds.sphere([0.5, 0.5, 0.5], 0.25)
+        assert_equal(sp["index", "ones"].size, ref)
+        cache = ds.index._get_mask_cache()
+        assert len(cache._masks) > 0
+        # Every cached mask is the one fill_mask computes.
+        for g in ds.index.grids:
+            cached = cache.get(sp.selector, g.id)
+            if cached is None: continue
+            mask = sp.selector.fill_mask(g)
+            if mask is None:
+                assert cached[0] is None
+            else:
+                assert_equal(cached[0], mask)
+        # A second selection is served from the cache and agrees.
+        sp2 = ds.sphere([0.5, 0.5, 0.5], 0.25)
+        assert_equal(sp2["index", "ones"].size, ref)
+    finally:
+        ytcfg["yt", "mask_cache_bytes"] = old
+
+def test_batched_grid_masks():
+    ds = fake_amr_ds()
+    sp = ds.sphere([0.5, 0.5, 0.5], 0.25)
+    grids = ds.index.grids
+    ds.index._fill_selector_masks(sp.selector, grids)
+    sid = hash(sp.selector)
+    for g in grids:
+        if g._last_selector_id != sid: continue
+        mask = sp.selector.fill_mask(g)
+        if mask is None:
+            assert g._last_mask is None
+            continue
+        assert_equal(g._last_mask, mask)
+        assert_equal(g._last_count, mask.sum())
+        # Each grid holds its own mask, not a view of the batch.
+        assert g._last_mask.flags.owndata
+        assert (sp.selector, g.id) in ds.index._get_mask_cache()
@@ -0,0 +1,138 @@
+"""
+Tests for the grid mask fills of the selectors
+
+
+
+"""
+
+#-----------------------------------------------------------------------------
+# Copyright (c) 2018, yt Development Team.
+#
+# Distributed under the terms of the Modified BSD License.
+#
+# The full license is in the file COPYING.txt, distributed with this software.
+#-----------------------------------------------------------------------------
+import numpy as np
+
+from yt.testing import \
+    assert_equal, fake_amr_ds
+
+
+def _cell_edges(grid):
+    # Accumulated along each axis the way the mask fills walk the cells; the
+    # fake grids have dyadic edges, so the one-cell grids built from these
+    # see bit-identical cell centers.
+    le = grid.LeftEdge.d
+    dds = grid.dds.d
+    axes = []
+    for i in range(3):
+        c = np.empty(grid.ActiveDimensions[i], dtype="float64")
+        v = le[i] + dds[i] * 0.5
+        for k in range(c.size):
+            c[k] = v
+            v += dds[i]
+        axes.append(c)
+    x, y, z = np.meshgrid(*axes, indexing="ij")
+    centers = np.column_stack([x.ravel(), y.ravel(), z.ravel()])
+    return centers - dds * 0.5, centers + dds * 0.5
+
+def _cellwise_mask(selector, grid):
+    # Every cell of the grid filled as a grid of its own, so each row the
+    # selector sees holds a single cell.
+    left, right = _cell_edges(grid)
+    n = left.shape[0]
+    dds = np.tile(grid.dds.d, (n, 1))
+    dims = np.ones((n, 3), dtype="int32")
+    levels = np.full(n, grid.Level, dtype="int32")
+    child_masks = grid.child_mask.reshape((n, 1, 1, 1))
+    masks, offsets, counts = selector.fill_masks(
+        left, right, dims, levels, child_masks, dds=dds)
+    sel = masks.reshape(grid.ActiveDimensions)
+    if not sel.any():
+        return None
+    return sel
+
+def _assert_masks_equal(ds, selector, grids):
+    total = 0
+    for grid in grids:
+        mask = selector.fill_mask(grid)
+        ref = _cellwise_mask(selector, grid)
+        if ref is None:
+            assert mask is None
+        else:
+            assert_equal(mask, ref)
+            total += mask.sum()
+    # The grid tree counts through visit_grid_cells rather than the fills
+    assert_equal(ds.index._get_grid_tree().count(selector), total)
+
+def _cell_test_objects(ds):
+    return [ds.sphere([0.5, 0.5, 0.5], 0.25),
+            ds.sphere([0.05, 0.5, 0.95], 0.2),
+            ds.sphere([0.4, 0.4, 0.4], 0.01),
+            ds.region([0.3, 0.3, 0.3], [0.1, 0.2, 0.15], [0.6, 0.45, 0.7]),
+            ds.region([0.5, 0.5, 0.5], [0.0, 0.0, 0.0], [1.0, 1.0, 1.0]),
+            ds.disk([0.5, 0.5, 0.5], [0.2, 0.3, 0.9], 0.3, 0.1),
+            ds.ellipsoid([0.45, 0.5, 0.55], 0.3, 0.2, 0.1,
+                         np.array([0.0, 0.6, 0.8]), 0.3),
+            ds.cutting([0.2, 0.3, 0.9], [0.5, 0.5, 0.5]),
+            ds.cutting([0.0, 0.0, 1.0], [0.5, 0.5, 0.5])]
+
+def test_fill_mask_rows():
+    ds = fake_amr_ds()
+    grids = ds.index.grids
+    for dobj in _cell_test_objects(ds):
+        _assert_masks_equal(ds, dobj.selector, grids)
+
+def test_boolean_fill_mask_rows():
+    ds = fake_amr_ds()
+    sp, sp_edge, tiny, reg, full, disk, ell, cut, cut_z = \
+        _cell_test_objects(ds)
+    objs = [sp & reg, sp | cut, sp - reg, ~sp, sp ^ disk, full - sp,
+            sp_edge & full, (sp & reg) | ell, sp & (reg | ell),
+            ds.intersection([sp, reg, disk]), ds.union([tiny, reg, cut_z])]
+    for dobj in objs:
+        _assert_masks_equal(ds, dobj.selector, ds.index.grids)
+
+def test_boolean_hash_structure():
+    ds = fake_amr_ds()
+    a = ds.sphere([0.5, 0.5, 0.5], 0.25)
+    b = ds.region([0.3, 0.3, 0.3], [0.1, 0.2, 0.15], [0.6, 0.45, 0.7])
+    c = ds.disk([0.5, 0.5, 0.5], [0.2, 0.3, 0.9], 0.3, 0.1)
+    h1 = hash(((a & b) | c).selector)
+    h2 = hash((a & (b | c)).selector)
+    assert h1 != h2
+    assert h1 == hash(((a & b) | c).selector)
+    assert hash((a - b).selector) != hash((b - a).selector)
+    assert hash(ds.intersection([a, b, c]).selector) != \
+        hash(ds.union([a, b, c]).selector)
+    assert hash(ds.intersection([a, b, c]).selector) != \
+        hash(ds.intersection([a, b]).selector)
+
+def test_fill_masks_batch():
+    ds = fake_amr_ds()
+    grids = ds.index.grids
+    le = np.array([g.LeftEdge.d for g in grids])
+    re = np.array([g.RightEdge.d for g in grids])
+    dds = np.array([g.dds.d for g in grids])
+    dims = np.array([g.ActiveDimensions for g in grids])
+    levels = np.array([g.Level for g in grids])
+    child_masks = [g.child_mask for g in grids]
+    sp, sp_edge, tiny, reg, full, disk, ell, cut, cut_z = \
+        _cell_test_objects(ds)
+    for dobj in [sp, sp_edge, tiny, reg, full, disk, ell, cut,
+                 sp & reg, sp - ell]:
+        selector = dobj.selector
+        for num_threads in (1, 4):
+            masks, offsets, counts = selector.fill_masks(
+                le, re, dims, levels, child_masks, dds=dds,
+                num_threads=num_threads)
+            assert_equal(offsets[-1], masks.size)
+            for n, g in enumerate(grids):
+                mask = masks[offsets[n]:offsets[n + 1]].reshape(dims[n])
+                ref = selector.fill_mask(g)
+                if ref is None:
+                    assert_equal(counts[n], 0)
+                    assert not mask.any()
+                else:
+                    assert_equal(counts[n], ref.sum())
+                    assert_equal(mask, ref)
@@ -36,6 +36,20 @@ cdef extern from "platform_dep.h":
     double log2(double x) nogil
     long int lrint(double x) nogil
 
+cdef extern from "space_filling_curves.h":
+    int SFC_ORDER_MAX
+    np.uint64_t sfc_morton_encode(np.uint64_t x, np.uint64_t y,
+                                  np.uint64_t z) nogil
+    void sfc_morton_encode_array(np.int64_t n, np.int64_t *x, np.int64_t *y,
+                                 np.int64_t *z, np.int64_t stride,
+                                 np.int64_t *out) nogil
+    void sfc_hilbert_encode_array(int order, np.int64_t n, np.int64_t *x,
+                                  np.int64_t *y, np.int64_t *z,
+                                  np.int64_t stride, np.int64_t *out) nogil
+    void sfc_hilbert_decode_array(int order, np.int64_t n, np.int64_t *h,
+                                  np.int64_t *x, np.int64_t *y, np.int64_t *z,
+                                  np.int64_t stride) nogil
+
 # Finally, miscellaneous routines.
 
 @cython.cdivision(True)
@@ -116,220 +130,52 @@ def obtain_rvec(data, ftype="gas"):
                     rg[2,i,j,k] = zg[i,j,k] - c[2]
         return rg
 
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t graycode(np.int64_t x):
-    return x^(x>>1)
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t igraycode(np.int64_t x):
-    cdef np.int64_t i, j
-    if x == 0:
-        return x
-    m = <np.int64_t> ceil(log2(x)) + 1
-    i, j = x, 1
-    while j < m:
-        i = i ^ (x>>j)
-        j += 1
-    return i
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t direction(np.int64_t x, np.int64_t n):
-    #assert x < 2**n
-    if x == 0:
-        return 0
-    elif x%2 == 0:
-        return tsb(x-1, n)%n
-    else:
-        return tsb(x, n)%n
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t tsb(np.int64_t x, np.int64_t width):
-    #assert x < 2**width
-    cdef np.int64_t i = 0
-    while x&1 and i <= width:
-        x = x >> 1
-        i += 1
-    return i
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t bitrange(np.int64_t x, np.int64_t width,
-                         np.int64_t start, np.int64_t end):
-    return x >> (width-end) & ((2**(end-start))-1)
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t rrot(np.int64_t x, np.int64_t i, np.int64_t width):
-    i = i%width
-    x = (x>>i) | (x<<width-i)
-    return x&(2**width-1)
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t lrot(np.int64_t x, np.int64_t i, np.int64_t width):
-    i = i%width
-    x = (x<<i) | (x>>width-i)
-    return x&(2**width-1)
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t transform(np.int64_t entry, np.int64_t direction,
-                          np.int64_t width, np.int64_t x):
-    return rrot((x^entry), direction + 1, width)
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t entry(np.int64_t x):
-    if x == 0: return 0
-    return graycode(2*((x-1)/2))
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t setbit(np.int64_t x, np.int64_t w, np.int64_t i, np.int64_t b):
-    if b == 1:
-        return x | 2**(w-i-1)
-    elif b == 0:
-        return x & ~2**(w-i-1)
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef np.int64_t point_to_hilbert(int order, np.int64_t p[3]):
-    cdef np.int64_t h, e, d, l, b, w, i, x
-    h = e = d = 0
-    for i in range(order):
-        l = 0
-        for x in range(3):
-            b = bitrange(p[3-x-1], order, i, i+1)
-            l |= (b<<x)
-        l = transform(e, d, 3, l)
-        w = igraycode(l)
-        e = e ^ lrot(entry(w), d+1, 3)
-        d = (d + direction(w, 3) + 1)%3
-        h = (h<<3)|w
-    return h
-
-#def hilbert_point(dimension, order, h):
-#    """
-#        Convert an index on the Hilbert curve of the specified dimension and
-#        order to a set of point coordinates.
-#    """
-#    #    The bit widths in this function are:
-#    #        p[*]  - order
-#    #        h     - order*dimension
-#    #        l     - dimension
-#    #        e     - dimension
-#    hwidth = order*dimension
-#    e, d = 0, 0
-#    p = [0]*dimension
-#    for i in range(order):
-#        w = utils.bitrange(h, hwidth, i*dimension, i*dimension+dimension)
-#        l = utils.graycode(w)
-#        l = itransform(e, d, dimension, l)
-#        for j in range(dimension):
-#            b = utils.bitrange(l, dimension, j, j+1)
-#            p[j] = utils.setbit(p[j], order, i, b)
-#        e = e ^ utils.lrot(entry(w), d+1, dimension)
-#        d = (d + direction(w, dimension) + 1)%dimension
-#    return p
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef void hilbert_to_point(int order, np.int64_t h, np.int64_t *p):
-    cdef np.int64_t hwidth, e, d, w, l, b
-    cdef int i, j
-    hwidth = 3 * order
-    e = d = p[0] = p[1] = p[2] = 0
-    for i in range(order):
-        w = bitrange(h, hwidth, i*3, i*3+3)
-        l = graycode(w)
-        l = lrot(l, d +1, 3)^e
-        for j in range(3):
-            b = bitrange(l, 3, j, j+1)
-            p[j] = setbit(p[j], order, i, b)
-        e = e ^ lrot(entry(w), d+1, 3)
-        d = (d + direction(w, 3) + 1)%3
-
 @cython.cdivision(True)
 @cython.boundscheck(False)
 @cython.wraparound(False)
 def get_hilbert_indices(int order, np.ndarray[np.int64_t, ndim=2] left_index):
-    # This is inspired by the scurve package by user cortesi on GH.
-    cdef int i
-    cdef np.int64_t p[3]
+    # The curve is the one of the scurve package by user cortesi on GH,
+    # evaluated from lookup tables in space_filling_curves.h.
+    cdef np.int64_t n = left_index.shape[0]
     cdef np.ndarray[np.int64_t, ndim=1] hilbert_indices
-    hilbert_indices = np.zeros(left_index.shape[0], 'int64')
-    for i in range(left_index.shape[0]):
-        p[0] = left_index[i, 0]
-        p[1] = left_index[i, 1]
-        p[2] = left_index[i, 2]
-        hilbert_indices[i] = point_to_hilbert(order, p)
+    if order < 0 or order > SFC_ORDER_MAX:
+        raise ValueError("order must be between 0 and %d" % SFC_ORDER_MAX)
+    left_index = np.ascontiguousarray(left_index)
+    hilbert_indices = np.zeros(n, 'int64')
+    cdef np.int64_t *li = <np.int64_t *> left_index.data
+    with nogil:
+        sfc_hilbert_encode_array(order, n, li, li + 1, li + 2, 3,
+                                 <np.int64_t *> hilbert_indices.data)
     return hilbert_indices
 
 @cython.cdivision(True)
 @cython.boundscheck(False)
 @cython.wraparound(False)
 def get_hilbert_points(int order, np.ndarray[np.int64_t, ndim=1] indices):
-    # This is inspired by the scurve package by user cortesi on GH.
-    cdef int i, j
-    cdef np.int64_t p[3]
+    cdef np.int64_t n = indices.shape[0]
     cdef np.ndarray[np.int64_t, ndim=2] positions
-    positions = np.zeros((indices.shape[0], 3), 'int64')
-    for i in range(indices.shape[0]):
-        hilbert_to_point(order, indices[i], p)
-        for j in range(3):
-            positions[i, j] = p[j]
+    if order < 0 or order > SFC_ORDER_MAX:
+        raise ValueError("order must be between 0 and %d" % SFC_ORDER_MAX)
+    indices = np.ascontiguousarray(indices)
+    positions = np.zeros((n, 3), 'int64')
+    cdef np.int64_t *pos = <np.int64_t *> positions.data
+    with nogil:
+        sfc_hilbert_decode_array(order, n, <np.int64_t *> indices.data,
+                                 pos, pos + 1, pos + 2, 3)
     return positions
 
-# yt did not invent these! :)
-cdef np.uint64_t _const20 = 0x000001FFC00003FF
-cdef np.uint64_t _const10 = 0x0007E007C00F801F
-cdef np.uint64_t _const04 = 0x00786070C0E181C3
-cdef np.uint64_t _const2a = 0x0199219243248649
-cdef np.uint64_t _const2b = 0x0649249249249249
-cdef np.uint64_t _const2c = 0x1249249249249249
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef inline np.uint64_t spread_bits(np.uint64_t x):
-    # This magic comes from http://stackoverflow.com/questions/1024754/how-to-compute-a-3d-morton-number-interleave-the-bits-of-3-ints
-    x=(x|(x<<20))&_const20
-    x=(x|(x<<10))&_const10
-    x=(x|(x<<4))&_const04
-    x=(x|(x<<2))&_const2a
-    x=(x|(x<<2))&_const2b
-    x=(x|(x<<2))&_const2c
-    return x
-
 @cython.cdivision(True)
 @cython.boundscheck(False)
 @cython.wraparound(False)
 def get_morton_indices(np.ndarray[np.uint64_t, ndim=2] left_index):
-    cdef np.int64_t i, mi
+    cdef np.int64_t n = left_index.shape[0]
     cdef np.ndarray[np.uint64_t, ndim=1] morton_indices
-    morton_indices = np.zeros(left_index.shape[0], 'uint64')
-    for i in range(left_index.shape[0]):
-        mi = 0
-        mi |= spread_bits(left_index[i,2])<<0
-        mi |= spread_bits(left_index[i,1])<<1
-        mi |= spread_bits(left_index[i,0])<<2
-        morton_indices[i] = mi
+    left_index = np.ascontiguousarray(left_index)
+    morton_indices = np.zeros(n, 'uint64')
+    cdef np.int64_t *li = <np.int64_t *> left_index.data
+    with nogil:
+        sfc_morton_encode_array(n, li, li + 1, li + 2, 3,
+                                <np.int64_t *> morton_indices.data)
     return morton_indices
 
 @cython.cdivision(True)
@@ -338,15 +184,17 @@ def get_morton_indices(np.ndarray[np.uint64_t, ndim=2] left_index):
 def get_morton_indices_unravel(np.ndarray[np.uint64_t, ndim=1] left_x,
                                np.ndarray[np.uint64_t, ndim=1] left_y,
                                np.ndarray[np.uint64_t, ndim=1] left_z,):
-    cdef np.int64_t i, mi
+    cdef np.int64_t n = left_x.shape[0]
     cdef np.ndarray[np.uint64_t, ndim=1] morton_indices
-    morton_indices = np.zeros(left_x.shape[0], 'uint64')
-    for i in range(left_x.shape[0]):
-        mi = 0
-        mi |= spread_bits(left_z[i])<<0
-        mi |= spread_bits(left_y[i])<<1
-        mi |= spread_bits(left_x[i])<<2
-        morton_indices[i] = mi
+    left_x = np.ascontiguousarray(left_x)
+    left_y = np.ascontiguousarray(left_y)
+    left_z = np.ascontiguousarray(left_z)
+    morton_indices = np.zeros(n, 'uint64')
+    with nogil:
+        sfc_morton_encode_array(n, <np.int64_t *> left_x.data,
+                                <np.int64_t *> left_y.data,
+                                <np.int64_t *> left_z.data, 1,
+                                <np.int64_t *> morton_indices.data)
     return morton_indices
 
 @cython.cdivision(True)
@@ -359,7 +207,6 @@ cdef np.int64_t position_to_morton(np.ndarray[floating, ndim=1] pos_x,
                         np.float64_t DRE[3],
                         np.ndarray[np.uint64_t, ndim=1] ind,
                         int filter):
-    cdef np.uint64_t mi
     cdef np.uint64_t ii[3]
     cdef np.float64_t p[3]
     cdef np.int64_t i, j, use
@@ -384,11 +231,7 @@ cdef np.int64_t position_to_morton(np.ndarray[floating, ndim=1] pos_x,
         if use == 0:
             ind[i] = FLAG
             continue
-        mi = 0
-        mi |= spread_bits(ii[2])<<0
-        mi |= spread_bits(ii[1])<<1
-        mi |= spread_bits(ii[0])<<2
-        ind[i] = mi
+        ind[i] = sfc_morton_encode(ii[0], ii[1], ii[2])
     return pos_x.shape[0]
 
 DEF ORDER_MAX=20
@@ -15,20 +15,30 @@ This calls the ORIGAMI routines
 
 import numpy as np
 cimport numpy as np
-from libc.stdlib cimport malloc, free
 
 cdef extern from "origami_tags.h":
-    int compute_tags(int ng, double boxsize, double **r, int npart,
-                     unsigned char *m)
+    ctypedef void (*origami_progress)(void *data, int done, int total) nogil
+    int compute_tags_parallel(int ng, double boxsize, void **r, int bfloat,
+                              int npart, unsigned char *m, int nthreads,
+                              origami_progress progress, void *data,
+                              int *nhalo) nogil
 
 cdef int printed_citation = 0
 
-def run_origami(np.ndarray[np.float64_t, ndim=1] pos_x,
-                np.ndarray[np.float64_t, ndim=1] pos_y,
-                np.ndarray[np.float64_t, ndim=1] pos_z,
-                double boxsize):
-    # We assume these have been passed in in the correct order and
-    # C-contiguous.
+cdef void _report_progress(void *data, int done, int total) with gil:
+    (<object> data)(done, total)
+
+def run_origami(np.ndarray pos_x, np.ndarray pos_y, np.ndarray pos_z,
+                double boxsize, int num_threads = 1, progress = None):
+    r"""Tag each particle of a lattice with its ORIGAMI morphology: the
+    number of orthogonal axes (0 to 3) along which it has crossed other
+    particles.  3 is halo, 2 filament, 1 wall and 0 void.
+
+    The positions must be in lattice order, as C-contiguous float64 or
+    float32 arrays; float32 is used as it is, without a copy.  The lattice
+    is split into x slabs over num_threads OpenMP threads.  If given,
+    progress(slabs_done, slabs_total) is called as the slabs finish.
+    """
     global printed_citation
     if printed_citation == 0:
         print "ORIGAMI was developed by Bridget Falck and Mark Neyrinck."
@@ -37,16 +47,25 @@ def run_origami(np.ndarray[np.float64_t, ndim=1] pos_x,
     cdef int npart = pos_x.size
     if npart == 1:
         return np.zeros(1, dtype="uint8")
-    assert(sizeof(unsigned char) == sizeof(np.uint8_t))
-    assert(sizeof(double) == sizeof(np.float64_t))
+    cdef int bfloat = pos_x.dtype == np.float32
+    dtype = "float32" if bfloat else "float64"
+    pos = [np.ascontiguousarray(a, dtype=dtype) for a in (pos_x, pos_y, pos_z)]
+    assert(pos[1].size == npart and pos[2].size == npart)
     cdef int ng = np.round(npart**(1./3))
     assert(ng**3 == npart)
-    cdef double **r = <double **> malloc(sizeof(double *) * 3)
-    r[0] = <double *> pos_x.data
-    r[1] = <double *> pos_y.data
-    r[2] = <double *> pos_z.data
+    cdef void *r[3]
+    cdef np.ndarray p
+    for i in range(3):
+        p = pos[i]
+        r[i] = p.data
     cdef np.ndarray[np.uint8_t, ndim=1] tags = np.zeros(npart, dtype="uint8")
-    cdef void *m = <void*> tags.data
-    compute_tags(ng, boxsize, r, npart, <unsigned char*> m)
-    free(r)
+    cdef unsigned char *m = <unsigned char *> tags.data
+    cdef origami_progress cb = NULL
+    cdef void *cb_data = NULL
+    if progress is not None:
+        cb = _report_progress
+        cb_data = <void *> progress
+    with nogil:
+        compute_tags_parallel(ng, boxsize, r, bfloat, npart, m, num_threads,
+                              cb, cb_data, NULL)
     return tags
@@ -1,6 +1,18 @@
 // This code was originally written by Bridget Falck and Mark Neyrinck.
 // They have agreed to release it under the terms of the BSD license.
 #include "origami_tags.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Each tag byte is built up in place while the lattice is searched.  The
+ * low three bits flag a crossing along x, y and z; they can be set by the
+ * particle at either end of the pair, so they are or-ed in atomically.
+ * The high five bits hold d0 + 3*d1 + 9*d2, where dn (0-2) counts the
+ * crossings along the two diagonals perpendicular to axis n.  Only the
+ * particle itself searches its diagonals, so these are written once. */
+#define AXBIT(n) (1 << (n))
+#define DIAGSHIFT 3
 
 int isneg(int h) {
   return (int)(h < 0);
@@ -10,212 +22,232 @@ int par(int i, int j, int k, int ng) {
   return i + (j + k*ng)*ng;
 }
 
-int compute_tags(int ng, double boxsize, double **r, int np,
-                 unsigned char *m) {
+static double rpos(void **r, int bfloat, int d, int i) {
+  if (bfloat) return ((float *)r[d])[i];
+  return ((double *)r[d])[i];
+}
+
+static void set_bits(unsigned char *m, int i, unsigned char bits) {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+  m[i] |= bits;
+}
+
+int compute_tags_parallel(int ng, double boxsize, void **r, int bfloat,
+                          int np, unsigned char *m, int nthreads,
+                          origami_progress progress, void *data,
+                          int *nhalo) {
   /* Note that the particles must be fed in according to the order specified in
    * the README file */
-  double predict, xmin,xmax,ymin,ymax,zmin,zmax;
-  
   double negb2, b2;
-  int ng2,ng4, h, i,i2, x,y,z,nhalo,nhalo0,nhalo1,nhalo2,nhaloany;
-  unsigned char *m0,*m1,*m2, mn,m0n,m1n,m2n; /*Morphology tag */
-  
-  double dx,d1,d2;
+  int ng4, i, ndone;
+  int n0, n1, n2, n3, n4;
 
   b2 = boxsize/2.;
   negb2 = -boxsize/2.;
-  ng2=ng/2;
   ng4=ng/4;
 
-  /* Boxsize should be the range in r, yielding a range 0-1 */
-  printf("%d particles\n",np);fflush(stdout);
-  xmin = BF; xmax = -BF; ymin = BF; ymax = -BF; zmin = BF; zmax = -BF;
-  m0 = (unsigned char *)malloc(np*sizeof(unsigned char)); /* for the diagonals */
-  m1 = (unsigned char *)malloc(np*sizeof(unsigned char));
-  m2 = (unsigned char *)malloc(np*sizeof(unsigned char));
-  for (i=0; i<np;i++) {
-    if (r[0][i]<xmin) xmin = r[0][i]; if (r[0][i]>xmax) xmax = r[0][i];
-    if (r[1][i]<ymin) ymin = r[1][i]; if (r[1][i]>ymax) ymax = r[1][i];
-    if (r[2][i]<zmin) zmin = r[2][i]; if (r[2][i]>zmax) zmax = r[2][i];
-   
-    m[i] = 1;
-    m0[i] = 1;
-    m1[i] = 1;
-    m2[i] = 1;
-  }
-
-  if (m==NULL) {
-    printf("Morphology array cannot be allocated.\n");
-    return 1;
-  }
-  //  printf("np: %d, x: %f,%f; y: %f,%f; z: %f,%f\n",np,xmin,xmax, ymin,ymax, zmin,zmax); fflush(stdout);
-
-  printf("Calculating ORIGAMI morphology.\n");
+  if (m==NULL) return 1;
+  for (i=0; i<np; i++) m[i] = 0;
+  if (nthreads < 1) nthreads = 1;
+  ndone = 0;
 
+  /* Each x slab of the lattice is one unit of work */
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+  {
+  int h, i, i2, x, y, z, d0, d1, d2, done;
+  double dx, d1x, d2x;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,1)
+#endif
   for (x=0; x<ng; x++){
-    //    printf("%d\n",x);fflush(stdout);
     for (y=0; y<ng; y++) {
       for (z=0; z<ng; z++) {
 	i = par(x,y,z,ng);
 	/* First just along the Cartesian axes */
 	/* x-direction */
-	  for (h=1; h<ng4; h++) {
-	    i2 = par((x+h)%ng,y,z,ng);
-	    dx = r[0][i2]-r[0][i];
-	    if (dx < negb2) dx += boxsize;
-	    if (dx > b2) dx -= boxsize;
-	    if (dx < 0.) {
-	      /*printf("x:%d %d %d %d %f\n",x,y,z,h,dx);*/
-	    if (m[i] % 2 > 0) {
-	      m[i] *= 2;
-	    }
-	      if (m[i2] % 2 > 0){
-		m[i2] *= 2;
-	      }
+	for (h=1; h<ng4; h++) {
+	  i2 = par((x+h)%ng,y,z,ng);
+	  dx = rpos(r,bfloat,0,i2)-rpos(r,bfloat,0,i);
+	  if (dx < negb2) dx += boxsize;
+	  if (dx > b2) dx -= boxsize;
+	  if (dx < 0.) {
+	    set_bits(m, i, AXBIT(0));
+	    set_bits(m, i2, AXBIT(0));
 	    break;
-	    }
 	  }
-	  for (h=1; h<ng4; h++) {
-	    i2 = par(x,(y+h)%ng,z,ng);
-	    dx = r[1][i2]-r[1][i];
-	    if (dx < negb2) dx += boxsize;
-	    if (dx > b2) dx -= boxsize;
-	    if (dx < 0.) {
-	      /*printf("y:%d %d %d %d %f\n",x,y,z,h,dx);*/
-	    if (m[i] % 3 > 0) {
-	      m[i] *= 3;
-	    }
-	      if (m[i2] % 3 > 0){
-		m[i2] *= 3;
-	      }
-	      break;
-	    }
+	}
+	for (h=1; h<ng4; h++) {
+	  i2 = par(x,(y+h)%ng,z,ng);
+	  dx = rpos(r,bfloat,1,i2)-rpos(r,bfloat,1,i);
+	  if (dx < negb2) dx += boxsize;
+	  if (dx > b2) dx -= boxsize;
+	  if (dx < 0.) {
+	    set_bits(m, i, AXBIT(1));
+	    set_bits(m, i2, AXBIT(1));
+	    break;
 	  }
-	  for (h=1; h<ng4; h++) {
-	    i2 = par(x,y,(z+h)%ng,ng);
-	    dx = r[2][i2]-r[2][i];
-	    if (dx < negb2) dx += boxsize;
-	    if (dx > b2) dx -= boxsize;
-	    if (dx < 0.) {
-	      /*printf("z:%d %d %d %d %f\n",x,y,z,h,dx);*/
-	    if (m[i] % 5 > 0) {
-	      m[i] *= 5;
-	    }
-	      if (m[i2] % 5 > 0){
-		m[i2] *= 5;
-	      }
-	      break;
-	    }
+	}
+	for (h=1; h<ng4; h++) {
+	  i2 = par(x,y,(z+h)%ng,ng);
+	  dx = rpos(r,bfloat,2,i2)-rpos(r,bfloat,2,i);
+	  if (dx < negb2) dx += boxsize;
+	  if (dx > b2) dx -= boxsize;
+	  if (dx < 0.) {
+	    set_bits(m, i, AXBIT(2));
+	    set_bits(m, i2, AXBIT(2));
+	    break;
 	  }
-	// Now do diagonal directions 
+	}
+	// Now do diagonal directions
+	d0 = d1 = d2 = 0;
 	for (h=1; h<ng4; h = -h + isneg(h)) {
 	  i2 = par(x,goodmod(y+h,ng),goodmod(z+h,ng),ng);
-	  d1 = r[1][i2]-r[1][i];
-	  d2 = r[2][i2]-r[2][i];
-	  if (d1 < negb2) d1 += boxsize;
-	  if (d1 > b2) d1 -= boxsize;
-	  if (d2 < negb2) d2 += boxsize;
-	  if (d2 > b2) d2 -= boxsize;
-	  if ((d1 + d2)*h < 0.) {
-	    m0[i] *= 2;
+	  d1x = rpos(r,bfloat,1,i2)-rpos(r,bfloat,1,i);
+	  d2x = rpos(r,bfloat,2,i2)-rpos(r,bfloat,2,i);
+	  if (d1x < negb2) d1x += boxsize;
+	  if (d1x > b2) d1x -= boxsize;
+	  if (d2x < negb2) d2x += boxsize;
+	  if (d2x > b2) d2x -= boxsize;
+	  if ((d1x + d2x)*h < 0.) {
+	    d0++;
 	    break;
 	  }
 	}
 	for (h=1; h<ng4; h = -h + isneg(h)) {
 	  i2 = par(x,goodmod(y+h,ng),goodmod(z-h,ng),ng);
-	  d1 = r[1][i2]-r[1][i];
-	  d2 = r[2][i2]-r[2][i];
-	  if (d1 < negb2) d1 += boxsize;
-	  if (d1 > b2) d1 -= boxsize;
-	  if (d2 < negb2) d2 += boxsize;
-	  if (d2 > b2) d2 -= boxsize;
-	  if ((d1 - d2)*h < 0.) {
-	    m0[i] *= 3;
+	  d1x = rpos(r,bfloat,1,i2)-rpos(r,bfloat,1,i);
+	  d2x = rpos(r,bfloat,2,i2)-rpos(r,bfloat,2,i);
+	  if (d1x < negb2) d1x += boxsize;
+	  if (d1x > b2) d1x -= boxsize;
+	  if (d2x < negb2) d2x += boxsize;
+	  if (d2x > b2) d2x -= boxsize;
+	  if ((d1x - d2x)*h < 0.) {
+	    d0++;
 	    break;
 	  }
 	}
 	// y
 	for (h=1; h<ng4; h = -h + isneg(h)) {
 	  i2 = par(goodmod(x+h,ng),y,goodmod(z+h,ng),ng);
-	  d1 = r[0][i2]-r[0][i];
-	  d2 = r[2][i2]-r[2][i];
-	  if (d1 < negb2) d1 += boxsize;
-	  if (d1 > b2) d1 -= boxsize;
-	  if (d2 < negb2) d2 += boxsize;
-	  if (d2 > b2) d2 -= boxsize;
-	  if ((d1 + d2)*h < 0.) {
-	    m1[i] *= 2;
+	  d1x = rpos(r,bfloat,0,i2)-rpos(r,bfloat,0,i);
+	  d2x = rpos(r,bfloat,2,i2)-rpos(r,bfloat,2,i);
+	  if (d1x < negb2) d1x += boxsize;
+	  if (d1x > b2) d1x -= boxsize;
+	  if (d2x < negb2) d2x += boxsize;
+	  if (d2x > b2) d2x -= boxsize;
+	  if ((d1x + d2x)*h < 0.) {
+	    d1++;
 	    break;
 	  }
 	}
 	for (h=1; h<ng4; h = -h + isneg(h)) {
 	  i2 = par(goodmod(x+h,ng),y,goodmod(z-h,ng),ng);
-	  d1 = r[0][i2]-r[0][i];
-	  d2 = r[2][i2]-r[2][i];
-	  if (d1 < negb2) d1 += boxsize;
-	  if (d1 > b2) d1 -= boxsize;
-	  if (d2 < negb2) d2 += boxsize;
-	  if (d2 > b2) d2 -= boxsize;
-	  if ((d1 - d2)*h < 0.) {
-	    m1[i] *= 3;
+	  d1x = rpos(r,bfloat,0,i2)-rpos(r,bfloat,0,i);
+	  d2x = rpos(r,bfloat,2,i2)-rpos(r,bfloat,2,i);
+	  if (d1x < negb2) d1x += boxsize;
+	  if (d1x > b2) d1x -= boxsize;
+	  if (d2x < negb2) d2x += boxsize;
+	  if (d2x > b2) d2x -= boxsize;
+	  if ((d1x - d2x)*h < 0.) {
+	    d1++;
 	    break;
 	  }
 	}
 	// z
 	for (h=1; h<ng4; h = -h + isneg(h)) {
 	  i2 = par(goodmod(x+h,ng),goodmod(y+h,ng),z,ng);
-	  d1 = r[0][i2]-r[0][i];
-	  d2 = r[1][i2]-r[1][i];
-	  if (d1 < negb2) d1 += boxsize;
-	  if (d1 > b2) d1 -= boxsize;
-	  if (d2 < negb2) d2 += boxsize;
-	  if (d2 > b2) d2 -= boxsize;
-	  if ((d1 + d2)*h < 0.) {
-	    m2[i] *=2;
+	  d1x = rpos(r,bfloat,0,i2)-rpos(r,bfloat,0,i);
+	  d2x = rpos(r,bfloat,1,i2)-rpos(r,bfloat,1,i);
+	  if (d1x < negb2) d1x += boxsize;
+	  if (d1x > b2) d1x -= boxsize;
+	  if (d2x < negb2) d2x += boxsize;
+	  if (d2x > b2) d2x -= boxsize;
+	  if ((d1x + d2x)*h < 0.) {
+	    d2++;
 	    break;
 	  }
 	}
 	for (h=1; h<ng4; h = -h + isneg(h)) {
 	  i2 = par(goodmod(x+h,ng),goodmod(y-h,ng),z,ng);
-	  d1 = r[0][i2]-r[0][i];
-	  d2 = r[1][i2]-r[1][i];
-	  if (d1 < negb2) d1 += boxsize;
-	  if (d1 > b2) d1 -= boxsize;
-	  if (d2 < negb2) d2 += boxsize;
-	  if (d2 > b2) d2 -= boxsize;
-	  if ((d1 - d2)*h < 0.) {
-	    m2[i] *= 3;
+	  d1x = rpos(r,bfloat,0,i2)-rpos(r,bfloat,0,i);
+	  d2x = rpos(r,bfloat,1,i2)-rpos(r,bfloat,1,i);
+	  if (d1x < negb2) d1x += boxsize;
+	  if (d1x > b2) d1x -= boxsize;
+	  if (d2x < negb2) d2x += boxsize;
+	  if (d2x > b2) d2x -= boxsize;
+	  if ((d1x - d2x)*h < 0.) {
+	    d2++;
 	    break;
 	  }
-	  }
+	}
+	if (d0 + d1 + d2 > 0)
+	  set_bits(m, i, (unsigned char)((d0 + 3*d1 + 9*d2) << DIAGSHIFT));
       }
     }
+    if (progress != NULL) {
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+      done = ++ndone;
+      /* Only the master thread reports, so that a callback into Python
+       * is never made from two threads at once */
+#ifdef _OPENMP
+      if (omp_get_thread_num() == 0)
+#endif
+      if (done < ng) progress(data, done, ng);
+    }
   }
+  }
+  if (progress != NULL) progress(data, ng, ng);
 
-  nhalo = 0;
-  nhalo0 = 0;
-  nhalo1 = 0;
-  nhalo2 = 0;
-  nhaloany = 0;
+  /* Collapse each byte into the number of orthogonal axes (0-3) along
+   * which the particle has been crossed, in the best of the four frames */
+  n0 = n1 = n2 = n3 = n4 = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) reduction(+:n0,n1,n2,n3,n4)
+#endif
   for (i=0;i<np;i++){
-    mn = (m[i]%2 == 0) + (m[i]%3 == 0) + (m[i]%5 == 0);
-    m0n = (unsigned char)(m[i]%2 == 0) + (unsigned char)(m0[i]%2 == 0) + (unsigned char)(m0[i]%3 == 0);
-    m1n = (unsigned char)(m[i]%3 == 0) + (unsigned char)(m1[i]%2 == 0) + (unsigned char)(m1[i]%3 == 0);
-    m2n = (unsigned char)(m[i]%5 == 0) + (unsigned char)(m2[i]%2 == 0) + (unsigned char)(m2[i]%3 == 0);
+    int ax, dg, mn, m0n, m1n, m2n;
+    ax = m[i] & 7;
+    dg = m[i] >> DIAGSHIFT;
+    mn = (ax & 1) + ((ax >> 1) & 1) + ((ax >> 2) & 1);
+    m0n = (ax & 1) + dg % 3;
+    m1n = ((ax >> 1) & 1) + (dg / 3) % 3;
+    m2n = ((ax >> 2) & 1) + dg / 9;
     m[i] = max(mn,max(m0n,max(m1n,m2n)));
-    if (mn == 3) nhalo++;
-    if (m0n == 3) nhalo0++;
-    if (m1n == 3) nhalo1++;
-    if (m2n == 3) nhalo2++;
-    if (m[i] == 3) {
-      nhaloany++;
-    }
+    if (mn == 3) n0++;
+    if (m0n == 3) n1++;
+    if (m1n == 3) n2++;
+    if (m2n == 3) n3++;
+    if (m[i] == 3) n4++;
+  }
+  if (nhalo != NULL) {
+    nhalo[0] = n0;
+    nhalo[1] = n1;
+    nhalo[2] = n2;
+    nhalo[3] = n3;
+    nhalo[4] = n4;
   }
-  printf("nhalo=%d,%d,%d,%d,%d\n",nhalo,nhalo0,nhalo1,nhalo2,nhaloany);
-  free(m0);
-  free(m1);
-  free(m2);
+  return 0;
+}
 
-  /* Output m */
+int compute_tags(int ng, double boxsize, double **r, int np,
+                 unsigned char *m) {
+  int nhalo[5];
+
+  if (m==NULL) {
+    printf("Morphology array cannot be allocated.\n");
+    return 1;
+  }
+  printf("%d particles\n",np);fflush(stdout);
+  printf("Calculating ORIGAMI morphology.\n");
+  compute_tags_parallel(ng, boxsize, (void **)r, 0, np, m, 1,
+                        NULL, NULL, nhalo);
+  printf("nhalo=%d,%d,%d,%d,%d\n",nhalo[0],nhalo[1],nhalo[2],nhalo[3],
+         nhalo[4]);
   return 0;
 }
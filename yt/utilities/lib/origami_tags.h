@@ -9,6 +9,14 @@
 
 int isneg(int h);
 int par(int i, int j, int k, int ng);
+/* Called as progress(data, slabs_done, ng) as x slabs of the lattice
+ * are finished */
+typedef void (*origami_progress)(void *data, int done, int total);
+
 int compute_tags(int ng, double boxsize, double **r, int npart,
                  unsigned char *m);
+int compute_tags_parallel(int ng, double boxsize, void **r, int bfloat,
+                          int npart, unsigned char *m, int nthreads,
+                          origami_progress progress, void *data,
+                          int *nhalo);
 #endif // __ORIGAMI_TAGS_H__
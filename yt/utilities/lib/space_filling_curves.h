@@ -0,0 +1,321 @@
+/*
+ * Batch encoding and decoding of 3D Morton and Hilbert curve indices.
+ *
+ * Morton codes are formed by spreading the bits of each coordinate with
+ * magic masks, x in the most significant position of each 3 bit digit.
+ * Hilbert indices are formed from the Morton digits by a state machine
+ * over the 12 orientations of the 3D Hilbert curve, consuming two levels
+ * (one 6 bit lookup) per step.  The curve is the one used by
+ * geometry_utils.get_hilbert_indices; ARTIO's Hilbert ordering is the same
+ * curve with its coordinates passed as (y, z, x).
+ *
+ * The array versions take x, y and z pointers with a common stride, so
+ * both (N, 3) arrays (stride 3) and separate arrays (stride 1) work, and
+ * are OpenMP parallel over large inputs.
+ */
+
+#ifndef __SPACE_FILLING_CURVES_H__
+#define __SPACE_FILLING_CURVES_H__
+
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#define SFC_INLINE static __inline
+#else
+#define SFC_INLINE static inline
+#endif
+
+/* maximum bits per coordinate that fit a 64 bit index */
+#define SFC_ORDER_MAX 21
+
+/* below this many elements the arrays are processed by a single thread */
+#define SFC_PARALLEL_MIN 65536
+
+/* packed (next_state << 3) | digit for one level, indexed by [state][digit],
+ * and (next_state << 6) | digits for two levels */
+static const uint8_t sfc_hilbert_encode_level[12][8] = {
+    {   8,  23,  25,  38,  43,  44,  26,  37 },
+    {  24,  51,  63,  52,   1,   2,  70,  69 },
+    {  76,  39,  75,  80,   5,   6,  66,  65 },
+    {   0,   9,  83,  10,  95,  78,  84,  77 },
+    {  22,   7,  21,  60,  49,  88,  50,  59 },
+    {  58,  85,   3,   4,  57,  86,  72,  55 },
+    {  90,  89,  45,  46,  11,  32,  12,  87 },
+    {  36,  13,  71,  14,  35,  74,  40,  73 },
+    {  62,  81,  15,  16,  61,  82,  92,  91 },
+    {  94,  93,  41,  42,  31,  20,  56,  19 },
+    {  18,  27,  17,  64,  53,  28,  54,  47 },
+    {  68,  67,  29,  34,  79,  48,  30,  33 }
+};
+
+static const uint8_t sfc_hilbert_decode_level[12][8] = {
+    {   8,  26,  30,  44,  45,  39,  35,  17 },
+    {  24,   4,   5,  49,  51,  71,  70,  58 },
+    {  83,  71,  70,  74,  72,   4,   5,  33 },
+    {   0,   9,  11,  82,  86,  79,  77,  92 },
+    {  93,  52,  54,  63,  59,  18,  16,   1 },
+    {  78,  60,  56,   2,   3,  81,  85,  55 },
+    {  37,  89,  88,  12,  14,  42,  43,  87 },
+    {  46,  79,  77,  36,  32,   9,  11,  66 },
+    {  19,  81,  85,  95,  94,  60,  56,  10 },
+    {  62,  42,  43,  23,  21,  89,  88,  28 },
+    {  67,  18,  16,  25,  29,  52,  54,  47 },
+    {  53,  39,  35,  65,  64,  26,  30,  76 }
+};
+
+static const uint16_t sfc_hilbert_encode_pair[12][64] = {
+    { 192, 387, 455, 388,   1,   2, 518, 517, 636, 319, 635, 696,  61,  62, 570, 569,
+        8,  73, 651,  74, 719, 590, 652, 589, 182,  55, 181, 500, 433, 752, 434, 499,
+      474, 669,  27,  28, 473, 670, 600, 415, 482, 677,  35,  36, 481, 678, 608, 423,
+       16,  81, 659,  82, 727, 598, 660, 597, 174,  47, 173, 492, 425, 744, 426, 491 },
+    {   0,  65, 643,  66, 711, 582, 644, 581, 730, 729, 349, 350,  91, 280,  92, 671,
+      316, 125, 575, 126, 315, 634, 376, 633, 738, 737, 357, 358,  99, 288, 100, 679,
+       72, 143, 201, 270, 331, 332, 202, 269,  80, 151, 209, 278, 339, 340, 210, 277,
+      502, 689, 119, 176, 501, 690, 756, 755, 494, 681, 111, 168, 493, 682, 748, 747 },
+    { 742, 741, 353, 354, 231, 164, 480, 163, 190,  63, 189, 508, 441, 760, 442, 507,
+      734, 733, 345, 346, 223, 156, 472, 155, 130, 195, 129, 512, 389, 196, 390, 327,
+      104, 175, 233, 302, 363, 364, 234, 301, 112, 183, 241, 310, 371, 372, 242, 309,
+      470, 657,  87, 144, 469, 658, 724, 723, 462, 649,  79, 136, 461, 650, 716, 715 },
+    {  64, 135, 193, 262, 323, 324, 194, 261, 200, 395, 463, 396,   9,  10, 526, 525,
+      154, 219, 153, 536, 413, 220, 414, 351, 208, 403, 471, 404,  17,  18, 534, 533,
+      572, 571, 253, 314, 639, 440, 254, 313, 758, 757, 369, 370, 247, 180, 496, 179,
+      162, 227, 161, 544, 421, 228, 422, 359, 750, 749, 361, 362, 239, 172, 488, 171 },
+    { 628, 311, 627, 688,  53,  54, 562, 561, 120, 191, 249, 318, 379, 380, 250, 317,
+      620, 303, 619, 680,  45,  46, 554, 553, 292, 101, 551, 102, 291, 610, 352, 609,
+      714, 713, 333, 334,  75, 264,  76, 655, 516, 515, 197, 258, 583, 384, 198, 257,
+      722, 721, 341, 342,  83, 272,  84, 663, 284,  93, 543,  94, 283, 602, 344, 601 },
+    { 276,  85, 535,  86, 275, 594, 336, 593, 170, 235, 169, 552, 429, 236, 430, 367,
+       88, 159, 217, 286, 347, 348, 218, 285,  96, 167, 225, 294, 355, 356, 226, 293,
+      268,  77, 527,  78, 267, 586, 328, 585, 178, 243, 177, 560, 437, 244, 438, 375,
+      710, 709, 321, 322, 199, 132, 448, 131, 762, 761, 381, 382, 123, 312, 124, 703 },
+    { 532, 531, 213, 274, 599, 400, 214, 273, 524, 523, 205, 266, 591, 392, 206, 265,
+      490, 685,  43,  44, 489, 686, 616, 431, 498, 693,  51,  52, 497, 694, 624, 439,
+      216, 411, 479, 412,  25,  26, 542, 541, 134,   7, 133, 452, 385, 704, 386, 451,
+      224, 419, 487, 420,  33,  34, 550, 549, 186, 251, 185, 568, 445, 252, 446, 383 },
+    { 166,  39, 165, 484, 417, 736, 418, 483, 232, 427, 495, 428,  41,  42, 558, 557,
+      510, 697, 127, 184, 509, 698, 764, 763, 240, 435, 503, 436,  49,  50, 566, 565,
+      158,  31, 157, 476, 409, 728, 410, 475, 726, 725, 337, 338, 215, 148, 464, 147,
+      450, 645,   3,   4, 449, 646, 576, 391, 718, 717, 329, 330, 207, 140, 456, 139 },
+    { 308, 117, 567, 118, 307, 626, 368, 625, 138, 203, 137, 520, 397, 204, 398, 335,
+      248, 443, 511, 444,  57,  58, 574, 573, 580, 263, 579, 640,   5,   6, 514, 513,
+      300, 109, 559, 110, 299, 618, 360, 617, 146, 211, 145, 528, 405, 212, 406, 343,
+      548, 547, 229, 290, 615, 416, 230, 289, 540, 539, 221, 282, 607, 408, 222, 281 },
+    { 564, 563, 245, 306, 631, 432, 246, 305, 556, 555, 237, 298, 623, 424, 238, 297,
+      458, 653,  11,  12, 457, 654, 584, 399, 466, 661,  19,  20, 465, 662, 592, 407,
+       56, 121, 699, 122, 767, 638, 700, 637, 612, 295, 611, 672,  37,  38, 546, 545,
+      260,  69, 519,  70, 259, 578, 320, 577, 604, 287, 603, 664,  29,  30, 538, 537 },
+    { 596, 279, 595, 656,  21,  22, 530, 529,  24,  89, 667,  90, 735, 606, 668, 605,
+      588, 271, 587, 648,  13,  14, 522, 521, 454, 641,  71, 128, 453, 642, 708, 707,
+      746, 745, 365, 366, 107, 296, 108, 687,  32,  97, 675,  98, 743, 614, 676, 613,
+      754, 753, 373, 374, 115, 304, 116, 695, 506, 701,  59,  60, 505, 702, 632, 447 },
+    { 486, 673, 103, 160, 485, 674, 740, 739, 478, 665,  95, 152, 477, 666, 732, 731,
+       40, 105, 683, 106, 751, 622, 684, 621, 150,  23, 149, 468, 401, 720, 402, 467,
+      766, 765, 377, 378, 255, 188, 504, 187, 706, 705, 325, 326,  67, 256,  68, 647,
+       48, 113, 691, 114, 759, 630, 692, 629, 142,  15, 141, 460, 393, 712, 394, 459 }
+};
+
+static const uint16_t sfc_hilbert_decode_pair[12][64] = {
+    { 192,   4,   5, 385, 387, 519, 518, 450,  16,  81,  83, 658, 662, 599, 597, 724,
+       48, 113, 115, 690, 694, 631, 629, 756, 614, 484, 480,  34,  35, 673, 677, 423,
+      622, 492, 488,  42,  43, 681, 685, 431, 765, 444, 446, 511, 507, 186, 184,  57,
+      733, 412, 414, 479, 475, 154, 152,  25, 651, 527, 526, 586, 584,  12,  13, 265 },
+    {   0,  65,  67, 642, 646, 583, 581, 708,  96, 226, 230, 356, 357, 295, 291, 161,
+      104, 234, 238, 364, 365, 303, 299, 169, 269, 713, 712,  76,  78, 330, 331, 655,
+      285, 729, 728,  92,  94, 346, 347, 671, 187, 697, 701, 767, 766, 508, 504, 122,
+      179, 689, 693, 759, 758, 500, 496, 114, 342, 599, 597, 276, 272,  81,  83, 530 },
+    { 539, 154, 152, 217, 221, 412, 414, 351, 187, 697, 701, 767, 766, 508, 504, 122,
+      179, 689, 693, 759, 758, 500, 496, 114, 470, 338, 339, 151, 149, 721, 720, 212,
+      454, 322, 323, 135, 133, 705, 704, 196,  96, 226, 230, 356, 357, 295, 291, 161,
+      104, 234, 238, 364, 365, 303, 299, 169, 717, 396, 398, 463, 459, 138, 136,   9 },
+    {  64, 194, 198, 324, 325, 263, 259, 129, 200,  12,  13, 393, 395, 527, 526, 458,
+      216,  28,  29, 409, 411, 543, 542, 474, 531, 146, 144, 209, 213, 404, 406, 343,
+      563, 178, 176, 241, 245, 436, 438, 375, 510, 378, 379, 191, 189, 761, 760, 252,
+      494, 362, 363, 175, 173, 745, 744, 236, 421, 295, 291, 545, 544, 226, 230, 612 },
+    { 429, 303, 299, 553, 552, 234, 238, 620, 293, 737, 736, 100, 102, 354, 355, 679,
+      309, 753, 752, 116, 118, 370, 371, 695, 382, 639, 637, 316, 312, 121, 123, 570,
+      350, 607, 605, 284, 280,  89,  91, 538, 659, 535, 534, 594, 592,  20,  21, 273,
+      643, 519, 518, 578, 576,   4,   5, 257,  72, 202, 206, 332, 333, 271, 267, 137 },
+    { 502, 370, 371, 183, 181, 753, 752, 244, 358, 615, 613, 292, 288,  97,  99, 546,
+      326, 583, 581, 260, 256,  65,  67, 514,  80, 210, 214, 340, 341, 279, 275, 145,
+       88, 218, 222, 348, 349, 287, 283, 153, 523, 138, 136, 201, 205, 396, 398, 335,
+      555, 170, 168, 233, 237, 428, 430, 367, 317, 761, 760, 124, 126, 378, 379, 703 },
+    { 749, 428, 430, 495, 491, 170, 168,  41, 397, 271, 267, 521, 520, 202, 206, 588,
+      389, 263, 259, 513, 512, 194, 198, 580, 224,  36,  37, 417, 419, 551, 550, 482,
+      240,  52,  53, 433, 435, 567, 566, 498, 598, 468, 464,  18,  19, 657, 661, 407,
+      606, 476, 472,  26,  27, 665, 669, 415, 571, 186, 184, 249, 253, 444, 446, 383 },
+    { 630, 500, 496,  50,  51, 689, 693, 439, 510, 378, 379, 191, 189, 761, 760, 252,
+      494, 362, 363, 175, 173, 745, 744, 236, 741, 420, 422, 487, 483, 162, 160,  33,
+      709, 388, 390, 455, 451, 130, 128,   1, 200,  12,  13, 393, 395, 527, 526, 458,
+      216,  28,  29, 409, 411, 543, 542, 474, 147, 657, 661, 727, 726, 468, 464,  82 },
+    { 667, 543, 542, 602, 600,  28,  29, 281, 523, 138, 136, 201, 205, 396, 398, 335,
+      555, 170, 168, 233, 237, 428, 430, 367, 445, 319, 315, 569, 568, 250, 254, 636,
+      437, 311, 307, 561, 560, 242, 246, 628, 358, 615, 613, 292, 288,  97,  99, 546,
+      326, 583, 581, 260, 256,  65,  67, 514, 208,  20,  21, 401, 403, 535, 534, 466 },
+    { 374, 631, 629, 308, 304, 113, 115, 562, 598, 468, 464,  18,  19, 657, 661, 407,
+      606, 476, 472,  26,  27, 665, 669, 415, 699, 575, 574, 634, 632,  60,  61, 313,
+      683, 559, 558, 618, 616,  44,  45, 297, 397, 271, 267, 521, 520, 202, 206, 588,
+      389, 263, 259, 513, 512, 194, 198, 580,  32,  97,  99, 674, 678, 615, 613, 740 },
+    { 155, 665, 669, 735, 734, 476, 472,  90, 659, 535, 534, 594, 592,  20,  21, 273,
+      643, 519, 518, 578, 576,   4,   5, 257,   8,  73,  75, 650, 654, 591, 589, 716,
+       40, 105, 107, 682, 686, 623, 621, 748, 293, 737, 736, 100, 102, 354, 355, 679,
+      309, 753, 752, 116, 118, 370, 371, 695, 638, 508, 504,  58,  59, 697, 701, 447 },
+    { 301, 745, 744, 108, 110, 362, 363, 687, 765, 444, 446, 511, 507, 186, 184,  57,
+      733, 412, 414, 479, 475, 154, 152,  25, 139, 649, 653, 719, 718, 460, 456,  74,
+      131, 641, 645, 711, 710, 452, 448,  66,  16,  81,  83, 658, 662, 599, 597, 724,
+       48, 113, 115, 690, 694, 631, 629, 756, 486, 354, 355, 167, 165, 737, 736, 228 }
+};
+
+SFC_INLINE uint64_t sfc_spread_bits(uint64_t x)
+{
+    x = (x | (x << 20)) & 0x000001FFC00003FFULL;
+    x = (x | (x << 10)) & 0x0007E007C00F801FULL;
+    x = (x | (x << 4)) & 0x00786070C0E181C3ULL;
+    x = (x | (x << 2)) & 0x0199219243248649ULL;
+    x = (x | (x << 2)) & 0x0649249249249249ULL;
+    x = (x | (x << 2)) & 0x1249249249249249ULL;
+    return x;
+}
+
+SFC_INLINE uint64_t sfc_compact_bits(uint64_t x)
+{
+    x &= 0x1249249249249249ULL;
+    x = (x ^ (x >> 2)) & 0x10C30C30C30C30C3ULL;
+    x = (x ^ (x >> 4)) & 0x100F00F00F00F00FULL;
+    x = (x ^ (x >> 8)) & 0x001F0000FF0000FFULL;
+    x = (x ^ (x >> 16)) & 0x001F00000000FFFFULL;
+    x = (x ^ (x >> 32)) & 0x00000000001FFFFFULL;
+    return x;
+}
+
+SFC_INLINE uint64_t sfc_morton_encode(uint64_t x, uint64_t y, uint64_t z)
+{
+    return (sfc_spread_bits(x) << 2) | (sfc_spread_bits(y) << 1) |
+            sfc_spread_bits(z);
+}
+
+SFC_INLINE void sfc_morton_decode(uint64_t m, uint64_t *x, uint64_t *y,
+                                  uint64_t *z)
+{
+    *x = sfc_compact_bits(m >> 2);
+    *y = sfc_compact_bits(m >> 1);
+    *z = sfc_compact_bits(m);
+}
+
+/* maps the order low Morton digits of m onto the Hilbert curve (and back) */
+SFC_INLINE uint64_t sfc_hilbert_from_morton(int order, uint64_t m)
+{
+    uint64_t h = 0;
+    unsigned int state = 0, t;
+    int shift = 3 * order;
+
+    if (order & 1) {
+        shift -= 3;
+        t = sfc_hilbert_encode_level[state][(m >> shift) & 7];
+        h = t & 7;
+        state = t >> 3;
+    }
+    while (shift > 0) {
+        shift -= 6;
+        t = sfc_hilbert_encode_pair[state][(m >> shift) & 63];
+        h = (h << 6) | (t & 63);
+        state = t >> 6;
+    }
+    return h;
+}
+
+SFC_INLINE uint64_t sfc_morton_from_hilbert(int order, uint64_t h)
+{
+    uint64_t m = 0;
+    unsigned int state = 0, t;
+    int shift = 3 * order;
+
+    if (order & 1) {
+        shift -= 3;
+        t = sfc_hilbert_decode_level[state][(h >> shift) & 7];
+        m = t & 7;
+        state = t >> 3;
+    }
+    while (shift > 0) {
+        shift -= 6;
+        t = sfc_hilbert_decode_pair[state][(h >> shift) & 63];
+        m = (m << 6) | (t & 63);
+        state = t >> 6;
+    }
+    return m;
+}
+
+SFC_INLINE uint64_t sfc_hilbert_encode(int order, uint64_t x, uint64_t y,
+                                       uint64_t z)
+{
+    return sfc_hilbert_from_morton(order, sfc_morton_encode(x, y, z));
+}
+
+SFC_INLINE void sfc_hilbert_decode(int order, uint64_t h, uint64_t *x,
+                                   uint64_t *y, uint64_t *z)
+{
+    sfc_morton_decode(sfc_morton_from_hilbert(order, h), x, y, z);
+}
+
+SFC_INLINE void sfc_morton_encode_array(int64_t n, const int64_t *x,
+                                    const int64_t *y, const int64_t *z,
+                                    int64_t stride, int64_t *out)
+{
+    int64_t i;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) if (n >= SFC_PARALLEL_MIN)
+#endif
+    for (i = 0; i < n; i++) {
+        out[i] = (int64_t) sfc_morton_encode(x[i*stride], y[i*stride],
+                                             z[i*stride]);
+    }
+}
+
+SFC_INLINE void sfc_morton_decode_array(int64_t n, const int64_t *m,
+                                    int64_t *x, int64_t *y, int64_t *z,
+                                    int64_t stride)
+{
+    int64_t i;
+    uint64_t p[3];
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) private(p) if (n >= SFC_PARALLEL_MIN)
+#endif
+    for (i = 0; i < n; i++) {
+        sfc_morton_decode(m[i], &p[0], &p[1], &p[2]);
+        x[i*stride] = p[0];
+        y[i*stride] = p[1];
+        z[i*stride] = p[2];
+    }
+}
+
+SFC_INLINE void sfc_hilbert_encode_array(int order, int64_t n, const int64_t *x,
+                                     const int64_t *y, const int64_t *z,
+                                     int64_t stride, int64_t *out)
+{
+    int64_t i;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) if (n >= SFC_PARALLEL_MIN)
+#endif
+    for (i = 0; i < n; i++) {
+        out[i] = (int64_t) sfc_hilbert_encode(order, x[i*stride],
+                                              y[i*stride], z[i*stride]);
+    }
+}
+
+SFC_INLINE void sfc_hilbert_decode_array(int order, int64_t n, const int64_t *h,
+                                     int64_t *x, int64_t *y, int64_t *z,
+                                     int64_t stride)
+{
+    int64_t i;
+    uint64_t p[3];
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) private(p) if (n >= SFC_PARALLEL_MIN)
+#endif
+    for (i = 0; i < n; i++) {
+        sfc_hilbert_decode(order, h[i], &p[0], &p[1], &p[2]);
+        x[i*stride] = p[0];
+        y[i*stride] = p[1];
+        z[i*stride] = p[2];
+    }
+}
+
+#endif /* __SPACE_FILLING_CURVES_H__ */
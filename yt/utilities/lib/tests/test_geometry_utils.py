@@ -5,6 +5,11 @@ from yt.testing import \
     assert_array_less, \
     assert_array_equal
 from yt.utilities.lib.misc_utilities import obtain_rvec, obtain_rv_vec
+from yt.utilities.lib.geometry_utils import \
+    get_hilbert_indices, \
+    get_hilbert_points, \
+    get_morton_indices, \
+    get_morton_indices_unravel
 
 _fields = ("density", "velocity_x", "velocity_y", "velocity_z")
 
@@ -33,3 +38,114 @@ def test_obtain_rv_vec():
     assert_array_equal(vels[0,:], dd['velocity_x'])
     assert_array_equal(vels[1,:], dd['velocity_y'])
     assert_array_equal(vels[2,:], dd['velocity_z'])
+
+# Bit-by-bit reference implementations of the Hilbert curve (after the
+# scurve package by user cortesi on GH) and of Morton interleaving, which
+# the table driven routines in space_filling_curves.h must reproduce.
+
+def _graycode(x):
+    return x ^ (x >> 1)
+
+def _igraycode(x):
+    i = x
+    j = 1
+    while (x >> j) > 0:
+        i ^= x >> j
+        j += 1
+    return i
+
+def _tsb(x, width):
+    i = 0
+    while x & 1 and i <= width:
+        x >>= 1
+        i += 1
+    return i
+
+def _direction(x, n):
+    if x == 0:
+        return 0
+    elif x % 2 == 0:
+        return _tsb(x - 1, n) % n
+    return _tsb(x, n) % n
+
+def _bitrange(x, width, start, end):
+    return x >> (width - end) & ((1 << (end - start)) - 1)
+
+def _rrot(x, i, width):
+    i = i % width
+    x = (x >> i) | (x << (width - i))
+    return x & ((1 << width) - 1)
+
+def _lrot(x, i, width):
+    i = i % width
+    x = (x << i) | (x >> (width - i))
+    return x & ((1 << width) - 1)
+
+def _entry(x):
+    if x == 0:
+        return 0
+    return _graycode(2 * ((x - 1) // 2))
+
+def _point_to_hilbert(order, p):
+    h = e = d = 0
+    for i in range(order):
+        l = 0
+        for x in range(3):
+            l |= _bitrange(p[2 - x], order, i, i + 1) << x
+        l = _rrot(l ^ e, d + 1, 3)
+        w = _igraycode(l)
+        e ^= _lrot(_entry(w), d + 1, 3)
+        d = (d + _direction(w, 3) + 1) % 3
+        h = (h << 3) | w
+    return h
+
+def _hilbert_to_point(order, h):
+    p = [0, 0, 0]
+    e = d = 0
+    for i in range(order):
+        w = _bitrange(h, 3 * order, 3 * i, 3 * i + 3)
+        l = _lrot(_graycode(w), d + 1, 3) ^ e
+        for j in range(3):
+            if _bitrange(l, 3, j, j + 1):
+                p[j] |= 1 << (order - i - 1)
+        e ^= _lrot(_entry(w), d + 1, 3)
+        d = (d + _direction(w, 3) + 1) % 3
+    return p
+
+def _morton(p):
+    mi = 0
+    for b in range(21):
+        for j in range(3):
+            mi |= ((p[j] >> b) & 1) << (3 * b + 2 - j)
+    return mi
+
+def test_hilbert_indices():
+    np.random.seed(0x4d3d3d3)
+    for order in [1, 2, 3, 5, 8, 10, 16, 21]:
+        points = np.random.randint(0, 2**order, size=(200, 3)).astype("int64")
+        if order <= 3:
+            points = np.mgrid[0:2**order, 0:2**order, 0:2**order]
+            points = points.reshape(3, -1).T.astype("int64")
+        ref = np.array([_point_to_hilbert(order, p) for p in points],
+                       dtype="int64")
+        indices = get_hilbert_indices(order, points)
+        assert_array_equal(indices, ref)
+        positions = get_hilbert_points(order, indices)
+        assert_array_equal(positions, points)
+        ref = np.array([_hilbert_to_point(order, h) for h in indices],
+                       dtype="int64")
+        assert_array_equal(positions, ref)
+        # Strided input must work as well as contiguous input
+        assert_array_equal(get_hilbert_indices(order, points[::2]),
+                           indices[::2])
+        assert_array_equal(get_hilbert_points(order, indices[::2]),
+                           points[::2])
+
+def test_morton_indices():
+    np.random.seed(0x4d3d3d3)
+    points = np.random.randint(0, 2**21, size=(500, 3)).astype("uint64")
+    ref = np.array([_morton([int(v) for v in p]) for p in points],
+                   dtype="uint64")
+    assert_array_equal(get_morton_indices(points), ref)
+    assert_array_equal(get_morton_indices_unravel(
+        points[:, 0].copy(), points[:, 1].copy(), points[:, 2].copy()), ref)
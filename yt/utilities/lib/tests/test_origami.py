@@ -0,0 +1,98 @@
+import numpy as np
+
+from yt.testing import \
+    assert_equal
+from yt.utilities.lib.origami import run_origami
+
+
+def _wrap(d, boxsize):
+    d = np.where(d < -boxsize / 2., d + boxsize, d)
+    return np.where(d > boxsize / 2., d - boxsize, d)
+
+def _first_crossing(steps, test):
+    # For each particle, whether any step crosses, stopping at the first
+    # step that does.  test(h) gives the crossing mask of step h and the
+    # axes and shift of the partner it pairs with.
+    found = None
+    partners = []
+    for h in steps:
+        cross, shift = test(h)
+        new = cross if found is None else cross & ~found
+        found = new if found is None else found | new
+        partners.append((new, shift))
+    return found, partners
+
+def _reference_tags(pos, ng, boxsize):
+    # The serial ORIGAMI loop, one lattice-wide step at a time.  The
+    # lattice index is x + (y + z*ng)*ng, so the arrays are indexed [z,y,x].
+    r = [np.asarray(p, dtype="float64").reshape(ng, ng, ng) for p in pos]
+    ng4 = ng // 4
+    axial = list(range(1, ng4))
+    diag = []
+    for h in axial:
+        diag.extend([h, -h])
+    false = np.zeros((ng, ng, ng), dtype="bool")
+    # Crossings along x, y and z flag both particles of the pair.
+    flags = []
+    for a, axis in ((0, 2), (1, 1), (2, 0)):
+        def test(h):
+            d = _wrap(np.roll(r[a], -h, axis=axis) - r[a], boxsize)
+            return d < 0., h
+        found, partners = _first_crossing(axial, test)
+        flag = false.copy() if found is None else found.copy()
+        for new, h in partners:
+            flag |= np.roll(new, h, axis=axis)
+        flags.append(flag)
+    # The diagonals of each plane flag only the particle itself.
+    def diagonal(a1, ax1, a2, ax2, sign):
+        def test(h):
+            d1 = _wrap(np.roll(np.roll(r[a1], -h, axis=ax1), -sign * h,
+                               axis=ax2) - r[a1], boxsize)
+            d2 = _wrap(np.roll(np.roll(r[a2], -h, axis=ax1), -sign * h,
+                               axis=ax2) - r[a2], boxsize)
+            return (d1 + sign * d2) * h < 0., h
+        found = _first_crossing(diag, test)[0]
+        return false if found is None else found
+    counts = [flags[0].astype("uint8") + flags[1] + flags[2]]
+    for f, (a1, ax1, a2, ax2) in zip(flags, ((1, 1, 2, 0), (0, 2, 2, 0),
+                                             (0, 2, 1, 1))):
+        counts.append(f.astype("uint8") + diagonal(a1, ax1, a2, ax2, 1) +
+                      diagonal(a1, ax1, a2, ax2, -1))
+    return np.max(counts, axis=0).astype("uint8").ravel()
+
+def _perturbed_lattice(ng, boxsize, sigma, seed=0x4d3d3d3):
+    prng = np.random.RandomState(seed)
+    cell = boxsize / ng
+    z, y, x = np.mgrid[0:ng, 0:ng, 0:ng]
+    pos = []
+    for c in (x, y, z):
+        p = (c.ravel() + 0.5) * cell + prng.normal(size=ng**3) * sigma * cell
+        pos.append(np.mod(p, boxsize))
+    return pos
+
+def test_origami_tags():
+    boxsize = 10.0
+    for ng in (16, 24, 32):
+        for sigma in (0.3, 1.0):
+            pos = _perturbed_lattice(ng, boxsize, sigma)
+            ref = _reference_tags(pos, ng, boxsize)
+            assert ref.max() > 0
+            pos32 = [p.astype("float32") for p in pos]
+            ref32 = _reference_tags(pos32, ng, boxsize)
+            for num_threads in (1, 4):
+                tags = run_origami(pos[0], pos[1], pos[2], boxsize,
+                                   num_threads)
+                assert_equal(tags, ref)
+                tags = run_origami(pos32[0], pos32[1], pos32[2], boxsize,
+                                   num_threads)
+                assert_equal(tags, ref32)
+
+def test_origami_progress():
+    pos = _perturbed_lattice(16, 1.0, 0.5)
+    calls = []
+    def progress(done, total):
+        calls.append((done, total))
+    tags = run_origami(pos[0], pos[1], pos[2], 1.0, 2, progress)
+    assert_equal(tags, run_origami(pos[0], pos[1], pos[2], 1.0, 1))
+    assert len(calls) > 0
+    assert_equal(calls[-1][0], calls[-1][1])